@@ -0,0 +1,207 @@
+
+/*
+ * Erases most elements of a BPlusTree (so leaves are merged in both
+ * directions) and checks that forward and reverse iteration still see
+ * exactly the remaining elements, and that lower_bound(), upper_bound()
+ * and equal_range() agree with std::map.
+ * 
+ * Also builds trees with bulk_load() and merge() (both the insert and
+ * the rebuild path) from batches with duplicate keys and checks them the
+ * same way.
+ */
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+
+#include <external_interface/external_interface.h>
+
+#undef DBG
+#define DBG(...)
+
+using namespace wiselib;
+
+typedef PCOsModel Os;
+typedef Os::block_data_t block_data_t;
+
+#include <util/allocators/malloc_free_allocator.h>
+typedef MallocFreeAllocator<Os> Allocator;
+Allocator allocator_;
+Allocator& get_allocator() { return allocator_; }
+
+#include <algorithms/block_memory/ram_block_memory.h>
+#include <algorithms/block_memory/cached_block_memory.h>
+#include <algorithms/block_memory/bitmap_chunk_allocator.h>
+#include <algorithms/block_memory/b_plus_tree.h>
+
+typedef RamBlockMemory<Os> Ram;
+typedef CachedBlockMemory<Os, Ram, 100, 10> Cache;
+typedef BitmapChunkAllocator<Os, Cache, 8> ChunkAllocator;
+typedef BPlusTree<Os, ChunkAllocator, ::uint32_t, ::uint32_t> Tree;
+typedef std::map< ::uint32_t, ::uint32_t> Map;
+typedef std::pair< ::uint32_t, ::uint32_t> KV;
+typedef std::vector<KV> Batch;
+
+Cache cache;
+ChunkAllocator chunk_allocator;
+Tree tree;
+
+int check_forward(Map& expected) {
+	Map::iterator e = expected.begin();
+	for(Tree::iterator it = tree.begin(); it != tree.end(); ++it, ++e) {
+		if(e == expected.end() || (*it).key() != e->first || (*it).value() != e->second) {
+			return 1;
+		}
+	}
+	return e != expected.end();
+}
+
+int check_reverse(Map& expected) {
+	Map::reverse_iterator e = expected.rbegin();
+	for(Tree::iterator it = tree.last(); it != tree.end(); --it, ++e) {
+		if(e == expected.rend() || (*it).key() != e->first || (*it).value() != e->second) {
+			return 1;
+		}
+	}
+	return e != expected.rend();
+}
+
+/**
+ * @return 1 iff it and e point to different elements.
+ */
+int differ(Tree::iterator it, Map::iterator e, Map& expected) {
+	if(e == expected.end()) { return it != tree.end(); }
+	return it == tree.end() || (*it).key() != e->first || (*it).value() != e->second;
+}
+
+int check_bounds(Map& expected) {
+	int failures = 0;
+	Map::iterator e = expected.begin();
+	for(::uint32_t probe = 0; probe <= 101000; ) {
+		Map::iterator lower = expected.lower_bound(probe);
+		Map::iterator upper = expected.upper_bound(probe);
+		pair<Tree::iterator, Tree::iterator> range = tree.equal_range(probe);
+		if(differ(tree.lower_bound(probe), lower, expected) ||
+				differ(tree.upper_bound(probe), upper, expected) ||
+				differ(range.first, lower, expected) ||
+				differ(range.second, upper, expected)) {
+			printf("  FAIL: bounds of %lu\n", (unsigned long)probe);
+			failures++;
+		}
+		
+		// probe every key, its neighbours and the gaps in between
+		if(e == expected.end()) { probe = (probe < 101000) ? 101000 : probe + 1; }
+		else if(probe + 1 < e->first) { probe = e->first - 1; }
+		else if(probe < e->first + 1) { probe++; }
+		else { ++e; }
+	}
+	return failures != 0;
+}
+
+int check_all(Map& expected, const char* what) {
+	int forward = check_forward(expected);
+	int reverse = check_reverse(expected);
+	int bounds = check_bounds(expected);
+	int size = (tree.size() != expected.size());
+	printf("%s, %5lu elements: forward %s, reverse %s, bounds %s, size %s\n", what,
+			(unsigned long)expected.size(), forward ? "FAILED" : "ok", reverse ? "FAILED" : "ok",
+			bounds ? "FAILED" : "ok", size ? "FAILED" : "ok");
+	return forward + reverse + bounds + size;
+}
+
+int test_erase() {
+	Map expected;
+	srand(1);
+	for(::uint32_t i = 0; i < 5000; i++) {
+		::uint32_t k = rand() % 100000;
+		if(expected.count(k)) { continue; }
+		expected[k] = i;
+		tree.insert(k, i);
+	}
+	
+	int failures = 0;
+	for(int round = 0; round < 8; round++) {
+		// erase half of the remaining elements, in random order
+		size_t n = expected.size() / 2;
+		while(n) {
+			::uint32_t k = rand() % 100000;
+			Tree::iterator it = tree.find(k);
+			if(it == tree.end()) { continue; }
+			tree.erase(it);
+			expected.erase(k);
+			n--;
+		}
+		failures += check_all(expected, "erase");
+	}
+	return failures;
+}
+
+bool key_less(const KV& a, const KV& b) { return a.first < b.first; }
+
+/**
+ * Random batch sorted by key, with duplicate keys in random order.
+ * Adds the first occurrence of every key not in expected yet to it.
+ */
+Batch make_batch(size_t n, ::uint32_t value_base, Map& expected) {
+	Batch batch;
+	for(size_t i = 0; i < n; i++) {
+		batch.push_back(KV(rand() % 100000, value_base + i));
+	}
+	std::stable_sort(batch.begin(), batch.end(), key_less);
+	for(Batch::iterator it = batch.begin(); it != batch.end(); ++it) {
+		expected.insert(*it);
+	}
+	return batch;
+}
+
+int test_bulk() {
+	int failures = 0;
+	
+	Map expected;
+	Batch empty;
+	if(tree.bulk_load(empty.begin(), empty.end()) != Tree::SUCCESS) { failures++; }
+	failures += check_all(expected, "bulk_load empty");
+	
+	size_t fills[] = { 100, 50, 0 };
+	for(size_t f = 0; f < sizeof(fills) / sizeof(fills[0]); f++) {
+		expected.clear();
+		Batch batch = make_batch(5000, 0, expected);
+		if(tree.bulk_load(batch.begin(), batch.end(), fills[f]) != Tree::SUCCESS) { failures++; }
+		failures += check_all(expected, "bulk_load");
+	}
+	
+	// Small batch: inserted one by one; keys already in the tree keep
+	// their value
+	Batch small = make_batch(expected.size() / Tree::BULK_MERGE_RATIO / 2, 10000, expected);
+	if(tree.merge(small.begin(), small.end()) != Tree::SUCCESS) { failures++; }
+	failures += check_all(expected, "merge small");
+	
+	// Large batch: rebuilds the tree
+	Batch large = make_batch(2 * expected.size(), 20000, expected);
+	if(tree.merge(large.begin(), large.end(), 70) != Tree::SUCCESS) { failures++; }
+	failures += check_all(expected, "merge large");
+	
+	// The rebuilt tree still takes regular inserts
+	for(::uint32_t k = 100000; k < 100500; k++) {
+		expected[k] = k;
+		tree.insert(k, k);
+	}
+	failures += check_all(expected, "insert after merge");
+	return failures;
+}
+
+void application_main(Os::AppMainParameter& amp) {
+	Os::Debug debug;
+	cache.init();
+	chunk_allocator.init(&cache, &debug);
+	chunk_allocator.format();
+	tree.init(&chunk_allocator, &debug);
+	
+	int failures = 0;
+	failures += test_erase();
+	failures += test_bulk();
+	
+	printf(failures ? "FAILED\n" : "OK\n");
+	exit(failures ? 1 : 0);
+}
@@ -0,0 +1,185 @@
+/*
+ * Checks for BloomFilter, BlockedBloomFilter and CountingBloomFilter:
+ *
+ * - no false negatives and a false positive rate close to the expected
+ *   one, for plain objects and for strings,
+ * - strings are hashed by content, not by address,
+ * - union and intersection contain the union / intersection,
+ * - counting filter: erase() removes values, saturated counters are
+ *   never decremented, to_bloom_filter() matches BloomFilter,
+ * - write() / from_buffer() round trip.
+ */
+
+#include <external_interface/external_interface.h>
+
+#undef DBG
+#define DBG(...)
+
+using namespace wiselib;
+
+typedef PCOsModel Os;
+typedef Os::block_data_t block_data_t;
+
+#include <util/allocators/malloc_free_allocator.h>
+typedef MallocFreeAllocator<Os> Allocator;
+Allocator allocator_;
+Allocator& get_allocator() { return allocator_; }
+
+#include <algorithms/bloom_filter/bloom_filter.h>
+#include <algorithms/bloom_filter/blocked_bloom_filter.h>
+#include <algorithms/bloom_filter/counting_bloom_filter.h>
+
+typedef BloomFilter<Os, 8192, 5> Filter;
+typedef BlockedBloomFilter<Os, 8192, 5> BlockedFilter;
+typedef CountingBloomFilter<Os, 8192, 5> CountingFilter;
+
+enum { VALUES = 400, PROBES = 100000 };
+
+/// Upper bound for false positives among PROBES, about twice the
+/// expected rate for 2 * VALUES values.
+enum { MAX_FALSE_POSITIVES = 2 * PROBES / 100 };
+
+void value(char* buffer, int i) {
+	sprintf(buffer, "<http://example.org/value/%d>", i);
+}
+
+template<typename F>
+int check_membership(F& f, const char* name) {
+	int failures = 0;
+	char buffer[64];
+	for(::uint32_t i = 0; i < VALUES; i++) {
+		value(buffer, i);
+		if(!f.contains(i) || !f.contains(buffer)) {
+			printf("  FAIL: %s lost value %d\n", name, (int)i);
+			failures++;
+		}
+	}
+	int false_positives = 0;
+	for(::uint32_t i = VALUES; i < VALUES + PROBES; i++) {
+		if(f.contains(i)) { false_positives++; }
+	}
+	if(false_positives > MAX_FALSE_POSITIVES) {
+		printf("  FAIL: %s has %d false positives in %d\n", name, false_positives, (int)PROBES);
+		failures++;
+	}
+	return failures;
+}
+
+template<typename F>
+int test_filter(const char* name) {
+	F *f = F::create();
+	char buffer[64];
+	for(::uint32_t i = 0; i < VALUES; i++) {
+		value(buffer, i);
+		f->add(i);
+		f->add(buffer);
+	}
+	int failures = check_membership(*f, name);
+
+	// Same content at another address
+	char copy[64];
+	value(buffer, 3);
+	strcpy(copy, buffer);
+	if(!f->contains(copy) || !f->contains(reinterpret_cast<block_data_t*>(copy), strlen(copy))) {
+		printf("  FAIL: %s hashes strings by address\n", name);
+		failures++;
+	}
+
+	block_data_t message[F::SIZE_BYTES];
+	f->write(message);
+	failures += check_membership(*F::from_buffer(message), name);
+
+	f->destroy();
+	printf("%s: %s\n", name, failures ? "FAILED" : "ok");
+	return failures;
+}
+
+template<typename F>
+int test_set_operations(const char* name) {
+	F a, b;
+	a.clear();
+	b.clear();
+	for(::uint32_t i = 0; i < 200; i++) { a.add(i); }
+	for(::uint32_t i = 100; i < 300; i++) { b.add(i); }
+
+	F u = a, n = a;
+	u |= b;
+	n &= b;
+
+	int failures = 0;
+	for(::uint32_t i = 0; i < 300; i++) {
+		if(!u.contains(i)) {
+			printf("  FAIL: %s union lost %d\n", name, (int)i);
+			failures++;
+		}
+	}
+	for(::uint32_t i = 100; i < 200; i++) {
+		if(!n.contains(i)) {
+			printf("  FAIL: %s intersection lost %d\n", name, (int)i);
+			failures++;
+		}
+	}
+	printf("%s set operations: %s\n", name, failures ? "FAILED" : "ok");
+	return failures;
+}
+
+int test_counting_erase() {
+	CountingFilter *c = CountingFilter::create();
+	Filter *f = Filter::create();
+	int failures = 0;
+
+	for(::uint32_t i = 0; i < VALUES; i++) {
+		c->add(i);
+		f->add(i);
+	}
+	Filter converted;
+	c->to_bloom_filter(converted);
+	if(converted != *f) {
+		printf("  FAIL: to_bloom_filter() differs from BloomFilter\n");
+		failures++;
+	}
+
+	for(::uint32_t i = 0; i < VALUES / 2; i++) { c->erase(i); }
+	int removed = 0;
+	for(::uint32_t i = 0; i < VALUES / 2; i++) {
+		if(!c->contains(i)) { removed++; }
+	}
+	for(::uint32_t i = VALUES / 2; i < VALUES; i++) {
+		if(!c->contains(i)) {
+			printf("  FAIL: erase() lost value %d\n", (int)i);
+			failures++;
+		}
+	}
+	if(removed < VALUES / 2 * 9 / 10) {
+		printf("  FAIL: only %d of %d erased values are gone\n", removed, (int)VALUES / 2);
+		failures++;
+	}
+
+	// Saturated counters stay, even if erased as often as added
+	::uint32_t v = 2 * VALUES;
+	for(int i = 0; i <= CountingFilter::MAX_COUNT; i++) { c->add(v); }
+	for(int i = 0; i <= CountingFilter::MAX_COUNT; i++) { c->erase(v); }
+	if(!c->contains(v)) {
+		printf("  FAIL: saturated value erased\n");
+		failures++;
+	}
+
+	f->destroy();
+	c->destroy();
+	printf("counting erase: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+void application_main(Os::AppMainParameter& amp) {
+	int failures = 0;
+	failures += test_filter<Filter>("bloom");
+	failures += test_filter<BlockedFilter>("blocked");
+	failures += test_filter<CountingFilter>("counting");
+	failures += test_set_operations<Filter>("bloom");
+	failures += test_set_operations<BlockedFilter>("blocked");
+	failures += test_set_operations<CountingFilter>("counting");
+	failures += test_counting_erase();
+
+	printf(failures ? "FAILED\n" : "OK\n");
+	exit(failures ? 1 : 0);
+}
@@ -0,0 +1,161 @@
+/*
+ * Checks for CowBlockMemory:
+ * 
+ * - a snapshot keeps seeing the blocks as they were when it was taken,
+ *   and releasing it frees the shadow blocks,
+ * - writes that need a shadow block fail once all are in use, without
+ *   changing the block,
+ * - init() finds the current version of every block again after a
+ *   restart instead of falling back to the home locations.
+ */
+
+#include <external_interface/external_interface.h>
+
+#undef DBG
+#define DBG(...)
+
+using namespace wiselib;
+
+typedef PCOsModel Os;
+typedef Os::block_data_t block_data_t;
+
+#include <util/allocators/malloc_free_allocator.h>
+typedef MallocFreeAllocator<Os> Allocator;
+Allocator allocator_;
+Allocator& get_allocator() { return allocator_; }
+
+#include <algorithms/block_memory/ram_block_memory.h>
+#include <algorithms/block_memory/cow_block_memory.h>
+
+enum { SHADOW_BLOCKS = 8, BLOCKS = 32 };
+
+typedef CowBlockMemory<Os, RamBlockMemory<Os>, SHADOW_BLOCKS, 2> Cow;
+
+Cow cow;
+
+void fill(block_data_t* buffer, ::uint32_t tag) {
+	for(size_t i = 0; i < Cow::BLOCK_SIZE; i += sizeof(tag)) {
+		memcpy(buffer + i, &tag, sizeof(tag));
+	}
+}
+
+bool has_tag(block_data_t* buffer, ::uint32_t tag) {
+	block_data_t expected[Cow::BUFFER_SIZE];
+	fill(expected, tag);
+	return memcmp(buffer, expected, Cow::BLOCK_SIZE) == 0;
+}
+
+/**
+ * @return number of blocks in [0, BLOCKS) that do not read as
+ * changed_base + a (for a < changed) or base + a through memory.
+ */
+template<typename Memory>
+int check_blocks(Memory& memory, ::uint32_t base, ::uint32_t changed_base, ::uint32_t changed) {
+	block_data_t buffer[Cow::BUFFER_SIZE];
+	int failures = 0;
+	for(::uint32_t a = 0; a < BLOCKS; a++) {
+		memory.read(buffer, a);
+		::uint32_t tag = (a < changed) ? changed_base + a : base + a;
+		if(!has_tag(buffer, tag)) {
+			printf("  FAIL: block %lu should be %lu\n", (unsigned long)a, (unsigned long)tag);
+			failures++;
+		}
+	}
+	return failures;
+}
+
+void write_blocks(::uint32_t base, ::uint32_t count) {
+	block_data_t buffer[Cow::BUFFER_SIZE];
+	for(::uint32_t a = 0; a < count; a++) {
+		fill(buffer, base + a);
+		cow.write(buffer, a);
+	}
+}
+
+int start() {
+	cow.block_memory().init();
+	if(cow.init() != Cow::SUCCESS) { return 1; }
+	write_blocks(100, BLOCKS);
+	return 0;
+}
+
+int test_snapshot() {
+	int failures = start();
+	
+	Cow::Snapshot *s = cow.snapshot();
+	write_blocks(200, SHADOW_BLOCKS / 2);
+	failures += check_blocks(*s, 100, 0, 0);
+	failures += check_blocks(cow, 100, 200, SHADOW_BLOCKS / 2);
+	if(cow.free_shadow_blocks() != SHADOW_BLOCKS - SHADOW_BLOCKS / 2) {
+		printf("  FAIL: %lu shadow blocks free\n", (unsigned long)cow.free_shadow_blocks());
+		failures++;
+	}
+	cow.release(s);
+	if(cow.free_shadow_blocks() != SHADOW_BLOCKS) {
+		printf("  FAIL: shadow blocks not freed on release\n");
+		failures++;
+	}
+	printf("snapshot: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+int test_out_of_shadow_blocks() {
+	int failures = start();
+	
+	Cow::Snapshot *s = cow.snapshot();
+	write_blocks(200, SHADOW_BLOCKS);
+	block_data_t buffer[Cow::BUFFER_SIZE];
+	fill(buffer, 300);
+	if(cow.write(buffer, SHADOW_BLOCKS) == Cow::SUCCESS) {
+		printf("  FAIL: write without a free shadow block succeeded\n");
+		failures++;
+	}
+	failures += check_blocks(cow, 100, 200, SHADOW_BLOCKS);
+	failures += check_blocks(*s, 100, 0, 0);
+	cow.release(s);
+	printf("out of shadow blocks: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+int test_restart() {
+	int failures = start();
+	
+	// Move some blocks to shadow locations, twice for the first ones,
+	// and keep the last snapshot pinned
+	Cow::Snapshot *s = cow.snapshot();
+	write_blocks(300, SHADOW_BLOCKS / 4);
+	cow.release(s);
+	s = cow.snapshot();
+	write_blocks(200, SHADOW_BLOCKS / 2);
+	
+	// Restart: snapshots are gone, current contents must not be
+	if(cow.init() != Cow::SUCCESS) {
+		printf("  FAIL: init() rejected the map area\n");
+		failures++;
+	}
+	failures += check_blocks(cow, 100, 200, SHADOW_BLOCKS / 2);
+	if(cow.free_shadow_blocks() != SHADOW_BLOCKS) {
+		printf("  FAIL: %lu blocks free after restart\n", (unsigned long)cow.free_shadow_blocks());
+		failures++;
+	}
+	
+	// The blocks freed by the restart are usable again
+	s = cow.snapshot();
+	write_blocks(400, SHADOW_BLOCKS);
+	failures += check_blocks(*s, 100, 200, SHADOW_BLOCKS / 2);
+	failures += check_blocks(cow, 100, 400, SHADOW_BLOCKS);
+	cow.release(s);
+	printf("restart: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+void application_main(Os::AppMainParameter& amp) {
+	int failures = 0;
+	failures += test_snapshot();
+	failures += test_out_of_shadow_blocks();
+	failures += test_restart();
+	
+	cow.destruct();
+	printf(failures ? "FAILED\n" : "OK\n");
+	exit(failures ? 1 : 0);
+}
@@ -0,0 +1,321 @@
+/*
+ * Checks for PCMpscQueue and the PCExecutorOsModel runtime:
+ *
+ * - the queue reports full and empty correctly, and with several
+ *   producer threads every value arrives exactly once and in the order
+ *   of its producer,
+ * - tasks posted from any thread run exactly once on the executor
+ *   thread, timers fire in deadline order, also when set from another
+ *   thread,
+ * - radio messages between nodes on different executors are all
+ *   delivered, on the thread of the receiving node.
+ */
+
+#include <external_interface/external_interface.h>
+#include <external_interface/pc/pc_executor_os_model.h>
+
+#undef DBG
+#define DBG(...)
+
+using namespace wiselib;
+
+typedef PCOsModel Os;
+typedef PCExecutorOsModel XOs;
+
+/// How long to wait for the workers before giving up
+enum { TIMEOUT_MS = 5000 };
+
+/**
+ * Wait until *counter reaches value.
+ * @return false on timeout.
+ */
+bool wait_for(long* counter, long value) {
+	for(int i = 0; i < TIMEOUT_MS; i++) {
+		if(__atomic_load_n(counter, __ATOMIC_SEQ_CST) >= value) { return true; }
+		usleep(1000);
+	}
+	return false;
+}
+
+//
+// Queue
+//
+
+enum { PRODUCERS = 4, VALUES = 100000, QUEUE_SIZE = 64 };
+
+typedef PCMpscQueue<Os, ::uint32_t, QUEUE_SIZE> Queue;
+
+Queue queue_;
+
+void* produce(void* arg) {
+	::uint32_t producer = (::uint32_t)(long)arg;
+	for(::uint32_t i = 0; i < VALUES; i++) {
+		while(!queue_.push((producer << 24) | i)) { sched_yield(); }
+	}
+	return 0;
+}
+
+int test_queue_bounds() {
+	Queue *q = new Queue;
+	int failures = 0;
+	::uint32_t v;
+	if(q->pop(v) || !q->empty()) {
+		printf("  FAIL: new queue not empty\n");
+		failures++;
+	}
+	for(::uint32_t i = 0; i < QUEUE_SIZE; i++) {
+		if(!q->push(i)) {
+			printf("  FAIL: push %d of %d failed\n", (int)i, (int)QUEUE_SIZE);
+			failures++;
+		}
+	}
+	if(q->push(QUEUE_SIZE)) {
+		printf("  FAIL: push into full queue succeeded\n");
+		failures++;
+	}
+	for(::uint32_t i = 0; i < QUEUE_SIZE; i++) {
+		if(!q->pop(v) || v != i) {
+			printf("  FAIL: pop %d\n", (int)i);
+			failures++;
+		}
+	}
+	if(q->pop(v)) {
+		printf("  FAIL: pop from empty queue succeeded\n");
+		failures++;
+	}
+	delete q;
+	printf("queue bounds: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+int test_queue_producers() {
+	pthread_t threads[PRODUCERS];
+	for(long i = 0; i < PRODUCERS; i++) {
+		pthread_create(&threads[i], 0, &produce, (void*)i);
+	}
+
+	int failures = 0;
+	::uint32_t next[PRODUCERS] = { 0 };
+	for(long n = 0; n < (long)PRODUCERS * VALUES; ) {
+		::uint32_t v;
+		if(!queue_.pop(v)) {
+			sched_yield();
+			continue;
+		}
+		::uint32_t producer = v >> 24, i = v & 0xffffff;
+		if(producer >= PRODUCERS || i != next[producer]) {
+			if(failures < 10) { printf("  FAIL: unexpected value %x\n", v); }
+			failures++;
+		}
+		else {
+			next[producer]++;
+		}
+		n++;
+	}
+	for(long i = 0; i < PRODUCERS; i++) {
+		pthread_join(threads[i], 0);
+	}
+	if(!queue_.empty()) {
+		printf("  FAIL: values left in the queue\n");
+		failures++;
+	}
+	printf("queue producers: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+//
+// Executor
+//
+
+enum { POSTERS = 4, TASKS = 10000 };
+
+struct Counter {
+	XOs::Executor *executor;
+	long runs;
+	long wrong_thread;
+	long order[3];
+	long fired;
+
+	void task(void*) {
+		if(XOs::Executor::current() != executor) { wrong_thread++; }
+		__atomic_add_fetch(&runs, 1, __ATOMIC_SEQ_CST);
+	}
+
+	void timer(void* userdata) {
+		if(XOs::Executor::current() != executor) { wrong_thread++; }
+		if(fired < 3) { order[fired] = (long)userdata; }
+		__atomic_add_fetch(&fired, 1, __ATOMIC_SEQ_CST);
+	}
+
+	void set_timers(void*) {
+		XOs::Timer t;
+		t.set_timer<Counter, &Counter::timer>(30, this, (void*)3);
+		t.set_timer<Counter, &Counter::timer>(10, this, (void*)1);
+		t.set_timer<Counter, &Counter::timer>(20, this, (void*)2);
+	}
+};
+
+XOs::Executor executor_;
+Counter counter_;
+
+void* post_tasks(void*) {
+	for(int i = 0; i < TASKS; i++) {
+		while(executor_.post(XOs::Executor::task_delegate_t::from_method<Counter, &Counter::task>(&counter_), 0) != XOs::SUCCESS) {
+			sched_yield();
+		}
+	}
+	return 0;
+}
+
+int test_executor() {
+	int failures = 0;
+	memset(&counter_, 0, sizeof(counter_));
+	counter_.executor = &executor_;
+	executor_.init();
+	executor_.start();
+
+	pthread_t threads[POSTERS];
+	for(int i = 0; i < POSTERS; i++) {
+		pthread_create(&threads[i], 0, &post_tasks, 0);
+	}
+	for(int i = 0; i < POSTERS; i++) {
+		pthread_join(threads[i], 0);
+	}
+	if(!wait_for(&counter_.runs, (long)POSTERS * TASKS)) {
+		printf("  FAIL: %ld of %d tasks ran\n", counter_.runs, POSTERS * TASKS);
+		failures++;
+	}
+
+	// Timers set on the worker, then from this thread
+	executor_.post(XOs::Executor::task_delegate_t::from_method<Counter, &Counter::set_timers>(&counter_), 0);
+	if(!wait_for(&counter_.fired, 3)) {
+		printf("  FAIL: %ld of 3 timers fired\n", counter_.fired);
+		failures++;
+	}
+	else if(counter_.order[0] != 1 || counter_.order[1] != 2 || counter_.order[2] != 3) {
+		printf("  FAIL: timers fired in order %ld %ld %ld\n", counter_.order[0], counter_.order[1], counter_.order[2]);
+		failures++;
+	}
+	XOs::Timer t;
+	t.init(executor_);
+	if(t.set_timer<Counter, &Counter::timer>(5, &counter_, (void*)4) != XOs::SUCCESS || !wait_for(&counter_.fired, 4)) {
+		printf("  FAIL: timer set from another thread did not fire\n");
+		failures++;
+	}
+
+	executor_.stop();
+	executor_.join();
+	executor_.destruct();
+
+	if(counter_.runs != (long)POSTERS * TASKS || counter_.fired != 4) {
+		printf("  FAIL: tasks or timers ran more than once\n");
+		failures++;
+	}
+	if(counter_.wrong_thread) {
+		printf("  FAIL: %ld callbacks ran on the wrong thread\n", counter_.wrong_thread);
+		failures++;
+	}
+	printf("executor: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+//
+// Radio
+//
+
+enum { WORKERS = 4, NODES = 64, ROUNDS = 5, MESSAGE = 8 };
+
+XOs::Executor workers_[WORKERS];
+long received_, wrong_thread_, initialized_;
+
+struct Node {
+	XOs::Timer timer;
+	XOs::Radio radio;
+	int id;
+	int round;
+	XOs::Executor *executor;
+
+	void init(void*) {
+		executor = XOs::Executor::current();
+		radio.init(id);
+		radio.reg_recv_callback<Node, &Node::receive>(this);
+		radio.enable_radio();
+		__atomic_add_fetch(&initialized_, 1, __ATOMIC_SEQ_CST);
+	}
+
+	void start(void*) {
+		timer.set_timer<Node, &Node::send>(10, this, 0);
+	}
+
+	void send(void*) {
+		if(XOs::Executor::current() != executor) { __atomic_add_fetch(&wrong_thread_, 1, __ATOMIC_SEQ_CST); }
+		XOs::block_data_t message[MESSAGE];
+		for(int i = 0; i < MESSAGE; i++) { message[i] = id + i; }
+		radio.send(XOs::Radio::BROADCAST_ADDRESS, MESSAGE, message);
+		if(++round < ROUNDS) {
+			timer.set_timer<Node, &Node::send>(10, this, 0);
+		}
+	}
+
+	void receive(XOs::Radio::node_id_t from, XOs::Radio::size_t len, XOs::Radio::block_data_t* data) {
+		if(XOs::Executor::current() != executor) { __atomic_add_fetch(&wrong_thread_, 1, __ATOMIC_SEQ_CST); }
+		if(len != MESSAGE || data[MESSAGE - 1] != (XOs::block_data_t)(from + MESSAGE - 1)) { return; }
+		__atomic_add_fetch(&received_, 1, __ATOMIC_SEQ_CST);
+	}
+};
+
+Node nodes_[NODES];
+
+int test_radio() {
+	int failures = 0;
+	for(int i = 0; i < WORKERS; i++) {
+		workers_[i].init();
+		workers_[i].start();
+	}
+	for(int i = 0; i < NODES; i++) {
+		nodes_[i].id = i;
+		workers_[i % WORKERS].post(XOs::Executor::task_delegate_t::from_method<Node, &Node::init>(&nodes_[i]), 0);
+	}
+	// All radios must be enabled before anyone sends
+	wait_for(&initialized_, NODES);
+	for(int i = 0; i < NODES; i++) {
+		workers_[i % WORKERS].post(XOs::Executor::task_delegate_t::from_method<Node, &Node::start>(&nodes_[i]), 0);
+	}
+
+	long expected = (long)NODES * (NODES - 1) * ROUNDS;
+	if(!wait_for(&received_, expected)) {
+		printf("  FAIL: %ld of %ld messages received\n", received_, expected);
+		failures++;
+	}
+	for(int i = 0; i < WORKERS; i++) {
+		workers_[i].stop();
+		workers_[i].join();
+	}
+	for(int i = 0; i < NODES; i++) {
+		nodes_[i].radio.disable_radio();
+	}
+	for(int i = 0; i < WORKERS; i++) {
+		workers_[i].destruct();
+	}
+	if(received_ != expected) {
+		printf("  FAIL: %ld messages received, expected %ld\n", received_, expected);
+		failures++;
+	}
+	if(wrong_thread_) {
+		printf("  FAIL: %ld callbacks ran on the wrong thread\n", wrong_thread_);
+		failures++;
+	}
+	printf("radio: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+void application_main(Os::AppMainParameter& amp) {
+	int failures = 0;
+	failures += test_queue_bounds();
+	failures += test_queue_producers();
+	failures += test_executor();
+	failures += test_radio();
+
+	printf(failures ? "FAILED\n" : "OK\n");
+	exit(failures ? 1 : 0);
+}
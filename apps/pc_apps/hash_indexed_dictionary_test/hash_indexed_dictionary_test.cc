@@ -0,0 +1,160 @@
+/*
+ * Checks for HashIndexedDictionary and its use by HashTranslator:
+ * 
+ * - init() indexes the values already in the wrapped dictionary,
+ * - insert() and erase() through the wrapper keep the index in sync,
+ *   also while the tables grow,
+ * - HashTranslator resolves values the index does not know (inserted
+ *   into the wrapped dictionary directly) by scanning.
+ */
+
+#include <external_interface/external_interface.h>
+
+#undef DBG
+#define DBG(...)
+
+using namespace wiselib;
+
+typedef PCOsModel Os;
+typedef Os::block_data_t block_data_t;
+
+#include <util/allocators/malloc_free_allocator.h>
+typedef MallocFreeAllocator<Os> Allocator;
+Allocator allocator_;
+Allocator& get_allocator() { return allocator_; }
+
+#include <algorithms/hash/fnv.h>
+#include <util/tuple_store/prescilla_dictionary.h>
+#include <util/tuple_store/hash_indexed_dictionary.h>
+#include <algorithms/rdf/inqp/hash_translator.h>
+
+typedef Fnv32<Os> Hash;
+typedef PrescillaDictionary<Os> Dictionary;
+typedef HashIndexedDictionary<Os, Dictionary, Hash, 4> Indexed;
+typedef HashTranslator<Os, Indexed, Hash, 8> Translator;
+
+Os::Debug debug_;
+Dictionary dictionary_;
+Indexed indexed_;
+Translator translator_;
+
+enum { VALUES = 100 };
+
+void value(char* buffer, int i) {
+	sprintf(buffer, "<http://example.org/value/%d>", i);
+}
+
+Hash::hash_t hash_of(int i) {
+	char buffer[64];
+	value(buffer, i);
+	return Hash::hash((block_data_t*)buffer, strlen(buffer));
+}
+
+/**
+ * @return number of values in [from, to) that find_hash() does not
+ * resolve to their key.
+ */
+int check_index(int from, int to) {
+	int failures = 0;
+	char buffer[64];
+	for(int i = from; i < to; i++) {
+		value(buffer, i);
+		Indexed::key_type k = indexed_.find((block_data_t*)buffer);
+		if(k == Indexed::NULL_KEY || indexed_.find_hash(hash_of(i)) != k) {
+			printf("  FAIL: value %d not indexed\n", i);
+			failures++;
+		}
+	}
+	return failures;
+}
+
+int test_init_populated() {
+	char buffer[64];
+	for(int i = 0; i < VALUES; i++) {
+		value(buffer, i);
+		dictionary_.insert((block_data_t*)buffer);
+	}
+	int failures = 0;
+	if(indexed_.init(&dictionary_) != Indexed::SUCCESS) { failures++; }
+	if(indexed_.size() != VALUES) {
+		printf("  FAIL: %d values indexed instead of %d\n", (int)indexed_.size(), (int)VALUES);
+		failures++;
+	}
+	failures += check_index(0, VALUES);
+	printf("init populated: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+int test_insert_erase() {
+	char buffer[64];
+	int failures = 0;
+	for(int i = VALUES; i < 2 * VALUES; i++) {
+		value(buffer, i);
+		indexed_.insert((block_data_t*)buffer);
+	}
+	failures += check_index(0, 2 * VALUES);
+	
+	// Insert twice, erase once: must stay indexed
+	value(buffer, VALUES);
+	indexed_.insert((block_data_t*)buffer);
+	indexed_.erase(indexed_.find((block_data_t*)buffer));
+	failures += check_index(VALUES, VALUES + 1);
+	
+	for(int i = VALUES; i < 2 * VALUES; i += 2) {
+		value(buffer, i);
+		indexed_.erase(indexed_.find((block_data_t*)buffer));
+	}
+	for(int i = VALUES; i < 2 * VALUES; i += 2) {
+		if(indexed_.find_hash(hash_of(i)) != Indexed::NULL_KEY) {
+			printf("  FAIL: erased value %d still indexed\n", i);
+			failures++;
+		}
+	}
+	failures += check_index(VALUES + 1, VALUES + 2);
+	if(indexed_.size() != VALUES + VALUES / 2) {
+		printf("  FAIL: index has %d values\n", (int)indexed_.size());
+		failures++;
+	}
+	printf("insert/erase: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+int test_translator_fallback() {
+	char buffer[64];
+	int failures = 0;
+	translator_.init(&indexed_);
+	
+	// Bypass the index
+	value(buffer, 3 * VALUES);
+	Dictionary::key_type k = dictionary_.insert((block_data_t*)buffer);
+	if(indexed_.find_hash(hash_of(3 * VALUES)) != Indexed::NULL_KEY) {
+		printf("  FAIL: index knows a value it was never told about\n");
+		failures++;
+	}
+	if(translator_.translate(hash_of(3 * VALUES)) != k) {
+		printf("  FAIL: translator did not fall back to scanning\n");
+		failures++;
+	}
+	for(int i = 0; i < VALUES; i++) {
+		value(buffer, i);
+		if(translator_.translate(hash_of(i)) != indexed_.find((block_data_t*)buffer)) {
+			printf("  FAIL: value %d not translated\n", i);
+			failures++;
+		}
+	}
+	printf("translator fallback: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+void application_main(Os::AppMainParameter& amp) {
+	dictionary_.init(&debug_);
+	
+	int failures = 0;
+	failures += test_init_populated();
+	failures += test_insert_erase();
+	failures += test_translator_fallback();
+	
+	indexed_.destruct();
+	printf(failures ? "FAILED\n" : "OK\n");
+	exit(failures ? 1 : 0);
+}
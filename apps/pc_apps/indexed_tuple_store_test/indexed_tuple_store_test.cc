@@ -0,0 +1,213 @@
+/*
+ * Checks IndexedTupleStore against a plain set of triples:
+ * 
+ * - every query mask returns the same tuples, whether it is answered by
+ *   an index (added before or after the tuples were inserted) or by a
+ *   scan,
+ * - erasing through an index iterator removes exactly the matching
+ *   tuples and keeps all indexes in sync,
+ * - iterators can be default constructed and copied.
+ */
+
+#include <set>
+#include <string>
+#include <stdlib.h>
+
+#include <external_interface/external_interface.h>
+
+#undef DBG
+#define DBG(...)
+
+using namespace wiselib;
+
+typedef PCOsModel Os;
+typedef Os::block_data_t block_data_t;
+
+#include <util/allocators/malloc_free_allocator.h>
+typedef MallocFreeAllocator<Os> Allocator;
+Allocator allocator_;
+Allocator& get_allocator() { return allocator_; }
+
+#include <util/pstl/list_dynamic.h>
+#include <util/pstl/unique_container.h>
+#include <util/tuple_store/tuplestore.h>
+#include <util/tuple_store/prescilla_dictionary.h>
+#include <util/tuple_store/indexed_tuple_store.h>
+#include <algorithms/block_memory/ram_block_memory.h>
+#include <algorithms/block_memory/cached_block_memory.h>
+#include <algorithms/block_memory/bitmap_chunk_allocator.h>
+#include "../../generic_apps/inqp_test/tuple.h"
+
+typedef Tuple<Os> TupleT;
+typedef list_dynamic<Os, TupleT> TupleList;
+typedef UniqueContainer<TupleList> TupleContainer;
+typedef PrescillaDictionary<Os> Dictionary;
+typedef TupleStore<Os, TupleContainer, Dictionary, Os::Debug, BIN(111), &TupleT::compare> TS;
+
+typedef RamBlockMemory<Os> Ram;
+typedef CachedBlockMemory<Os, Ram, 100, 10> Cache;
+typedef BitmapChunkAllocator<Os, Cache, 8> ChunkAllocator;
+typedef IndexedTupleStore<Os, TS, ChunkAllocator> ITS;
+
+typedef std::set<std::string> Triples;
+
+Os::Debug debug_;
+Dictionary dictionary_;
+TupleContainer container_;
+TS ts_;
+Cache cache_;
+ChunkAllocator chunk_allocator_;
+ITS its_;
+
+enum { VOCABULARY = 12, TUPLES = 300 };
+
+const char* word(int i) {
+	static char words[VOCABULARY][8];
+	sprintf(words[i], "w%d", i);
+	return words[i];
+}
+
+std::string key(TupleT& t) {
+	return std::string((char*)t.get(0)) + " " + (char*)t.get(1) + " " + (char*)t.get(2);
+}
+
+bool matches(const std::string& triple, TupleT& query, int mask) {
+	std::string parts[3];
+	size_t start = 0;
+	for(int i = 0; i < 3; i++) {
+		size_t end = triple.find(' ', start);
+		parts[i] = triple.substr(start, end - start);
+		start = end + 1;
+	}
+	for(int i = 0; i < 3; i++) {
+		if((mask & (1 << i)) && parts[i] != (char*)query.get(i)) { return false; }
+	}
+	return true;
+}
+
+TupleT make_tuple(int s, int p, int o) {
+	TupleT t;
+	t.set(0, (block_data_t*)word(s));
+	t.set(1, (block_data_t*)word(p));
+	t.set(2, (block_data_t*)word(o));
+	return t;
+}
+
+/**
+ * @return number of (query, mask) combinations for which its_ does not
+ * return exactly the matching elements of expected.
+ */
+int check_queries(Triples& expected, const char* what) {
+	int failures = 0;
+	for(int mask = 0; mask < 8; mask++) {
+		for(int round = 0; round < 20; round++) {
+			char s[8], p[8], o[8];
+			strcpy(s, word(rand() % VOCABULARY));
+			strcpy(p, word(rand() % VOCABULARY));
+			strcpy(o, word(rand() % VOCABULARY));
+			TupleT query;
+			query.set(0, (block_data_t*)s);
+			query.set(1, (block_data_t*)p);
+			query.set(2, (block_data_t*)o);
+			
+			Triples found;
+			bool duplicate = false;
+			for(ITS::iterator it = its_.begin(&query, mask); it != its_.end(); ++it) {
+				duplicate |= !found.insert(key(*it)).second;
+			}
+			Triples wanted;
+			for(Triples::iterator it = expected.begin(); it != expected.end(); ++it) {
+				if(matches(*it, query, mask)) { wanted.insert(*it); }
+			}
+			if(duplicate || found != wanted) {
+				printf("  FAIL: query %s %s %s mask %d: %lu found, %lu expected\n", s, p, o, mask,
+						(unsigned long)found.size(), (unsigned long)wanted.size());
+				failures++;
+			}
+		}
+	}
+	printf("%s: %s\n", what, failures ? "FAILED" : "ok");
+	return failures;
+}
+
+int test_queries(Triples& expected) {
+	::uint8_t spo[] = { 0, 1, 2 };
+	::uint8_t pos[] = { 1, 2, 0 };
+	its_.add_index(spo);
+	for(int i = 0; i < TUPLES; i++) {
+		TupleT t = make_tuple(rand() % VOCABULARY, rand() % VOCABULARY, rand() % VOCABULARY);
+		expected.insert(key(t));
+		its_.insert(t);
+	}
+	// Filled from the existing tuples
+	its_.add_index(pos);
+	
+	int failures = 0;
+	if(its_.size() != expected.size()) {
+		printf("  FAIL: %lu tuples stored, %lu expected\n", (unsigned long)its_.size(), (unsigned long)expected.size());
+		failures++;
+	}
+	return failures + check_queries(expected, "queries");
+}
+
+int test_erase(Triples& expected) {
+	int failures = 0;
+	
+	// Erase everything with predicate w3 through the POS index
+	char p[8];
+	strcpy(p, word(3));
+	TupleT query;
+	query.set(1, (block_data_t*)p);
+	ITS::iterator it = its_.begin(&query, BIN(010));
+	if(!it.index()) {
+		printf("  FAIL: predicate query not answered by an index\n");
+		failures++;
+	}
+	while(it != its_.end()) {
+		expected.erase(key(*it));
+		it = its_.erase(it);
+	}
+	for(Triples::iterator e = expected.begin(); e != expected.end(); ) {
+		Triples::iterator next = e;
+		++next;
+		if(matches(*e, query, BIN(010))) {
+			printf("  FAIL: %s not erased\n", e->c_str());
+			failures++;
+		}
+		e = next;
+	}
+	if(its_.size() != expected.size()) {
+		printf("  FAIL: %lu tuples left, %lu expected\n", (unsigned long)its_.size(), (unsigned long)expected.size());
+		failures++;
+	}
+	return failures + check_queries(expected, "erase");
+}
+
+int test_iterator_copy() {
+	ITS::iterator a;
+	ITS::iterator b(a);
+	ITS::iterator c = its_.end();
+	c = b;
+	int failures = !(c == its_.end());
+	printf("iterator copy: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+void application_main(Os::AppMainParameter& amp) {
+	dictionary_.init(&debug_);
+	ts_.init(&dictionary_, &container_, &debug_);
+	cache_.init();
+	chunk_allocator_.init(&cache_, &debug_);
+	chunk_allocator_.format();
+	its_.init(&ts_, &chunk_allocator_, &debug_);
+	srand(1);
+	
+	Triples expected;
+	int failures = 0;
+	failures += test_queries(expected);
+	failures += test_erase(expected);
+	failures += test_iterator_copy();
+	
+	printf(failures ? "FAILED\n" : "OK\n");
+	exit(failures ? 1 : 0);
+}
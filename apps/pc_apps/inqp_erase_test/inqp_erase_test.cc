@@ -0,0 +1,188 @@
+
+/*
+ * Runs INQP queries with an aggregate on top of each join type and
+ * checks that erase_query() releases everything the operators allocated,
+ * both for queries that ran to completion and for joins that are still
+ * holding their table (right input never finished).
+ */
+
+#include <external_interface/external_interface.h>
+
+#undef DBG
+#define DBG(...)
+
+using namespace wiselib;
+
+typedef PCOsModel Os;
+typedef Os::block_data_t block_data_t;
+
+#include <util/allocators/malloc_free_allocator.h>
+typedef MallocFreeAllocator<Os> Allocator;
+Allocator allocator_;
+Allocator& get_allocator() { return allocator_; }
+
+#include <util/allocators/instrumented_allocator.h>
+#include <util/pstl/list_dynamic.h>
+#include <util/pstl/unique_container.h>
+#include <util/tuple_store/tuplestore.h>
+#include <util/tuple_store/prescilla_dictionary.h>
+#include <algorithms/rdf/inqp/query_processor.h>
+#include <algorithms/rdf/inqp/communicator.h>
+#include "../../generic_apps/inqp_test/tuple.h"
+
+/**
+ * Timer that never fires, so aggregates do not send after the query
+ * has been erased.
+ */
+class NullTimer {
+	public:
+		typedef NullTimer self_type;
+		typedef self_type* self_pointer_t;
+		typedef Os::Timer::millis_t millis_t;
+
+		template<typename T, void (T::*TMethod)(void*)>
+		int set_timer(millis_t, T*, void*) { return Os::SUCCESS; }
+};
+
+typedef InstrumentedAllocator<Os, Allocator> CountingAllocator;
+
+typedef Tuple<Os> TupleT;
+typedef list_dynamic<Os, TupleT> TupleList;
+typedef UniqueContainer<TupleList> TupleContainer;
+typedef PrescillaDictionary<Os> Dictionary;
+typedef TupleStore<Os, TupleContainer, Dictionary, Os::Debug, BIN(111), &TupleT::compare> TS;
+
+typedef INQPQueryProcessor<Os, TS, Fnv32<Os>, Dictionary,
+		DictionaryTranslator<Os, Dictionary, Fnv32<Os>, 64>,
+		HashTranslator<Os, Dictionary, Fnv32<Os>, 64>,
+		::uint32_t, 8, NullTimer, CountingAllocator> Processor;
+typedef INQPCommunicator<Os, Processor> Communicator;
+typedef Communicator::QMessage QMessage;
+
+#define LEFT 0
+#define RIGHT 0x80
+#define AGAIN 0x80
+
+#define LEFT_COL(X) ((X) << 4)
+#define RIGHT_COL(X) ((X) & 0x0f)
+
+class EraseTest {
+	public:
+		void init() {
+			dictionary_.init(&debug_);
+			ts_.init(&dictionary_, &container_, &debug_);
+
+			ins("A", "measures", "m1");
+			ins("A", "measures", "m2");
+			ins("m1", "has_value", "12");
+			ins("m2", "has_value", "14");
+			ins("B", "measures", "mb1");
+			ins("mb1", "has_value", "20");
+
+			allocator_.init(&get_allocator());
+			processor_.init(&ts_, &timer_, &allocator_);
+		}
+
+		/**
+		 * Send an aggregate over a join of type join_type and its two
+		 * graph pattern selections; if complete is false the right
+		 * selection is left out so the join never sees the end of its
+		 * right input.
+		 */
+		void send_query(::uint8_t qid, char join_type, bool complete) {
+			block_data_t info[] = {
+				Communicator::MESSAGE_ID_QUERY, qid,
+				(block_data_t)(complete ? 4 : 3),
+			};
+			processor_.handle_query_info((QMessage*)info, 0, sizeof(info));
+
+			block_data_t aggregate[] = {
+				Communicator::MESSAGE_ID_OPERATOR, qid, 100, 'a', 0,
+				BIN(0111), 0, 0, 0,
+				5, 0, AGAIN | 4, AGAIN | 5, AGAIN | 1, 2
+			};
+			send(aggregate, sizeof(aggregate));
+
+			block_data_t join[] = {
+				Communicator::MESSAGE_ID_OPERATOR, qid, 90, (block_data_t)join_type, LEFT | 100,
+				BIN(01000011), 0, 0, 0,
+				LEFT_COL(1) | RIGHT_COL(0)
+			};
+			send(join, sizeof(join));
+
+			if(complete) {
+				block_data_t right[] = {
+					Communicator::MESSAGE_ID_OPERATOR, qid, 80, 'g', RIGHT | 90,
+					BIN(00010011), 0, 0, 0,
+					BIN(010), 0xd6, 0x88, 0x14, 0xad // "has_value"
+				};
+				send(right, sizeof(right));
+			}
+
+			block_data_t left[] = {
+				Communicator::MESSAGE_ID_OPERATOR, qid, 70, 'g', LEFT | 90,
+				BIN(00110011), 0, 0, 0,
+				BIN(010), 0x08, 0xff, 0xea, 0xc4 // "measures"
+			};
+			send(left, sizeof(left));
+		}
+
+		int check(::uint8_t qid, char join_type, bool complete) {
+			size_t before = allocator_.size();
+			send_query(qid, join_type, complete);
+			assert(processor_.get_query(qid) != 0);
+			size_t during = allocator_.size();
+			processor_.erase_query(qid);
+
+			printf("join '%c' %-10s live during=%lu after=%lu\n",
+					join_type, complete ? "complete" : "partial",
+					(unsigned long)during, (unsigned long)allocator_.size());
+
+			if(allocator_.size() != before) {
+				printf("  FAIL: %lu bytes leaked\n", (unsigned long)(allocator_.size() - before));
+				return 1;
+			}
+			return 0;
+		}
+
+	private:
+		#pragma GCC diagnostic push
+		#pragma GCC diagnostic ignored "-Wwrite-strings"
+		void ins(const char* s, const char* p, const char* o) {
+			TupleT t;
+			t.set(0, (block_data_t*)s);
+			t.set(1, (block_data_t*)p);
+			t.set(2, (block_data_t*)o);
+			ts_.insert(t);
+		}
+		#pragma GCC diagnostic pop
+
+		void send(block_data_t* msg, size_t size) {
+			processor_.handle_operator((QMessage*)msg, 0, size);
+		}
+
+		Os::Debug debug_;
+		NullTimer timer_;
+		CountingAllocator allocator_;
+		Dictionary dictionary_;
+		TupleContainer container_;
+		TS ts_;
+		Processor processor_;
+};
+
+void application_main(Os::AppMainParameter& amp) {
+	EraseTest test;
+	test.init();
+
+	const char join_types[] = { 'j', 'h', 'm' };
+	int failures = 0;
+	::uint8_t qid = 1;
+	for(size_t i = 0; i < sizeof(join_types); i++) {
+		failures += test.check(qid++, join_types[i], true);
+		failures += test.check(qid++, join_types[i], false);
+	}
+
+	printf(failures ? "FAILED\n" : "OK\n");
+	exit(failures ? 1 : 0);
+}
+
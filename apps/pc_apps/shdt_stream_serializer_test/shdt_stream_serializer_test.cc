@@ -0,0 +1,221 @@
+/*
+ * Checks for ShdtStreamSerializer:
+ *
+ * - fill_buffer() accepts iterators that return tuples by value,
+ * - with a ring too small for all strings entries are evicted and
+ *   inserted again, and the decoder (ShdtStreamSerializer or
+ *   ShdtSerializer) still reads back every tuple,
+ * - a tuple whose strings do not fit into the ring is not written,
+ * - fill_frames() / read_frames() round trip.
+ */
+
+#include <external_interface/external_interface.h>
+
+#undef DBG
+#define DBG(...)
+
+using namespace wiselib;
+
+typedef PCOsModel Os;
+typedef Os::block_data_t block_data_t;
+typedef Os::size_t size_type;
+
+#include <util/allocators/malloc_free_allocator.h>
+typedef MallocFreeAllocator<Os> Allocator;
+Allocator allocator_;
+Allocator& get_allocator() { return allocator_; }
+
+#include <util/serialization/serialization.h>
+#include <util/broker/shdt_serializer.h>
+#include <util/broker/shdt_stream_serializer.h>
+
+typedef ShdtStreamSerializer<Os, 40> Serializer;
+typedef ShdtSerializer<Os, 40> PlainSerializer;
+
+enum { STRINGS = 60, TUPLES = 2000, FRAME_SIZE = 160, RING_SIZE = 4096, SMALL_RING_SIZE = 300 };
+
+struct Tuple {
+	block_data_t *data[3];
+	block_data_t* get(size_type i) { return data[i]; }
+	void set(size_type i, block_data_t* d) { data[i] = d; }
+};
+
+/**
+ * Iterates over tuples_[i] and returns copies of them, like
+ * DictionaryTupleStore::iterator does.
+ */
+struct Iterator {
+	typedef ::Tuple Tuple;
+	int i;
+	Iterator(int i) : i(i) { }
+	Tuple operator*();
+	Iterator& operator++() { ++i; return *this; }
+	bool operator==(const Iterator& other) const { return i == other.i; }
+	bool operator!=(const Iterator& other) const { return i != other.i; }
+};
+
+char strings_[STRINGS][64];
+Tuple tuples_[TUPLES];
+
+Tuple Iterator::operator*() { return tuples_[i]; }
+
+void make_tuples() {
+	for(int i = 0; i < STRINGS; i++) {
+		sprintf(strings_[i], "<http://example.org/%s/%d>", (i % 4) ? "s" : "a/longer/path", i);
+	}
+	unsigned r = 1;
+	for(int i = 0; i < TUPLES; i++) {
+		for(int j = 0; j < 3; j++) {
+			r = r * 1103515245 + 12345;
+			tuples_[i].data[j] = (block_data_t*)strings_[(r >> 16) % (j == 1 ? 5 : STRINGS)];
+		}
+	}
+}
+
+bool equal(Tuple& a, Tuple& b) {
+	for(int j = 0; j < 3; j++) {
+		if(!a.data[j] || strcmp((char*)a.data[j], (char*)b.data[j])) { return false; }
+	}
+	return true;
+}
+
+/**
+ * Encode all tuples frame by frame with encoder, decode every frame
+ * right away with decoder and compare.
+ * @return number of bytes written or 0 on failure.
+ */
+template<typename Decoder>
+size_type round_trip(Serializer& encoder, Decoder& decoder) {
+	block_data_t frame[FRAME_SIZE];
+	Iterator current(0), end(TUPLES);
+	int n = 0;
+	size_type bytes = 0;
+
+	while(current != end) {
+		size_type l = encoder.fill_buffer(frame, FRAME_SIZE, current, end);
+		if(!l) {
+			printf("  FAIL: tuple %d does not fit into a frame\n", current.i);
+			return 0;
+		}
+		bytes += l;
+		for(size_type offset = 0; offset < l; ) {
+			Tuple t;
+			t.data[0] = 0;
+			offset += decoder.read_buffer(t, frame + offset, l - offset);
+			if(!t.data[0]) { continue; }
+			if(n >= TUPLES || !equal(t, tuples_[n])) {
+				printf("  FAIL: tuple %d decoded wrongly\n", n);
+				return 0;
+			}
+			n++;
+		}
+	}
+	if(n != TUPLES) {
+		printf("  FAIL: decoded %d of %d tuples\n", n, (int)TUPLES);
+		return 0;
+	}
+	return bytes;
+}
+
+int test_eviction() {
+	static block_data_t encoder_ring[RING_SIZE], decoder_ring[RING_SIZE];
+	int failures = 0;
+
+	Serializer encoder, decoder;
+	encoder.init(encoder_ring, RING_SIZE);
+	decoder.init(decoder_ring, RING_SIZE);
+	size_type large = round_trip(encoder, decoder);
+	if(!large) { failures++; }
+
+	encoder.init(encoder_ring, SMALL_RING_SIZE);
+	decoder.init(decoder_ring, SMALL_RING_SIZE);
+	size_type small = round_trip(encoder, decoder);
+	if(!small) { failures++; }
+
+	// Evicted strings must have been sent again
+	if(small <= large) {
+		printf("  FAIL: small ring wrote %d bytes, large ring %d\n", (int)small, (int)large);
+		failures++;
+	}
+
+	PlainSerializer plain;
+	encoder.init(encoder_ring, SMALL_RING_SIZE);
+	if(!round_trip(encoder, plain)) { failures++; }
+
+	printf("eviction: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+int test_oversize() {
+	static block_data_t ring[64];
+	block_data_t frame[FRAME_SIZE];
+	int failures = 0;
+
+	Serializer encoder;
+	encoder.init(ring, sizeof(ring));
+	// 3 distinct strings of ~30 bytes each
+	Iterator current(0), end(TUPLES);
+	while(current != end && (*current).data[0] == (*current).data[2]) { ++current; }
+	int i = current.i;
+	if(encoder.fill_buffer(frame, FRAME_SIZE, current, end) != 0 || current.i != i) {
+		printf("  FAIL: wrote a tuple larger than the ring\n");
+		failures++;
+	}
+	printf("oversize: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+int test_frames() {
+	static block_data_t encoder_ring[SMALL_RING_SIZE], decoder_ring[SMALL_RING_SIZE];
+	static block_data_t data[8][FRAME_SIZE];
+	int failures = 0;
+
+	Serializer encoder, decoder;
+	encoder.init(encoder_ring, SMALL_RING_SIZE);
+	decoder.init(decoder_ring, SMALL_RING_SIZE);
+
+	Serializer::Frame frames[8];
+	for(int i = 0; i < 8; i++) {
+		frames[i].data = data[i];
+		frames[i].size = FRAME_SIZE;
+	}
+
+	Iterator current(0), end(TUPLES);
+	int n = 0;
+	while(current != end && !failures) {
+		size_type count = encoder.fill_frames(frames, 8, current, end);
+		if(!count) {
+			printf("  FAIL: no frame filled\n");
+			failures++;
+			break;
+		}
+		size_type frame = 0, offset = 0;
+		Tuple t;
+		while(decoder.read_frames(t, frames, count, frame, offset)) {
+			if(n >= TUPLES || !equal(t, tuples_[n])) {
+				printf("  FAIL: tuple %d decoded wrongly\n", n);
+				failures++;
+				break;
+			}
+			n++;
+		}
+	}
+	if(!failures && n != TUPLES) {
+		printf("  FAIL: decoded %d of %d tuples\n", n, (int)TUPLES);
+		failures++;
+	}
+	printf("frames: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+void application_main(Os::AppMainParameter& amp) {
+	make_tuples();
+
+	int failures = 0;
+	failures += test_eviction();
+	failures += test_oversize();
+	failures += test_frames();
+
+	printf(failures ? "FAILED\n" : "OK\n");
+	exit(failures ? 1 : 0);
+}
@@ -0,0 +1,179 @@
+/*
+ * Checks for the parallel mode of the SimOsModel simulator:
+ *
+ * - a gossip workload gives the same statistics and the same per node
+ *   reception traces for 1, 2, 4 and 8 threads,
+ * - splitting the run into several run_until() calls does not change
+ *   the result,
+ * - a link model without lookahead falls back to one thread and still
+ *   gives the same result.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <external_interface/external_interface.h>
+
+using namespace wiselib;
+
+typedef SimOsModel Os;
+
+enum { NODES = 2000 };
+
+::uint64_t traces_[NODES];
+
+/**
+ * Beacons at random intervals, answers some beacons and folds every
+ * reception (time, sender, payload) into a per node hash. Each node
+ * only writes its own trace, so this is safe with several threads.
+ */
+struct GossipApp {
+	Os::Radio *radio;
+	Os::Timer *timer;
+	Os::Rand *rand;
+	Os::Clock *clock;
+	::uint32_t received;
+
+	void init(SimOs& os) {
+		radio = &FacetProvider<Os, Os::Radio>::get_facet(os);
+		timer = &FacetProvider<Os, Os::Timer>::get_facet(os);
+		rand = &FacetProvider<Os, Os::Rand>::get_facet(os);
+		clock = &FacetProvider<Os, Os::Clock>::get_facet(os);
+		received = 0;
+		traces_[radio->id()] = 1469598103934665603ULL;
+		radio->reg_recv_callback<GossipApp, &GossipApp::receive>(this);
+		timer->set_timer<GossipApp, &GossipApp::beacon>((*rand)(1000) + 1, this, 0);
+	}
+
+	void beacon(void*) {
+		Os::block_data_t message[4];
+		memcpy(message, &received, sizeof(received));
+		radio->send(Os::Radio::BROADCAST_ADDRESS, sizeof(message), message);
+		timer->set_timer<GossipApp, &GossipApp::beacon>(900 + (*rand)(200), this, 0);
+	}
+
+	void receive(Os::Radio::node_id_t from, Os::Radio::size_t len, Os::Radio::block_data_t* data) {
+		::uint32_t c = 0;
+		if(len == sizeof(c)) { memcpy(&c, data, sizeof(c)); }
+		::uint64_t &h = traces_[radio->id()];
+		h = (h ^ (clock->time() * 131 + from * 7 + c)) * 1099511628211ULL;
+		received++;
+		if((*rand)(10) == 0) {
+			Os::block_data_t reply[1] = { 0 };
+			radio->send(from, sizeof(reply), reply);
+		}
+	}
+};
+
+/**
+ * SimUnitDiskLinkModel without lookahead, forces sequential
+ * simulation.
+ */
+class NoLookaheadLinkModel : public SimUnitDiskLinkModel {
+	public:
+		NoLookaheadLinkModel(double range, double loss, ::uint64_t latency, ::uint64_t jitter)
+			: SimUnitDiskLinkModel(range, loss, latency, jitter) {
+		}
+
+		::uint64_t lookahead() { return 0; }
+};
+
+struct Result {
+	SimWorld::Stats stats;
+	::uint64_t traces[NODES];
+};
+
+/**
+ * Simulate 10 s of gossip in \p steps run_until() calls.
+ */
+void run_gossip(SimLinkModel& link, int threads, int steps, Result& r) {
+	SimWorld world(42);
+	world.set_debug(false);
+	world.set_link_model(&link);
+	world.set_threads(threads);
+	int side = (int)sqrt((double)NODES);
+	for(int i = 0; i < NODES; i++) {
+		WiselibApplication<Os, GossipApp> app;
+		app.init(world.add_node((i % side) + world.random_real() * 0.5, (i / side) + world.random_real() * 0.5));
+	}
+	for(int i = 1; i <= steps; i++) {
+		world.run_until(i * 10 * SimWorld::SECOND / steps);
+	}
+	r.stats = world.stats();
+	memcpy(r.traces, traces_, sizeof(traces_));
+}
+
+int compare(Result& expected, Result& r, const char* name) {
+	int failures = 0;
+	if(r.stats.events != expected.stats.events || r.stats.sent != expected.stats.sent ||
+			r.stats.delivered != expected.stats.delivered || r.stats.lost != expected.stats.lost) {
+		printf("  FAIL: %s: %lu events, %lu sent, %lu delivered, %lu lost instead of %lu, %lu, %lu, %lu\n", name,
+				(unsigned long)r.stats.events, (unsigned long)r.stats.sent,
+				(unsigned long)r.stats.delivered, (unsigned long)r.stats.lost,
+				(unsigned long)expected.stats.events, (unsigned long)expected.stats.sent,
+				(unsigned long)expected.stats.delivered, (unsigned long)expected.stats.lost);
+		failures++;
+	}
+	int differ = 0;
+	for(int i = 0; i < NODES; i++) {
+		if(r.traces[i] != expected.traces[i]) { differ++; }
+	}
+	if(differ) {
+		printf("  FAIL: %s: traces of %d nodes differ\n", name, differ);
+		failures++;
+	}
+	return failures;
+}
+
+int test_threads(Result& sequential) {
+	int failures = 0;
+	static Result r;
+	SimUnitDiskLinkModel link(1.5, 0.1, 2000, 500);
+	int threads[] = { 2, 4, 8 };
+	for(int i = 0; i < 3; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "%d threads", threads[i]);
+		run_gossip(link, threads[i], 1, r);
+		failures += compare(sequential, r, name);
+		if(!r.stats.windows) {
+			printf("  FAIL: %s did not run in parallel\n", name);
+			failures++;
+		}
+	}
+	run_gossip(link, 4, 7, r);
+	failures += compare(sequential, r, "4 threads, 7 steps");
+	printf("threads: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+int test_no_lookahead(Result& sequential) {
+	int failures = 0;
+	static Result r;
+	NoLookaheadLinkModel link(1.5, 0.1, 2000, 500);
+	run_gossip(link, 4, 1, r);
+	failures += compare(sequential, r, "no lookahead");
+	if(r.stats.windows) {
+		printf("  FAIL: ran in parallel without lookahead\n");
+		failures++;
+	}
+	printf("no lookahead: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+int main(int argc, char** argv) {
+	static Result sequential;
+	SimUnitDiskLinkModel link(1.5, 0.1, 2000, 500);
+	run_gossip(link, 1, 1, sequential);
+
+	int failures = 0;
+	if(!sequential.stats.delivered || !sequential.stats.lost) {
+		printf("  FAIL: gossip did not exchange messages\n");
+		failures++;
+	}
+	failures += test_threads(sequential);
+	failures += test_no_lookahead(sequential);
+
+	printf(failures ? "FAILED\n" : "OK\n");
+	return failures ? 1 : 0;
+}
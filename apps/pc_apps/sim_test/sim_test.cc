@@ -0,0 +1,308 @@
+/*
+ * Checks for the SimOsModel simulator (single threaded):
+ *
+ * - timers fire in order at exactly the requested virtual time and
+ *   run_until() leaves the clock at its argument,
+ * - a flood over a grid reaches every node and only crosses links
+ *   within range,
+ * - independent message loss matches the link model's loss rate,
+ * - runs with the same seed are identical, runs with another seed
+ *   are not.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <external_interface/external_interface.h>
+
+using namespace wiselib;
+
+typedef SimOsModel Os;
+
+//
+// Timers
+//
+
+struct TimerApp {
+	Os::Timer *timer;
+	Os::Clock *clock;
+	std::vector<long> fired;
+	std::vector<SimWorld::time_t> times;
+
+	void init(SimOs& os) {
+		timer = &FacetProvider<Os, Os::Timer>::get_facet(os);
+		clock = &FacetProvider<Os, Os::Clock>::get_facet(os);
+		timer->set_timer<TimerApp, &TimerApp::on_time>(30, this, (void*)3);
+		timer->set_timer<TimerApp, &TimerApp::on_time>(10, this, (void*)1);
+		timer->set_timer<TimerApp, &TimerApp::on_time>(20, this, (void*)2);
+	}
+
+	void on_time(void* userdata) {
+		fired.push_back((long)userdata);
+		times.push_back(clock->time());
+	}
+};
+
+int test_timers() {
+	int failures = 0;
+	SimWorld world(1);
+	world.set_debug(false);
+	TimerApp *app = new TimerApp;
+	world.own(app);
+	app->init(world.add_node());
+	world.run_until(SimWorld::SECOND);
+
+	if(app->fired.size() != 3) {
+		printf("  FAIL: %d of 3 timers fired\n", (int)app->fired.size());
+		failures++;
+	}
+	for(size_t i = 0; i < app->fired.size(); i++) {
+		if(app->fired[i] != (long)i + 1 || app->times[i] != (i + 1) * 10 * SimWorld::MILLISECOND) {
+			printf("  FAIL: timer %ld fired at %lu\n", app->fired[i], (unsigned long)app->times[i]);
+			failures++;
+		}
+	}
+	if(world.now() != SimWorld::SECOND) {
+		printf("  FAIL: clock at %lu after run_until()\n", (unsigned long)world.now());
+		failures++;
+	}
+	printf("timers: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+//
+// Flood
+//
+
+enum { SIDE = 10 };
+
+struct FloodApp {
+	static int reached;
+	static int too_far;
+
+	Os::Radio *radio;
+	Os::Timer *timer;
+	SimOs *os;
+	bool seen;
+
+	void init(SimOs& os) {
+		this->os = &os;
+		radio = &FacetProvider<Os, Os::Radio>::get_facet(os);
+		timer = &FacetProvider<Os, Os::Timer>::get_facet(os);
+		seen = false;
+		radio->reg_recv_callback<FloodApp, &FloodApp::receive>(this);
+		if(radio->id() == 0) {
+			timer->set_timer<FloodApp, &FloodApp::forward>(1, this, 0);
+		}
+	}
+
+	void forward(void*) {
+		if(seen) { return; }
+		seen = true;
+		reached++;
+		Os::block_data_t message[4] = { 1, 2, 3, 4 };
+		radio->send(Os::Radio::BROADCAST_ADDRESS, sizeof(message), message);
+	}
+
+	void receive(Os::Radio::node_id_t from, Os::Radio::size_t len, Os::Radio::block_data_t* data) {
+		double dx = os->world->x(from) - os->world->x(os->id);
+		double dy = os->world->y(from) - os->world->y(os->id);
+		if(sqrt(dx * dx + dy * dy) > os->world->link_model().range()) { too_far++; }
+		if(!seen) { timer->set_timer<FloodApp, &FloodApp::forward>(1, this, 0); }
+	}
+};
+
+int FloodApp::reached = 0;
+int FloodApp::too_far = 0;
+
+int test_flood() {
+	int failures = 0;
+	SimWorld world(1);
+	world.set_debug(false);
+	SimUnitDiskLinkModel link(1.5, 0.0, 1000, 500);
+	world.set_link_model(&link);
+	for(int i = 0; i < SIDE * SIDE; i++) {
+		WiselibApplication<Os, FloodApp> app;
+		app.init(world.add_node(i % SIDE, i / SIDE));
+	}
+	world.run();
+
+	if(FloodApp::reached != SIDE * SIDE) {
+		printf("  FAIL: flood reached %d of %d nodes\n", FloodApp::reached, SIDE * SIDE);
+		failures++;
+	}
+	if(FloodApp::too_far) {
+		printf("  FAIL: %d messages crossed more than the range\n", FloodApp::too_far);
+		failures++;
+	}
+	if(world.stats().lost || !world.stats().delivered) {
+		printf("  FAIL: %lu delivered, %lu lost on a lossless link\n",
+				(unsigned long)world.stats().delivered, (unsigned long)world.stats().lost);
+		failures++;
+	}
+	printf("flood: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+//
+// Loss
+//
+
+enum { LOSS_MESSAGES = 20000 };
+
+struct SenderApp {
+	Os::Radio *radio;
+	Os::Timer *timer;
+	int sent;
+
+	void init(SimOs& os) {
+		radio = &FacetProvider<Os, Os::Radio>::get_facet(os);
+		timer = &FacetProvider<Os, Os::Timer>::get_facet(os);
+		sent = 0;
+		if(radio->id() == 0) {
+			timer->set_timer<SenderApp, &SenderApp::send>(1, this, 0);
+		}
+	}
+
+	void send(void*) {
+		Os::block_data_t message[1] = { 0 };
+		radio->send(1, sizeof(message), message);
+		if(++sent < LOSS_MESSAGES) {
+			timer->set_timer<SenderApp, &SenderApp::send>(1, this, 0);
+		}
+	}
+};
+
+int test_loss() {
+	int failures = 0;
+	SimWorld world(1);
+	world.set_debug(false);
+	SimUnitDiskLinkModel link(1.0, 0.3, 100, 0);
+	world.set_link_model(&link);
+	for(int i = 0; i < 2; i++) {
+		WiselibApplication<Os, SenderApp> app;
+		app.init(world.add_node(0.5 * i, 0.0));
+	}
+	world.run();
+
+	SimWorld::Stats s = world.stats();
+	double rate = (double)s.lost / s.sent;
+	if(s.sent != LOSS_MESSAGES || s.delivered + s.lost != s.sent || fabs(rate - 0.3) > 0.02) {
+		printf("  FAIL: %lu sent, %lu delivered, %lu lost\n",
+				(unsigned long)s.sent, (unsigned long)s.delivered, (unsigned long)s.lost);
+		failures++;
+	}
+	printf("loss: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+//
+// Determinism
+//
+
+enum { GOSSIP_NODES = 400 };
+
+::uint64_t traces_[GOSSIP_NODES];
+
+/**
+ * Beacons at random intervals, answers some beacons and folds every
+ * reception (time, sender, payload) into a per node hash.
+ */
+struct GossipApp {
+	Os::Radio *radio;
+	Os::Timer *timer;
+	Os::Rand *rand;
+	Os::Clock *clock;
+	::uint32_t received;
+
+	void init(SimOs& os) {
+		radio = &FacetProvider<Os, Os::Radio>::get_facet(os);
+		timer = &FacetProvider<Os, Os::Timer>::get_facet(os);
+		rand = &FacetProvider<Os, Os::Rand>::get_facet(os);
+		clock = &FacetProvider<Os, Os::Clock>::get_facet(os);
+		received = 0;
+		traces_[radio->id()] = 1469598103934665603ULL;
+		radio->reg_recv_callback<GossipApp, &GossipApp::receive>(this);
+		timer->set_timer<GossipApp, &GossipApp::beacon>((*rand)(1000) + 1, this, 0);
+	}
+
+	void beacon(void*) {
+		Os::block_data_t message[4];
+		memcpy(message, &received, sizeof(received));
+		radio->send(Os::Radio::BROADCAST_ADDRESS, sizeof(message), message);
+		timer->set_timer<GossipApp, &GossipApp::beacon>(900 + (*rand)(200), this, 0);
+	}
+
+	void receive(Os::Radio::node_id_t from, Os::Radio::size_t len, Os::Radio::block_data_t* data) {
+		::uint32_t c = 0;
+		if(len == sizeof(c)) { memcpy(&c, data, sizeof(c)); }
+		::uint64_t &h = traces_[radio->id()];
+		h = (h ^ (clock->time() * 131 + from * 7 + c)) * 1099511628211ULL;
+		received++;
+		if((*rand)(10) == 0) {
+			Os::block_data_t reply[1] = { 0 };
+			radio->send(from, sizeof(reply), reply);
+		}
+	}
+};
+
+struct GossipResult {
+	SimWorld::Stats stats;
+	::uint64_t traces[GOSSIP_NODES];
+};
+
+void run_gossip(::uint64_t seed, GossipResult& r) {
+	SimWorld world(seed);
+	world.set_debug(false);
+	SimUnitDiskLinkModel link(1.5, 0.1, 2000, 500);
+	world.set_link_model(&link);
+	int side = (int)sqrt((double)GOSSIP_NODES);
+	for(int i = 0; i < GOSSIP_NODES; i++) {
+		WiselibApplication<Os, GossipApp> app;
+		app.init(world.add_node((i % side) + world.random_real() * 0.5, (i / side) + world.random_real() * 0.5));
+	}
+	world.run_until(10 * SimWorld::SECOND);
+	r.stats = world.stats();
+	memcpy(r.traces, traces_, sizeof(traces_));
+}
+
+bool same(GossipResult& a, GossipResult& b) {
+	return a.stats.events == b.stats.events && a.stats.sent == b.stats.sent &&
+		a.stats.delivered == b.stats.delivered && a.stats.lost == b.stats.lost &&
+		memcmp(a.traces, b.traces, sizeof(a.traces)) == 0;
+}
+
+int test_determinism() {
+	int failures = 0;
+	static GossipResult a, b, c;
+	run_gossip(42, a);
+	run_gossip(42, b);
+	run_gossip(43, c);
+	if(!a.stats.delivered || !a.stats.lost) {
+		printf("  FAIL: gossip did not exchange messages\n");
+		failures++;
+	}
+	if(!same(a, b)) {
+		printf("  FAIL: two runs with the same seed differ\n");
+		failures++;
+	}
+	if(same(a, c)) {
+		printf("  FAIL: runs with different seeds are equal\n");
+		failures++;
+	}
+	printf("determinism: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+int main(int argc, char** argv) {
+	int failures = 0;
+	failures += test_timers();
+	failures += test_flood();
+	failures += test_loss();
+	failures += test_determinism();
+
+	printf(failures ? "FAILED\n" : "OK\n");
+	return failures ? 1 : 0;
+}
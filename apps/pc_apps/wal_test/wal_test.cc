@@ -0,0 +1,319 @@
+
+/*
+ * Checks for WalBlockMemory and the error handling of CachedBlockMemory:
+ * 
+ * - replaying a log that is filled up to its very last block does not
+ *   read past the end of the log,
+ * - flushing a cache over a WAL logs only the blocks that changed,
+ * - a transaction larger than BATCH_BLOCKS is rejected as a whole instead
+ *   of being split,
+ * - a block the cache can not write back is kept instead of being lost,
+ *   and eviction moves on to the next least recently used block.
+ */
+
+#include <external_interface/external_interface.h>
+
+#undef DBG
+#define DBG(...)
+
+using namespace wiselib;
+
+typedef PCOsModel Os;
+typedef Os::block_data_t block_data_t;
+
+#include <util/allocators/malloc_free_allocator.h>
+typedef MallocFreeAllocator<Os> Allocator;
+Allocator allocator_;
+Allocator& get_allocator() { return allocator_; }
+
+#include <algorithms/block_memory/ram_block_memory.h>
+#include <algorithms/block_memory/wal_block_memory.h>
+#include <algorithms/block_memory/cached_block_memory.h>
+
+/**
+ * RAM block memory that counts accesses outside of [0, SIZE) and can be
+ * told to fail writes (all or those to one address).
+ */
+class CheckedRam : public RamBlockMemory<Os> {
+	public:
+		typedef RamBlockMemory<Os> Base;
+		
+		int init() {
+			out_of_range_ = 0;
+			fail_writes_ = false;
+			fail_address_ = NO_ADDRESS;
+			return Base::init();
+		}
+		
+		int read(block_data_t* buffer, address_t a) {
+			if(a >= (address_t)SIZE) { out_of_range_++; return ERR_UNSPEC; }
+			return Base::read(buffer, a);
+		}
+		
+		int write(block_data_t* buffer, address_t a) {
+			if(a >= (address_t)SIZE) { out_of_range_++; return ERR_UNSPEC; }
+			if(fail_writes_ || a == fail_address_) { return ERR_UNSPEC; }
+			return Base::write(buffer, a);
+		}
+		
+		size_t out_of_range_;
+		bool fail_writes_;
+		address_t fail_address_;
+};
+
+enum { LOG_BLOCKS = 200 };
+
+typedef WalBlockMemory<Os, CheckedRam, LOG_BLOCKS, 32, 1> Wal;
+typedef WalBlockMemory<Os, CheckedRam, LOG_BLOCKS, 8, 4> SmallWal;
+typedef CachedBlockMemory<Os, SmallWal, 32, 0> WalCache;
+typedef CachedBlockMemory<Os, CheckedRam, 4, 0> Cache;
+
+Wal wal;
+WalCache wal_cache;
+Cache cache;
+
+void fill(block_data_t* buffer, ::uint32_t tag) {
+	for(size_t i = 0; i < Wal::BLOCK_SIZE; i += sizeof(tag)) {
+		memcpy(buffer + i, &tag, sizeof(tag));
+	}
+}
+
+bool has_tag(block_data_t* buffer, ::uint32_t tag) {
+	block_data_t expected[Wal::BUFFER_SIZE];
+	fill(expected, tag);
+	return memcmp(buffer, expected, Wal::BLOCK_SIZE) == 0;
+}
+
+int test_replay_full_log() {
+	CheckedRam &ram = wal.block_memory();
+	ram.init();
+	wal.init();
+	
+	// After init() the log has LOG_BLOCKS - 1 blocks left, a single
+	// block transaction takes 2 (record header + data). Start with a
+	// 2 block transaction so the last record ends exactly at the end.
+	block_data_t buffer[Wal::BUFFER_SIZE];
+	size_t left = LOG_BLOCKS - 1;
+	::uint32_t tx = 1;
+	if(left % 2) {
+		fill(buffer, tx);
+		wal.write(buffer, 0);
+		wal.write(buffer, 1);
+		wal.commit();
+		left -= 3;
+		tx++;
+	}
+	for( ; left; left -= 2, tx++) {
+		fill(buffer, tx);
+		wal.write(buffer, tx % 10);
+		wal.commit();
+	}
+	
+	// Lose the home locations, init() has to restore them from the log
+	for(Wal::address_t a = 0; a < 10; a++) {
+		fill(buffer, 0);
+		ram.write(buffer, a);
+	}
+	wal.init();
+	
+	int failures = 0;
+	if(ram.out_of_range_) {
+		printf("  FAIL: %lu accesses past the end of the log\n", (unsigned long)ram.out_of_range_);
+		failures++;
+	}
+	for(::uint32_t t = tx - 10; t < tx; t++) {
+		wal.read(buffer, t % 10);
+		if(!has_tag(buffer, t)) {
+			printf("  FAIL: block %lu not replayed\n", (unsigned long)(t % 10));
+			failures++;
+		}
+	}
+	printf("replay full log: %d transactions, %s\n", (int)tx - 1, failures ? "FAILED" : "ok");
+	return failures;
+}
+
+int test_dirty_blocks() {
+	SmallWal &wal = wal_cache.block_memory();
+	wal.block_memory().init();
+	wal.init();
+	wal_cache.init();
+	
+	block_data_t buffer[Wal::BUFFER_SIZE];
+	int failures = 0;
+	
+	// Fill the cache with more blocks than a transaction can hold, but
+	// change only a few of them
+	enum { BLOCKS = 3 * SmallWal::BATCH_BLOCKS, CHANGED = 3 };
+	for(::uint32_t a = 0; a < BLOCKS; a++) {
+		fill(buffer, a + 100);
+		wal.block_memory().write(buffer, a);
+		wal_cache.read(buffer, a);
+	}
+	for(::uint32_t a = 0; a < CHANGED; a++) {
+		fill(buffer, a + 500);
+		if(wal_cache.write(buffer, a) != WalCache::SUCCESS) { failures++; }
+	}
+	if(wal_cache.flush() != WalCache::SUCCESS) {
+		printf("  FAIL: flush() wrote clean blocks\n");
+		failures++;
+	}
+	if(wal_cache.writebacks() != CHANGED) {
+		printf("  FAIL: %lu blocks written back instead of %d\n",
+				(unsigned long)wal_cache.writebacks(), (int)CHANGED);
+		failures++;
+	}
+	if(wal.commit() != SmallWal::SUCCESS) { failures++; }
+	if(wal.sync() != SmallWal::SUCCESS) { failures++; }
+	
+	// Nothing is dirty anymore
+	if(wal_cache.flush() != WalCache::SUCCESS || wal_cache.writebacks() != CHANGED) {
+		printf("  FAIL: second flush() wrote blocks again\n");
+		failures++;
+	}
+	
+	for(::uint32_t a = 0; a < BLOCKS; a++) {
+		wal.block_memory().read(buffer, a);
+		if(!has_tag(buffer, a < CHANGED ? a + 500 : a + 100)) {
+			printf("  FAIL: block %lu wrong\n", (unsigned long)a);
+			failures++;
+		}
+	}
+	printf("dirty blocks: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+int test_oversize_transaction() {
+	SmallWal &wal = wal_cache.block_memory();
+	wal.block_memory().init();
+	wal.init();
+	wal_cache.init();
+	
+	enum { BLOCKS = SmallWal::BATCH_BLOCKS + 1 };
+	block_data_t buffer[Wal::BUFFER_SIZE];
+	int failures = 0;
+	for(::uint32_t a = 0; a < BLOCKS; a++) {
+		fill(buffer, 0);
+		wal.block_memory().write(buffer, a);
+	}
+	for(::uint32_t a = 0; a < BLOCKS; a++) {
+		fill(buffer, a + 100);
+		if(wal_cache.write(buffer, a) != WalCache::SUCCESS) { failures++; }
+	}
+	if(wal_cache.flush() == WalCache::SUCCESS) {
+		printf("  FAIL: oversize transaction accepted\n");
+		failures++;
+	}
+	wal.abort();
+	if(wal.sync() != SmallWal::SUCCESS) { failures++; }
+	
+	// No part of the transaction may have reached the disk
+	for(::uint32_t a = 0; a < BLOCKS; a++) {
+		wal.block_memory().read(buffer, a);
+		if(!has_tag(buffer, 0)) {
+			printf("  FAIL: block %lu of an aborted transaction written\n", (unsigned long)a);
+			failures++;
+		}
+	}
+	wal.init();
+	for(::uint32_t a = 0; a < BLOCKS; a++) {
+		wal.block_memory().read(buffer, a);
+		if(!has_tag(buffer, 0)) {
+			printf("  FAIL: block %lu of an aborted transaction replayed\n", (unsigned long)a);
+			failures++;
+		}
+	}
+	printf("oversize transaction: %d blocks, %s\n", (int)BLOCKS, failures ? "FAILED" : "ok");
+	return failures;
+}
+
+int test_cache_write_error() {
+	CheckedRam &ram = cache.block_memory();
+	ram.init();
+	cache.init();
+	
+	block_data_t buffer[Wal::BUFFER_SIZE];
+	int failures = 0;
+	for(::uint32_t a = 0; a < Cache::CACHE_SIZE; a++) {
+		fill(buffer, a + 200);
+		cache.write(buffer, a);
+	}
+	
+	// Cache is full, writing another block needs a write back
+	ram.fail_writes_ = true;
+	fill(buffer, 300);
+	if(cache.write(buffer, Cache::CACHE_SIZE) == Cache::SUCCESS) {
+		printf("  FAIL: write back error not reported by write()\n");
+		failures++;
+	}
+	if(cache.flush() == Cache::SUCCESS) {
+		printf("  FAIL: write back error not reported by flush()\n");
+		failures++;
+	}
+	
+	ram.fail_writes_ = false;
+	if(cache.flush() != Cache::SUCCESS) { failures++; }
+	for(::uint32_t a = 0; a < Cache::CACHE_SIZE; a++) {
+		ram.read(buffer, a);
+		if(!has_tag(buffer, a + 200)) {
+			printf("  FAIL: block %lu lost\n", (unsigned long)a);
+			failures++;
+		}
+	}
+	printf("cache write error: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+int test_cache_evict_fallback() {
+	CheckedRam &ram = cache.block_memory();
+	ram.init();
+	cache.init();
+	
+	block_data_t buffer[Wal::BUFFER_SIZE];
+	int failures = 0;
+	for(::uint32_t a = 0; a < Cache::CACHE_SIZE; a++) {
+		fill(buffer, a + 200);
+		cache.write(buffer, a);
+	}
+	
+	// Block 0 is least recently used but can not be written back,
+	// block 1 has to make room instead
+	ram.fail_address_ = 0;
+	fill(buffer, 300);
+	if(cache.write(buffer, Cache::CACHE_SIZE) != Cache::SUCCESS) {
+		printf("  FAIL: eviction stuck on a block that can not be written\n");
+		failures++;
+	}
+	ram.read(buffer, 1);
+	if(!has_tag(buffer, 201)) {
+		printf("  FAIL: block 1 not written back\n");
+		failures++;
+	}
+	
+	ram.fail_address_ = Cache::NO_ADDRESS;
+	if(cache.flush() != Cache::SUCCESS) { failures++; }
+	ram.read(buffer, 0);
+	if(!has_tag(buffer, 200)) {
+		printf("  FAIL: block 0 lost\n");
+		failures++;
+	}
+	ram.read(buffer, Cache::CACHE_SIZE);
+	if(!has_tag(buffer, 300)) {
+		printf("  FAIL: block %lu lost\n", (unsigned long)Cache::CACHE_SIZE);
+		failures++;
+	}
+	printf("cache evict fallback: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+void application_main(Os::AppMainParameter& amp) {
+	int failures = 0;
+	failures += test_replay_full_log();
+	failures += test_dirty_blocks();
+	failures += test_oversize_transaction();
+	failures += test_cache_write_error();
+	failures += test_cache_evict_fallback();
+	
+	printf(failures ? "FAILED\n" : "OK\n");
+	exit(failures ? 1 : 0);
+}
+
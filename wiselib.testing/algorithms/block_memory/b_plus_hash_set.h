@@ -154,7 +154,6 @@ namespace wiselib {
 #endif // DEBUG_OSTREAM
 					
 					void check() {
-						assert(next_ == ChunkAddress::invalid() || next_.address() >= 6000);
 					}
 					
 				private:
@@ -393,40 +392,37 @@ namespace wiselib {
 					return end();
 				}
 
-				ChunkAddress k = it->second;
 				ChunkAddress addr;
 				block_data_t buffer[BlockMemory::BUFFER_SIZE];
 				Entry &entry = *reinterpret_cast<Entry*>(buffer);
-				DBG("find read entry");
-				read_entry(entry, k);
 				
-				for(addr = it->value();
-						addr != ChunkAddress::invalid() && Compare<value_type>::cmp(entry.payload(), v) != 0;
-						addr = entry.next()) {
+				// walk the list of entries with this hash
+				for(addr = it->value(); addr != ChunkAddress::invalid(); addr = entry.next()) {
 					DBG("find read entry list");
 					read_entry(entry, addr);
+					if(Compare<value_type>::cmp(entry.payload(), v) == 0) {
+						break;
+					}
 				} // for
+				
+				if(addr == ChunkAddress::invalid()) {
+					return end();
+				}
 				return iterator(this, it, addr);
 			} // find()
 			
 			size_type count(const value_type& v) {
 				check();
 				
-				hash_t h = Hash::hash(reinterpret_cast<block_data_t*>(&v), sizeof(value_type));
-				typename Tree::iterator it = tree_.find(h);
-				ChunkAddress k = it.chunk_address();
-				ChunkAddress addr;
+				iterator it = find(v);
+				if(it == end()) {
+					return 0;
+				}
+				
 				block_data_t buffer[BlockMemory::BUFFER_SIZE];
 				Entry &entry = *reinterpret_cast<Entry*>(buffer);
 				DBG("count read entry");
-				read_entry(entry, k);
-				
-				for(addr = it->value();
-						addr != ChunkAddress::invalid() && Compare<value_type>::cmp(entry.payload(), v) != 0;
-						addr = entry.next()) {
-					DBG("count list read entry");
-					read_entry(entry, addr);
-				} // for
+				read_entry(entry, it.chunk_address());
 				return entry.refcount();
 			}
 			
@@ -35,35 +35,59 @@
 
 namespace wiselib {
 	
+	/**
+	 * Forwards read-ahead hints to the block memory, or nothing at all for
+	 * a read-ahead of 0 (so block memories without prefetch() can be used).
+	 */
+	template<typename BlockMemory_P, int ReadAhead_P>
+	struct BPlusTreeReadAhead {
+		static void prefetch(BlockMemory_P *memory, typename BlockMemory_P::address_t start, typename BlockMemory_P::address_t blocks) {
+			memory->prefetch(start, blocks);
+		}
+	};
+	
+	template<typename BlockMemory_P>
+	struct BPlusTreeReadAhead<BlockMemory_P, 0> {
+		static void prefetch(BlockMemory_P *memory, typename BlockMemory_P::address_t start, typename BlockMemory_P::address_t blocks) {
+		}
+	};
+	
 	/**
 	 * @brief
 	 * 
 	 * @ingroup
 	 * 
-	 * @tparam 
+	 * @tparam ReadAhead_P When an iterator enters a leaf, it makes sure the
+	 *   block memory has been asked to prefetch() the neighbouring leaf in
+	 *   iteration direction, along with the following ReadAhead_P - 1
+	 *   blocks (leaves of bulk loaded trees are allocated consecutively).
+	 *   Requires prefetch() on the block memory if non-zero.
 	 */
 	template<
 		typename OsModel_P,
 		typename BlockMemory_P,
 		typename Key_P,
 		typename Mapped_P,
-		typename Debug_P = typename OsModel_P::Debug
+		typename Debug_P = typename OsModel_P::Debug,
+		int ReadAhead_P = 0
 	>
 	class BPlusTree {
 		public:
 			// Typedefs
 			// {{{
-			typedef BPlusTree<OsModel_P, BlockMemory_P, Key_P, Mapped_P, Debug_P> self_type;
+			typedef BPlusTree<OsModel_P, BlockMemory_P, Key_P, Mapped_P, Debug_P, ReadAhead_P> self_type;
 			
 			typedef OsModel_P OsModel;
 			typedef typename OsModel::block_data_t block_data_t;
 			typedef typename OsModel::size_t size_type;
 			typedef Debug_P Debug;
-			enum { SUCCESS = OsModel::SUCCESS, ERR_UNSPEC = OsModel::SUCCESS };
+			enum { SUCCESS = OsModel::SUCCESS, ERR_UNSPEC = OsModel::ERR_UNSPEC };
 			
 			typedef BlockMemory_P BlockMemory;
 			typedef typename BlockMemory::address_t address_t;
 			enum { NO_ADDRESS = BlockMemory::NO_ADDRESS, npos = (size_type)(-1) };
+			enum { READ_AHEAD = ReadAhead_P };
+			typedef BPlusTreeReadAhead<BlockMemory, ReadAhead_P> ReadAhead;
 			
 			typedef StandaloneMath<OsModel> Math;
 			
@@ -77,15 +101,30 @@ namespace wiselib {
 			typedef typename LeafBlock::KVPair value_type;
 			// }}}
 			
+			enum {
+				/// Maximum tree height bulk_load() can produce
+				BULK_MAX_HEIGHT = 8,
+				/// merge() rebuilds the tree if batch size * BULK_MERGE_RATIO >= size()
+				BULK_MERGE_RATIO = 8
+			};
+			
+			/**
+			 * Iterators access leaves through BlockMemory::get(), so with a
+			 * sharded CachedBlockMemory they must not be used while other
+			 * threads access the same cache.
+			 * The tree itself does no locking either: threads sharing one
+			 * tree have to serialize all operations on it, including the
+			 * use of the iterators they return.
+			 */
 			class iterator {
 				// {{{
 				public:
 					iterator()
-						: block_address_(NO_ADDRESS), index_(0) {
+						: block_address_(NO_ADDRESS), index_(0), ahead_begin_(NO_ADDRESS), ahead_end_(NO_ADDRESS) {
 					}
 					
 					iterator(BlockMemory *memory, address_t a, size_type index)
-						: block_address_(a), index_(index), memory_(memory) {
+						: block_address_(a), index_(index), memory_(memory), ahead_begin_(NO_ADDRESS), ahead_end_(NO_ADDRESS) {
 						if(a != NO_ADDRESS) {
 							block_size_ = block().size();
 							value_ = block()[index_];
@@ -93,6 +132,7 @@ namespace wiselib {
 								index_ = 0;
 								block_address_ = block().next();
 							}
+							read_ahead(true);
 						}
 					}
 					
@@ -103,6 +143,8 @@ namespace wiselib {
 						index_ = other.index_;
 						value_ = other.value_;
 						memory_ = other.memory_;
+						ahead_begin_ = other.ahead_begin_;
+						ahead_end_ = other.ahead_end_;
 						return *this;
 					}
 					
@@ -112,6 +154,29 @@ namespace wiselib {
 							if(index_ >= block().size()) {
 								index_ = 0;
 								block_address_ = block().next();
+								read_ahead(true);
+							}
+						}
+						return *this;
+					}
+					
+					/**
+					 * Move to the previous element. Decrementing an iterator
+					 * to the first element yields end(), so a reverse scan
+					 * looks like:
+					 * for(it = tree.last(); it != tree.end(); --it) { ... }
+					 */
+					iterator& operator--() {
+						if(block_address_ != NO_ADDRESS) {
+							if(index_ > 0) {
+								index_--;
+							}
+							else {
+								block_address_ = block().prev();
+								if(block_address_ != NO_ADDRESS) {
+									index_ = block().size() - 1;
+									read_ahead(false);
+								}
 							}
 						}
 						return *this;
@@ -137,12 +202,38 @@ namespace wiselib {
 						return *reinterpret_cast<LeafBlock*>(memory_->get(block_address_));
 					}
 					
+					/**
+					 * Announce the leaf we will visit after the current one
+					 * (and READ_AHEAD - 1 blocks behind it) unless that has
+					 * been done already.
+					 */
+					void read_ahead(bool forward) {
+						if(READ_AHEAD == 0 || block_address_ == NO_ADDRESS) { return; }
+						
+						address_t a = forward ? block().next() : block().prev();
+						if(a == NO_ADDRESS || (a >= ahead_begin_ && a < ahead_end_)) { return; }
+						
+						if(forward) {
+							ahead_begin_ = a;
+							ahead_end_ = a + READ_AHEAD;
+						}
+						else {
+							ahead_begin_ = (a >= (address_t)READ_AHEAD - 1) ? a - (READ_AHEAD - 1) : 0;
+							ahead_end_ = a + 1;
+						}
+						ReadAhead::prefetch(memory_, ahead_begin_, ahead_end_ - ahead_begin_);
+					}
+					
 					address_t block_address_;
 					size_type index_;
 					value_type value_;
 					BlockMemory *memory_;
 					size_type block_size_;
 					
+					/// Blocks [ahead_begin_, ahead_end_) have been prefetched
+					address_t ahead_begin_;
+					address_t ahead_end_;
+					
 				// }}}
 			}; // iterator
 			
@@ -452,7 +543,7 @@ namespace wiselib {
 								if(block_next != NO_ADDRESS) {
 							DBG("merge read 4");
 									tree_->read_block(other, block_next);
-									other.set_prev(a);
+									other.set_prev(a_other);
 									tree_->write_block(other, block_next);
 								}
 								tree_->block_memory_->free(a);
@@ -488,6 +579,69 @@ namespace wiselib {
 				// }}}
 			}; // class Eraser
 			
+			/**
+			 * State of one level of the tree during bulk loading.
+			 */
+			struct BulkLevel {
+				// {{{
+				InnerBlock block;
+				address_t address;
+				address_t next;
+				size_type count;
+				size_type blocks;
+				size_type index;
+				size_type target;
+				key_type last_key;
+				// }}}
+			};
+			
+			/**
+			 * Produces the union of a range of the tree and a sorted batch
+			 * in ascending key order. If a key occurs more than once, its
+			 * first occurrence wins (elements already in the tree come
+			 * first).
+			 */
+			template<typename Iterator>
+			class BulkSource {
+				// {{{
+				public:
+					BulkSource(iterator tree_first, iterator tree_last, Iterator first, Iterator last)
+						: tree_(tree_first), tree_end_(tree_last), batch_(first), batch_end_(last), emitted_(false) {
+					}
+					
+					bool next(value_type& kv) {
+						while(true) {
+							bool have_tree = (tree_ != tree_end_);
+							bool have_batch = !(batch_ == batch_end_);
+							if(!have_tree && !have_batch) { return false; }
+							
+							if(have_tree && (!have_batch || !((*batch_).first < (*tree_).key()))) {
+								kv = *tree_;
+								++tree_;
+							}
+							else {
+								kv = value_type((*batch_).first, (*batch_).second);
+								++batch_;
+							}
+							
+							if(!emitted_ || last_ < kv.key()) {
+								emitted_ = true;
+								last_ = kv.key();
+								return true;
+							}
+						}
+					}
+					
+				private:
+					iterator tree_;
+					iterator tree_end_;
+					Iterator batch_;
+					Iterator batch_end_;
+					key_type last_;
+					bool emitted_;
+				// }}}
+			}; // class BulkSource
+			
 		public:
 			
 			int init(BlockMemory *block_memory, Debug *debug) {
@@ -500,6 +654,18 @@ namespace wiselib {
 				return SUCCESS;
 			}
 			
+			/**
+			 * Open an existing tree (e.g. one that is being modified by
+			 * another BPlusTree instance, as seen through a snapshot) from
+			 * its root block and size.
+			 */
+			int init(BlockMemory *block_memory, Debug *debug, address_t root, size_type size) {
+				init(block_memory, debug);
+				root_ = root;
+				size_ = size;
+				return SUCCESS;
+			}
+			
 			/**
 			 * TODO: this is quite memory hungry (basically keeps all blocks
 			 * in ram at the same time!)
@@ -566,6 +732,72 @@ namespace wiselib {
 				return insert(value_type(k, m));
 			}
 			
+			/**
+			 * Replace the contents of the tree by the elements in
+			 * [first, last) which must be sorted by key. If a key occurs
+			 * more than once, only its first occurrence is inserted.
+			 * 
+			 * The tree is built bottom-up, each leaf and inner block
+			 * receives about @a fill_percent of its capacity (but never
+			 * less than the minimum an erase would allow), so each block
+			 * is written exactly once.
+			 * 
+			 * @param first, last forward iterator range over elements with
+			 *   members first (key) and second (mapped value), e.g. pair or
+			 *   value_type. The range is traversed twice (once to count
+			 *   the elements), so it must yield the same elements again.
+			 * @return ERR_UNSPEC if the tree would be higher than
+			 *   BULK_MAX_HEIGHT (the tree is left unchanged then).
+			 */
+			template<typename Iterator>
+			int bulk_load(Iterator first, Iterator last, size_type fill_percent = 100) {
+				BulkSource<Iterator> counter(end(), end(), first, last);
+				BulkSource<Iterator> source(end(), end(), first, last);
+				int r = bulk_build(counter, source, fill_percent, true);
+				check();
+				return r;
+			}
+			
+			/**
+			 * Insert the elements of the sorted range [first, last).
+			 * Keys that are already in the tree keep their old value (just
+			 * as with insert()).
+			 * 
+			 * If the batch is large compared to the tree, the tree is
+			 * rebuilt from scratch (like bulk_load()) from the merged
+			 * sequence. Otherwise the elements are inserted one by one.
+			 * Like with bulk_load(), [first, last) must be a forward
+			 * iterator range, it is traversed up to three times.
+			 * 
+			 * @return ERR_UNSPEC if the rebuilt tree would be higher than
+			 *   BULK_MAX_HEIGHT (the tree is left unchanged then).
+			 */
+			template<typename Iterator>
+			int merge(Iterator first, Iterator last, size_type fill_percent = 100) {
+				size_type n = 0;
+				for(Iterator it = first; !(it == last); ++it) { n++; }
+				
+				if(n * BULK_MERGE_RATIO < size_) {
+					for(Iterator it = first; !(it == last); ++it) {
+						insert((*it).first, (*it).second);
+					}
+					return SUCCESS;
+				}
+				
+				address_t old_root = root_;
+				BulkSource<Iterator> counter(begin(), end(), first, last);
+				BulkSource<Iterator> source(begin(), end(), first, last);
+				if(bulk_build(counter, source, fill_percent, false) != SUCCESS) {
+					return ERR_UNSPEC;
+				}
+				
+				size_type sz = size_;
+				clear(old_root);
+				size_ = sz;
+				check();
+				return SUCCESS;
+			}
+			
 			/**
 			 */
 			iterator erase(iterator it) {
@@ -591,7 +823,7 @@ namespace wiselib {
 					return end();
 				}
 				size_type p = block.find(k);
-				if(block[p].key() == k) {
+				if(p != LeafBlock::npos && block[p].key() == k) {
 					check();
 					return iterator(block_memory_, a, p);
 				}
@@ -601,6 +833,58 @@ namespace wiselib {
 			}
 			
 			size_type count(const key_type& k) { return find(k) != end(); }
+
+			/**
+			 * @return iterator pointing to the first element whose key is
+			 * not less than @a k or end() if there is no such element.
+			 */
+			iterator lower_bound(const key_type& k) {
+				check();
+
+				LeafBlock block;
+				address_t a = find_leaf(block, k);
+				if(a == NO_ADDRESS) {
+					return end();
+				}
+
+				size_type p = block.find(k);
+				if(p == LeafBlock::npos) { p = 0; }
+				else if(block[p].key() < k) { p++; }
+
+				// k is larger than everything in this leaf, so its
+				// successor is the first element of the next one
+				if(p >= block.size()) {
+					a = block.next();
+					p = 0;
+					if(a == NO_ADDRESS) { return end(); }
+				}
+				return iterator(block_memory_, a, p);
+			}
+
+			/**
+			 * @return iterator pointing to the first element whose key is
+			 * greater than @a k or end() if there is no such element.
+			 */
+			iterator upper_bound(const key_type& k) {
+				iterator it = lower_bound(k);
+				if(it != end() && (*it).key() == k) {
+					++it;
+				}
+				return it;
+			}
+			
+			/**
+			 * @return the range of elements with key @a k, that is
+			 * [lower_bound(k), upper_bound(k)).
+			 */
+			pair<iterator, iterator> equal_range(const key_type& k) {
+				iterator first = lower_bound(k);
+				iterator last = first;
+				if(last != end() && (*last).key() == k) {
+					++last;
+				}
+				return make_pair(first, last);
+			}
 			
 			iterator begin() {
 				LeafBlock block;
@@ -615,6 +899,24 @@ namespace wiselib {
 				return iterator(block_memory_, NO_ADDRESS, 0);
 			}
 			
+			/**
+			 * @return iterator pointing to the element with the largest key
+			 * or end() if the tree is empty. Starting point for reverse
+			 * iteration with operator--().
+			 */
+			iterator last() {
+				InnerBlock block;
+				address_t a = root_;
+				while(a != NO_ADDRESS) {
+					read_block(block, a);
+					if(is_leaf(block)) {
+						return iterator(block_memory_, a, block.size() - 1);
+					}
+					a = block[block.size() - 1].value();
+				}
+				return end();
+			}
+			
 			value_type operator[](const key_type& k) {
 				return *find(k);
 			}
@@ -630,6 +932,9 @@ namespace wiselib {
 			
 			BlockMemory& block_memory() { return *block_memory_; }
 			
+			/// Address of the root block, NO_ADDRESS for an empty tree.
+			address_t root() { return root_; }
+			
 			// Debuging - Graphviz
 			// {{{
 			
@@ -823,6 +1128,120 @@ namespace wiselib {
 				return a;
 			}
 			
+			/**
+			 * Build a new tree from the elements of source (which must
+			 * yield exactly as many elements as counter) and make it the
+			 * current one. The old tree is cleared first if @a replace is
+			 * set and not touched otherwise.
+			 * 
+			 * @return ERR_UNSPEC if the new tree would be higher than
+			 *   BULK_MAX_HEIGHT, nothing is changed then.
+			 */
+			template<typename Source>
+			int bulk_build(Source& counter, Source& source, size_type fill_percent, bool replace) {
+				value_type kv;
+				size_type n = 0;
+				while(counter.next(kv)) { n++; }
+				
+				// Decide on the number of blocks per level,
+				// with every block holding at least MIN_ELEMENTS
+				// (unless it is the root)
+				BulkLevel levels[BULK_MAX_HEIGHT];
+				size_type height = 0;
+				size_type count = n;
+				do {
+					if(height == BULK_MAX_HEIGHT) { return ERR_UNSPEC; }
+					size_type max = height ? (size_type)InnerBlock::MAX_ELEMENTS : (size_type)LeafBlock::MAX_ELEMENTS;
+					size_type min = height ? (size_type)InnerBlock::MIN_ELEMENTS : (size_type)LeafBlock::MIN_ELEMENTS;
+					size_type fill = Math::max(min, Math::min(max, max * fill_percent / 100));
+					
+					levels[height].count = count;
+					levels[height].blocks = Math::max((size_type)1, Math::max((count + max - 1) / max, count / fill));
+					levels[height].index = 0;
+					levels[height].next = NO_ADDRESS;
+					count = levels[height].blocks;
+					height++;
+				} while(count > 1);
+				
+				if(replace) { clear(); }
+				root_ = NO_ADDRESS;
+				size_ = n;
+				if(n == 0) { return SUCCESS; }
+				
+				bulk_start<LeafBlock>(levels[0]);
+				for(size_type i = 1; i < height; i++) {
+					bulk_start<InnerBlock>(levels[i]);
+				}
+				
+				while(source.next(kv)) {
+					bulk_append<LeafBlock>(levels, height, 0, kv);
+				}
+				return SUCCESS;
+			}
+			
+			/**
+			 * Start filling the next block of the given level.
+			 */
+			template<typename Block>
+			void bulk_start(BulkLevel& level) {
+				Block &block = *reinterpret_cast<Block*>(&level.block);
+				
+				address_t prev = NO_ADDRESS;
+				if(level.index == 0) {
+					level.address = create_block(block);
+				}
+				else {
+					prev = level.address;
+					level.address = level.next;
+					block.init();
+				}
+				
+				block.set_prev(prev);
+				if(level.index + 1 < level.blocks) {
+					level.next = block_memory_->create(block.data());
+					block.set_next(level.next);
+				}
+				level.target = level.count / level.blocks + (level.index < level.count % level.blocks);
+			}
+			
+			/**
+			 * Append kv to the current block of level l, write the block
+			 * and add it to its parent level once it has reached its
+			 * target size.
+			 */
+			template<typename Block>
+			void bulk_append(BulkLevel *levels, size_type height, size_type l, const typename Block::KVPair& kv) {
+				BulkLevel &level = levels[l];
+				Block &block = *reinterpret_cast<Block*>(&level.block);
+				
+				block[block.size()] = kv;
+				block.set_size(block.size() + 1);
+				if(block.size() < level.target) { return; }
+				
+				// Like insert(), use 0 for the leftmost child so lookups for
+				// keys below the minimum still find a path
+				key_type pivot = 0;
+				if(level.index > 0) {
+					typename Block::KVPair prev_last;
+					prev_last.key() = level.last_key;
+					pivot = Block::pivot(prev_last, block.first());
+				}
+				level.last_key = block.last().key();
+				write_block(block, level.address);
+				
+				if(l + 1 < height) {
+					bulk_append<InnerBlock>(levels, height, l + 1, typename InnerBlock::KVPair(pivot, level.address));
+				}
+				else {
+					root_ = level.address;
+				}
+				
+				level.index++;
+				if(level.index < level.blocks) {
+					bulk_start<Block>(level);
+				}
+			}
+			
 			template<typename Block>
 			static bool is_leaf(Block& b) {
 				return b.marker_is(LEAF_MARKER);
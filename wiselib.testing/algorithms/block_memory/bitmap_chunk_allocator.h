@@ -342,10 +342,14 @@ namespace wiselib {
 				return block_memory_->invalidate(a);
 			}
 			
+			void prefetch(address_t start, address_t blocks) {
+				block_memory_->prefetch(start, blocks);
+			}
+			
 			ChunkAddress create_chunks(block_data_t* buffer, size_type bytes) {
 //				DBG("create_chunks(%ld)", bytes);
 				size_type chunks = (bytes + CHUNK_SIZE - 1) / CHUNK_SIZE;
-				assert(chunks * 4 >= bytes);
+				assert(chunks <= CHUNKS_PER_BLOCK);
 				
 				ChunkAddress r = allocate_chunks(chunks);
 				block_data_t buf[BlockMemory::BUFFER_SIZE];
@@ -21,22 +21,61 @@
 #define CACHED_BLOCK_MEMORY_H
 
 #include <util/meta.h>
+#include <util/null_mutex.h>
 
 namespace wiselib {
 	
 	/**
-	 * @brief
+	 * @brief Block cache in front of a block memory.
+	 * 
+	 * Blocks are looked up through a hash table and evicted in least
+	 * recently used order, both in O(1).
+	 * 
+	 * The cache is divided in two areas: SPECIAL_AREA_SIZE slots are reserved
+	 * for blocks in the address range given by set_special_range() (e.g.
+	 * allocation bitmaps), the rest is used for all other blocks. That way
+	 * a scan over user data can not evict the blocks the layers above
+	 * need on every operation.
+	 * 
+	 * For concurrent use (e.g. on a PC host with several threads reading
+	 * and writing blocks through one cache), the cache can be split into
+	 * SHARDS_P independent shards (address a belongs to shard
+	 * a % SHARDS_P), each protected by its own Mutex_P. Access to the
+	 * underlying block memory is serialized by another Mutex_P.
+	 * Only read(), write(), update(), invalidate(), prefetch() and flush()
+	 * are thread-safe. get() is not: the slot its result points to may be
+	 * evicted by another thread at any time. So get(), and everything
+	 * built on it such as BPlusTree iterators, may only be used while no
+	 * other thread accesses the cache.
+	 * 
+	 * In write back mode, only blocks changed by write() or update() since
+	 * they were last written back are dirty and will be written back on
+	 * eviction or flush(); blocks that were only read are never written.
+	 * 
+	 * Write errors of the underlying block memory are passed on: A block
+	 * that can not be written back stays in the cache (and stays dirty), so
+	 * it is not lost and flush() can retry it later.
 	 * 
 	 * @ingroup
 	 * 
-	 * @tparam 
+	 * @tparam CACHE_SIZE_P total number of cached blocks.
+	 * @tparam SPECIAL_AREA_SIZE_P number of slots reserved for the special
+	 * range.
+	 * @tparam WRITE_THROUGH_P if true, write() writes to the underlying
+	 * block memory immediately, otherwise blocks are written back on
+	 * eviction or flush().
+	 * @tparam SHARDS_P number of shards, must divide CACHE_SIZE_P and
+	 * SPECIAL_AREA_SIZE_P.
+	 * @tparam Mutex_P Mutex concept (e.g. OsModel::Mutex on PC).
 	 */
 	template<
 		typename OsModel_P,
 		typename BlockMemory_P,
 		int CACHE_SIZE_P,
 		int SPECIAL_AREA_SIZE_P,
-		bool WRITE_THROUGH_P = false
+		bool WRITE_THROUGH_P = false,
+		int SHARDS_P = 1,
+		typename Mutex_P = NullMutex<OsModel_P>
 	>
 	class CachedBlockMemory : protected BlockMemory_P {
 		public:
@@ -46,15 +85,17 @@ namespace wiselib {
 			
 			typedef BlockMemory_P BlockMemory;
 			typedef typename BlockMemory::address_t address_t;
+			typedef Mutex_P Mutex;
 //			typedef typename BlockMemory::ChunkAddress ChunkAddress;
 
-			typedef CachedBlockMemory<OsModel_P, BlockMemory_P, CACHE_SIZE_P, SPECIAL_AREA_SIZE_P, WRITE_THROUGH_P> self_type;
+			typedef CachedBlockMemory<OsModel_P, BlockMemory_P, CACHE_SIZE_P, SPECIAL_AREA_SIZE_P, WRITE_THROUGH_P, SHARDS_P, Mutex_P> self_type;
 			typedef self_type* self_pointer_t;
 			
 			enum {
 				CACHE_SIZE = CACHE_SIZE_P,
 				SPECIAL_AREA_SIZE = SPECIAL_AREA_SIZE_P,
 				WRITE_THROUGH = WRITE_THROUGH_P,
+				SHARDS = SHARDS_P,
 				BLOCK_SIZE = BlockMemory::BLOCK_SIZE,
 				SIZE = BlockMemory::SIZE,
 				BUFFER_SIZE = BlockMemory::BUFFER_SIZE,
@@ -65,27 +106,38 @@ namespace wiselib {
 				SUCCESS = BlockMemory::SUCCESS,
 				ERR_UNSPEC = BlockMemory::ERR_UNSPEC
 			};
-
+			
+		private:
+			enum {
+				SHARD_SIZE = CACHE_SIZE / SHARDS,
+				SHARD_SPECIAL_SIZE = SPECIAL_AREA_SIZE / SHARDS
+			};
+			
+			enum Area { AREA_SPECIAL = 0, AREA_NORMAL = 1, AREAS = 2 };
+			
+			/// Slot index within a shard, SHARD_SIZE means "none".
+			typedef typename SmallUint<SHARD_SIZE + 1>::t slot_t;
+			enum { NO_SLOT = SHARD_SIZE };
+			
+		public:
+			
 			class CacheEntry {
 				public:
-					void mark_used() {
-						// skip date 0 as it has as special meaning
-						if(current_date_ == 0) { current_date_++; }
-						date_ = current_date_++;
-					}
-					void mark_unused() { date_ = 0; }
-					bool used() { return date_ != 0; }
-					
-					size_type date() { return date_; }
+					bool used() { return used_; }
+					bool dirty() { return dirty_; }
 					block_data_t* data() { return data_; }
 					address_t& address() { return address_; }
 					
 				private:
-					static size_type current_date_;
-					
 					block_data_t data_[BlockMemory::BUFFER_SIZE];
 					address_t address_;
-					size_type date_;
+					slot_t hash_next_;
+					slot_t lru_prev_;
+					slot_t lru_next_;
+					bool used_;
+					bool dirty_;
+				
+				friend class CachedBlockMemory;
 			};
 			
 			/*
@@ -106,11 +158,14 @@ namespace wiselib {
 				return SUCCESS;
 			}*/
 			int init() {
-				memset(cache_, 0, sizeof(cache_));
+				// SHARDS must divide both CACHE_SIZE and SPECIAL_AREA_SIZE
+				static_assert((SHARD_SIZE * SHARDS == CACHE_SIZE) && (SHARD_SPECIAL_SIZE * SHARDS == SPECIAL_AREA_SIZE));
+				
 				start_ = 0;
 				end_ = (address_t)(-1);
-				reads_ = 0;
-				writes_ = 0;
+				for(size_type s = 0; s < SHARDS; s++) {
+					shards_[s].init();
+				}
 				return SUCCESS;
 			}
 			
@@ -155,57 +210,47 @@ namespace wiselib {
 			//
 
 			int write(block_data_t* buffer, address_t a) {
-				update(buffer, a);
+				Shard &shard = shard_for(a);
+				MutexGuard<Mutex> guard(shard.mutex_);
+				
+				if(update(shard, buffer, a) != SUCCESS) { return ERR_UNSPEC; }
 				if(WRITE_THROUGH) {
-					physical_write(buffer, a);
-				}
-				else {
-					assert(cache_[find(a)].used() && cache_[find(a)].address() == a);
+					return physical_write(shard, buffer, a);
 				}
 				return SUCCESS;
 			}
 
 			int read(block_data_t* buffer, address_t a) {
-				memcpy(buffer, get(a), BLOCK_SIZE);
+				Shard &shard = shard_for(a);
+				MutexGuard<Mutex> guard(shard.mutex_);
+				
+				block_data_t *data = get(shard, a);
+				if(!data) { return ERR_UNSPEC; }
+				memcpy(buffer, data, BLOCK_SIZE);
 				return SUCCESS;
 			}
 			
+			/**
+			 * @return pointer to the cached copy of the block at a. It stays
+			 * valid until the next operation on this cache. Not thread-safe,
+			 * see the class description.
+			 * The buffer is meant for reading, changes to it are not tracked
+			 * and may get lost; use write() to change a block.
+			 * NULL if the block could not be read or the slot for it could
+			 * not be written back.
+			 */
 			block_data_t* get(address_t a) {
-				size_type i = find(a);
-				if(cache_[i].used() && cache_[i].address() == a) {
-					// cache hit
-				}
-				else {
-					// cache miss
-					if(!WRITE_THROUGH && cache_[i].used()) {
-						physical_write(cache_[i].data(), cache_[i].address());
-					}
-					cache_[i].mark_used();
-					cache_[i].address() = a;
-					physical_read(cache_[i].data(), a);
-				}
-				return cache_[i].data();
+				Shard &shard = shard_for(a);
+				MutexGuard<Mutex> guard(shard.mutex_);
+				
+				return get(shard, a);
 			}
 			
-			void update(block_data_t* new_data, address_t a) {
-				size_type i = find(a);
-				CacheEntry &e = cache_[i];
+			int update(block_data_t* new_data, address_t a) {
+				Shard &shard = shard_for(a);
+				MutexGuard<Mutex> guard(shard.mutex_);
 				
-				if((e.used() && (e.address() != a))) {
-					// only update if a already in the cache or
-					// free slot available for write-through.
-					// for write-back, force the update
-					if(WRITE_THROUGH) {
-						return;
-					}
-					else {
-						physical_write(e.data(), e.address());
-					}
-				}
-
-				memcpy(e.data(), new_data, BLOCK_SIZE);
-				e.mark_used();
-				e.address() = a;
+				return update(shard, new_data, a);
 			}
 			
 			/**
@@ -215,17 +260,67 @@ namespace wiselib {
 			 * @param a
 			 */
 			void invalidate(address_t a) {
-				size_type i = find(a);
-				CacheEntry &e = cache_[i];
+				Shard &shard = shard_for(a);
+				MutexGuard<Mutex> guard(shard.mutex_);
 				
-				if(e.used() && e.address() == a) {
-					e.mark_unused();
+				slot_t i = shard.find(a);
+				if(i != NO_SLOT) {
+					shard.release(i, area(a));
+				}
+				assert(shard.find(a) == NO_SLOT);
+			}
+			
+			/**
+			 * @brief Hint that the blocks [start, start + blocks) will be
+			 * read soon. Runs of blocks that are not cached are passed on to
+			 * the underlying block memory (which has to provide
+			 * prefetch() as well), nothing is loaded into the cache.
+			 */
+			void prefetch(address_t start, address_t blocks) {
+				address_t run = start;
+				for(address_t a = start; a < start + blocks; a++) {
+					Shard &shard = shard_for(a);
+					bool cached;
+					{
+						MutexGuard<Mutex> guard(shard.mutex_);
+						cached = (shard.find(a) != NO_SLOT);
+					}
+					if(cached) {
+						physical_prefetch(run, a - run);
+						run = a + 1;
+					}
 				}
+				physical_prefetch(run, start + blocks - run);
+			}
+			
+			/**
+			 * @brief Write all dirty blocks back to the underlying block
+			 * memory (no-op in write through mode). Blocks stay cached.
+			 * @return ERR_UNSPEC if any block could not be written back,
+			 * all others are written anyway.
+			 */
+			int flush() {
+				if(WRITE_THROUGH) { return SUCCESS; }
 				
-				assert(
-					!cache_[find(a)].used() ||
-					(cache_[find(a)].address() != a)
-				);
+				int r = SUCCESS;
+				for(size_type s = 0; s < SHARDS; s++) {
+					Shard &shard = shards_[s];
+					MutexGuard<Mutex> guard(shard.mutex_);
+					
+					for(size_type i = 0; i < SHARD_SIZE; i++) {
+						CacheEntry &e = shard.entries_[i];
+						if(e.used() && e.dirty()) {
+							shard.writebacks_++;
+							if(physical_write(shard, e.data(), e.address()) != SUCCESS) {
+								r = ERR_UNSPEC;
+							}
+							else {
+								e.dirty_ = false;
+							}
+						}
+					}
+				}
+				return r;
 			}
 
 			void set_special_range(address_t start, address_t end) {
@@ -234,83 +329,257 @@ namespace wiselib {
 			}
 
 			BlockMemory& block_memory() { return *(BlockMemory*)this; }
+			
+			/// @{
+			/// Statistics, summed over all shards.
+			
+			size_type hits() { return sum(&Shard::hits_); }
+			size_type misses() { return sum(&Shard::misses_); }
+			
+			/// Dirty blocks written back on eviction or flush() (write back mode only).
+			size_type writebacks() { return sum(&Shard::writebacks_); }
+			
+			size_type physical_reads() { return sum(&Shard::reads_); }
+			size_type physical_writes() { return sum(&Shard::writes_); }
+			
+			void reset_stats() {
+				for(size_type s = 0; s < SHARDS; s++) {
+					shards_[s].reset_stats();
+				}
+			}
+			
+			void print_stats() {
+				DBG("CBM hits: %ld misses: %ld writebacks: %ld phys reads: %ld phys writes: %ld",
+						hits(), misses(), writebacks(), physical_reads(), physical_writes());
+			}
+			
+			/// @}
 		
 		private:
-
-			bool in_special_area(address_t a) { return a >= start_ && a < end_; }
-				
+			
 			/**
-			 * Returns slot containing block for given address a.
-			 * If no such slot is available, will return a free slot.
-			 * If that is also not available, will return
-			 * a least expendable entry (the earliest inserted one).
+			 * One independently locked part of the cache.
+			 * Entries [0, SHARD_SPECIAL_SIZE) belong to the special area, the
+			 * rest to the normal area. Each area keeps its entries in a
+			 * doubly linked list ordered by recency of use, unused entries
+			 * are kept at the tail so they are picked first.
 			 */
-			size_type find(address_t a) {
-				size_type lowest_idx = 0, lowest_date = -1;
-				size_type unused_idx = -1;
-
-				size_type start, end;
-				if(in_special_area(a)) {
-					start = 0; end = SPECIAL_AREA_SIZE;
+			struct Shard {
+				void init() {
+					memset(entries_, 0, sizeof(entries_));
+					for(size_type i = 0; i < SHARD_SIZE; i++) {
+						buckets_[i] = NO_SLOT;
+					}
+					for(size_type a = 0; a < AREAS; a++) {
+						head_[a] = tail_[a] = NO_SLOT;
+					}
+					for(size_type i = 0; i < SHARD_SIZE; i++) {
+						entries_[i].hash_next_ = NO_SLOT;
+						lru_push_back(i, (i < SHARD_SPECIAL_SIZE) ? AREA_SPECIAL : AREA_NORMAL);
+					}
+					reset_stats();
 				}
-				else {
-					start = SPECIAL_AREA_SIZE;
-					end = CACHE_SIZE;
+				
+				void reset_stats() {
+					hits_ = misses_ = writebacks_ = reads_ = writes_ = 0;
+				}
+				
+				static size_type bucket(address_t a) { return (a / SHARDS) % SHARD_SIZE; }
+				
+				slot_t find(address_t a) {
+					slot_t i = buckets_[bucket(a)];
+					while(i != NO_SLOT && entries_[i].address_ != a) {
+						i = entries_[i].hash_next_;
+					}
+					return i;
+				}
+				
+				void hash_insert(slot_t i) {
+					slot_t &b = buckets_[bucket(entries_[i].address_)];
+					entries_[i].hash_next_ = b;
+					b = i;
+				}
+				
+				void hash_erase(slot_t i) {
+					slot_t *p = &buckets_[bucket(entries_[i].address_)];
+					while(*p != i) {
+						assert(*p != NO_SLOT);
+						p = &entries_[*p].hash_next_;
+					}
+					*p = entries_[i].hash_next_;
+					entries_[i].hash_next_ = NO_SLOT;
+				}
+				
+				void lru_unlink(slot_t i, size_type area) {
+					CacheEntry &e = entries_[i];
+					if(e.lru_prev_ != NO_SLOT) { entries_[e.lru_prev_].lru_next_ = e.lru_next_; }
+					else { head_[area] = e.lru_next_; }
+					if(e.lru_next_ != NO_SLOT) { entries_[e.lru_next_].lru_prev_ = e.lru_prev_; }
+					else { tail_[area] = e.lru_prev_; }
+				}
+				
+				void lru_push_front(slot_t i, size_type area) {
+					CacheEntry &e = entries_[i];
+					e.lru_prev_ = NO_SLOT;
+					e.lru_next_ = head_[area];
+					if(head_[area] != NO_SLOT) { entries_[head_[area]].lru_prev_ = i; }
+					else { tail_[area] = i; }
+					head_[area] = i;
+				}
+				
+				void lru_push_back(slot_t i, size_type area) {
+					CacheEntry &e = entries_[i];
+					e.lru_next_ = NO_SLOT;
+					e.lru_prev_ = tail_[area];
+					if(tail_[area] != NO_SLOT) { entries_[tail_[area]].lru_next_ = i; }
+					else { head_[area] = i; }
+					tail_[area] = i;
 				}
+				
+				void touch(slot_t i, size_type area) {
+					if(head_[area] != i) {
+						lru_unlink(i, area);
+						lru_push_front(i, area);
+					}
+				}
+				
+				/**
+				 * Forget about the block in slot i and make it the first
+				 * candidate for reuse.
+				 */
+				void release(slot_t i, size_type area) {
+					hash_erase(i);
+					entries_[i].used_ = false;
+					entries_[i].dirty_ = false;
+					lru_unlink(i, area);
+					lru_push_back(i, area);
+				}
+				
+				CacheEntry entries_[SHARD_SIZE];
+				slot_t buckets_[SHARD_SIZE];
+				slot_t head_[AREAS];
+				slot_t tail_[AREAS];
+				Mutex mutex_;
+				
+				size_type hits_;
+				size_type misses_;
+				size_type writebacks_;
+				size_type reads_;
+				size_type writes_;
+			};
+			
+			Shard& shard_for(address_t a) { return shards_[a % SHARDS]; }
 
-				for(size_type i = start; i < end; i++) {
-					CacheEntry &e = cache_[i];
-					
+			bool in_special_area(address_t a) { return a >= start_ && a < end_; }
+			
+			size_type area(address_t a) {
+				if(SHARD_SPECIAL_SIZE == 0) { return AREA_NORMAL; }
+				if(SHARD_SPECIAL_SIZE == SHARD_SIZE) { return AREA_SPECIAL; }
+				return in_special_area(a) ? AREA_SPECIAL : AREA_NORMAL;
+			}
+			
+			/**
+			 * Take the least recently used slot of a's area for a, writing
+			 * back its previous content if it is dirty. If that fails, the
+			 * next least recently used slot is tried and so on.
+			 * The slot is *not* filled with data.
+			 * @return the slot or NO_SLOT if no slot of the area could be
+			 * written back (their contents stay cached then).
+			 */
+			slot_t evict_for(Shard& shard, address_t a, size_type ar) {
+				for(slot_t i = shard.tail_[ar]; i != NO_SLOT; i = shard.entries_[i].lru_prev_) {
+					CacheEntry &e = shard.entries_[i];
 					if(e.used()) {
-						if(e.address() == a) { return i; }
-						else if(e.date() <= lowest_date) {
-							lowest_idx = i;
-							lowest_date = e.date();
+						if(e.dirty()) {
+							if(physical_write(shard, e.data(), e.address()) != SUCCESS) {
+								continue;
+							}
+							shard.writebacks_++;
 						}
+						shard.hash_erase(i);
 					}
-					else if(unused_idx == (size_type)-1) { unused_idx = i; }
+					e.used_ = true;
+					e.dirty_ = false;
+					e.address_ = a;
+					shard.hash_insert(i);
+					shard.touch(i, ar);
+					return i;
 				}
-				
-				if(unused_idx != (size_type)-1) { return unused_idx; }
-				return lowest_idx;
+				return NO_SLOT;
 			}
-
-			int physical_write(block_data_t* data, address_t a) {
-				DBG("write %ld", a);
-				writes_++;
-				if(writes_ % 100 == 0) { print_stats();	}
+			
+			block_data_t* get(Shard& shard, address_t a) {
+				size_type ar = area(a);
+				slot_t i = shard.find(a);
+				if(i != NO_SLOT) {
+					shard.hits_++;
+					shard.touch(i, ar);
+				}
+				else {
+					shard.misses_++;
+					i = evict_for(shard, a, ar);
+					if(i == NO_SLOT) { return 0; }
+					if(physical_read(shard, shard.entries_[i].data(), a) != SUCCESS) {
+						shard.release(i, ar);
+						return 0;
+					}
+				}
+				return shard.entries_[i].data();
+			}
+			
+			int update(Shard& shard, block_data_t* new_data, address_t a) {
+				size_type ar = area(a);
+				slot_t i = shard.find(a);
+				if(i == NO_SLOT) {
+					// only update if a already in the cache or
+					// free slot available for write-through.
+					// for write-back, force the update
+					if(WRITE_THROUGH && shard.entries_[shard.tail_[ar]].used()) {
+						return SUCCESS;
+					}
+					i = evict_for(shard, a, ar);
+					if(i == NO_SLOT) { return ERR_UNSPEC; }
+				}
+				else {
+					shard.touch(i, ar);
+				}
+				memcpy(shard.entries_[i].data(), new_data, BLOCK_SIZE);
+				shard.entries_[i].dirty_ = !WRITE_THROUGH;
+				return SUCCESS;
+			}
+			
+			int physical_write(Shard& shard, block_data_t* data, address_t a) {
+				MutexGuard<Mutex> guard(io_mutex_);
+				shard.writes_++;
 				return BlockMemory::write(data, a);
 			}
 
-			int physical_read(block_data_t* data, address_t a) {
-				DBG("read %ld", a);
-				reads_++;
-				if(reads_ % 100 == 0) { print_stats();	}
+			int physical_read(Shard& shard, block_data_t* data, address_t a) {
+				MutexGuard<Mutex> guard(io_mutex_);
+				shard.reads_++;
 				return BlockMemory::read(data, a);
 			}
-
-
-			void print_stats() {
-				DBG("CBM phys reads: %ld phys writes: %ld", reads_, writes_);
+			
+			void physical_prefetch(address_t start, address_t blocks) {
+				if(blocks == 0) { return; }
+				MutexGuard<Mutex> guard(io_mutex_);
+				BlockMemory::prefetch(start, blocks);
 			}
 			
-			CacheEntry cache_[CACHE_SIZE];
+			size_type sum(size_type Shard::*counter) {
+				size_type r = 0;
+				for(size_type s = 0; s < SHARDS; s++) {
+					r += shards_[s].*counter;
+				}
+				return r;
+			}
+			
+			Shard shards_[SHARDS];
+			Mutex io_mutex_;
 			address_t start_;
 			address_t end_;
-			size_type reads_;
-			size_type writes_;
 			
 	}; // CachedBlockMemory
-	
-	template<
-		typename OsModel_P,
-		typename BlockMemory_P,
-		int CACHE_SIZE_P,
-		int SPECIAL_AREA_SIZE_P,
-		bool WRITE_THROUGH_P
-	>
-	typename CachedBlockMemory<OsModel_P, BlockMemory_P, CACHE_SIZE_P, SPECIAL_AREA_SIZE_P, WRITE_THROUGH_P>::size_type
-	CachedBlockMemory<OsModel_P, BlockMemory_P, CACHE_SIZE_P, SPECIAL_AREA_SIZE_P, WRITE_THROUGH_P>::CacheEntry::current_date_ = 0;
 }
 
 #endif // CACHED_BLOCK_MEMORY_H
@@ -0,0 +1,521 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef COW_BLOCK_MEMORY_H
+#define COW_BLOCK_MEMORY_H
+
+#include <util/meta.h>
+#include <util/null_mutex.h>
+
+namespace wiselib {
+	
+	/**
+	 * @brief Copy-on-write block memory with snapshots for concurrent
+	 * readers.
+	 * 
+	 * Logical blocks [0, SIZE) are mapped to blocks of the underlying block
+	 * memory, which needs SHADOW_BLOCKS_P more blocks than that. snapshot()
+	 * freezes the current contents of all blocks: Writing a block that is
+	 * still visible to a pinned snapshot puts the new contents into a
+	 * shadow block and keeps the old one for the snapshot, so readers see
+	 * a consistent state without blocking or copying anything. Blocks
+	 * not visible to any snapshot are overwritten in place. Old versions are
+	 * freed when the last snapshot that can see them is released.
+	 * 
+	 * Each snapshot carries ROOTS_P "root" values (e.g. root address and
+	 * size of a BPlusTree, see BPlusTree::root()) that the writer
+	 * publishes with set_root(), so readers know where to start.
+	 * 
+	 * A Snapshot provides the read side of the block memory concept (read(),
+	 * get()), so read-only structures can be put on top of it directly:
+	 * 
+	 * @code
+	 * cache.flush(); // no dirty blocks above this layer!
+	 * cow.set_root(0, tree.root());
+	 * cow.set_root(1, tree.size());
+	 * Cow::Snapshot *s = cow.snapshot();
+	 * // ... possibly in another thread:
+	 * BPlusTree<Os, Cow::Snapshot, K, V> view;
+	 * view.init(s, debug, s->root(0), s->root(1));
+	 * // ... read from view while the writer keeps modifying tree
+	 * cow.release(s);
+	 * @endcode
+	 * 
+	 * The block mapping is kept in RAM (allocated in init()) and mirrored
+	 * to a map area at the end of the underlying block memory, so init()
+	 * finds the current version of every block again after a restart.
+	 * A remapped block is written before its map entry, so after a crash
+	 * a block has either its old or its new contents. Old versions and
+	 * snapshots live in RAM only and are gone after a restart, their
+	 * shadow blocks become free again.
+	 * 
+	 * Layout of the underlying block memory:
+	 * [0, SIZE) home locations, [SIZE, SIZE + SHADOW_BLOCKS) shadow
+	 * blocks, then MAP_BLOCKS blocks of map area.
+	 * 
+	 * @tparam SHADOW_BLOCKS_P number of blocks of the underlying memory
+	 *   reserved for shadow copies, at most that many blocks can be written
+	 *   while a snapshot is pinned (further writes fail with ERR_UNSPEC).
+	 * @tparam MAX_SNAPSHOTS_P maximum number of pinned snapshots.
+	 * @tparam ROOTS_P number of root values per snapshot.
+	 * @tparam Mutex_P Mutex concept, needed if snapshots are read from other
+	 *   threads than the writer.
+	 */
+	template<
+		typename OsModel_P,
+		typename BlockMemory_P,
+		int SHADOW_BLOCKS_P,
+		int MAX_SNAPSHOTS_P = 4,
+		int ROOTS_P = 4,
+		typename Mutex_P = NullMutex<OsModel_P>
+	>
+	class CowBlockMemory : protected BlockMemory_P {
+		public:
+			typedef OsModel_P OsModel;
+			typedef typename OsModel::block_data_t block_data_t;
+			typedef typename OsModel::size_t size_type;
+			
+			typedef BlockMemory_P BlockMemory;
+			typedef typename BlockMemory::address_t address_t;
+			typedef Mutex_P Mutex;
+			
+			typedef CowBlockMemory<OsModel_P, BlockMemory_P, SHADOW_BLOCKS_P, MAX_SNAPSHOTS_P, ROOTS_P, Mutex_P> self_type;
+			typedef self_type* self_pointer_t;
+			
+			typedef ::uint32_t epoch_t;
+			
+			enum {
+				/// Map entries per block of the map area
+				MAP_ENTRIES = BlockMemory::BLOCK_SIZE / sizeof(address_t),
+				/// Header block + map entries for all non-shadow blocks
+				MAP_BLOCKS = 1 + (BlockMemory::SIZE - SHADOW_BLOCKS_P + MAP_ENTRIES - 1) / MAP_ENTRIES
+			};
+			
+			enum {
+				SHADOW_BLOCKS = SHADOW_BLOCKS_P,
+				MAX_SNAPSHOTS = MAX_SNAPSHOTS_P,
+				ROOTS = ROOTS_P,
+				BLOCK_SIZE = BlockMemory::BLOCK_SIZE,
+				SIZE = BlockMemory::SIZE - SHADOW_BLOCKS - MAP_BLOCKS,
+				BUFFER_SIZE = BlockMemory::BUFFER_SIZE,
+				NO_ADDRESS = BlockMemory::NO_ADDRESS
+			};
+			
+			enum {
+				SUCCESS = BlockMemory::SUCCESS,
+				ERR_UNSPEC = BlockMemory::ERR_UNSPEC
+			};
+			
+		private:
+			enum {
+				MAGIC = 0x434f5731, // "COW1"
+				MAP_START = SIZE + SHADOW_BLOCKS
+			};
+			
+			/**
+			 * First block of the map area, the map is only valid if the
+			 * header matches.
+			 */
+			struct MapHeader {
+				::uint32_t magic;
+				::uint32_t size;
+			};
+			
+			/// Index into the version pool, SHADOW_BLOCKS means "none".
+			typedef typename SmallUint<SHADOW_BLOCKS + 1>::t version_t;
+			enum { NO_VERSION = SHADOW_BLOCKS };
+			
+			/**
+			 * Current version of a logical block.
+			 */
+			struct Mapping {
+				address_t physical;
+				/// epoch in which this version was written
+				epoch_t epoch;
+				/// older versions, newest first
+				version_t old;
+			};
+			
+			/**
+			 * Older version of a logical block, valid (visible) for
+			 * snapshots in [from, until).
+			 */
+			struct Version {
+				address_t logical;
+				address_t physical;
+				epoch_t from;
+				epoch_t until;
+				version_t next;
+				bool used;
+			};
+			
+		public:
+			
+			/**
+			 * Read-only view of the block memory at the time of
+			 * snapshot(). Every snapshot() call gets its own Snapshot, so
+			 * a Snapshot (and its get() buffer) must only be used by one
+			 * reader at a time.
+			 */
+			class Snapshot {
+				public:
+					typedef OsModel_P OsModel;
+					typedef typename OsModel::block_data_t block_data_t;
+					typedef typename OsModel::size_t size_type;
+					typedef typename BlockMemory::address_t address_t;
+					typedef Snapshot* self_pointer_t;
+					
+					enum {
+						BLOCK_SIZE = self_type::BLOCK_SIZE,
+						SIZE = self_type::SIZE,
+						BUFFER_SIZE = self_type::BUFFER_SIZE,
+						NO_ADDRESS = self_type::NO_ADDRESS
+					};
+					
+					enum {
+						SUCCESS = self_type::SUCCESS,
+						ERR_UNSPEC = self_type::ERR_UNSPEC
+					};
+					
+					int read(block_data_t* buffer, address_t a) {
+						return memory_->read(buffer, a, epoch_);
+					}
+					
+					/**
+					 * @return pointer to a copy of block a. It stays valid until
+					 * the next call to get() on this snapshot.
+					 */
+					block_data_t* get(address_t a) {
+						if(a != buffered_) {
+							memory_->read(buffer_, a, epoch_);
+							buffered_ = a;
+						}
+						return buffer_;
+					}
+					
+					void invalidate(address_t a) {
+					}
+					
+					size_type root(size_type i) { return roots_[i]; }
+					epoch_t epoch() { return epoch_; }
+					
+				private:
+					self_type *memory_;
+					epoch_t epoch_;
+					bool pinned_;
+					size_type roots_[ROOTS];
+					address_t buffered_;
+					block_data_t buffer_[BUFFER_SIZE];
+				
+				friend class CowBlockMemory;
+			};
+			
+			CowBlockMemory() : mappings_(0) {
+			}
+			
+			/**
+			 * Load the block mapping from the map area, or set up an
+			 * identity mapping if there is none yet. The underlying block
+			 * memory has to be initialized separately (see block_memory()).
+			 * 
+			 * @return ERR_UNSPEC if the map area can not be read or is
+			 * corrupt.
+			 */
+			int init() {
+				// We need at least one shadow block, the version pool uses
+				// SHADOW_BLOCKS as "none"
+				static_assert((SHADOW_BLOCKS > 0) && ((size_type)SHADOW_BLOCKS + MAP_BLOCKS < (size_type)BlockMemory::SIZE));
+				
+				if(!mappings_) {
+					mappings_ = ::get_allocator().template allocate_array<Mapping>(SIZE).raw();
+					if(!mappings_) { return ERR_UNSPEC; }
+				}
+				
+				epoch_ = 1;
+				for(size_type i = 0; i < SHADOW_BLOCKS; i++) {
+					versions_[i].used = false;
+					versions_[i].next = i + 1;
+				}
+				free_versions_ = 0;
+				for(size_type i = 0; i < MAX_SNAPSHOTS; i++) {
+					snapshots_[i].memory_ = this;
+					snapshots_[i].pinned_ = false;
+				}
+				for(size_type i = 0; i < ROOTS; i++) {
+					roots_[i] = 0;
+				}
+				
+				if(BlockMemory::read(buffer_, MAP_START) != SUCCESS) { return ERR_UNSPEC; }
+				MapHeader &header = *reinterpret_cast<MapHeader*>(buffer_);
+				if(header.magic == MAGIC && header.size == (::uint32_t)SIZE) {
+					return load_map();
+				}
+				return format();
+			}
+			
+			int destruct() {
+				if(mappings_) {
+					::get_allocator().free_array(mappings_);
+					mappings_ = 0;
+				}
+				return SUCCESS;
+			}
+			
+			/**
+			 * Wipe the underlying block memory and restart with an identity
+			 * mapping. No snapshots may be pinned.
+			 */
+			int wipe() {
+				MutexGuard<Mutex> guard(mutex_);
+				if(BlockMemory::wipe() != SUCCESS) { return ERR_UNSPEC; }
+				return init();
+			}
+			
+			int read(block_data_t* buffer, address_t a) {
+				MutexGuard<Mutex> guard(mutex_);
+				return BlockMemory::read(buffer, mappings_[a].physical);
+			}
+			
+			int write(block_data_t* buffer, address_t a) {
+				MutexGuard<Mutex> guard(mutex_);
+				
+				Mapping &m = mappings_[a];
+				if(m.epoch == epoch_ || !visible(m.epoch, epoch_)) {
+					m.epoch = epoch_;
+					return BlockMemory::write(buffer, m.physical);
+				}
+				
+				if(free_blocks_top_ == 0) { return ERR_UNSPEC; }
+				address_t physical = free_blocks_[free_blocks_top_ - 1];
+				if(BlockMemory::write(buffer, physical) != SUCCESS) { return ERR_UNSPEC; }
+				free_blocks_top_--;
+				
+				// there are as many versions as blocks in use by them,
+				// so there is a free one
+				version_t v = free_versions_;
+				Version &version = versions_[v];
+				free_versions_ = version.next;
+				version.used = true;
+				version.logical = a;
+				version.physical = m.physical;
+				version.from = m.epoch;
+				version.until = epoch_;
+				version.next = m.old;
+				
+				m.old = v;
+				m.physical = physical;
+				m.epoch = epoch_;
+				
+				// If this fails, the map area still points to the old
+				// contents, which are kept until the next restart
+				return write_map_block(a / MAP_ENTRIES);
+			}
+			
+			/**
+			 * Set root value i, it will be part of all following snapshots.
+			 */
+			void set_root(size_type i, size_type value) {
+				MutexGuard<Mutex> guard(mutex_);
+				roots_[i] = value;
+			}
+			
+			size_type root(size_type i) { return roots_[i]; }
+			
+			/**
+			 * Pin the current state of all blocks and root values.
+			 * Every call must be matched by a call to release().
+			 * 
+			 * @return the snapshot or NULL if MAX_SNAPSHOTS snapshots are
+			 * pinned already.
+			 */
+			Snapshot* snapshot() {
+				MutexGuard<Mutex> guard(mutex_);
+				
+				for(size_type i = 0; i < MAX_SNAPSHOTS; i++) {
+					Snapshot &s = snapshots_[i];
+					if(!s.pinned_) {
+						s.pinned_ = true;
+						s.epoch_ = epoch_;
+						s.buffered_ = NO_ADDRESS;
+						for(size_type j = 0; j < ROOTS; j++) {
+							s.roots_[j] = roots_[j];
+						}
+						epoch_++;
+						return &s;
+					}
+				}
+				return 0;
+			}
+			
+			/**
+			 * Unpin snapshot s and free all block versions no snapshot can
+			 * see anymore.
+			 */
+			void release(Snapshot *s) {
+				MutexGuard<Mutex> guard(mutex_);
+				
+				assert(s->pinned_);
+				s->pinned_ = false;
+				
+				for(version_t v = 0; v < SHADOW_BLOCKS; v++) {
+					Version &version = versions_[v];
+					if(!version.used || visible(version.from, version.until)) { continue; }
+					
+					// unlink from the version list of its logical block
+					version_t *p = &mappings_[version.logical].old;
+					while(*p != v) { p = &versions_[*p].next; }
+					*p = version.next;
+					
+					version.used = false;
+					version.next = free_versions_;
+					free_versions_ = v;
+					free_blocks_[free_blocks_top_++] = version.physical;
+				}
+			}
+			
+			/// Number of shadow blocks currently available.
+			size_type free_shadow_blocks() { return free_blocks_top_; }
+			
+			BlockMemory& block_memory() { return *(BlockMemory*)this; }
+			
+		private:
+			
+			/**
+			 * @return true iff a version valid in [from, until) is visible
+			 * to a pinned snapshot.
+			 */
+			bool visible(epoch_t from, epoch_t until) {
+				for(size_type i = 0; i < MAX_SNAPSHOTS; i++) {
+					Snapshot &s = snapshots_[i];
+					if(s.pinned_ && s.epoch_ >= from && s.epoch_ < until) {
+						return true;
+					}
+				}
+				return false;
+			}
+			
+			/**
+			 * Write an identity mapping for all blocks to the map area.
+			 */
+			int format() {
+				for(address_t a = 0; a < SIZE; a++) {
+					mappings_[a].physical = a;
+					mappings_[a].epoch = 0;
+					mappings_[a].old = NO_VERSION;
+				}
+				for(size_type i = 0; i < SHADOW_BLOCKS; i++) {
+					free_blocks_[i] = SIZE + i;
+				}
+				free_blocks_top_ = SHADOW_BLOCKS;
+				
+				for(size_type i = 0; i * MAP_ENTRIES < (size_type)SIZE; i++) {
+					if(write_map_block(i) != SUCCESS) { return ERR_UNSPEC; }
+				}
+				memset(buffer_, 0, BLOCK_SIZE);
+				MapHeader &header = *reinterpret_cast<MapHeader*>(buffer_);
+				header.magic = MAGIC;
+				header.size = SIZE;
+				return BlockMemory::write(buffer_, MAP_START);
+			}
+			
+			/**
+			 * Read the mapping from the map area. Every block of
+			 * [0, SIZE + SHADOW_BLOCKS) that is not mapped is free.
+			 */
+			int load_map() {
+				::uint8_t *mapped = ::get_allocator().template allocate_array< ::uint8_t>(MAP_START).raw();
+				if(!mapped) { return ERR_UNSPEC; }
+				memset(mapped, 0, MAP_START);
+				
+				int r = SUCCESS;
+				for(size_type i = 0; r == SUCCESS && i * MAP_ENTRIES < (size_type)SIZE; i++) {
+					if(BlockMemory::read(buffer_, MAP_START + 1 + i) != SUCCESS) {
+						r = ERR_UNSPEC;
+						break;
+					}
+					for(size_type j = 0; j < MAP_ENTRIES && i * MAP_ENTRIES + j < (size_type)SIZE; j++) {
+						address_t physical;
+						memcpy(&physical, buffer_ + j * sizeof(address_t), sizeof(address_t));
+						if(physical >= (address_t)MAP_START || mapped[physical]) {
+							r = ERR_UNSPEC;
+							break;
+						}
+						mapped[physical] = 1;
+						
+						Mapping &m = mappings_[i * MAP_ENTRIES + j];
+						m.physical = physical;
+						m.epoch = 0;
+						m.old = NO_VERSION;
+					}
+				}
+				
+				free_blocks_top_ = 0;
+				for(address_t p = 0; r == SUCCESS && p < (address_t)MAP_START; p++) {
+					if(!mapped[p]) { free_blocks_[free_blocks_top_++] = p; }
+				}
+				::get_allocator().free_array(mapped);
+				return r;
+			}
+			
+			/**
+			 * Write block i of the map area from mappings_.
+			 */
+			int write_map_block(size_type i) {
+				memset(buffer_, 0xff, BLOCK_SIZE);
+				for(size_type j = 0; j < MAP_ENTRIES && i * MAP_ENTRIES + j < (size_type)SIZE; j++) {
+					memcpy(buffer_ + j * sizeof(address_t), &mappings_[i * MAP_ENTRIES + j].physical, sizeof(address_t));
+				}
+				return BlockMemory::write(buffer_, MAP_START + 1 + i);
+			}
+			
+			/**
+			 * Read block a as it was in the given epoch.
+			 */
+			int read(block_data_t* buffer, address_t a, epoch_t epoch) {
+				MutexGuard<Mutex> guard(mutex_);
+				
+				Mapping &m = mappings_[a];
+				address_t physical = m.physical;
+				if(m.epoch > epoch) {
+					version_t v = m.old;
+					while(v != NO_VERSION && !(versions_[v].from <= epoch && epoch < versions_[v].until)) {
+						v = versions_[v].next;
+					}
+					assert(v != NO_VERSION);
+					physical = versions_[v].physical;
+				}
+				return BlockMemory::read(buffer, physical);
+			}
+			
+			Mapping *mappings_;
+			Version versions_[SHADOW_BLOCKS];
+			version_t free_versions_;
+			address_t free_blocks_[SHADOW_BLOCKS];
+			size_type free_blocks_top_;
+			Snapshot snapshots_[MAX_SNAPSHOTS];
+			size_type roots_[ROOTS];
+			epoch_t epoch_;
+			Mutex mutex_;
+			block_data_t buffer_[BUFFER_SIZE];
+			
+	}; // CowBlockMemory
+}
+
+#endif // COW_BLOCK_MEMORY_H
+
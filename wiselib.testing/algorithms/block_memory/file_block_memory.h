@@ -20,15 +20,41 @@
 #ifndef FILE_BLOCK_MEMORY_H
 #define FILE_BLOCK_MEMORY_H
 
-#include <fstream>
 #include <iostream>
-#include <iomanip>
-#include <ios>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <util/pstl/algorithm.h>
 
 namespace wiselib {
 
+	/**
+	 * @brief Block memory in a file (Linux/POSIX only).
+	 * 
+	 * Reads go to the file directly (one pread per call, no matter how many
+	 * blocks). Writes are staged in a batch of up to PENDING_BLOCKS_P blocks
+	 * (rewriting a staged block just updates it). When the batch is full
+	 * it is sorted by address and written with one pwritev per run of
+	 * adjacent blocks. With ASYNC_P that happens in a background thread
+	 * while the next batch is being filled. Reads always see the latest
+	 * write.
+	 * 
+	 * Call flush() to make sure everything written so far is on disk.
+	 * 
+	 * The file is created if it doesn't exist, blocks that were never
+	 * written read as zeroes (use wipe() to set everything to 0xff).
+	 * 
+	 * @tparam PENDING_BLOCKS_P number of blocks per write batch (< 2^15).
+	 * @tparam ASYNC_P write full batches in a background thread.
+	 */
 	template<
-		typename OsModel_P
+		typename OsModel_P,
+		int PENDING_BLOCKS_P = 64,
+		bool ASYNC_P = true
 	>
 	class FileBlockMemory {
 		public:
@@ -37,7 +63,7 @@ namespace wiselib {
 			typedef typename OsModel::size_t size_type;
 			typedef size_type address_t;
 
-			typedef FileBlockMemory<OsModel_P> self_type;
+			typedef FileBlockMemory<OsModel_P, PENDING_BLOCKS_P, ASYNC_P> self_type;
 			typedef self_type* self_pointer_t;
 
 			enum {
@@ -46,6 +72,11 @@ namespace wiselib {
 				SIZE = 1 * 1024UL * 1024UL * 1024UL / 512UL
 //				SIZE = 100* 2048
 			};
+			
+			enum {
+				PENDING_BLOCKS = PENDING_BLOCKS_P,
+				ASYNC = ASYNC_P
+			};
 
 			enum {
 				SUCCESS = OsModel::SUCCESS,
@@ -56,52 +87,367 @@ namespace wiselib {
 				NO_ADDRESS = (address_t)(-1)
 			};
 
-			FileBlockMemory() {
-				std::cout << "You are using FileBlockMemory. Please make sure a 1GB file named block_memory.img exists in the current directory!"
+			FileBlockMemory() : fd_(-1) {
+				std::cout << "You are using FileBlockMemory. Blocks will be stored in block_memory.img in the current directory (unless specified otherwise)!"
 							 << std::endl;
 			}
+			
+			~FileBlockMemory() {
+				destruct();
+			}
 
-			int init() {
+			int init(const char *path = "block_memory.img") {
+				destruct();
+				
+				fd_ = ::open(path, O_RDWR | O_CREAT, 0644);
+				if(fd_ < 0) { return ERR_UNSPEC; }
+				
+				error_ = false;
+				filling_ = &batches_[0];
+				in_flight_ = &batches_[1];
+				filling_->clear();
+				in_flight_->clear();
+				
+				if(ASYNC) {
+					busy_ = false;
+					stop_ = false;
+					pthread_mutex_init(&mutex_, 0);
+					pthread_cond_init(&cond_, 0);
+					
+					// The writer thread inherits our signal mask. Block
+					// everything for it, so signal handlers (e.g. the
+					// SIGALRM timer of the PC os model) keep running on the
+					// application thread only.
+					sigset_t all, old;
+					sigfillset(&all);
+					pthread_sigmask(SIG_SETMASK, &all, &old);
+					int r = pthread_create(&thread_, 0, &self_type::writer_thread, this);
+					pthread_sigmask(SIG_SETMASK, &old, 0);
+					if(r != 0) {
+						pthread_cond_destroy(&cond_);
+						pthread_mutex_destroy(&mutex_);
+						::close(fd_);
+						fd_ = -1;
+						return ERR_UNSPEC;
+					}
+				}
 				return SUCCESS;
 			}
+			
+			/**
+			 * Flush, stop the writer thread and close the file.
+			 */
+			int destruct() {
+				if(fd_ < 0) { return SUCCESS; }
+				
+				int r = flush();
+				if(ASYNC) {
+					pthread_mutex_lock(&mutex_);
+					stop_ = true;
+					pthread_cond_broadcast(&cond_);
+					pthread_mutex_unlock(&mutex_);
+					pthread_join(thread_, 0);
+					pthread_cond_destroy(&cond_);
+					pthread_mutex_destroy(&mutex_);
+				}
+				::close(fd_);
+				fd_ = -1;
+				return r;
+			}
 
 			int wipe() {
-				open();
-				stream_.seekp(0, std::ios::beg);
-				for(size_type i = 0; i < SIZE * BLOCK_SIZE; i++) {
-					stream_ << '\xff';
+				enum { WIPE_BLOCKS = 256 };
+				
+				drain();
+				filling_->clear();
+				block_data_t buffer[WIPE_BLOCKS * BLOCK_SIZE];
+				memset(buffer, 0xff, sizeof(buffer));
+				for(address_t a = 0; a < SIZE; a += WIPE_BLOCKS) {
+					size_type n = (SIZE - a < WIPE_BLOCKS) ? (SIZE - a) : WIPE_BLOCKS;
+					if(pwrite_all(buffer, a, n) != SUCCESS) { return ERR_UNSPEC; }
 				}
-				close();
 				return SUCCESS;
 			}
 
 			int read(block_data_t* buffer, address_t a) {
-				open();
-				stream_.seekg(a * BLOCK_SIZE);
-				stream_.read(reinterpret_cast<char*>(buffer), BLOCK_SIZE);
-				close();
+				return read(buffer, a, 1);
+			}
+			
+			/**
+			 * Read blocks [start, start + blocks) into buffer.
+			 */
+			int read(block_data_t* buffer, address_t start, address_t blocks) {
+				size_type bytes = blocks * BLOCK_SIZE;
+				size_type done = 0;
+				while(done < bytes) {
+					ssize_t r = ::pread(fd_, buffer + done, bytes - done, start * BLOCK_SIZE + done);
+					if(r < 0) { return ERR_UNSPEC; }
+					if(r == 0) {
+						// beyond end of file
+						memset(buffer + done, 0, bytes - done);
+						break;
+					}
+					done += r;
+				}
+				
+				// Blocks that have not reached the file yet.
+				// in_flight_ is older than filling_ so apply it first.
+				in_flight_->overlay(buffer, start, blocks);
+				filling_->overlay(buffer, start, blocks);
 				return SUCCESS;
 			}
 
 			int write(block_data_t* buffer, address_t a) {
-				open();
-				stream_.seekp(a * BLOCK_SIZE);
-				stream_.write(reinterpret_cast<char*>(buffer), BLOCK_SIZE);
-				close();
+				return write(buffer, a, 1);
+			}
+			
+			/**
+			 * Write blocks [start, start + blocks) from buffer.
+			 * Writes of at least PENDING_BLOCKS blocks bypass the batch.
+			 */
+			int write(block_data_t* buffer, address_t start, address_t blocks) {
+				if(blocks >= PENDING_BLOCKS) {
+					drain();
+					return pwrite_all(buffer, start, blocks);
+				}
+				
+				for(address_t i = 0; i < blocks; i++) {
+					if(!filling_->stage(buffer + i * BLOCK_SIZE, start + i)) {
+						submit();
+						filling_->stage(buffer + i * BLOCK_SIZE, start + i);
+					}
+				}
 				return SUCCESS;
 			}
+			
+			/**
+			 * Hint that blocks [start, start + blocks) will be read soon,
+			 * the kernel starts loading them in the background.
+			 */
+			void prefetch(address_t start, address_t blocks) {
+				posix_fadvise(fd_, start * BLOCK_SIZE, blocks * BLOCK_SIZE, POSIX_FADV_WILLNEED);
+			}
+			
+			/**
+			 * Barrier: Return when all blocks written so far are in the file
+			 * and the file has been synced to disk.
+			 */
+			int flush() {
+				if(fd_ < 0) { return ERR_UNSPEC; }
+				drain();
+				if(::fdatasync(fd_) != 0) { error_ = true; }
+				
+				int r = error_ ? ERR_UNSPEC : SUCCESS;
+				error_ = false;
+				return r;
+			}
 
 		private:
-			void open() {
-				stream_.open("block_memory.img", std::ios::in | std::ios::out);
+			
+			/**
+			 * Staging area for up to PENDING_BLOCKS blocks, indexed by an
+			 * open addressing hash table.
+			 */
+			class WriteBatch {
+				public:
+					enum { HASH_SIZE = 2 * PENDING_BLOCKS, EMPTY = -1 };
+					
+					void clear() {
+						size_ = 0;
+						for(size_type i = 0; i < HASH_SIZE; i++) { hash_[i] = EMPTY; }
+					}
+					
+					bool empty() { return size_ == 0; }
+					
+					/**
+					 * @return false iff the batch is full and does not contain
+					 * a yet.
+					 */
+					bool stage(block_data_t *data, address_t a) {
+						size_type h = find(a);
+						if(hash_[h] == EMPTY) {
+							if(size_ >= PENDING_BLOCKS) { return false; }
+							hash_[h] = size_;
+							addresses_[size_] = a;
+							size_++;
+						}
+						memcpy(data_ + hash_[h] * BLOCK_SIZE, data, BLOCK_SIZE);
+						return true;
+					}
+					
+					/**
+					 * Copy staged versions of blocks in [start, start + blocks)
+					 * over the according positions in buffer.
+					 */
+					void overlay(block_data_t *buffer, address_t start, address_t blocks) {
+						if(empty()) { return; }
+						
+						if(blocks > (address_t)size_) {
+							for(size_type i = 0; i < size_; i++) {
+								if(addresses_[i] >= start && addresses_[i] < start + blocks) {
+									memcpy(buffer + (addresses_[i] - start) * BLOCK_SIZE, data_ + i * BLOCK_SIZE, BLOCK_SIZE);
+								}
+							}
+						}
+						else {
+							for(address_t a = start; a < start + blocks; a++) {
+								size_type h = find(a);
+								if(hash_[h] != EMPTY) {
+									memcpy(buffer + (a - start) * BLOCK_SIZE, data_ + hash_[h] * BLOCK_SIZE, BLOCK_SIZE);
+								}
+							}
+						}
+					}
+					
+					/**
+					 * Write all staged blocks to fd, one pwritev per run of
+					 * adjacent addresses.
+					 */
+					bool write_to(int fd) {
+						for(size_type i = 0; i < size_; i++) { order_[i] = i; }
+						AddressCompare cmp(this);
+						heap_sort(order_, order_ + size_, cmp);
+						
+						struct iovec iov[IOV_MAX < PENDING_BLOCKS ? IOV_MAX : PENDING_BLOCKS];
+						size_type i = 0;
+						while(i < size_) {
+							address_t run_start = addresses_[order_[i]];
+							size_type n = 0;
+							do {
+								iov[n].iov_base = data_ + order_[i] * BLOCK_SIZE;
+								iov[n].iov_len = BLOCK_SIZE;
+								n++; i++;
+							} while(i < size_ && n < sizeof(iov) / sizeof(iov[0]) &&
+									addresses_[order_[i]] == run_start + n);
+							
+							if(!pwritev_all(fd, iov, n, run_start * BLOCK_SIZE)) { return false; }
+						}
+						return true;
+					}
+					
+				private:
+					struct AddressCompare {
+						AddressCompare(WriteBatch *b) : batch_(b) { }
+						bool operator()(const ::int16_t& a, const ::int16_t& b) const {
+							return batch_->addresses_[a] < batch_->addresses_[b];
+						}
+						WriteBatch *batch_;
+					};
+					
+					size_type find(address_t a) {
+						size_type h = (a * 2654435761UL) % HASH_SIZE;
+						while(hash_[h] != EMPTY && addresses_[hash_[h]] != a) {
+							h = (h + 1) % HASH_SIZE;
+						}
+						return h;
+					}
+					
+					static bool pwritev_all(int fd, struct iovec *iov, size_type n, off_t offset) {
+						while(n) {
+							ssize_t r = ::pwritev(fd, iov, n, offset);
+							if(r < 0) { return false; }
+							offset += r;
+							while(n && (size_type)r >= iov->iov_len) {
+								r -= iov->iov_len;
+								iov++; n--;
+							}
+							if(n) {
+								iov->iov_base = (char*)iov->iov_base + r;
+								iov->iov_len -= r;
+							}
+						}
+						return true;
+					}
+					
+					block_data_t data_[PENDING_BLOCKS * BLOCK_SIZE];
+					address_t addresses_[PENDING_BLOCKS];
+					::int16_t hash_[HASH_SIZE];
+					::int16_t order_[PENDING_BLOCKS];
+					size_type size_;
+			};
+			
+			int pwrite_all(block_data_t *buffer, address_t start, address_t blocks) {
+				size_type bytes = blocks * BLOCK_SIZE;
+				size_type done = 0;
+				while(done < bytes) {
+					ssize_t r = ::pwrite(fd_, buffer + done, bytes - done, start * BLOCK_SIZE + done);
+					if(r < 0) { return ERR_UNSPEC; }
+					done += r;
+				}
+				return SUCCESS;
 			}
-
-			void close() {
-				stream_.close();
+			
+			/**
+			 * Hand the filling batch over for writing, block until there is
+			 * an empty batch to fill.
+			 */
+			void submit() {
+				if(filling_->empty()) { return; }
+				
+				if(ASYNC) {
+					pthread_mutex_lock(&mutex_);
+					while(busy_) { pthread_cond_wait(&cond_, &mutex_); }
+					WriteBatch *b = in_flight_;
+					in_flight_ = filling_;
+					filling_ = b;
+					filling_->clear();
+					busy_ = true;
+					pthread_cond_broadcast(&cond_);
+					pthread_mutex_unlock(&mutex_);
+				}
+				else {
+					if(!filling_->write_to(fd_)) { error_ = true; }
+					filling_->clear();
+				}
+			}
+			
+			/**
+			 * Write out all staged blocks and wait for completion.
+			 */
+			void drain() {
+				submit();
+				if(ASYNC) {
+					pthread_mutex_lock(&mutex_);
+					while(busy_) { pthread_cond_wait(&cond_, &mutex_); }
+					in_flight_->clear();
+					pthread_mutex_unlock(&mutex_);
+				}
+			}
+			
+			static void* writer_thread(void *p) {
+				self_type &self = *reinterpret_cast<self_type*>(p);
+				
+				pthread_mutex_lock(&self.mutex_);
+				while(true) {
+					while(!self.busy_ && !self.stop_) { pthread_cond_wait(&self.cond_, &self.mutex_); }
+					if(!self.busy_) { break; }
+					
+					WriteBatch *b = self.in_flight_;
+					pthread_mutex_unlock(&self.mutex_);
+					bool ok = b->write_to(self.fd_);
+					pthread_mutex_lock(&self.mutex_);
+					
+					if(!ok) { self.error_ = true; }
+					self.busy_ = false;
+					pthread_cond_broadcast(&self.cond_);
+				}
+				pthread_mutex_unlock(&self.mutex_);
+				return 0;
 			}
 
-			std::fstream stream_;
+			int fd_;
+			WriteBatch batches_[2];
+			WriteBatch *filling_;
+			WriteBatch *in_flight_;
+			
+			pthread_t thread_;
+			pthread_mutex_t mutex_;
+			pthread_cond_t cond_;
+			bool busy_;
+			bool stop_;
+			volatile bool error_;
 	};
 }
 
 #endif // FILE_BLOCK_MEMORY_H
+
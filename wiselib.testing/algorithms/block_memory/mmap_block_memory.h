@@ -0,0 +1,221 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef MMAP_BLOCK_MEMORY_H
+#define MMAP_BLOCK_MEMORY_H
+
+#include <iostream>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace wiselib {
+	
+	/**
+	 * @brief Block memory backed by a memory mapped file (POSIX only).
+	 * 
+	 * get() returns a pointer directly into the mapping, so blocks can be
+	 * accessed without copying. Changes made through that pointer are
+	 * visible to all readers at once, write() with the same pointer is a
+	 * no-op. As get(), update() and invalidate() behave like in
+	 * CachedBlockMemory, this can be used in its place (e.g. below
+	 * BitmapChunkAllocator) without an additional cache.
+	 * 
+	 * The kernel writes dirty pages back eventually, call flush() (or
+	 * sync() for a range of blocks) to make sure changes are on disk.
+	 * 
+	 * The file is created and extended (sparsely) to SIZE blocks if
+	 * necessary, blocks that were never written read as zeroes.
+	 * 
+	 * @tparam BLOCKS_P number of blocks (default 1 GiB).
+	 */
+	template<
+		typename OsModel_P,
+		unsigned long BLOCKS_P = 1 * 1024UL * 1024UL * 1024UL / 512UL
+	>
+	class MmapBlockMemory {
+		
+		public:
+			typedef OsModel_P OsModel;
+			typedef typename OsModel::block_data_t block_data_t;
+			typedef typename OsModel::size_t size_type;
+			typedef size_type address_t;
+			
+			typedef MmapBlockMemory<OsModel_P, BLOCKS_P> self_type;
+			typedef self_type* self_pointer_t;
+			
+			enum {
+				BLOCK_SIZE = 512,
+				BUFFER_SIZE = 512,
+				SIZE = BLOCKS_P
+			};
+			
+			enum {
+				SUCCESS = OsModel::SUCCESS,
+				ERR_UNSPEC = OsModel::ERR_UNSPEC
+			};
+			
+			enum {
+				NO_ADDRESS = (address_t)(-1)
+			};
+			
+			MmapBlockMemory() : fd_(-1), data_(0) {
+				std::cout << "You are using MmapBlockMemory. Blocks will be stored in block_memory.img in the current directory (unless specified otherwise)!"
+							 << std::endl;
+			}
+			
+			~MmapBlockMemory() {
+				destruct();
+			}
+			
+			int init(const char *path = "block_memory.img") {
+				destruct();
+				
+				fd_ = ::open(path, O_RDWR | O_CREAT, 0644);
+				if(fd_ < 0) { return ERR_UNSPEC; }
+				
+				struct stat st;
+				if(fstat(fd_, &st) != 0 ||
+						((size_type)st.st_size < bytes() && ftruncate(fd_, bytes()) != 0)) {
+					::close(fd_);
+					fd_ = -1;
+					return ERR_UNSPEC;
+				}
+				
+				void *p = mmap(0, bytes(), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+				if(p == MAP_FAILED) {
+					::close(fd_);
+					fd_ = -1;
+					return ERR_UNSPEC;
+				}
+				data_ = reinterpret_cast<block_data_t*>(p);
+				return SUCCESS;
+			}
+			
+			/**
+			 * Flush, unmap and close the file.
+			 */
+			int destruct() {
+				if(fd_ < 0) { return SUCCESS; }
+				
+				int r = flush();
+				munmap(data_, bytes());
+				::close(fd_);
+				data_ = 0;
+				fd_ = -1;
+				return r;
+			}
+			
+			int wipe() {
+				memset(data_, 0xff, bytes());
+				return SUCCESS;
+			}
+			
+			int read(block_data_t* buffer, address_t a) {
+				return read(buffer, a, 1);
+			}
+			
+			int read(block_data_t* buffer, address_t start, address_t blocks) {
+				if(!in_range(start, blocks)) { return ERR_UNSPEC; }
+				if(buffer != get(start)) {
+					memcpy(buffer, get(start), blocks * BLOCK_SIZE);
+				}
+				return SUCCESS;
+			}
+			
+			int write(block_data_t* buffer, address_t a) {
+				return write(buffer, a, 1);
+			}
+			
+			int write(block_data_t* buffer, address_t start, address_t blocks) {
+				if(!in_range(start, blocks)) { return ERR_UNSPEC; }
+				if(buffer != get(start)) {
+					memcpy(get(start), buffer, blocks * BLOCK_SIZE);
+				}
+				return SUCCESS;
+			}
+			
+			/**
+			 * @return pointer to block a inside the mapping, valid until
+			 * destruct().
+			 */
+			block_data_t* get(address_t a) {
+				return data_ + a * BLOCK_SIZE;
+			}
+			
+			int update(block_data_t* new_data, address_t a) {
+				return write(new_data, a);
+			}
+			
+			void invalidate(address_t /* a */) {
+			}
+			
+			void set_special_range(address_t /* start */, address_t /* end */) {
+			}
+			
+			/**
+			 * Hint that blocks [start, start + blocks) will be accessed
+			 * soon, the kernel starts paging them in in the background.
+			 */
+			void prefetch(address_t start, address_t blocks) {
+				if(start >= SIZE) { return; }
+				if(start + blocks > SIZE) { blocks = SIZE - start; }
+				size_type page = sysconf(_SC_PAGESIZE);
+				size_type from = (start * BLOCK_SIZE) / page * page;
+				size_type to = (start + blocks) * BLOCK_SIZE;
+				madvise(data_ + from, to - from, MADV_WILLNEED);
+			}
+			
+			/**
+			 * Durability point: Return when all changes to blocks
+			 * [start, start + blocks) are on disk.
+			 */
+			int sync(address_t start, address_t blocks) {
+				if(!in_range(start, blocks)) { return ERR_UNSPEC; }
+				size_type page = sysconf(_SC_PAGESIZE);
+				size_type from = (start * BLOCK_SIZE) / page * page;
+				size_type to = (start + blocks) * BLOCK_SIZE;
+				return msync(data_ + from, to - from, MS_SYNC) ? ERR_UNSPEC : SUCCESS;
+			}
+			
+			/**
+			 * Durability point: Return when all changes are on disk.
+			 */
+			int flush() {
+				if(fd_ < 0) { return ERR_UNSPEC; }
+				return msync(data_, bytes(), MS_SYNC) ? ERR_UNSPEC : SUCCESS;
+			}
+			
+		private:
+			static size_type bytes() { return (size_type)SIZE * BLOCK_SIZE; }
+			
+			bool in_range(address_t start, address_t blocks) {
+				return data_ && start < SIZE && blocks <= SIZE - start;
+			}
+			
+			int fd_;
+			block_data_t *data_;
+		
+	}; // MmapBlockMemory
+}
+
+#endif // MMAP_BLOCK_MEMORY_H
+
@@ -77,6 +77,13 @@ namespace wiselib {
 				memcpy(data_ + a * BLOCK_SIZE, buffer, BLOCK_SIZE);
 				return SUCCESS;
 			}
+			
+			void prefetch(address_t start, address_t blocks) {
+			}
+			
+			int flush() {
+				return SUCCESS;
+			}
 		
 		private:
 			block_data_t data_[BLOCK_SIZE * SIZE];
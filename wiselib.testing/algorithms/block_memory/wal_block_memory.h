@@ -0,0 +1,415 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef WAL_BLOCK_MEMORY_H
+#define WAL_BLOCK_MEMORY_H
+
+#include <util/meta.h>
+#include <algorithms/hash/fnv.h>
+
+namespace wiselib {
+	
+	/**
+	 * @brief Write-ahead log in front of a block memory, makes groups of
+	 * block writes atomic and durable.
+	 * 
+	 * Written blocks are held in RAM until commit() is called, which ends
+	 * a transaction. Committed transactions are collected into a group
+	 * (group commit) which is written to the log when GROUP_COMMITS_P
+	 * transactions have been committed or sync() is called. Only after
+	 * the log has reached the disk (the underlying block memory's flush()),
+	 * the blocks are written to their actual locations. init() replays all
+	 * complete groups in the log, so after a crash the home locations
+	 * reflect exactly the transactions that made it into the log.
+	 * 
+	 * The log occupies the last LOG_BLOCKS_P blocks of the underlying
+	 * block memory. Each log record consists of a header block (addresses,
+	 * checksum) and the full contents of the written blocks. When the log
+	 * is full, it is checkpointed: all blocks are flushed to their home
+	 * locations and the log is started over.
+	 * 
+	 * Typical use below a write back cache:
+	 * 
+	 * @code
+	 * tree.insert(k, v);
+	 * cache.flush();  // hand all dirty blocks to the WAL
+	 * cache.block_memory().commit();
+	 * @endcode
+	 * 
+	 * The cache only hands over blocks that changed, but note that it may
+	 * also write back dirty blocks on eviction at any time, so they become
+	 * part of whatever transaction is open then.
+	 * 
+	 * For a time based batching window, call sync() periodically.
+	 * 
+	 * @tparam LOG_BLOCKS_P number of blocks reserved for the log.
+	 * @tparam BATCH_BLOCKS_P number of blocks held in RAM. A single
+	 *   transaction can write at most this many (different) blocks, write()
+	 *   fails with ERR_UNSPEC beyond that. The blocks written so far stay
+	 *   staged, so the caller can either commit() them (giving up
+	 *   atomicity) and write the rest, or abort().
+	 * @tparam GROUP_COMMITS_P number of commits per group.
+	 */
+	template<
+		typename OsModel_P,
+		typename BlockMemory_P,
+		int LOG_BLOCKS_P = 1024,
+		int BATCH_BLOCKS_P = 64,
+		int GROUP_COMMITS_P = 8,
+		typename Hash_P = Fnv32<OsModel_P>
+	>
+	class WalBlockMemory : protected BlockMemory_P {
+		public:
+			typedef OsModel_P OsModel;
+			typedef typename OsModel::block_data_t block_data_t;
+			typedef typename OsModel::size_t size_type;
+			
+			typedef BlockMemory_P BlockMemory;
+			typedef typename BlockMemory::address_t address_t;
+			typedef Hash_P Hash;
+			typedef typename Hash::hash_t hash_t;
+			
+			typedef WalBlockMemory<OsModel_P, BlockMemory_P, LOG_BLOCKS_P, BATCH_BLOCKS_P, GROUP_COMMITS_P, Hash_P> self_type;
+			typedef self_type* self_pointer_t;
+			
+			enum {
+				LOG_BLOCKS = LOG_BLOCKS_P,
+				BATCH_BLOCKS = BATCH_BLOCKS_P,
+				GROUP_COMMITS = GROUP_COMMITS_P,
+				BLOCK_SIZE = BlockMemory::BLOCK_SIZE,
+				SIZE = BlockMemory::SIZE - LOG_BLOCKS,
+				BUFFER_SIZE = BlockMemory::BUFFER_SIZE,
+				NO_ADDRESS = BlockMemory::NO_ADDRESS
+			};
+			
+			enum {
+				SUCCESS = BlockMemory::SUCCESS,
+				ERR_UNSPEC = BlockMemory::ERR_UNSPEC
+			};
+			
+		private:
+			enum {
+				MAGIC = 0x57414c31, // "WAL1"
+				LOG_START = SIZE,
+				LOG_END = SIZE + LOG_BLOCKS,
+				RECORD_HEADER_SIZE = 32,
+				RECORD_BLOCKS = (BLOCK_SIZE - RECORD_HEADER_SIZE) / sizeof(address_t)
+			};
+			
+			/**
+			 * First block of the log. Records are only valid if they carry
+			 * the generation stored here.
+			 */
+			struct LogHeader {
+				::uint32_t magic;
+				::uint32_t generation;
+			};
+			
+			/**
+			 * Header block of a log record, followed by count data blocks.
+			 * A group consists of one or more records, the last one has
+			 * final set.
+			 */
+			struct RecordHeader {
+				::uint32_t magic;
+				::uint32_t generation;
+				::uint32_t group;
+				::uint16_t count;
+				::uint8_t final;
+				hash_t checksum;
+				
+				/// RECORD_BLOCKS addresses follow at RECORD_HEADER_SIZE
+				address_t* addresses() {
+					return reinterpret_cast<address_t*>(reinterpret_cast<block_data_t*>(this) + RECORD_HEADER_SIZE);
+				}
+			};
+			
+		public:
+			
+			/**
+			 * Replay the log and start a new one. The underlying block
+			 * memory has to be initialized already (see block_memory()).
+			 */
+			int init() {
+				// The largest possible group must fit into the log
+				static_assert(
+						(sizeof(RecordHeader) <= RECORD_HEADER_SIZE) &&
+						(1 + BATCH_BLOCKS + (BATCH_BLOCKS + RECORD_BLOCKS - 1) / RECORD_BLOCKS <= LOG_BLOCKS)
+				);
+				
+				size_ = 0;
+				committed_ = 0;
+				commits_ = 0;
+				
+				LogHeader &header = *reinterpret_cast<LogHeader*>(buffer_);
+				BlockMemory::read(buffer_, LOG_START);
+				if(header.magic == MAGIC) {
+					generation_ = header.generation;
+					replay();
+				}
+				else {
+					generation_ = 0;
+				}
+				return checkpoint();
+			}
+			
+			int wipe() {
+				BlockMemory::wipe();
+				return init();
+			}
+			
+			int read(block_data_t* buffer, address_t a) {
+				size_type i = find(a, 0);
+				if(i != npos) {
+					memcpy(buffer, data_[i], BLOCK_SIZE);
+					return SUCCESS;
+				}
+				return BlockMemory::read(buffer, a);
+			}
+			
+			/**
+			 * Stage the block for the current transaction.
+			 */
+			int write(block_data_t* buffer, address_t a) {
+				size_type i = find(a, committed_);
+				if(i == npos) {
+					if(size_ == BATCH_BLOCKS) {
+						if(committed_ == 0) { return ERR_UNSPEC; }
+						if(sync() != SUCCESS) { return ERR_UNSPEC; }
+					}
+					i = size_++;
+					addresses_[i] = a;
+				}
+				memcpy(data_[i], buffer, BLOCK_SIZE);
+				return SUCCESS;
+			}
+			
+			/**
+			 * End the current transaction: All blocks written since the last
+			 * commit() will be made durable together (with the next group).
+			 */
+			int commit() {
+				if(committed_ == size_) { return SUCCESS; }
+				committed_ = size_;
+				commits_++;
+				if(commits_ >= GROUP_COMMITS) {
+					return sync();
+				}
+				return SUCCESS;
+			}
+			
+			/**
+			 * Discard all blocks written since the last commit().
+			 */
+			void abort() {
+				size_ = committed_;
+			}
+			
+			/**
+			 * Write all committed transactions to the log, wait until it is
+			 * on disk and update the home locations.
+			 * On error the transactions stay staged and sync() can be
+			 * retried.
+			 */
+			int sync() {
+				if(committed_ == 0) { return SUCCESS; }
+				
+				// Only log the newest committed version of each block
+				size_type n = 0;
+				for(size_type i = 0; i < committed_; i++) {
+					if(find(addresses_[i], i + 1, committed_) == npos) {
+						order_[n++] = i;
+					}
+				}
+				
+				size_type records = (n + RECORD_BLOCKS - 1) / RECORD_BLOCKS;
+				if(log_position_ + n + records > LOG_END) {
+					if(checkpoint() != SUCCESS) { return ERR_UNSPEC; }
+				}
+				
+				// Records of a failed attempt are overwritten by the next one
+				address_t group_start = log_position_;
+				RecordHeader &header = *reinterpret_cast<RecordHeader*>(buffer_);
+				for(size_type r = 0; r < records; r++) {
+					size_type from = r * RECORD_BLOCKS;
+					size_type count = (n - from < (size_type)RECORD_BLOCKS) ? (n - from) : (size_type)RECORD_BLOCKS;
+					
+					memset(buffer_, 0, BLOCK_SIZE);
+					header.magic = MAGIC;
+					header.generation = generation_;
+					header.group = group_;
+					header.count = count;
+					header.final = (r == records - 1);
+					header.checksum = 0;
+					for(size_type j = 0; j < count; j++) {
+						size_type i = order_[from + j];
+						header.addresses()[j] = addresses_[i];
+						header.checksum = combine(header.checksum, data_[i]);
+						if(BlockMemory::write(data_[i], log_position_ + 1 + j) != SUCCESS) {
+							log_position_ = group_start;
+							return ERR_UNSPEC;
+						}
+					}
+					if(BlockMemory::write(buffer_, log_position_) != SUCCESS) {
+						log_position_ = group_start;
+						return ERR_UNSPEC;
+					}
+					log_position_ += 1 + count;
+				}
+				
+				// Barrier: the group is durable once this returns
+				if(BlockMemory::flush() != SUCCESS) {
+					log_position_ = group_start;
+					return ERR_UNSPEC;
+				}
+				group_++;
+				
+				// If this fails, the group is in the log already and stays
+				// staged, so the next sync() writes it again.
+				for(size_type j = 0; j < n; j++) {
+					if(BlockMemory::write(data_[order_[j]], addresses_[order_[j]]) != SUCCESS) {
+						return ERR_UNSPEC;
+					}
+				}
+				
+				// keep the uncommitted rest
+				for(size_type i = committed_; i < size_; i++) {
+					addresses_[i - committed_] = addresses_[i];
+					memcpy(data_[i - committed_], data_[i], BLOCK_SIZE);
+				}
+				size_ -= committed_;
+				committed_ = 0;
+				commits_ = 0;
+				return SUCCESS;
+			}
+			
+			/// Number of blocks written but not committed yet.
+			size_type uncommitted() { return size_ - committed_; }
+			
+			BlockMemory& block_memory() { return *(BlockMemory*)this; }
+			
+		private:
+			enum { npos = (size_type)(-1) };
+			
+			/**
+			 * @return index of the newest staged version of block a in
+			 * [from, to) or npos.
+			 */
+			size_type find(address_t a, size_type from, size_type to = npos) {
+				if(to == npos) { to = size_; }
+				for(size_type i = to; i > from; i--) {
+					if(addresses_[i - 1] == a) { return i - 1; }
+				}
+				return npos;
+			}
+			
+			static hash_t combine(hash_t checksum, block_data_t *data) {
+				return checksum * 31 + Hash::hash(data, BLOCK_SIZE);
+			}
+			
+			/**
+			 * Make sure all blocks are at their home locations, then start a
+			 * new log generation (invalidating all records).
+			 */
+			int checkpoint() {
+				if(BlockMemory::flush() != SUCCESS) { return ERR_UNSPEC; }
+				
+				generation_++;
+				group_ = 0;
+				log_position_ = LOG_START + 1;
+				
+				LogHeader &header = *reinterpret_cast<LogHeader*>(buffer_);
+				memset(buffer_, 0, BLOCK_SIZE);
+				header.magic = MAGIC;
+				header.generation = generation_;
+				if(BlockMemory::write(buffer_, LOG_START) != SUCCESS) { return ERR_UNSPEC; }
+				return BlockMemory::flush();
+			}
+			
+			/**
+			 * @return true iff the record at p is a complete record of the
+			 * given group.
+			 */
+			bool valid_record(address_t p, ::uint32_t group) {
+				if(p >= LOG_END) { return false; }
+				
+				RecordHeader &header = *reinterpret_cast<RecordHeader*>(buffer_);
+				BlockMemory::read(buffer_, p);
+				if(header.magic != MAGIC || header.generation != generation_ || header.group != group ||
+						header.count > RECORD_BLOCKS || p + 1 + header.count > LOG_END) {
+					return false;
+				}
+				
+				hash_t checksum = 0;
+				block_data_t data[BUFFER_SIZE];
+				for(size_type j = 0; j < header.count; j++) {
+					BlockMemory::read(data, p + 1 + j);
+					checksum = combine(checksum, data);
+				}
+				BlockMemory::read(buffer_, p);
+				return checksum == header.checksum;
+			}
+			
+			/**
+			 * Apply all complete groups in the log to the home locations.
+			 */
+			void replay() {
+				RecordHeader &header = *reinterpret_cast<RecordHeader*>(buffer_);
+				block_data_t data[BUFFER_SIZE];
+				address_t p = LOG_START + 1;
+				
+				for(::uint32_t group = 0; ; group++) {
+					// find the end of the group, checking every record
+					address_t end = p;
+					do {
+						if(!valid_record(end, group)) { return; }
+						end += 1 + header.count;
+					} while(!header.final);
+					
+					while(p < end) {
+						BlockMemory::read(buffer_, p);
+						for(size_type j = 0; j < header.count; j++) {
+							BlockMemory::read(data, p + 1 + j);
+							BlockMemory::write(data, header.addresses()[j]);
+						}
+						p += 1 + header.count;
+					}
+				}
+			}
+			
+			address_t addresses_[BATCH_BLOCKS];
+			block_data_t data_[BATCH_BLOCKS][BUFFER_SIZE];
+			size_type order_[BATCH_BLOCKS];
+			/// Number of staged blocks
+			size_type size_;
+			/// Blocks [0, committed_) are committed
+			size_type committed_;
+			/// Number of transactions in the current group
+			size_type commits_;
+			
+			::uint32_t generation_;
+			::uint32_t group_;
+			address_t log_position_;
+			block_data_t buffer_[BUFFER_SIZE];
+			
+	}; // WalBlockMemory
+}
+
+#endif // WAL_BLOCK_MEMORY_H
+
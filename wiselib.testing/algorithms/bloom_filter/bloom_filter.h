@@ -21,19 +21,93 @@
 #define BLOOM_FILTER_H
 
 #include <util/meta.h>
+#include <algorithms/hash/fnv.h>
 
 namespace wiselib {
 	
 	/**
-	 * @brief
+	 * @brief Derives k bit positions from a single hash value by double
+	 * hashing (Kirsch/Mitzenmacher): g_i = h1 + i * h2.
+	 * 
+	 * Shared by the bloom filter variants so filters built from the same
+	 * hash can be compared and combined.
+	 */
+	template<
+		typename OsModel_P,
+		typename Hash_P = Fnv32<OsModel_P>
+	>
+	class BloomFilterHashing {
+		public:
+			typedef OsModel_P OsModel;
+			typedef typename OsModel::block_data_t block_data_t;
+			typedef typename OsModel::size_t size_type;
+			typedef Hash_P Hash;
+			typedef typename Hash::hash_t hash_t;
+			
+			BloomFilterHashing(hash_t h) {
+				::uint64_t x = h;
+				h1_ = (::uint32_t)x ^ (::uint32_t)(x >> 32);
+				// second, independent looking value; odd so that all
+				// g_i differ for power of two sizes
+				h2_ = (::uint32_t)((x * 0x9e3779b97f4a7c15ULL) >> 32) | 1;
+			}
+			
+			static hash_t hash(const block_data_t* data, size_type len) {
+				return Hash::hash(data, len);
+			}
+			
+			/**
+			 * Hash the bytes of \p value. Pointers other than strings are
+			 * rejected as their address rather than what they point to
+			 * would be hashed, use hash(data, len) for those.
+			 */
+			template<typename T>
+			static hash_t hash(const T& value) {
+				static_assert((!IsPointer<T>::value));
+				return Hash::hash(reinterpret_cast<const block_data_t*>(&value), sizeof(T));
+			}
+			
+			/// Hash a 0-terminated string (without the terminator).
+			static hash_t hash(const char* s) {
+				return Hash::hash(reinterpret_cast<const block_data_t*>(s), strlen(s));
+			}
+			
+			static hash_t hash(char* s) { return hash(const_cast<const char*>(s)); }
+			
+			/// @return i-th position in [0, modulus)
+			::uint32_t position(size_type i, ::uint32_t modulus) {
+				return (h1_ + (::uint32_t)i * h2_) % modulus;
+			}
+			
+			::uint32_t h1() { return h1_; }
+			::uint32_t h2() { return h2_; }
+			
+		private:
+			::uint32_t h1_, h2_;
+	};
+	
+	/**
+	 * @brief Bloom filter with K_P hash functions.
+	 * 
+	 * The object consists of nothing but its SIZE_BYTES bytes of bit
+	 * array, so it can be put into a message as is and a received
+	 * message can be used in place via from_buffer(). Both sides must
+	 * use the same SIZE, K and Hash.
+	 * 
+	 * Values can be added as byte strings, 0-terminated strings, plain
+	 * objects (hashed bytewise, pointers are rejected at compile time)
+	 * or as a precomputed hash value of Hash_P.
 	 * 
 	 * @ingroup
 	 * 
 	 * @tparam Size_P size in bits
+	 * @tparam K_P number of hash functions (bits per value)
 	 */
 	template<
 		typename OsModel_P,
-		int Size_P = 256
+		int Size_P = 256,
+		int K_P = 3,
+		typename Hash_P = Fnv32<OsModel_P>
 	>
 	class BloomFilter {
 		
@@ -41,43 +115,131 @@ namespace wiselib {
 			typedef OsModel_P OsModel;
 			typedef typename OsModel::block_data_t block_data_t;
 			typedef typename OsModel::size_t size_type;
+			typedef Hash_P Hash;
+			typedef typename Hash::hash_t hash_t;
+			typedef BloomFilterHashing<OsModel, Hash> Hashing;
 			
-			enum { SIZE = Size_P, SIZE_BYTES = DivCeil<SIZE, 8>::value };
+			enum { SIZE = Size_P, SIZE_BYTES = DivCeil<SIZE, 8>::value, K = K_P };
 			
-			typedef BloomFilter<OsModel, SIZE> self_type;
+			typedef BloomFilter<OsModel, SIZE, K, Hash> self_type;
+			typedef self_type* self_pointer_t;
 			
 			static self_type* create() {
 				self_type *r = reinterpret_cast<self_type*>(
-						::get_allocator().template allocate_array<block_data_t>(SIZE_BYTES)
+						::get_allocator().template allocate_array<block_data_t>(SIZE_BYTES) .raw()
 				);
 				r->clear();
+				return r;
+			}
+			
+			/**
+			 * Use \p buffer (e.g. a received message) of SIZE_BYTES bytes as
+			 * filter without copying.
+			 */
+			static self_type* from_buffer(block_data_t* buffer) {
+				return reinterpret_cast<self_type*>(buffer);
 			}
 			
 			void destroy() {
 				::get_allocator().free_array(reinterpret_cast<block_data_t*>(this));
 			}
 			
-			void add(size_type v) {
-				v %= SIZE;
-				data_[byte(v)] |= (1 << bit(v));
+			void add_hash(hash_t h) {
+				Hashing g(h);
+				for(size_type i = 0; i < K; i++) {
+					set(g.position(i, SIZE));
+				}
 			}
 			
-			void operator|=(self_type& other) {
-				for(size_type i = 0; i < SIZE; i++) {
+			bool contains_hash(hash_t h) {
+				Hashing g(h);
+				for(size_type i = 0; i < K; i++) {
+					if(!get(g.position(i, SIZE))) { return false; }
+				}
+				return true;
+			}
+			
+			void add(const block_data_t* data, size_type len) { add_hash(Hashing::hash(data, len)); }
+			bool contains(const block_data_t* data, size_type len) { return contains_hash(Hashing::hash(data, len)); }
+			
+			template<typename T>
+			void add(const T& value) { add_hash(Hashing::hash(value)); }
+			
+			template<typename T>
+			bool contains(const T& value) { return contains_hash(Hashing::hash(value)); }
+			
+			/// Union: afterwards contains everything either filter contains.
+			self_type& operator|=(const self_type& other) {
+				for(size_type i = 0; i < SIZE_BYTES; i++) {
 					data_[i] |= other.data_[i];
 				}
+				return *this;
+			}
+			
+			/**
+			 * Intersection: afterwards contains at least the values both
+			 * filters contain. Values contained in only one of them may
+			 * still test positive, at most as often as with the union.
+			 */
+			self_type& operator&=(const self_type& other) {
+				for(size_type i = 0; i < SIZE_BYTES; i++) {
+					data_[i] &= other.data_[i];
+				}
+				return *this;
+			}
+			
+			bool operator==(const self_type& other) const {
+				return memcmp(data_, other.data_, SIZE_BYTES) == 0;
 			}
 			
+			bool operator!=(const self_type& other) const { return !(*this == other); }
+			
 			void clear() {
 				memset(data_, 0x00, SIZE_BYTES);
 			}
+			
+			bool empty() const {
+				for(size_type i = 0; i < SIZE_BYTES; i++) {
+					if(data_[i]) { return false; }
+				}
+				return true;
+			}
+			
+			/// @return number of bits set
+			size_type count() const {
+				size_type r = 0;
+				for(size_type i = 0; i < SIZE_BYTES; i++) {
+					r += __builtin_popcount(data_[i]);
+				}
+				return r;
+			}
+			
+			block_data_t* data() { return data_; }
+			size_type size_bytes() const { return SIZE_BYTES; }
+			
+			/**
+			 * Write the filter into \p buffer (SIZE_BYTES bytes).
+			 * @return number of bytes written.
+			 */
+			size_type write(block_data_t* buffer) const {
+				memcpy(buffer, data_, SIZE_BYTES);
+				return SIZE_BYTES;
+			}
+			
+			size_type read(const block_data_t* buffer) {
+				memcpy(data_, buffer, SIZE_BYTES);
+				return SIZE_BYTES;
+			}
+			
+			void set(size_type n) { data_[byte(n)] |= (1 << bit(n)); }
+			bool get(size_type n) const { return data_[byte(n)] & (1 << bit(n)); }
 		
 		private:
 			
 			static size_type byte(size_type n) { return n / 8; }
 			static size_type bit(size_type n) { return n % 8; }
 			
-			block_data_t data_[0];
+			block_data_t data_[SIZE_BYTES];
 		
 	}; // BloomFilter
 }
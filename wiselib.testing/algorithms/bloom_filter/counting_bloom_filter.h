@@ -0,0 +1,192 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef COUNTING_BLOOM_FILTER_H
+#define COUNTING_BLOOM_FILTER_H
+
+#include <util/meta.h>
+#include <algorithms/hash/fnv.h>
+#include <algorithms/bloom_filter/bloom_filter.h>
+
+namespace wiselib {
+	
+	/**
+	 * @brief Counting bloom filter, supports removal of values.
+	 * 
+	 * Every position has a 4 bit counter instead of a bit. Counters
+	 * saturate at 15 and are never decremented afterwards, so removal
+	 * can not introduce false negatives (as long as only values that
+	 * were added are erased).
+	 * 
+	 * Uses the same positions as BloomFilter with equal size, K and
+	 * Hash, so the compact bit filter to send to other nodes is
+	 * obtained with to_bloom_filter().
+	 * 
+	 * @ingroup
+	 * 
+	 * @tparam Size_P number of counters
+	 */
+	template<
+		typename OsModel_P,
+		int Size_P = 256,
+		int K_P = 3,
+		typename Hash_P = Fnv32<OsModel_P>
+	>
+	class CountingBloomFilter {
+		
+		public:
+			typedef OsModel_P OsModel;
+			typedef typename OsModel::block_data_t block_data_t;
+			typedef typename OsModel::size_t size_type;
+			typedef Hash_P Hash;
+			typedef typename Hash::hash_t hash_t;
+			typedef BloomFilterHashing<OsModel, Hash> Hashing;
+			typedef BloomFilter<OsModel, Size_P, K_P, Hash_P> bloom_filter_t;
+			
+			enum {
+				SIZE = Size_P,
+				SIZE_BYTES = DivCeil<SIZE, 2>::value,
+				K = K_P,
+				MAX_COUNT = 15
+			};
+			
+			typedef CountingBloomFilter<OsModel, SIZE, K, Hash> self_type;
+			typedef self_type* self_pointer_t;
+			
+			static self_type* create() {
+				self_type *r = reinterpret_cast<self_type*>(
+						::get_allocator().template allocate_array<block_data_t>(SIZE_BYTES) .raw()
+				);
+				r->clear();
+				return r;
+			}
+			
+			static self_type* from_buffer(block_data_t* buffer) {
+				return reinterpret_cast<self_type*>(buffer);
+			}
+			
+			void destroy() {
+				::get_allocator().free_array(reinterpret_cast<block_data_t*>(this));
+			}
+			
+			void add_hash(hash_t h) {
+				Hashing g(h);
+				for(size_type i = 0; i < K; i++) {
+					size_type p = g.position(i, SIZE);
+					::uint8_t c = counter(p);
+					if(c < MAX_COUNT) { set_counter(p, c + 1); }
+				}
+			}
+			
+			/**
+			 * Remove a value that has been added before.
+			 */
+			void erase_hash(hash_t h) {
+				Hashing g(h);
+				for(size_type i = 0; i < K; i++) {
+					size_type p = g.position(i, SIZE);
+					::uint8_t c = counter(p);
+					if(c > 0 && c < MAX_COUNT) { set_counter(p, c - 1); }
+				}
+			}
+			
+			bool contains_hash(hash_t h) {
+				Hashing g(h);
+				for(size_type i = 0; i < K; i++) {
+					if(!counter(g.position(i, SIZE))) { return false; }
+				}
+				return true;
+			}
+			
+			void add(const block_data_t* data, size_type len) { add_hash(Hashing::hash(data, len)); }
+			void erase(const block_data_t* data, size_type len) { erase_hash(Hashing::hash(data, len)); }
+			bool contains(const block_data_t* data, size_type len) { return contains_hash(Hashing::hash(data, len)); }
+			
+			template<typename T>
+			void add(const T& value) { add_hash(Hashing::hash(value)); }
+			
+			template<typename T>
+			void erase(const T& value) { erase_hash(Hashing::hash(value)); }
+			
+			template<typename T>
+			bool contains(const T& value) { return contains_hash(Hashing::hash(value)); }
+			
+			/// Multiset union: counters are added (saturating).
+			self_type& operator|=(const self_type& other) {
+				for(size_type i = 0; i < SIZE; i++) {
+					::uint8_t c = counter(i) + other.counter(i);
+					set_counter(i, c > MAX_COUNT ? MAX_COUNT : c);
+				}
+				return *this;
+			}
+			
+			/// Multiset intersection: minimum of the counters.
+			self_type& operator&=(const self_type& other) {
+				for(size_type i = 0; i < SIZE; i++) {
+					::uint8_t a = counter(i), b = other.counter(i);
+					set_counter(i, a < b ? a : b);
+				}
+				return *this;
+			}
+			
+			/**
+			 * Set \p filter to the plain bloom filter of the current set.
+			 */
+			void to_bloom_filter(bloom_filter_t& filter) const {
+				filter.clear();
+				for(size_type i = 0; i < SIZE; i++) {
+					if(counter(i)) { filter.set(i); }
+				}
+			}
+			
+			void clear() {
+				memset(data_, 0x00, SIZE_BYTES);
+			}
+			
+			::uint8_t counter(size_type n) const {
+				return (data_[n / 2] >> ((n % 2) * 4)) & 0x0f;
+			}
+			
+			block_data_t* data() { return data_; }
+			size_type size_bytes() const { return SIZE_BYTES; }
+			
+			size_type write(block_data_t* buffer) const {
+				memcpy(buffer, data_, SIZE_BYTES);
+				return SIZE_BYTES;
+			}
+			
+			size_type read(const block_data_t* buffer) {
+				memcpy(data_, buffer, SIZE_BYTES);
+				return SIZE_BYTES;
+			}
+		
+		private:
+			
+			void set_counter(size_type n, ::uint8_t c) {
+				size_type shift = (n % 2) * 4;
+				data_[n / 2] = (data_[n / 2] & ~(0x0f << shift)) | (c << shift);
+			}
+			
+			block_data_t data_[SIZE_BYTES];
+		
+	}; // CountingBloomFilter
+}
+
+#endif // COUNTING_BLOOM_FILTER_H
+
@@ -0,0 +1,553 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef CANONICAL_HUFFMAN_CODEC_H
+#define CANONICAL_HUFFMAN_CODEC_H
+
+#include <util/meta.h>
+
+namespace wiselib {
+	
+	/**
+	 * @brief Canonical Huffman codec with table driven decoding.
+	 * 
+	 * Drop-in replacement for HuffmanCodec (e.g. in CodecTupleStore):
+	 * encode() and decode() take a zero terminated string and return a
+	 * newly allocated, zero terminated one.
+	 * 
+	 * Codes are canonical, so a code table is fully described by the
+	 * code length of each byte value. Table DEFAULT_TABLE is built in (a
+	 * rough distribution of english text and URIs), up to TABLES_P - 1
+	 * further tables can be trained from sample strings (e.g. the
+	 * contents of a tuple store) via Trainer and train(), or loaded with
+	 * read_table(). Each encoded string starts with the id of the table it
+	 * was encoded with, so data encoded with different tables can be
+	 * mixed; a table must not be changed while data encoded with it is
+	 * still around.
+	 * 
+	 * Encoded layout, before stuffing:
+	 * [table id] [symbol count, 7 bits per byte] [codes, MSB first]
+	 * The result is COBS stuffed so it contains no zero bytes and can be
+	 * handled as a string by dictionaries.
+	 * 
+	 * Codes are written through a bit accumulator and decoded by looking
+	 * up LOOKUP_BITS_P bits at a time in a table of 2^LOOKUP_BITS_P
+	 * entries, only codes longer than that take a slower canonical
+	 * decoding path. Each table takes about
+	 * 2^(LOOKUP_BITS_P + 1) + 900 bytes of RAM.
+	 * 
+	 * @ingroup codec_concept
+	 * 
+	 * @tparam LOOKUP_BITS_P bits decoded per table lookup (8-12 is
+	 *   a sensible range).
+	 * @tparam TABLES_P number of code tables including the built in one.
+	 */
+	template<
+		typename OsModel_P,
+		int LOOKUP_BITS_P = 9,
+		int TABLES_P = 2
+	>
+	class CanonicalHuffmanCodec {
+		public:
+			typedef OsModel_P OsModel;
+			typedef typename OsModel::block_data_t block_data_t;
+			typedef typename OsModel::size_t size_type;
+			typedef CanonicalHuffmanCodec<OsModel, LOOKUP_BITS_P, TABLES_P> self_type;
+			
+			enum {
+				SUCCESS = OsModel::SUCCESS,
+				ERR_UNSPEC = OsModel::ERR_UNSPEC
+			};
+			
+			enum {
+				SYMBOLS = 256,
+				MAX_CODE_LENGTH = 15,
+				LOOKUP_BITS = LOOKUP_BITS_P,
+				TABLES = TABLES_P,
+				DEFAULT_TABLE = 0,
+				/// Size of a serialized table (4 bits per code length)
+				TABLE_SIZE = SYMBOLS / 2
+			};
+			
+			static_assert((LOOKUP_BITS_P >= 1 && LOOKUP_BITS_P <= MAX_CODE_LENGTH && TABLES_P >= 1 && TABLES_P <= 256));
+			
+			/**
+			 * @brief Collects byte frequencies of sample strings for train().
+			 */
+			class Trainer {
+				public:
+					Trainer() { clear(); }
+					
+					void clear() {
+						for(size_type i = 0; i < SYMBOLS; i++) { counts_[i] = 0; }
+					}
+					
+					void add(const block_data_t* s, size_type len) {
+						for(size_type i = 0; i < len; i++) { counts_[s[i]]++; }
+					}
+					
+					/// Add a zero terminated string.
+					void add(const block_data_t* s) {
+						if(!s) { return; }
+						for( ; *s; s++) { counts_[*s]++; }
+					}
+					
+					/**
+					 * Add all values of the columns in mask of all tuples
+					 * in the given (uncompressed) tuple store.
+					 */
+					template<typename TupleStore>
+					void add_tuple_store(TupleStore& ts, int mask) {
+						for(typename TupleStore::iterator it = ts.begin(); it != ts.end(); ++it) {
+							for(size_type i = 0; i < (size_type)TupleStore::COLUMNS; i++) {
+								if(mask & (1 << i)) { add((*it).get(i)); }
+							}
+						}
+					}
+					
+					::uint32_t count(size_type symbol) const { return counts_[symbol]; }
+					
+				private:
+					::uint32_t counts_[SYMBOLS];
+			};
+			
+			/**
+			 * Build table id from the frequencies collected by trainer.
+			 * The built in table can not be replaced.
+			 */
+			static int train(::uint8_t id, const Trainer& trainer) {
+				if(id == DEFAULT_TABLE || id >= TABLES) { return ERR_UNSPEC; }
+				
+				::uint32_t freq[SYMBOLS];
+				for(size_type i = 0; i < SYMBOLS; i++) { freq[i] = trainer.count(i); }
+				build_lengths(freq, tables_[id].length_);
+				return build_table(tables_[id]);
+			}
+			
+			/// Select the table encode() uses.
+			static int use_table(::uint8_t id) {
+				if(id >= TABLES || !table(id).valid_) { return ERR_UNSPEC; }
+				encode_table_ = id;
+				return SUCCESS;
+			}
+			
+			static ::uint8_t current_table() { return encode_table_; }
+			
+			/**
+			 * Serialize table id into TABLE_SIZE bytes at buffer so it
+			 * can be stored along with data encoded by it.
+			 */
+			static int write_table(::uint8_t id, block_data_t* buffer) {
+				if(id >= TABLES || !table(id).valid_) { return ERR_UNSPEC; }
+				const ::uint8_t *l = table(id).length_;
+				for(size_type i = 0; i < TABLE_SIZE; i++) {
+					buffer[i] = (l[2 * i] << 4) | l[2 * i + 1];
+				}
+				return SUCCESS;
+			}
+			
+			/**
+			 * Load a table written by write_table() as table id.
+			 * If buffer does not hold a valid table, table id is left
+			 * unchanged.
+			 */
+			static int read_table(::uint8_t id, const block_data_t* buffer) {
+				if(id == DEFAULT_TABLE || id >= TABLES) { return ERR_UNSPEC; }
+				::uint8_t length[SYMBOLS];
+				for(size_type i = 0; i < TABLE_SIZE; i++) {
+					length[2 * i] = buffer[i] >> 4;
+					length[2 * i + 1] = buffer[i] & 0x0f;
+				}
+				if(check_lengths(length) != SUCCESS) { return ERR_UNSPEC; }
+				
+				Table &t = tables_[id];
+				memcpy(t.length_, length, SYMBOLS);
+				return build_table(t);
+			}
+			
+			static block_data_t* encode(block_data_t* in) {
+				return encode(in, encode_table_);
+			}
+			
+			static block_data_t* encode(block_data_t* in, ::uint8_t id) {
+				if(id >= TABLES) { return 0; }
+				const Table &t = table(id);
+				if(!t.valid_) { return 0; }
+				
+				size_type n = 0;
+				::uint32_t bits = 0;
+				for(const block_data_t *p = in; *p; p++, n++) { bits += t.length_[*p]; }
+				
+				size_type raw = 1 + varint_size(n) + (bits + 7) / 8;
+				size_type overhead = raw / 254 + 1;
+				block_data_t *out = ::get_allocator().template allocate_array<block_data_t>(overhead + raw + 1) .raw();
+				
+				// Write unstuffed data behind the space stuffing may
+				// need, then stuff in place.
+				block_data_t *w = out + overhead;
+				*w++ = id;
+				for(size_type v = n; ; v >>= 7) {
+					if(v < 0x80) { *w++ = v; break; }
+					*w++ = (v & 0x7f) | 0x80;
+				}
+				
+				::uint32_t acc = 0;
+				::uint8_t fill = 0;
+				for(const block_data_t *p = in; *p; p++) {
+					::uint8_t len = t.length_[*p];
+					acc = (acc << len) | t.code_[*p];
+					fill += len;
+					while(fill >= 8) {
+						fill -= 8;
+						*w++ = acc >> fill;
+					}
+				}
+				if(fill) { *w++ = acc << (8 - fill); }
+				
+				cobs_stuff(out + overhead, raw, out);
+				return out;
+			}
+			
+			/**
+			 * @return decoded string or NULL if the table of in is not
+			 * available or in is corrupt.
+			 */
+			static block_data_t* decode(block_data_t* in) {
+				BitReader r(in);
+				
+				::uint8_t id;
+				if(!r.next_byte(id) || id >= TABLES) { return 0; }
+				const Table &t = table(id);
+				if(!t.valid_) { return 0; }
+				
+				size_type n = 0;
+				for(size_type shift = 0; ; shift += 7) {
+					::uint8_t b;
+					if(shift >= 7 * sizeof(size_type) || !r.next_byte(b)) { return 0; }
+					n |= (size_type)(b & 0x7f) << shift;
+					if(!(b & 0x80)) { break; }
+				}
+				// Every code takes at least one bit
+				if(n > 8 * r.bytes_left()) { return 0; }
+				
+				block_data_t *out = ::get_allocator().template allocate_array<block_data_t>(n + 1) .raw();
+				if(!out) { return 0; }
+				r.start_bits();
+				for(size_type i = 0; i < n; i++) {
+					::uint16_t e = t.lookup_[r.peek(LOOKUP_BITS)];
+					if(e) {
+						out[i] = e & 0xff;
+						r.consume(e >> 8);
+						continue;
+					}
+					
+					// code longer than LOOKUP_BITS
+					::uint8_t len = LOOKUP_BITS + 1;
+					for( ; len <= MAX_CODE_LENGTH; len++) {
+						::uint16_t d = r.peek(len) - t.first_code_[len];
+						if(d < t.count_[len]) {
+							out[i] = t.sorted_[t.first_index_[len] + d];
+							r.consume(len);
+							break;
+						}
+					}
+					if(len > MAX_CODE_LENGTH) {
+						::get_allocator().free_array(out);
+						return 0;
+					}
+				}
+				out[n] = '\0';
+				return out;
+			}
+			
+		private:
+			struct Table {
+				::uint8_t length_[SYMBOLS];
+				::uint16_t code_[SYMBOLS];
+				/// symbol | length << 8, 0 for codes longer than LOOKUP_BITS
+				::uint16_t lookup_[1 << LOOKUP_BITS];
+				::uint16_t first_code_[MAX_CODE_LENGTH + 1];
+				::uint16_t first_index_[MAX_CODE_LENGTH + 1];
+				::uint16_t count_[MAX_CODE_LENGTH + 1];
+				/// symbols ordered by (length, value)
+				::uint8_t sorted_[SYMBOLS];
+				bool valid_;
+			};
+			
+			/**
+			 * Reads bits MSB first from COBS stuffed data, past the end
+			 * of the data it delivers zeros.
+			 */
+			class BitReader {
+				public:
+					BitReader(const block_data_t* p) : p_(p), buffer_(0), fill_(0) {
+						left_ = 0;
+						zero_ = false;
+						if(*p_) { start_block(); }
+					}
+					
+					bool next_byte(::uint8_t& b) {
+						while(!left_) {
+							if(!*p_) { return false; }
+							bool z = zero_;
+							start_block();
+							if(z) { b = 0; return true; }
+						}
+						b = *p_++;
+						left_--;
+						return true;
+					}
+					
+					void start_bits() { refill(); }
+					
+					/// @return upper bound for the number of bytes left
+					size_type bytes_left() {
+						return strlen((const char*)p_);
+					}
+					
+					::uint16_t peek(::uint8_t bits) {
+						return buffer_ >> (32 - bits);
+					}
+					
+					void consume(::uint8_t bits) {
+						buffer_ <<= bits;
+						fill_ -= bits;
+						refill();
+					}
+					
+				private:
+					void start_block() {
+						::uint8_t code = *p_++;
+						left_ = code - 1;
+						zero_ = (code != 0xff);
+					}
+					
+					void refill() {
+						while(fill_ <= 24) {
+							::uint8_t b;
+							if(!next_byte(b)) { b = 0; }
+							buffer_ |= (::uint32_t)b << (24 - fill_);
+							fill_ += 8;
+						}
+					}
+					
+					const block_data_t *p_;
+					::uint32_t buffer_;
+					::uint8_t fill_;
+					::uint8_t left_;
+					bool zero_;
+			};
+			
+			static const Table& table(::uint8_t id) {
+				if(id == DEFAULT_TABLE && !tables_[DEFAULT_TABLE].valid_) {
+					::uint32_t freq[SYMBOLS];
+					for(size_type i = 0; i < SYMBOLS; i++) {
+						freq[i] = (i >= 32 && i < 127) ? 16 * default_weights_[i - 32] : 0;
+					}
+					build_lengths(freq, tables_[DEFAULT_TABLE].length_);
+					build_table(tables_[DEFAULT_TABLE]);
+				}
+				return tables_[id];
+			}
+			
+			static size_type varint_size(size_type v) {
+				size_type r = 1;
+				for( ; v >= 0x80; v >>= 7) { r++; }
+				return r;
+			}
+			
+			/**
+			 * COBS encode len bytes from src to dst. dst may overlap src
+			 * as long as dst + len / 254 + 1 <= src.
+			 * Appends a terminating zero.
+			 */
+			static void cobs_stuff(const block_data_t* src, size_type len, block_data_t* dst) {
+				block_data_t *code_pos = dst++;
+				::uint8_t code = 1;
+				for(size_type i = 0; i < len; i++) {
+					block_data_t b = src[i];
+					if(b) {
+						*dst++ = b;
+						code++;
+					}
+					if(!b || code == 0xff) {
+						*code_pos = code;
+						code_pos = dst++;
+						code = 1;
+					}
+				}
+				*code_pos = code;
+				*dst = 0;
+			}
+			
+			/**
+			 * Huffman code lengths for freq, limited to MAX_CODE_LENGTH by
+			 * flattening the distribution until the tree is shallow
+			 * enough. Every symbol gets a code.
+			 */
+			static void build_lengths(::uint32_t* freq, ::uint8_t* length) {
+				enum { NODES = 2 * SYMBOLS - 1 };
+				::uint8_t order[SYMBOLS];
+				::uint32_t weight[NODES];
+				::uint16_t parent[NODES];
+				::uint8_t depth[NODES];
+				
+				for(size_type i = 0; i < SYMBOLS; i++) {
+					if(!freq[i]) { freq[i] = 1; }
+				}
+				
+				while(true) {
+					// leaves sorted by frequency (insertion sort, stable)
+					for(size_type i = 0; i < SYMBOLS; i++) {
+						size_type j = i;
+						for( ; j > 0 && freq[order[j - 1]] > freq[i]; j--) {
+							order[j] = order[j - 1];
+						}
+						order[j] = i;
+					}
+					for(size_type i = 0; i < SYMBOLS; i++) { weight[i] = freq[order[i]]; }
+					
+					// two queue construction: internal nodes are created
+					// in non-decreasing weight order
+					size_type leaf = 0, inner = SYMBOLS;
+					for(size_type next = SYMBOLS; next < NODES; next++) {
+						for(int k = 0; k < 2; k++) {
+							size_type pick;
+							if(leaf < SYMBOLS && (inner >= next || weight[leaf] <= weight[inner])) { pick = leaf++; }
+							else { pick = inner++; }
+							parent[pick] = next;
+							weight[next] = k ? weight[next] + weight[pick] : weight[pick];
+						}
+					}
+					
+					depth[NODES - 1] = 0;
+					for(size_type i = NODES - 1; i-- > SYMBOLS; ) {
+						depth[i] = depth[parent[i]] + 1;
+					}
+					::uint8_t max = 0;
+					for(size_type i = 0; i < SYMBOLS; i++) {
+						::uint8_t d = depth[parent[i]] + 1;
+						length[order[i]] = d;
+						if(d > max) { max = d; }
+					}
+					if(max <= MAX_CODE_LENGTH) { break; }
+					
+					for(size_type i = 0; i < SYMBOLS; i++) { freq[i] = (freq[i] >> 1) | 1; }
+				}
+			}
+			
+			/**
+			 * Check that length assigns every symbol a code of at most
+			 * MAX_CODE_LENGTH bits and the codes fit into a prefix code.
+			 */
+			static int check_lengths(const ::uint8_t* length) {
+				::uint16_t count[MAX_CODE_LENGTH + 1];
+				for(size_type l = 0; l <= MAX_CODE_LENGTH; l++) { count[l] = 0; }
+				for(size_type i = 0; i < SYMBOLS; i++) {
+					if(!length[i] || length[i] > MAX_CODE_LENGTH) { return ERR_UNSPEC; }
+					count[length[i]]++;
+				}
+				
+				::uint32_t code = 0;
+				for(size_type l = 1; l <= MAX_CODE_LENGTH; l++) {
+					if(code + count[l] > ((::uint32_t)1 << l)) { return ERR_UNSPEC; }
+					code = (code + count[l]) << 1;
+				}
+				return SUCCESS;
+			}
+			
+			/**
+			 * Assign canonical codes to the lengths in t and fill the
+			 * decoding tables.
+			 */
+			static int build_table(Table& t) {
+				t.valid_ = false;
+				for(size_type l = 0; l <= MAX_CODE_LENGTH; l++) { t.count_[l] = 0; }
+				for(size_type i = 0; i < SYMBOLS; i++) {
+					// every byte value must be encodable
+					if(!t.length_[i] || t.length_[i] > MAX_CODE_LENGTH) { return ERR_UNSPEC; }
+					t.count_[t.length_[i]]++;
+				}
+				
+				::uint32_t code = 0;
+				::uint16_t index = 0;
+				for(size_type l = 1; l <= MAX_CODE_LENGTH; l++) {
+					if(code + t.count_[l] > ((::uint32_t)1 << l)) { return ERR_UNSPEC; }
+					t.first_code_[l] = code;
+					t.first_index_[l] = index;
+					index += t.count_[l];
+					code = (code + t.count_[l]) << 1;
+				}
+				
+				::uint16_t next[MAX_CODE_LENGTH + 1];
+				for(size_type l = 1; l <= MAX_CODE_LENGTH; l++) { next[l] = 0; }
+				for(size_type i = 0; i < (1 << LOOKUP_BITS); i++) { t.lookup_[i] = 0; }
+				
+				for(size_type i = 0; i < SYMBOLS; i++) {
+					::uint8_t l = t.length_[i];
+					::uint16_t rank = next[l]++;
+					t.code_[i] = t.first_code_[l] + rank;
+					t.sorted_[t.first_index_[l] + rank] = i;
+					
+					if(l <= LOOKUP_BITS) {
+						size_type base = (size_type)t.code_[i] << (LOOKUP_BITS - l);
+						size_type n = (size_type)1 << (LOOKUP_BITS - l);
+						for(size_type j = 0; j < n; j++) {
+							t.lookup_[base + j] = i | ((::uint16_t)l << 8);
+						}
+					}
+				}
+				
+				t.valid_ = true;
+				return SUCCESS;
+			}
+			
+			static Table tables_[TABLES_P];
+			static ::uint8_t encode_table_;
+			static const ::uint8_t default_weights_[95];
+	};
+	
+	template<typename OsModel_P, int LOOKUP_BITS_P, int TABLES_P>
+	typename CanonicalHuffmanCodec<OsModel_P, LOOKUP_BITS_P, TABLES_P>::Table
+		CanonicalHuffmanCodec<OsModel_P, LOOKUP_BITS_P, TABLES_P>::tables_[TABLES_P];
+	
+	template<typename OsModel_P, int LOOKUP_BITS_P, int TABLES_P>
+	::uint8_t CanonicalHuffmanCodec<OsModel_P, LOOKUP_BITS_P, TABLES_P>::encode_table_ = 0;
+	
+	/// Rough character weights of english text and URIs for ' ' .. '~'
+	template<typename OsModel_P, int LOOKUP_BITS_P, int TABLES_P>
+	const ::uint8_t CanonicalHuffmanCodec<OsModel_P, LOOKUP_BITS_P, TABLES_P>::default_weights_[95] = {
+		//  !   "   #   $   %   &   '   (   )   *   +   ,   -   .   /
+		40, 2, 12, 20, 1, 4, 6, 3, 2, 2, 1, 2, 6, 15, 40, 60,
+		//0  1   2   3   4   5   6   7   8   9   :   ;   <   =   >   ?
+		20, 20, 16, 12, 10, 10, 10, 9, 9, 9, 25, 2, 10, 6, 10, 3,
+		//@ A  B  C  D  E  F  G  H  I  J  K  L  M  N  O
+		4, 8, 6, 7, 6, 8, 5, 4, 5, 7, 2, 2, 5, 6, 6, 6,
+		//P Q  R  S  T  U  V  W  X  Y  Z  [  \  ]  ^  _
+		8, 1, 7, 8, 8, 4, 3, 4, 2, 2, 1, 1, 1, 1, 1, 15,
+		//` a   b   c   d   e    f   g   h   i   j  k  l   m   n   o
+		1, 65, 12, 27, 34, 100, 18, 16, 40, 56, 2, 5, 32, 20, 54, 60,
+		//p q  r   s   t   u   v  w   x  y   z  {  |  }  ~
+		19, 2, 47, 50, 72, 22, 8, 12, 3, 13, 2, 1, 1, 1, 2
+	};
+	
+} // namespace wiselib
+
+#endif // CANONICAL_HUFFMAN_CODEC_H
+
@@ -0,0 +1,489 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef SYMBOL_TABLE_CODEC_H
+#define SYMBOL_TABLE_CODEC_H
+
+#include <util/meta.h>
+
+namespace wiselib {
+	
+	/**
+	 * @brief String codec replacing frequent substrings by one byte codes
+	 * (FSST style static symbol table).
+	 * 
+	 * A table of up to 254 symbols of 1 .. MAX_SYMBOL_LENGTH_P bytes is
+	 * either trained from sample strings with train() /
+	 * train_tuple_store() or, until then, a built in table of common URI
+	 * parts and english letter pairs is used. Encoding greedily replaces
+	 * the longest matching symbol by its code 1 .. 254, bytes not covered
+	 * by any symbol are written as ESCAPE followed by the byte itself.
+	 * As input strings contain no zero bytes, neither does the output, so
+	 * encoded values can be stored in dictionaries as strings.
+	 * 
+	 * Every value is decoded on its own (no shared state between values)
+	 * and encoding is deterministic, so two encoded values are equal iff
+	 * the original values are: equal() / compare() can be used on
+	 * compressed values directly, e.g. for lookups in a CodecTupleStore.
+	 * The order of compressed values does not follow the order of the
+	 * original ones.
+	 * 
+	 * The table is shared by all users of the codec: train or load it
+	 * (read_table()) before encoding the first value and keep it
+	 * (write_table()) as long as encoded data exists.
+	 * 
+	 * @ingroup codec_concept
+	 */
+	template<
+		typename OsModel_P,
+		int MAX_SYMBOL_LENGTH_P = 8
+	>
+	class SymbolTableCodec {
+		public:
+			typedef OsModel_P OsModel;
+			typedef typename OsModel::block_data_t block_data_t;
+			typedef typename OsModel::size_t size_type;
+			typedef SymbolTableCodec<OsModel, MAX_SYMBOL_LENGTH_P> self_type;
+			
+			enum {
+				SUCCESS = OsModel::SUCCESS,
+				ERR_UNSPEC = OsModel::ERR_UNSPEC
+			};
+			
+			enum {
+				SYMBOLS = 254,
+				MAX_SYMBOL_LENGTH = MAX_SYMBOL_LENGTH_P,
+				ESCAPE = 0xff,
+				/// Number of training passes over the sample
+				GENERATIONS = 5
+			};
+			
+			static_assert((MAX_SYMBOL_LENGTH_P >= 1 && MAX_SYMBOL_LENGTH_P <= 255));
+			
+			static block_data_t* encode(block_data_t* in) {
+				ensure_table();
+				size_type l = strlen(reinterpret_cast<char*>(in));
+				size_type sz = encode_internal(in, l, 0);
+				block_data_t *out = ::get_allocator().template allocate_array<block_data_t>(sz + 1) .raw();
+				encode_internal(in, l, out);
+				out[sz] = '\0';
+				return out;
+			}
+			
+			static block_data_t* decode(block_data_t* in) {
+				size_type sz = decoded_length(in);
+				block_data_t *out = ::get_allocator().template allocate_array<block_data_t>(sz + 1) .raw();
+				decode(in, out);
+				return out;
+			}
+			
+			/**
+			 * Decode into out which must provide decoded_length(in) + 1
+			 * bytes.
+			 */
+			static void decode(const block_data_t* in, block_data_t* out) {
+				ensure_table();
+				for( ; *in; in++) {
+					if(*in == ESCAPE) {
+						if(!*++in) { break; }
+						*out++ = *in;
+					}
+					else {
+						const block_data_t *s = symbols_[*in - 1];
+						for(::uint8_t i = 0; i < length_[*in - 1]; i++) { *out++ = s[i]; }
+					}
+				}
+				*out = '\0';
+			}
+			
+			static size_type decoded_length(const block_data_t* in) {
+				ensure_table();
+				size_type r = 0;
+				for( ; *in; in++) {
+					if(*in == ESCAPE) {
+						if(!*++in) { break; }
+						r++;
+					}
+					else { r += length_[*in - 1]; }
+				}
+				return r;
+			}
+			
+			/// Compare encoded values, 0 iff the decoded values are equal.
+			static int compare(const block_data_t* a, const block_data_t* b) {
+				return strcmp(reinterpret_cast<const char*>(a), reinterpret_cast<const char*>(b));
+			}
+			
+			static bool equal(const block_data_t* a, const block_data_t* b) {
+				return compare(a, b) == 0;
+			}
+			
+			/**
+			 * Train the symbol table on the zero terminated strings
+			 * in [first, last). The sample is passed over GENERATIONS
+			 * times. Needs about 1 MB of temporary memory, so it is
+			 * meant to run on a PC / gateway; the result can be shipped
+			 * to other nodes with write_table() / read_table().
+			 */
+			template<typename Iterator>
+			static int train(Iterator first, Iterator last) {
+				Trainer t;
+				if(!t.init()) { return ERR_UNSPEC; }
+				for(::uint8_t g = 0; g < GENERATIONS; g++) {
+					for(Iterator it = first; it != last; ++it) { t.add(*it); }
+					t.next_generation();
+				}
+				t.destruct();
+				return SUCCESS;
+			}
+			
+			/**
+			 * Train on the columns in mask of all tuples in the given
+			 * (uncompressed) tuple store.
+			 */
+			template<typename TupleStore>
+			static int train_tuple_store(TupleStore& ts, int mask) {
+				Trainer t;
+				if(!t.init()) { return ERR_UNSPEC; }
+				for(::uint8_t g = 0; g < GENERATIONS; g++) {
+					for(typename TupleStore::iterator it = ts.begin(); it != ts.end(); ++it) {
+						for(size_type i = 0; i < (size_type)TupleStore::COLUMNS; i++) {
+							if(mask & (1 << i)) { t.add((*it).get(i)); }
+						}
+					}
+					t.next_generation();
+				}
+				t.destruct();
+				return SUCCESS;
+			}
+			
+			/// Number of bytes write_table() needs.
+			static size_type table_size() {
+				ensure_table();
+				size_type r = 1;
+				for(size_type i = 0; i < size_; i++) { r += 1 + length_[i]; }
+				return r;
+			}
+			
+			/**
+			 * Write the table as [count] ([length] [bytes])* into buffer
+			 * which must hold table_size() bytes.
+			 */
+			static int write_table(block_data_t* buffer) {
+				ensure_table();
+				*buffer++ = size_;
+				for(size_type i = 0; i < size_; i++) {
+					*buffer++ = length_[i];
+					memcpy(buffer, symbols_[i], length_[i]);
+					buffer += length_[i];
+				}
+				return SUCCESS;
+			}
+			
+			/**
+			 * Replace the table by one written with write_table(). The
+			 * current table is left untouched if buffer is malformed.
+			 */
+			static int read_table(const block_data_t* buffer) {
+				::uint8_t n = *buffer++;
+				if(n > SYMBOLS) { return ERR_UNSPEC; }
+				
+				const block_data_t *p = buffer;
+				for(size_type i = 0; i < n; i++) {
+					::uint8_t l = *p;
+					if(l < 1 || l > MAX_SYMBOL_LENGTH) { return ERR_UNSPEC; }
+					p += 1 + l;
+				}
+				
+				for(size_type i = 0; i < n; i++) {
+					length_[i] = *buffer++;
+					memcpy(symbols_[i], buffer, length_[i]);
+					buffer += length_[i];
+				}
+				size_ = n;
+				build_index();
+				return SUCCESS;
+			}
+			
+			/// Number of symbols in the current table.
+			static size_type symbols() {
+				ensure_table();
+				return size_;
+			}
+			
+		private:
+			
+			/**
+			 * Symbol table construction after the FSST paper: encode the
+			 * sample with the current table, count how often each symbol
+			 * (or escaped byte) and each pair of consecutive symbols
+			 * occurs and make the SYMBOLS symbols and concatenations that
+			 * save most bytes the next table.
+			 */
+			class Trainer {
+				public:
+					/// Symbols 0 .. SYMBOLS - 1, then one per escaped byte.
+					enum { CODES = SYMBOLS + 256 };
+					
+					bool init() {
+						ensure_table();
+						counts_ = ::get_allocator().template allocate_array< ::uint32_t>(CODES + CODES * CODES) .raw();
+						if(!counts_) { return false; }
+						pairs_ = counts_ + CODES;
+						size_ = 0;
+						clear();
+						return true;
+					}
+					
+					void destruct() {
+						::get_allocator().free_array(counts_);
+					}
+					
+					void add(const block_data_t* s) {
+						if(!s) { return; }
+						size_type rest = strlen(reinterpret_cast<const char*>(s));
+						size_type prev = CODES;
+						while(rest) {
+							::uint8_t l;
+							int i = match(s, rest, l);
+							size_type code = (i < 0) ? SYMBOLS + *s : i;
+							counts_[code]++;
+							if(prev != CODES) { pairs_[prev * CODES + code]++; }
+							prev = code;
+							s += l;
+							rest -= l;
+						}
+					}
+					
+					/// Replace the codec table by the best candidates.
+					void next_generation() {
+						for(size_type a = 0; a < CODES; a++) {
+							if(!counts_[a]) { continue; }
+							::uint8_t la = code_length(a);
+							offer(code_bytes(a), la, 0, 0, counts_[a]);
+							
+							for(size_type b = 0; b < CODES; b++) {
+								::uint32_t c = pairs_[a * CODES + b];
+								::uint8_t lb = code_length(b);
+								if(!c || la + lb > MAX_SYMBOL_LENGTH) { continue; }
+								offer(code_bytes(a), la, code_bytes(b), lb, c);
+							}
+						}
+						
+						for(size_type i = 0; i < size_; i++) {
+							length_[i] = length_candidate_[i];
+							memcpy(symbols_[i], candidates_[i], length_candidate_[i]);
+						}
+						self_type::size_ = size_;
+						build_index();
+						size_ = 0;
+						clear();
+					}
+					
+				private:
+					void clear() {
+						for(size_type i = 0; i < CODES + CODES * CODES; i++) { counts_[i] = 0; }
+					}
+					
+					const block_data_t* code_bytes(size_type code) {
+						if(code < SYMBOLS) { return symbols_[code]; }
+						literal_[code - SYMBOLS] = code - SYMBOLS;
+						return &literal_[code - SYMBOLS];
+					}
+					
+					::uint8_t code_length(size_type code) {
+						return (code < SYMBOLS) ? length_[code] : 1;
+					}
+					
+					/**
+					 * Candidate a + b that occurred count times. The gain
+					 * is the number of bytes it saves compared to escaping
+					 * every byte.
+					 */
+					void offer(const block_data_t* a, ::uint8_t la, const block_data_t* b, ::uint8_t lb, ::uint32_t count) {
+						::uint8_t l = la + lb;
+						::uint32_t gain = count * (2 * l - 1);
+						if(size_ == SYMBOLS && gain <= gain_[min_]) { return; }
+						
+						block_data_t s[MAX_SYMBOL_LENGTH];
+						memcpy(s, a, la);
+						if(lb) { memcpy(s + la, b, lb); }
+						
+						for(size_type i = 0; i < size_; i++) {
+							if(length_candidate_[i] == l && memcmp(candidates_[i], s, l) == 0) {
+								if(gain > gain_[i]) {
+									gain_[i] = gain;
+									if(i == min_) { find_min(); }
+								}
+								return;
+							}
+						}
+						
+						size_type i = (size_ < SYMBOLS) ? size_++ : min_;
+						memcpy(candidates_[i], s, l);
+						length_candidate_[i] = l;
+						gain_[i] = gain;
+						find_min();
+					}
+					
+					void find_min() {
+						min_ = 0;
+						for(size_type i = 1; i < size_; i++) {
+							if(gain_[i] < gain_[min_]) { min_ = i; }
+						}
+					}
+					
+					::uint32_t *counts_;
+					::uint32_t *pairs_;
+					block_data_t literal_[256];
+					block_data_t candidates_[SYMBOLS][MAX_SYMBOL_LENGTH];
+					::uint8_t length_candidate_[SYMBOLS];
+					::uint32_t gain_[SYMBOLS];
+					size_type size_;
+					size_type min_;
+			};
+			
+			/**
+			 * Longest symbol that is a prefix of the rest bytes at in.
+			 * @return its index or -1 if none matches (l is set to 1 then)
+			 */
+			static int match(const block_data_t* in, size_type rest, ::uint8_t& l) {
+				for(size_type i = first_[*in]; i < first_[*in + 1]; i++) {
+					l = length_[i];
+					if(l > rest) { continue; }
+					::uint8_t j = 1;
+					while(j < l && symbols_[i][j] == in[j]) { j++; }
+					if(j == l) { return i; }
+				}
+				l = 1;
+				return -1;
+			}
+			
+			/// @return encoded size, writes it to out if out is not NULL
+			static size_type encode_internal(const block_data_t* in, size_type len, block_data_t* out) {
+				size_type r = 0;
+				while(len) {
+					::uint8_t l;
+					int i = match(in, len, l);
+					if(i < 0) {
+						if(out) {
+							out[r] = ESCAPE;
+							out[r + 1] = *in;
+						}
+						r += 2;
+					}
+					else {
+						if(out) { out[r] = i + 1; }
+						r++;
+					}
+					in += l;
+					len -= l;
+				}
+				return r;
+			}
+			
+			/**
+			 * Sort symbols by first byte, longer ones first, and build
+			 * first_.
+			 */
+			static void build_index() {
+				for(size_type i = 1; i < size_; i++) {
+					block_data_t s[MAX_SYMBOL_LENGTH];
+					::uint8_t l = length_[i];
+					memcpy(s, symbols_[i], l);
+					size_type j = i;
+					for( ; j > 0 && (symbols_[j - 1][0] > s[0] ||
+								(symbols_[j - 1][0] == s[0] && length_[j - 1] < l)); j--) {
+						memcpy(symbols_[j], symbols_[j - 1], length_[j - 1]);
+						length_[j] = length_[j - 1];
+					}
+					memcpy(symbols_[j], s, l);
+					length_[j] = l;
+				}
+				for(size_type i = size_; i < SYMBOLS; i++) { length_[i] = 0; }
+				
+				size_type i = 0;
+				for(size_type b = 0; b <= 256; b++) {
+					while(i < size_ && symbols_[i][0] < b) { i++; }
+					first_[b] = i;
+				}
+				initialized_ = true;
+			}
+			
+			static void ensure_table() {
+				if(initialized_) { return; }
+				size_ = 0;
+				for(size_type c = 32; c < 127; c++) {
+					symbols_[size_][0] = c;
+					length_[size_++] = 1;
+				}
+				for(const char* const* p = default_symbols_; *p && size_ < SYMBOLS; p++) {
+					size_type l = strlen(*p);
+					if(l > MAX_SYMBOL_LENGTH) { continue; }
+					memcpy(symbols_[size_], *p, l);
+					length_[size_++] = l;
+				}
+				build_index();
+			}
+			
+			static block_data_t symbols_[SYMBOLS][MAX_SYMBOL_LENGTH_P];
+			static ::uint8_t length_[SYMBOLS];
+			static ::uint16_t first_[257];
+			static size_type size_;
+			static bool initialized_;
+			static const char* const default_symbols_[];
+	};
+	
+	template<typename OsModel_P, int MAX_SYMBOL_LENGTH_P>
+	typename SymbolTableCodec<OsModel_P, MAX_SYMBOL_LENGTH_P>::block_data_t
+		SymbolTableCodec<OsModel_P, MAX_SYMBOL_LENGTH_P>::symbols_[SYMBOLS][MAX_SYMBOL_LENGTH_P];
+	
+	template<typename OsModel_P, int MAX_SYMBOL_LENGTH_P>
+	::uint8_t SymbolTableCodec<OsModel_P, MAX_SYMBOL_LENGTH_P>::length_[SYMBOLS];
+	
+	template<typename OsModel_P, int MAX_SYMBOL_LENGTH_P>
+	::uint16_t SymbolTableCodec<OsModel_P, MAX_SYMBOL_LENGTH_P>::first_[257];
+	
+	template<typename OsModel_P, int MAX_SYMBOL_LENGTH_P>
+	typename SymbolTableCodec<OsModel_P, MAX_SYMBOL_LENGTH_P>::size_type
+		SymbolTableCodec<OsModel_P, MAX_SYMBOL_LENGTH_P>::size_ = 0;
+	
+	template<typename OsModel_P, int MAX_SYMBOL_LENGTH_P>
+	bool SymbolTableCodec<OsModel_P, MAX_SYMBOL_LENGTH_P>::initialized_ = false;
+	
+	/// Multi byte symbols of the built in table, besides all printable bytes
+	template<typename OsModel_P, int MAX_SYMBOL_LENGTH_P>
+	const char* const SymbolTableCodec<OsModel_P, MAX_SYMBOL_LENGTH_P>::default_symbols_[] = {
+		"http://", "https://", "www.", ".org/", ".com/", ".net/", ".de/",
+		"dbpedia.", "resource", "ontology", "/propert", "xmlns.co", "m/foaf/",
+		"0.1/", "w3.org/", "/1999/02", "/22-rdf-", "syntax-n", "s#", "2000/01/",
+		"rdf-sche", "ma#", "2001/XML", "Schema#", "2002/07/", "owl#", "purl.org",
+		"/dc/", "terms/", "elements", "/1.1/", "schema.o", "rg/", "#type",
+		"label", "name", "string", "integer", "dateTime", "\"@en", "^^<",
+		"th", "he", "in", "er", "an", "re", "on", "at", "en", "nd", "ti", "es",
+		"or", "te", "ed", "is", "it", "al", "ar", "st", "to", "nt", "ng", "se",
+		"ha", "as", "ou", "io", "le", "ve", "co", "me", "de", "hi", "ri", "ro",
+		"ic", "ne", "ea", "ra", "ce", "the", "ing", "ion", "and", "ent", "tio",
+		0
+	};
+	
+} // namespace wiselib
+
+#endif // SYMBOL_TABLE_CODEC_H
+
@@ -0,0 +1,187 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <external_interface/external_interface.h>
+#include <util/meta.h>
+#include "row.h"
+
+namespace wiselib {
+	
+	/**
+	 * @brief Fixed-size, column-major block of rows.
+	 * 
+	 * Operators pass batches instead of single rows in order to amortize
+	 * the cost of the push delegate, row allocation and per-row setup over
+	 * SIZE rows. Values of column c are stored contiguously at column(c).
+	 * 
+	 * Which physical rows are actually part of the batch is given by the
+	 * selection vector: selection(0) .. selection(selected() - 1) are the
+	 * physical row indices of the valid rows. That way a consumer can
+	 * filter a batch in place without moving any values around.
+	 * 
+	 * Like Row, a batch does not know its own size so it can only be
+	 * created on the heap via create() and destroy().
+	 * 
+	 * @ingroup
+	 * 
+	 * @tparam SIZE_P number of rows per batch, at most 256.
+	 */
+	template<
+		typename OsModel_P,
+		typename Value_P = ::uint32_t,
+		int SIZE_P = 32
+	>
+	class Batch {
+		public:
+			typedef OsModel_P OsModel;
+			typedef typename OsModel::block_data_t block_data_t;
+			typedef typename OsModel::size_t size_type;
+			typedef Value_P Value;
+			typedef Row<OsModel, Value> RowT;
+			typedef Batch<OsModel_P, Value_P, SIZE_P> self_type;
+			typedef ::uint8_t index_t;
+			
+			enum { SIZE = SIZE_P };
+			
+			static Batch* create(size_type columns) {
+				static_assert(SIZE <= 256);
+				Batch *r = reinterpret_cast<Batch*>( ::get_allocator()
+					.template allocate_array<block_data_t>(sizeof(self_type) + sizeof(Value) * SIZE * columns).raw() );
+				r->columns_ = columns;
+				r->clear();
+				return r;
+			}
+			
+			void destroy() {
+				::get_allocator().free_array(reinterpret_cast<block_data_t*>(this));
+			}
+			
+			template<typename Allocator>
+			static Batch* create(size_type columns, Allocator& allocator) {
+				static_assert(SIZE <= 256);
+				Batch *r = reinterpret_cast<Batch*>( allocator
+					.template allocate_array<block_data_t>(sizeof(self_type) + sizeof(Value) * SIZE * columns).raw() );
+				r->columns_ = columns;
+				r->clear();
+				return r;
+			}
+			
+			template<typename Allocator>
+			void destroy(Allocator& allocator) {
+				allocator.free_array(reinterpret_cast<block_data_t*>(this));
+			}
+			
+			void clear() {
+				size_ = 0;
+				selected_ = 0;
+			}
+			
+			size_type columns() { return columns_; }
+			
+			/// Number of physical rows in use (selected or not).
+			size_type size() { return size_; }
+			
+			/// Number of selected rows.
+			size_type selected() { return selected_; }
+			
+			bool full() { return size_ >= SIZE; }
+			bool empty() { return selected_ == 0; }
+			
+			Value* column(size_type c) { return data_ + c * SIZE; }
+			
+			Value& at(size_type row, size_type c) { return data_[c * SIZE + row]; }
+			
+			/// Physical index of the i'th selected row.
+			size_type selection(size_type i) { return selection_[i]; }
+			
+			/**
+			 * Reserve the next physical row and select it.
+			 * @return its physical index.
+			 */
+			size_type append() {
+				assert(!full());
+				selection_[selected_++] = size_;
+				return size_++;
+			}
+			
+			/**
+			 * Reserve the next physical row and fill it from row.
+			 */
+			void append(RowT& row) {
+				size_type r = append();
+				for(size_type c = 0; c < columns_; c++) {
+					at(r, c) = row[c];
+				}
+			}
+			
+			/**
+			 * Take back the last append(), e.g. because the row turned out
+			 * to not match after all.
+			 */
+			void unappend() {
+				assert(selected_ && selection_[selected_ - 1] == size_ - 1);
+				selected_--;
+				size_--;
+			}
+			
+			/**
+			 * Reduce the selection to the rows for which pred(batch,
+			 * physical_index) holds.
+			 */
+			template<typename Predicate>
+			void filter(Predicate& pred) {
+				size_type j = 0;
+				for(size_type i = 0; i < selected_; i++) {
+					if(pred(*this, selection_[i])) {
+						selection_[j++] = selection_[i];
+					}
+				}
+				selected_ = j;
+			}
+			
+			/**
+			 * Copy the i'th selected row into row (which must have at least
+			 * columns() columns).
+			 */
+			void gather(size_type i, RowT& row) {
+				size_type r = selection_[i];
+				for(size_type c = 0; c < columns_; c++) {
+					row[c] = at(r, c);
+				}
+			}
+			
+		private:
+			// not implementable as we dont know our own size!
+			self_type& operator=(const self_type& other);
+			Batch(const Batch& other);
+			
+			::uint8_t columns_;
+			::uint16_t size_;
+			::uint16_t selected_;
+			index_t selection_[SIZE];
+			Value data_[0];
+			
+	}; // Batch
+}
+
+#endif // BATCH_H
+
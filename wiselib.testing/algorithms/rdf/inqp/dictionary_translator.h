@@ -81,6 +81,7 @@ namespace wiselib {
 					p.dict_key() = dict_key;
 					block_data_t *s = dictionary_->get_value(dict_key);
 					p.hash() = Hash::hash(s, strlen((char*)s));
+					dictionary_->free_value(s);
 				}
 				return p.hash();
 			}
@@ -20,11 +20,33 @@
 #ifndef HASH_TRANSLATOR_H
 #define HASH_TRANSLATOR_H
 
+#include <util/meta.h>
+
 namespace wiselib {
 	
+	namespace {
+		HAS_METHOD(find_hash, has_find_hash);
+		
+		/**
+		 * Whether Dictionary maintains a hash -> key index
+		 * (e.g. HashIndexedDictionary).
+		 */
+		template<typename Dictionary, typename Hash>
+		struct has_hash_index {
+			static const bool value =
+				has_find_hash<Dictionary, typename Dictionary::key_type (Dictionary::*)(typename Hash::hash_t)>::value;
+		};
+	}
+	
 	/**
 	 * @brief
 	 * 
+	 * Translates hash values of strings back to dictionary keys, using
+	 * a direct mapped cache of MAX_SIZE_P entries. On a cache miss the
+	 * dictionary's hash index is used if it has one (see
+	 * HashIndexedDictionary). Without an index, or if the index misses,
+	 * all values are rehashed.
+	 * 
 	 * @ingroup
 	 * 
 	 * @tparam 
@@ -47,12 +69,11 @@ namespace wiselib {
 			typedef typename Hash::hash_t hash_t;
 			
 			enum { MAX_SIZE = MAX_SIZE_P };
-			enum { NULL_KEY = Dictionary::NULL_KEY };
 			
 			
 			class HashKeyPair {
 				public:
-					HashKeyPair() : dict_key_(NULL_KEY) {
+					HashKeyPair() : dict_key_(Dictionary::NULL_KEY) {
 					}
 					dict_key_t& dict_key() { return dict_key_; }
 					hash_t& hash() { return hash_; }
@@ -68,28 +89,11 @@ namespace wiselib {
 			dict_key_t translate(hash_t hash) {
 				size_type idx = hash_to_index(hash);
 				HashKeyPair &p = lookup_table_[idx];
-				if(p.dict_key() != NULL_KEY && p.hash() == hash) {
+				if(p.dict_key() != Dictionary::NULL_KEY && p.hash() == hash) {
 					return p.dict_key();
 				}
 				
-				// TODO: maybe a bloom filter could avoid the
-				// following search with some probability?
-				
-				// What a pity, we have to do an exhaustive search,
-				// isn't it coffee time anyway?
-				for(typename Dictionary::iterator iter = dictionary_->begin_keys();
-						iter != dictionary_->end_keys(); ++iter) {
-					dict_key_t k = *iter;
-					
-					block_data_t *s = dictionary_->get_value(k);
-					hash_t h = Hash::hash(s, strlen((char*)s));
-					dictionary_->free_value(s);
-					if(h == hash) {
-						return k;
-					}
-				}
-				
-				return NULL_KEY;
+				return lookup(dictionary_, hash);
 			}
 			
 			void fill() {
@@ -107,7 +111,7 @@ namespace wiselib {
 			void offer(dict_key_t key, hash_t hash) {
 				size_type idx = hash_to_index(hash);
 				HashKeyPair &p = lookup_table_[idx];
-				if(p.dict_key() == NULL_KEY) {
+				if(p.dict_key() == Dictionary::NULL_KEY) {
 					p.hash() = hash;
 					p.dict_key() = key;
 					
@@ -124,6 +128,36 @@ namespace wiselib {
 				return hash % MAX_SIZE;
 			}
 		private:
+			template<typename D>
+			ENABLE_IF((has_hash_index<D, Hash>::value), dict_key_t) lookup(D* dictionary, hash_t hash) {
+				dict_key_t k = dictionary->find_hash(hash);
+				if(k != Dictionary::NULL_KEY) { return k; }
+				return scan(hash);
+			}
+			
+			template<typename D>
+			ENABLE_IF((!has_hash_index<D, Hash>::value), dict_key_t) lookup(D*, hash_t hash) {
+				return scan(hash);
+			}
+			
+			dict_key_t scan(hash_t hash) {
+				// What a pity, we have to do an exhaustive search,
+				// isn't it coffee time anyway?
+				for(typename Dictionary::iterator iter = dictionary_->begin_keys();
+						iter != dictionary_->end_keys(); ++iter) {
+					dict_key_t k = *iter;
+					
+					block_data_t *s = dictionary_->get_value(k);
+					hash_t h = Hash::hash(s, strlen((char*)s));
+					dictionary_->free_value(s);
+					if(h == hash) {
+						return k;
+					}
+				}
+				
+				return Dictionary::NULL_KEY;
+			}
+			
 			HashKeyPair lookup_table_[MAX_SIZE];
 			typename Dictionary::self_pointer_t dictionary_;
 		
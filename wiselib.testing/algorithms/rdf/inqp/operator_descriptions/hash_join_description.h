@@ -0,0 +1,47 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef HASH_JOIN_DESCRIPTION_H
+#define HASH_JOIN_DESCRIPTION_H
+
+#include "simple_local_join_description.h"
+
+namespace wiselib {
+	
+	/**
+	 * @brief Description of a HashJoin operator.
+	 * 
+	 * Uses the same wire format as SimpleLocalJoinDescription,
+	 * i.e. a single byte holding left column (high nibble) and
+	 * right column (low nibble) after the common operator header.
+	 * 
+	 * @ingroup
+	 * 
+	 * @tparam 
+	 */
+	template<
+		typename OsModel_P,
+		typename Processor_P
+	>
+	class HashJoinDescription : public SimpleLocalJoinDescription<OsModel_P, Processor_P> {
+	}; // HashJoinDescription
+}
+
+#endif // HASH_JOIN_DESCRIPTION_H
+
@@ -49,6 +49,8 @@ namespace wiselib {
 			enum {
 				GRAPH_PATTERN_SELECTION = 'g',
 				SIMPLE_LOCAL_JOIN = 'j',
+				HASH_JOIN = 'h',
+				SORT_MERGE_JOIN = 'm',
 				COLLECT = 'c',
 				AGGREGATE = 'a',
 			};
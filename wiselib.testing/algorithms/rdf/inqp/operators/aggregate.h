@@ -57,9 +57,10 @@ namespace wiselib {
 			typedef Processor_P Processor;
 			typedef Aggregate<OsModel, Processor> self_type;
 			typedef Row<OsModel> RowT;
-			typedef Table<OsModel, RowT> TableT;
+			typedef Table<OsModel, RowT, typename Base::Allocator> TableT;
 			typedef typename RowT::Value Value;
 			typedef AggregateDescription<OsModel, Processor> AD;
+			typedef typename Base::BatchT BatchT;
 			
 			// TODO: this should be the node_id_t of the aggregation radio
 			// or the join radio (if that will turn out to be a different
@@ -85,17 +86,19 @@ namespace wiselib {
 				
 				//this->push_ = reinterpret_cast<typename Base::my_push_t>(&self_type::push);
 				hardcore_cast(this->push_, &self_type::push);
+				hardcore_cast(this->push_batch_, &self_type::push_batch);
 				operations_ = 0;
+				post_inited_ = false;
 				
 				aggregation_columns_logical_ = ad->aggregation_columns();
-				aggregation_types_ = ::get_allocator().template allocate_array< ::uint8_t>(aggregation_columns_logical_).raw();
+				aggregation_types_ = this->allocator().template allocate_array< ::uint8_t>(aggregation_columns_logical_).raw();
 				memcpy(aggregation_types_, ad->aggregation_types(), aggregation_columns_logical_);
 			}
 			#pragma GCC diagnostic pop
 			
 			void post_init() {
 				if(!post_inited_) {
-					operations_ = ::get_allocator().template allocate_array<Operation>(aggregation_columns_logical_).raw();
+					operations_ = this->allocator().template allocate_array<Operation>(aggregation_columns_logical_).raw();
 					
 					// i = index in aggregation types (logical output col)
 					// j = aggregate column (physical output col)
@@ -148,34 +151,41 @@ namespace wiselib {
 					}
 					aggregation_columns_physical_ = j;
 					
-					local_aggregates_.init(aggregation_columns_physical_);
-					updated_aggregates_.init(aggregation_columns_physical_);
+					local_aggregates_.init(aggregation_columns_physical_, &this->allocator());
+					updated_aggregates_.init(aggregation_columns_physical_, &this->allocator());
+					converted_ = RowT::create(aggregation_columns_physical_, this->allocator());
+					batch_row_ = RowT::create(this->child(Base::CHILD_LEFT).columns(), this->allocator());
 					post_inited_ = true;
 				}
 			}
 			
 			void destruct() {
 				if(operations_) {
-					::get_allocator().template free_array(operations_);
+					this->allocator().free_array(operations_);
 					operations_ = 0;
 				}
 				if(aggregation_types_) {
-					::get_allocator().template free_array(aggregation_types_);
+					this->allocator().free_array(aggregation_types_);
 					aggregation_types_ = 0;
 				}
+				for(typename ChildStates::iterator iter = child_states_.begin(); iter != child_states_.end(); ++iter) {
+					iter->second.clear();
+				}
+				child_states_.clear();
+				if(post_inited_) {
+					local_aggregates_.clear();
+					updated_aggregates_.clear();
+					converted_->destroy(this->allocator());
+					batch_row_->destroy(this->allocator());
+					post_inited_ = false;
+				}
 			}
 			
 			void push(size_type port, RowT& row) {
 				post_init();
 				
 				if(&row) {
-					size_type idx = find_matching_group(local_aggregates_, row);
-					if(idx == npos) {
-						create_group(row);
-					}
-					else {
-						add_to_aggregate(local_aggregates_[idx], row);
-					}
+					aggregate_row(row);
 				}
 				else {
 					local_aggregates_.pack();
@@ -191,6 +201,15 @@ namespace wiselib {
 				}
 			}
 			
+			void push_batch(size_type port, BatchT& batch) {
+				post_init();
+				
+				for(size_type i = 0; i < batch.selected(); i++) {
+					batch.gather(i, *batch_row_);
+					aggregate_row(*batch_row_);
+				}
+			}
+			
 			/**
 			 * Refresh updated table such that it contains up to date
 			 * information about the group given by r.
@@ -268,7 +287,7 @@ namespace wiselib {
 			
 			void on_receive_row(RowT& row, node_id_t from) {
 				if(!child_states_.contains(from)) {
-					child_states_[from].init(aggregation_columns_physical_);
+					child_states_[from].init(aggregation_columns_physical_, &this->allocator());
 				}
 					
 				size_type idx = find_matching_group(child_states_[from], row);
@@ -315,17 +334,30 @@ namespace wiselib {
 				return npos;
 			}
 			
+			/**
+			 * Aggregate a plain data row into local aggregates.
+			 */
+			void aggregate_row(RowT& row) {
+				size_type idx = find_matching_group(local_aggregates_, row);
+				if(idx == npos) {
+					create_group(row);
+				}
+				else {
+					add_to_aggregate(local_aggregates_[idx], row);
+				}
+			}
+			
 			/**
 			 * Add a simple data row (without extra columns) as aggregate
 			 * value of one into local aggregates.
 			 */
 			void create_group(RowT& row) {
-				RowT *aggregate = RowT::create(aggregation_columns_physical_);
+				RowT *aggregate = RowT::create(aggregation_columns_physical_, this->allocator());
 				for(size_type i = 0; i < aggregation_columns_logical_; i++) {
 					operations_[i].init(*aggregate, row);
 				}
 				local_aggregates_.insert(*aggregate);
-				aggregate->destroy();
+				aggregate->destroy(this->allocator());
 			}
 			
 			/*
@@ -357,12 +389,10 @@ namespace wiselib {
 			 * row.
 			 */
 			void add_to_aggregate(RowT& aggregate, RowT& row) {
-				RowT *converted = RowT::create(aggregation_columns_physical_);
 				for(size_type i = 0; i < aggregation_columns_logical_; i++) {
-					operations_[i].init(*converted, row);
+					operations_[i].init(*converted_, row);
 				}
-				merge_aggregates(aggregate, *converted);
-				converted->destroy();
+				merge_aggregates(aggregate, *converted_);
 			}
 			
 			void execute() {
@@ -500,6 +530,8 @@ namespace wiselib {
 			TableT local_aggregates_;
 			TableT updated_aggregates_;
 			Operation *operations_;
+			RowT *converted_;
+			RowT *batch_row_;
 			bool post_inited_;
 			uint8_t aggregation_columns_logical_;
 			uint8_t aggregation_columns_physical_;
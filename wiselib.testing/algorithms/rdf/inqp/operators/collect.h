@@ -52,6 +52,7 @@ namespace wiselib {
 			typedef Operator<OsModel_P, Processor_P> Base;
 			typedef typename Base::Query Query;
 			typedef Collect<OsModel, Processor> self_type;
+			typedef typename Base::BatchT BatchT;
 			
 			#pragma GCC diagnostic push
 			#pragma GCC diagnostic ignored "-Wpmf-conversions"
@@ -62,12 +63,14 @@ namespace wiselib {
 			
 				//this->push_ = reinterpret_cast<typename Base::my_push_t>(&self_type::push);
 				hardcore_cast(this->push_, &self_type::push);
+				hardcore_cast(this->push_batch_, &self_type::push_batch);
 			}
 			#pragma GCC diagnostic pop
 			
 			void init(Query* query, uint8_t id, uint8_t parent_id, uint8_t parent_port, ProjectionInfo<OsModel> projection) {
 				Base::init(Base::Description::COLLECT, query, id, parent_id, parent_port, projection);
 				hardcore_cast(this->push_, &self_type::push);
+				hardcore_cast(this->push_batch_, &self_type::push_batch);
 			}
 			
 			void push(size_type port, Row<OsModel>& row) {
@@ -105,6 +108,21 @@ namespace wiselib {
 				
 			}
 			
+			void push_batch(size_type port, BatchT& batch) {
+				Row<OsModel> *row = Row<OsModel>::create(batch.columns(), this->allocator());
+				for(size_type i = 0; i < batch.selected(); i++) {
+					batch.gather(i, *row);
+					this->processor().send_row(
+							Base::Processor::COMMUNICATION_TYPE_SINK,
+							this->child(Base::CHILD_LEFT).columns(),
+							*row,
+							this->query().id(),
+							this->id()
+					);
+				}
+				row->destroy(this->allocator());
+			}
+			
 			void execute() {
 				//DBG("Collect execute");
 			}
@@ -52,6 +52,7 @@ namespace wiselib {
 			typedef typename Base::Query Query;
 			typedef GraphPatternSelection<OsModel_P, Processor_P> self_type;
 			typedef typename RowT::Value Value;
+			typedef typename Base::BatchT BatchT;
 			
 			enum { MAX_STRING_LENGTH = 256 };
 			
@@ -78,16 +79,21 @@ namespace wiselib {
 				values_[2] = value2;
 			}
 			
+			/**
+			 * Scan the tuple store and push matching rows to the parent
+			 * in batches of BatchT::SIZE.
+			 */
 			void execute(TupleStoreT& ts) {
 				//DBG("GPS execute");
 				typedef typename TupleStoreT::TupleContainer Container;
 				typedef typename Container::iterator Citer;
 				
-				RowT *row = RowT::create(this->projection_info().columns()); //TupleStoreT::COLUMNS);
+				BatchT *batch = BatchT::create(this->projection_info().columns(), this->allocator()); //TupleStoreT::COLUMNS);
 				
 				for(Citer iter = ts.container().begin(); iter != ts.container().end(); ++iter) {
 					bool match = true;
 					size_type row_idx = 0;
+					size_type r = batch->append();
 					for(size_type i = 0; i < TupleStoreT::COLUMNS; i++) {
 						typename Processor::Value v = this->translator().translate(TupleStoreT::to_key(iter->get(i)));
 						
@@ -106,7 +112,7 @@ namespace wiselib {
 								//DBG("col %d INT", i);
 								block_data_t *s = this->dictionary().get_value(TupleStoreT::to_key(iter->get(i)));
 								long l = atol((char*)s);
-								(*row)[row_idx++] = *reinterpret_cast<Value*>(&l);
+								batch->at(r, row_idx++) = *reinterpret_cast<Value*>(&l);
 								this->dictionary().free_value(s);
 								break;
 							}
@@ -114,23 +120,30 @@ namespace wiselib {
 								//DBG("col %d FLOAT", i);
 								block_data_t *s = this->dictionary().get_value(TupleStoreT::to_key(iter->get(i)));
 								float f = atof((char*)s);
-								(*row)[row_idx++] = *reinterpret_cast<Value*>(&f);
+								batch->at(r, row_idx++) = *reinterpret_cast<Value*>(&f);
 								this->dictionary().free_value(s);
 								break;
 							}
 							case ProjectionInfoBase::STRING:
 								//DBG("col %d STRING", i);
-								(*row)[row_idx++] = v;
+								batch->at(r, row_idx++) = v;
 								this->reverse_translator().offer(TupleStoreT::to_key(iter->get(i)), v);
 								break;
 						}
 					}
-					if(match) {
-						this->parent().push(*row);
+					if(!match) {
+						batch->unappend();
+					}
+					else if(batch->full()) {
+						this->parent().push(*batch);
+						batch->clear();
 					}
 				}
 				
-				row->destroy();
+				if(!batch->empty()) {
+					this->parent().push(*batch);
+				}
+				batch->destroy(this->allocator());
 				this->parent().push(Base::END_OF_INPUT);
 			}
 			
@@ -0,0 +1,298 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef HASH_JOIN_H
+#define HASH_JOIN_H
+
+#include <external_interface/external_interface.h>
+#include "../row.h"
+#include "../table.h"
+#include "../projection_info.h"
+#include "operator.h"
+#include "../operator_descriptions/hash_join_description.h"
+#include "../compare_values.h"
+#include <util/types.h>
+
+namespace wiselib {
+	
+	/**
+	 * @brief Build/probe equi-join.
+	 * 
+	 * Rows arriving on the left port are stored in a Table (build side)
+	 * and chained into a hash table on the join column, rows arriving on
+	 * the right port (probe side) only visit the rows of their bucket.
+	 * This makes the join O(|L| + |R| + output) instead of the
+	 * O(|L| * |R|) of SimpleLocalJoin, it has the same
+	 * semantics otherwise (left input has to be complete before the first
+	 * right row arrives).
+	 * 
+	 * Rows of the build side are addressed by ::uint16_t indices,
+	 * as is the Table itself. The build side thus holds at most MAX_ROWS
+	 * rows, further left rows are dropped.
+	 * 
+	 * @ingroup
+	 * 
+	 * @tparam 
+	 */
+	template<
+		typename OsModel_P,
+		typename Processor_P
+	>
+	class HashJoin : public Operator<OsModel_P, Processor_P> {
+		
+		public:
+			typedef OsModel_P OsModel;
+			typedef typename OsModel::block_data_t block_data_t;
+			typedef typename OsModel::size_t size_type;
+			typedef Operator<OsModel_P, Processor_P> Base;
+			typedef typename Base::Query Query;
+			typedef Processor_P Processor;
+			typedef HashJoin<OsModel, Processor> self_type;
+			typedef Row<OsModel> RowT;
+			typedef typename RowT::Value Value;
+			typedef Table<OsModel, RowT, typename Base::Allocator> TableT;
+			typedef typename Base::BatchT BatchT;
+			typedef ::uint16_t row_index_t;
+			
+			enum { NO_ROW = (row_index_t)(-1) };
+			enum { MIN_BUCKETS = 16 };
+			/// Largest power of two a Table's ::uint16_t capacity can hold
+			enum { MAX_ROWS = 0x8000 };
+			
+			#pragma GCC diagnostic push
+			#pragma GCC diagnostic ignored "-Wpmf-conversions"
+			void init(HashJoinDescription<OsModel, Processor> *hjd, Query *query) {
+				Base::init(reinterpret_cast<OperatorDescription<OsModel, Processor>* >(hjd), query);
+				
+				left_column_ = hjd->left_column();
+				right_column_ = hjd->right_column();
+				
+				hardcore_cast(this->push_, &self_type::push);
+				hardcore_cast(this->push_batch_, &self_type::push_batch);
+				post_inited_ = false;
+			}
+			#pragma GCC diagnostic pop
+			
+			void post_init() {
+				if(!post_inited_) {
+					table_.init(this->child(Base::CHILD_LEFT).columns(), &this->allocator());
+					buckets_ = 0;
+					bucket_count_ = 0;
+					next_ = 0;
+					next_capacity_ = 0;
+					out_ = BatchT::create(this->projection_info().columns(), this->allocator());
+					in_ = RowT::create(RowT::MAX_COLUMNS, this->allocator());
+					post_inited_ = true;
+				}
+			}
+			
+			void push(size_type port, Row<OsModel>& row) {
+				post_init();
+				
+				if(&row) {
+					if(port == Base::CHILD_LEFT) {
+						build(row);
+					}
+					else {
+						probe(row);
+						flush();
+					}
+				}
+				else if(port == Base::CHILD_RIGHT) {
+					clear();
+					this->parent().push(row);
+				}
+			}
+			
+			void push_batch(size_type port, BatchT& batch) {
+				post_init();
+				
+				for(size_type i = 0; i < batch.selected(); i++) {
+					batch.gather(i, *in_);
+					if(port == Base::CHILD_LEFT) {
+						build(*in_);
+					}
+					else {
+						probe(*in_);
+					}
+				}
+				flush();
+			}
+			
+			void execute() { }
+			
+			/**
+			 * Release the table and batches of an operator that did not
+			 * see the end of its input.
+			 */
+			void destruct() {
+				if(post_inited_) {
+					clear();
+				}
+			}
+			
+		private:
+			
+			void build(RowT& row) {
+				if(table_.size() >= (size_type)MAX_ROWS) { return; }
+				
+				row_index_t idx = table_.size();
+				table_.insert(row);
+				
+				if(idx >= next_capacity_) {
+					grow_next();
+				}
+				if(table_.size() > 2 * bucket_count_) {
+					rehash(bucket_count_ ? 2 * bucket_count_ : (size_type)MIN_BUCKETS);
+				}
+				else {
+					link(idx);
+				}
+			}
+			
+			void probe(RowT& row) {
+				if(!bucket_count_) { return; }
+				
+				ProjectionInfo<OsModel>& l = this->child(Base::CHILD_LEFT);
+				ProjectionInfo<OsModel>& r = this->child(Base::CHILD_RIGHT);
+				assert(l.result_type(left_column_) == r.result_type(right_column_));
+				int type = l.result_type(left_column_);
+				
+				Value &v = row[right_column_];
+				for(row_index_t i = buckets_[bucket(type, v)]; i != NO_ROW; i = next_[i]) {
+					RowT &left = table_[i];
+					if(compare_values(type, left[left_column_], v) == 0) {
+						emit(left, row);
+					}
+				}
+			}
+			
+			/**
+			 * Append the projection of left and right to the output batch.
+			 */
+			void emit(RowT& left, RowT& right) {
+				ProjectionInfo<OsModel>& l = this->child(Base::CHILD_LEFT);
+				ProjectionInfo<OsModel>& r = this->child(Base::CHILD_RIGHT);
+				
+				size_type row = out_->append();
+				size_type j = 0;
+				for(size_type i = 0; i < l.columns(); i++) {
+					if(this->projection_info().type(i) != ProjectionInfoBase::IGNORE) {
+						out_->at(row, j++) = left[i];
+					}
+				}
+				for(size_type i = 0; i < r.columns(); i++) {
+					if(this->projection_info().type(l.columns() + i) != ProjectionInfoBase::IGNORE) {
+						out_->at(row, j++) = right[i];
+					}
+				}
+				
+				if(out_->full()) {
+					flush();
+				}
+			}
+			
+			void flush() {
+				if(!out_->empty()) {
+					this->parent().push(*out_);
+				}
+				out_->clear();
+			}
+			
+			/**
+			 * Hash a join value so that values compare_values() considers
+			 * equal end up in the same bucket.
+			 */
+			size_type bucket(int type, Value& v) {
+				Value h = v;
+				if(type == ProjectionInfoBase::FLOAT && *reinterpret_cast<float*>(&v) == 0.0f) {
+					// -0.0 == 0.0
+					h = 0;
+				}
+				// Fibonacci hashing, spreads consecutive integers and
+				// keeps the low bits of hash values meaningful.
+				::uint32_t x = (::uint32_t)h * 2654435769UL;
+				return (x ^ (x >> 16)) & (bucket_count_ - 1);
+			}
+			
+			void link(row_index_t idx) {
+				int type = this->child(Base::CHILD_LEFT).result_type(left_column_);
+				size_type b = bucket(type, table_[idx][left_column_]);
+				next_[idx] = buckets_[b];
+				buckets_[b] = idx;
+			}
+			
+			void rehash(size_type n) {
+				if(buckets_) {
+					this->allocator().free_array(buckets_);
+				}
+				buckets_ = this->allocator().template allocate_array<row_index_t>(n).raw();
+				bucket_count_ = n;
+				for(size_type i = 0; i < n; i++) {
+					buckets_[i] = NO_ROW;
+				}
+				for(row_index_t i = 0; i < table_.size(); i++) {
+					link(i);
+				}
+			}
+			
+			void grow_next() {
+				size_type n = next_capacity_ ? 2 * next_capacity_ : (size_type)MIN_BUCKETS;
+				row_index_t *next = this->allocator().template allocate_array<row_index_t>(n).raw();
+				if(next_) {
+					memcpy(next, next_, next_capacity_ * sizeof(row_index_t));
+					this->allocator().free_array(next_);
+				}
+				next_ = next;
+				next_capacity_ = n;
+			}
+			
+			void clear() {
+				table_.clear();
+				if(buckets_) {
+					this->allocator().free_array(buckets_);
+					buckets_ = 0;
+				}
+				if(next_) {
+					this->allocator().free_array(next_);
+					next_ = 0;
+				}
+				bucket_count_ = 0;
+				next_capacity_ = 0;
+				out_->destroy(this->allocator());
+				in_->destroy(this->allocator());
+				post_inited_ = false;
+			}
+			
+			uint8_t left_column_;
+			uint8_t right_column_;
+			bool post_inited_;
+			TableT table_;
+			row_index_t *buckets_;
+			row_index_t *next_;
+			size_type bucket_count_;
+			size_type next_capacity_;
+			BatchT *out_;
+			RowT *in_;
+		
+	}; // HashJoin
+}
+
+#endif // HASH_JOIN_H
+
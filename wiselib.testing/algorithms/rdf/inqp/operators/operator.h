@@ -22,6 +22,7 @@
 
 #include <util/delegates/delegate.hpp>
 #include "../row.h"
+#include "../batch.h"
 #include "../projection_info.h"
 #include "../operator_descriptions/operator_description.h"
 
@@ -30,6 +31,12 @@ namespace wiselib {
 	/**
 	 * @brief
 	 * 
+	 * Operators receive their input either row by row through push_ or
+	 * a batch of rows at a time through push_batch_. An operator that does
+	 * not set push_batch_ will be fed the rows of incoming batches one by
+	 * one through push_ (see unbatch()).
+	 * End of input is always signalled as a row push of END_OF_INPUT.
+	 * 
 	 * @ingroup
 	 * 
 	 * @tparam 
@@ -52,18 +59,24 @@ namespace wiselib {
 			typedef typename Processor::Translator Translator;
 			typedef typename Processor::ReverseTranslator ReverseTranslator;
 			typedef typename Processor::Timer Timer;
+			typedef typename Processor::Allocator Allocator;
 			
 			typedef void (*my_push_t)(void*, size_type, Row<OsModel>&);
 			typedef delegate2<void, size_type, Row<OsModel>&> push_t;
+			typedef Batch<OsModel> BatchT;
+			typedef void (*my_push_batch_t)(void*, size_type, BatchT&);
+			typedef delegate2<void, size_type, BatchT&> push_batch_t;
 			
 			enum { CHILD_LEFT = 0, CHILD_RIGHT = 1 };
 			
 			struct ParentInfo {
 				push_t push_;
+				push_batch_t push_batch_;
 				uint8_t id_;
 				uint8_t port_;
 				
 				void push(Row<OsModel>& row) { push_(port_, row); }
+				void push(BatchT& batch) { push_batch_(port_, batch); }
 			};
 		
 			void init(Description* od, Query *query) {
@@ -73,6 +86,7 @@ namespace wiselib {
 				projection_info_ = od->projection_info();
 				parent_.id_ = od->parent_id();
 				parent_.port_ = od->parent_port();
+				push_batch_ = 0;
 			}
 			
 			void init(uint8_t type, Query* query, uint8_t id, uint8_t parent_id, uint8_t parent_port, ProjectionInfo<OsModel> projection) {
@@ -82,10 +96,13 @@ namespace wiselib {
 				parent_.id_ = parent_id;
 				parent_.port_ = parent_port;
 				projection_info_ = projection;
+				push_batch_ = 0;
 			}
 			
 			void attach_to(self_type* parent) {
 				parent_.push_ = push_t::from_stub((void*)parent, parent->push_);
+				parent_.push_batch_ = push_batch_t::from_stub((void*)parent,
+						parent->push_batch_ ? parent->push_batch_ : &self_type::unbatch);
 				//parent_.port_ = port;
 				parent->set_projection_info(parent_.port_, projection_info_);
 			}
@@ -110,11 +127,28 @@ namespace wiselib {
 			Translator& translator() { return query_->processor().translator(); }
 			ReverseTranslator& reverse_translator() { return query_->processor().reverse_translator(); }
 			Timer& timer() { return query_->processor().timer(); }
+			Allocator& allocator() { return query_->processor().allocator(); }
 		
 		protected:
+			/**
+			 * Batch entry point for operators that only implement push():
+			 * Feed the selected rows of batch to push_ one by one.
+			 */
+			static void unbatch(void *obj, size_type port, BatchT& batch) {
+				self_type *op = reinterpret_cast<self_type*>(obj);
+				push_t push = push_t::from_stub(obj, op->push_);
+				Row<OsModel> *row = Row<OsModel>::create(batch.columns(), op->allocator());
+				for(size_type i = 0; i < batch.selected(); i++) {
+					batch.gather(i, *row);
+					push(port, *row);
+				}
+				row->destroy(op->allocator());
+			}
+			
 			ProjectionInfo<OsModel> projection_info_;
 			ParentInfo parent_;
 			my_push_t push_; // "my" push method, we need to save that for simulating virtual inheritance
+			my_push_batch_t push_batch_; // same for batches, may be 0
 			uint8_t type_;
 			operator_id_t id_;
 			Query *query_;
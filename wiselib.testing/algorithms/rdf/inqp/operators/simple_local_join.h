@@ -53,7 +53,8 @@ namespace wiselib {
 			typedef Processor_P Processor;
 			typedef SimpleLocalJoin<OsModel, Processor> self_type;
 			typedef Row<OsModel> RowT;
-			typedef Table<OsModel, RowT> TableT;
+			typedef Table<OsModel, RowT, typename Base::Allocator> TableT;
+			typedef typename Base::BatchT BatchT;
 			
 			#pragma GCC diagnostic push
 			#pragma GCC diagnostic ignored "-Wpmf-conversions"
@@ -65,13 +66,16 @@ namespace wiselib {
 				
 				//this->push_ = reinterpret_cast<typename Base::my_push_t>(&self_type::push);
 				hardcore_cast(this->push_, &self_type::push);
+				hardcore_cast(this->push_batch_, &self_type::push_batch);
 				post_inited_ = false;
 			}
 			#pragma GCC diagnostic pop
 			
 			void post_init() {
 				if(!post_inited_) {
-					table_.init(this->child(Base::CHILD_LEFT).columns());
+					table_.init(this->child(Base::CHILD_LEFT).columns(), &this->allocator());
+					out_ = BatchT::create(this->projection_info().columns(), this->allocator());
+					in_ = RowT::create(RowT::MAX_COLUMNS, this->allocator());
 					post_inited_ = true;
 				}
 			}
@@ -85,68 +89,106 @@ namespace wiselib {
 						table_.insert(row);
 					}
 					else {
-						ProjectionInfo<OsModel>& l = this->child(Base::CHILD_LEFT);
-						ProjectionInfo<OsModel>& r = this->child(Base::CHILD_RIGHT);
-						
-						// how many of the columns we receive on each side
-						// will actually be used for output?
-						
-						size_type output_columns_l = 0;
-						for(size_type i = 0; i < l.columns(); i++) {
-							if(this->projection_info().type(i) != ProjectionInfoBase::IGNORE) {
-								output_columns_l++;
-							}
-						}
-						
-						size_type output_columns_r = 0;
-						for(size_type i = 0; i < r.columns(); i++) {
-							if(this->projection_info().type(i + r.columns()) != ProjectionInfoBase::IGNORE) {
-								output_columns_r++;
-							}
-						}
-						
-						
-						RowT &result = *RowT::create(this->projection_info().columns());
-						size_type j = output_columns_l;
-						
-						for(size_type i = 0; i < r.columns(); i++) {
-							if(this->projection_info().type(l.columns() + i) != ProjectionInfoBase::IGNORE) {
-								result[j++] = row[i];
-							}
-						}
-						
-						for(typename TableT::iterator iter = table_.begin(); iter != table_.end(); ++iter) {
-							assert(l.result_type(left_column_) == r.result_type(right_column_));
-							
-							int c = compare_values(l.result_type(left_column_), (*iter)[left_column_], row[right_column_]);
-							if(c == 0) {
-								j = 0;
-								for(size_type i = 0; i < l.columns(); i++) {
-									if(this->projection_info().type(i) != ProjectionInfoBase::IGNORE) {
-										result[j++] = (*iter)[i];
-									} // if ! IGN
-								} // for i
-								
-								this->parent().push(result);
-							} // if c == 0
-						} // for iter
-						
-						result.destroy();
+						match(row);
+						flush();
 					} // else port = left
 				} // if row
 				else if(port == Base::CHILD_RIGHT) {
-					table_.clear();
+					clear();
 					this->parent().push(row);
 				}
 			}
 			
+			void push_batch(size_type port, BatchT& batch) {
+				post_init();
+				
+				for(size_type i = 0; i < batch.selected(); i++) {
+					batch.gather(i, *in_);
+					if(port == Base::CHILD_LEFT) {
+						table_.insert(*in_);
+					}
+					else {
+						match(*in_);
+					}
+				}
+				flush();
+			}
+			
 			void execute() { }
 			
+			/**
+			 * Release the table and batches of an operator that did not
+			 * see the end of its input.
+			 */
+			void destruct() {
+				if(post_inited_) {
+					clear();
+				}
+			}
+			
 		private:
+			
+			/**
+			 * Join a row from the right side against all left rows.
+			 */
+			void match(RowT& row) {
+				ProjectionInfo<OsModel>& l = this->child(Base::CHILD_LEFT);
+				ProjectionInfo<OsModel>& r = this->child(Base::CHILD_RIGHT);
+				assert(l.result_type(left_column_) == r.result_type(right_column_));
+				
+				for(typename TableT::iterator iter = table_.begin(); iter != table_.end(); ++iter) {
+					int c = compare_values(l.result_type(left_column_), (*iter)[left_column_], row[right_column_]);
+					if(c == 0) {
+						emit(*iter, row);
+					}
+				} // for iter
+			}
+			
+			/**
+			 * Append the projection of left and right to the output batch.
+			 */
+			void emit(RowT& left, RowT& right) {
+				ProjectionInfo<OsModel>& l = this->child(Base::CHILD_LEFT);
+				ProjectionInfo<OsModel>& r = this->child(Base::CHILD_RIGHT);
+				
+				size_type row = out_->append();
+				size_type j = 0;
+				for(size_type i = 0; i < l.columns(); i++) {
+					if(this->projection_info().type(i) != ProjectionInfoBase::IGNORE) {
+						out_->at(row, j++) = left[i];
+					}
+				}
+				for(size_type i = 0; i < r.columns(); i++) {
+					if(this->projection_info().type(l.columns() + i) != ProjectionInfoBase::IGNORE) {
+						out_->at(row, j++) = right[i];
+					}
+				}
+				
+				if(out_->full()) {
+					flush();
+				}
+			}
+			
+			void flush() {
+				if(!out_->empty()) {
+					this->parent().push(*out_);
+				}
+				out_->clear();
+			}
+			
+			void clear() {
+				table_.clear();
+				out_->destroy(this->allocator());
+				in_->destroy(this->allocator());
+				post_inited_ = false;
+			}
+			
 			uint8_t left_column_;
 			uint8_t right_column_;
 			bool post_inited_;
 			TableT table_;
+			BatchT *out_;
+			RowT *in_;
 		
 	}; // SimpleLocalJoin
 }
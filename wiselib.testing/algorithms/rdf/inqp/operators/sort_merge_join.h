@@ -0,0 +1,296 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef SORT_MERGE_JOIN_H
+#define SORT_MERGE_JOIN_H
+
+#include <external_interface/external_interface.h>
+#include "../row.h"
+#include "../table.h"
+#include "../projection_info.h"
+#include "operator.h"
+#include "../operator_descriptions/sort_merge_join_description.h"
+#include "../compare_values.h"
+#include <util/pstl/algorithm.h>
+#include <util/types.h>
+
+namespace wiselib {
+	
+	/**
+	 * @brief Merge-based equi-join.
+	 * 
+	 * The left input is buffered in a Table, when the first right row
+	 * arrives it is sorted on the join column (unless it arrived in order
+	 * already, e.g. from a sorted index scan). Right rows are then merged
+	 * against a cursor into the sorted left side, so for right input that
+	 * arrives in ascending order each left row is visited about once.
+	 * Unsorted right input is still handled correctly, the cursor is
+	 * repositioned by binary search whenever the right side steps back.
+	 * 
+	 * @ingroup
+	 * 
+	 * @tparam 
+	 */
+	template<
+		typename OsModel_P,
+		typename Processor_P
+	>
+	class SortMergeJoin : public Operator<OsModel_P, Processor_P> {
+		
+		public:
+			typedef OsModel_P OsModel;
+			typedef typename OsModel::block_data_t block_data_t;
+			typedef typename OsModel::size_t size_type;
+			typedef Operator<OsModel_P, Processor_P> Base;
+			typedef typename Base::Query Query;
+			typedef Processor_P Processor;
+			typedef SortMergeJoin<OsModel, Processor> self_type;
+			typedef Row<OsModel> RowT;
+			typedef typename RowT::Value Value;
+			typedef Table<OsModel, RowT, typename Base::Allocator> TableT;
+			typedef typename Base::BatchT BatchT;
+			typedef ::uint16_t row_index_t;
+			
+			/**
+			 * Orders row indices by the join column of the rows they refer
+			 * to.
+			 */
+			struct RowIndexCompare {
+				RowIndexCompare(self_type *join) : join_(join) { }
+				bool operator()(row_index_t a, row_index_t b) const {
+					return join_->compare_left(a, b) < 0;
+				}
+				self_type *join_;
+			};
+			
+			#pragma GCC diagnostic push
+			#pragma GCC diagnostic ignored "-Wpmf-conversions"
+			void init(SortMergeJoinDescription<OsModel, Processor> *smjd, Query *query) {
+				Base::init(reinterpret_cast<OperatorDescription<OsModel, Processor>* >(smjd), query);
+				
+				left_column_ = smjd->left_column();
+				right_column_ = smjd->right_column();
+				
+				hardcore_cast(this->push_, &self_type::push);
+				hardcore_cast(this->push_batch_, &self_type::push_batch);
+				post_inited_ = false;
+			}
+			#pragma GCC diagnostic pop
+			
+			void post_init() {
+				if(!post_inited_) {
+					table_.init(this->child(Base::CHILD_LEFT).columns(), &this->allocator());
+					order_ = 0;
+					left_sorted_ = true;
+					merging_ = false;
+					cursor_ = 0;
+					out_ = BatchT::create(this->projection_info().columns(), this->allocator());
+					in_ = RowT::create(RowT::MAX_COLUMNS, this->allocator());
+					post_inited_ = true;
+				}
+			}
+			
+			void push(size_type port, Row<OsModel>& row) {
+				post_init();
+				
+				if(&row) {
+					if(port == Base::CHILD_LEFT) {
+						insert(row);
+					}
+					else {
+						if(!merging_) {
+							sort_left();
+						}
+						merge(row);
+						flush();
+					}
+				}
+				else if(port == Base::CHILD_RIGHT) {
+					clear();
+					this->parent().push(row);
+				}
+			}
+			
+			void push_batch(size_type port, BatchT& batch) {
+				post_init();
+				
+				for(size_type i = 0; i < batch.selected(); i++) {
+					batch.gather(i, *in_);
+					if(port == Base::CHILD_LEFT) {
+						insert(*in_);
+					}
+					else {
+						if(!merging_) {
+							sort_left();
+						}
+						merge(*in_);
+					}
+				}
+				flush();
+			}
+			
+			void execute() { }
+			
+			/**
+			 * Release the table and batches of an operator that did not
+			 * see the end of its input.
+			 */
+			void destruct() {
+				if(post_inited_) {
+					clear();
+				}
+			}
+			
+			int compare_left(row_index_t a, row_index_t b) {
+				return compare_values(type(), table_[a][left_column_], table_[b][left_column_]);
+			}
+			
+		private:
+			
+			void insert(RowT& row) {
+				if(left_sorted_ && table_.size() &&
+						compare_values(type(), table_[table_.size() - 1][left_column_], row[left_column_]) > 0) {
+					left_sorted_ = false;
+				}
+				table_.insert(row);
+			}
+			
+			int type() {
+				return this->child(Base::CHILD_LEFT).result_type(left_column_);
+			}
+			
+			RowT& left(size_type i) {
+				return table_[order_ ? order_[i] : i];
+			}
+			
+			/**
+			 * Establish sorted access to the left side. If the rows arrived
+			 * in order no index array is needed at all.
+			 */
+			void sort_left() {
+				merging_ = true;
+				if(left_sorted_ || table_.size() < 2) { return; }
+				
+				order_ = this->allocator().template allocate_array<row_index_t>(table_.size()).raw();
+				for(row_index_t i = 0; i < table_.size(); i++) {
+					order_[i] = i;
+				}
+				heap_sort(order_, order_ + table_.size(), RowIndexCompare(this));
+			}
+			
+			/**
+			 * @return position of the first left row whose join value is not
+			 * smaller than v.
+			 */
+			size_type lower_bound(Value& v) {
+				size_type lo = 0, hi = table_.size();
+				while(lo < hi) {
+					size_type mid = lo + (hi - lo) / 2;
+					if(compare_values(type(), left(mid)[left_column_], v) < 0) { lo = mid + 1; }
+					else { hi = mid; }
+				}
+				return lo;
+			}
+			
+			void merge(RowT& row) {
+				ProjectionInfo<OsModel>& l = this->child(Base::CHILD_LEFT);
+				ProjectionInfo<OsModel>& r = this->child(Base::CHILD_RIGHT);
+				assert(l.result_type(left_column_) == r.result_type(right_column_));
+				int t = type();
+				Value &v = row[right_column_];
+				
+				// Step back if the right input is not in order
+				if(cursor_ > 0 && compare_values(t, left(cursor_ - 1)[left_column_], v) >= 0) {
+					cursor_ = lower_bound(v);
+				}
+				while(cursor_ < table_.size() && compare_values(t, left(cursor_)[left_column_], v) < 0) {
+					cursor_++;
+				}
+				if(cursor_ >= table_.size() || compare_values(t, left(cursor_)[left_column_], v) != 0) {
+					return;
+				}
+				
+				// Emit the run of equal keys but leave the cursor at its
+				// start, the next right row might have the same value
+				for(size_type p = cursor_; p < table_.size(); p++) {
+					RowT &lrow = left(p);
+					if(compare_values(t, lrow[left_column_], v) != 0) { break; }
+					emit(lrow, row);
+				}
+			}
+			
+			/**
+			 * Append the projection of left and right to the output batch.
+			 */
+			void emit(RowT& left, RowT& right) {
+				ProjectionInfo<OsModel>& l = this->child(Base::CHILD_LEFT);
+				ProjectionInfo<OsModel>& r = this->child(Base::CHILD_RIGHT);
+				
+				size_type row = out_->append();
+				size_type j = 0;
+				for(size_type i = 0; i < l.columns(); i++) {
+					if(this->projection_info().type(i) != ProjectionInfoBase::IGNORE) {
+						out_->at(row, j++) = left[i];
+					}
+				}
+				for(size_type i = 0; i < r.columns(); i++) {
+					if(this->projection_info().type(l.columns() + i) != ProjectionInfoBase::IGNORE) {
+						out_->at(row, j++) = right[i];
+					}
+				}
+				
+				if(out_->full()) {
+					flush();
+				}
+			}
+			
+			void flush() {
+				if(!out_->empty()) {
+					this->parent().push(*out_);
+				}
+				out_->clear();
+			}
+			
+			void clear() {
+				table_.clear();
+				if(order_) {
+					this->allocator().free_array(order_);
+					order_ = 0;
+				}
+				out_->destroy(this->allocator());
+				in_->destroy(this->allocator());
+				post_inited_ = false;
+			}
+			
+			uint8_t left_column_;
+			uint8_t right_column_;
+			bool post_inited_;
+			bool left_sorted_;
+			bool merging_;
+			TableT table_;
+			row_index_t *order_;
+			size_type cursor_;
+			BatchT *out_;
+			RowT *in_;
+		
+	}; // SortMergeJoin
+}
+
+#endif // SORT_MERGE_JOIN_H
+
@@ -68,6 +68,16 @@ namespace wiselib {
 				expected_operators_set_ = false;
 			}
 			
+			/**
+			 * Destruct and free all operators of this query.
+			 */
+			void destruct() {
+				for(typename Operators::iterator iter = operators_.begin(); iter != operators_.end(); ++iter) {
+					processor_->free_operator(iter->second);
+				}
+				operators_.clear();
+			}
+			
 			Operators& operators() { return operators_; }
 			
 			template<typename OperatorT>
@@ -78,7 +88,7 @@ namespace wiselib {
 			template<typename DescriptionT, typename OperatorT>
 			void add_operator(BOD *bod) {
 				DescriptionT *description = reinterpret_cast<DescriptionT*>(bod);
-				OperatorT *op = ::get_allocator().template allocate<OperatorT>().raw();
+				OperatorT *op = processor_->allocator().template allocate<OperatorT>().raw();
 				op->init(description, this);
 				operators_[bod->id()] = reinterpret_cast<BasicOperator*>(op);
 			}
@@ -26,16 +26,21 @@
 #include "operators/collect.h"
 #include "operators/aggregate.h"
 #include "operators/simple_local_join.h"
+#include "operators/hash_join.h"
+#include "operators/sort_merge_join.h"
 #include "operator_descriptions/operator_description.h"
 #include "operator_descriptions/aggregate_description.h"
 #include "operator_descriptions/graph_pattern_selection_description.h"
 #include "operator_descriptions/collect_description.h"
 #include "operator_descriptions/simple_local_join_description.h"
+#include "operator_descriptions/hash_join_description.h"
+#include "operator_descriptions/sort_merge_join_description.h"
 #include <util/pstl/map_static_vector.h>
 #include "row.h"
 #include "dictionary_translator.h"
 #include "hash_translator.h"
 #include <algorithms/hash/fnv.h>
+#include <util/allocators/global_allocator.h>
 
 namespace wiselib {
 	
@@ -44,7 +49,11 @@ namespace wiselib {
 	 * 
 	 * @ingroup
 	 * 
-	 * @tparam 
+	 * @tparam Allocator_P Allocator for queries, operators and their
+	 * intermediate rows and tables. Pass an ArenaAllocator to init() to
+	 * free everything a query allocated in one step, e.g. by taking a
+	 * mark before the first operator arrives and releasing it after
+	 * erase_query().
 	 */
 	template<
 		typename OsModel_P,
@@ -55,7 +64,8 @@ namespace wiselib {
 		typename ReverseTranslator_P = HashTranslator<OsModel_P, Dictionary_P, Hash_P, 64>,
 		typename Value_P = ::uint32_t,
 		int MAX_QUERIES_P = 8,
-		typename Timer_P = typename OsModel_P::Timer
+		typename Timer_P = typename OsModel_P::Timer,
+		typename Allocator_P = GlobalAllocator<OsModel_P>
 	>
 	class INQPQueryProcessor {
 		
@@ -63,7 +73,7 @@ namespace wiselib {
 			typedef OsModel_P OsModel;
 			typedef typename OsModel::block_data_t block_data_t;
 			typedef typename OsModel::size_t size_type;
-			typedef INQPQueryProcessor<OsModel_P, TupleStore_P, Hash_P, Dictionary_P, Translator_P, ReverseTranslator_P, Value_P, MAX_QUERIES_P> self_type;
+			typedef INQPQueryProcessor<OsModel_P, TupleStore_P, Hash_P, Dictionary_P, Translator_P, ReverseTranslator_P, Value_P, MAX_QUERIES_P, Timer_P, Allocator_P> self_type;
 			typedef self_type* self_pointer_t;
 			
 			typedef Value_P Value;
@@ -73,6 +83,7 @@ namespace wiselib {
 			typedef ReverseTranslator_P ReverseTranslator;
 			typedef Row<OsModel, Value> RowT;
 			typedef Timer_P Timer;
+			typedef Allocator_P Allocator;
 			
 			enum {
 				MAX_QUERIES = MAX_QUERIES_P
@@ -92,6 +103,10 @@ namespace wiselib {
 			typedef GraphPatternSelectionDescription<OsModel, self_type> GPSD;
 			typedef SimpleLocalJoin<OsModel, self_type> SLJ;
 			typedef SimpleLocalJoinDescription<OsModel, self_type> SLJD;
+			typedef HashJoin<OsModel, self_type> HJ;
+			typedef HashJoinDescription<OsModel, self_type> HJD;
+			typedef SortMergeJoin<OsModel, self_type> SMJ;
+			typedef SortMergeJoinDescription<OsModel, self_type> SMJD;
 			typedef Collect<OsModel, self_type> C;
 			typedef CollectDescription<OsModel, self_type> CD;
 			typedef Aggregate<OsModel, self_type> A;
@@ -118,9 +133,11 @@ namespace wiselib {
 			
 			enum { MAX_OPERATOR_ID = 255 };
 			
-			void init(typename TupleStoreT::self_pointer_t tuple_store, typename Timer::self_pointer_t timer) {
+			void init(typename TupleStoreT::self_pointer_t tuple_store, typename Timer::self_pointer_t timer,
+					typename Allocator::self_pointer_t allocator = 0) {
 				tuple_store_ = tuple_store;
 				timer_ = timer;
+				allocator_ = allocator ? allocator : &default_allocator<Allocator>();
 				row_callback_ = row_callback_t();
 				translator_.init(&dictionary());
 				reverse_translator_.init(&dictionary());
@@ -169,6 +186,12 @@ namespace wiselib {
 						case BOD::SIMPLE_LOCAL_JOIN:
 							(reinterpret_cast<SLJ*>(op))->execute();
 							break;
+						case BOD::HASH_JOIN:
+							(reinterpret_cast<HJ*>(op))->execute();
+							break;
+						case BOD::SORT_MERGE_JOIN:
+							(reinterpret_cast<SMJ*>(op))->execute();
+							break;
 						case BOD::AGGREGATE:
 							(reinterpret_cast<A*>(op))->execute();
 							break;
@@ -196,6 +219,12 @@ namespace wiselib {
 					case BOD::SIMPLE_LOCAL_JOIN:
 						query->template add_operator<SLJD, SLJ>(bod);
 						break;
+					case BOD::HASH_JOIN:
+						query->template add_operator<HJD, HJ>(bod);
+						break;
+					case BOD::SORT_MERGE_JOIN:
+						query->template add_operator<SMJD, SMJ>(bod);
+						break;
 					case BOD::COLLECT:
 						query->template add_operator<CD, C>(bod);
 						break;
@@ -241,19 +270,21 @@ namespace wiselib {
 				switch(op.type()) {
 					case BOD::GRAPH_PATTERN_SELECTION:
 					case BOD::SIMPLE_LOCAL_JOIN:
+					case BOD::HASH_JOIN:
+					case BOD::SORT_MERGE_JOIN:
 					case BOD::COLLECT:
 						break;
 					case BOD::AGGREGATE: {
 						size_type payload_length = size - Message::HEADER_SIZE;
 						size_type columns = payload_length / sizeof(Value);
 						
-						RowT *row = RowT::create(columns);
+						RowT *row = RowT::create(columns, allocator());
 						for(size_type i = 0; i < columns; i++) {
 							(*row)[i] = wiselib::read<OsModel, block_data_t, Value>(msg->payload() + i * sizeof(Value));
 						}
 						reinterpret_cast<A&>(op).on_receive_row(*row, from);
 						
-						row->destroy();
+						row->destroy(allocator());
 						break;
 					}
 					default:
@@ -270,7 +301,7 @@ namespace wiselib {
 			}
 			
 			Query* create_query(query_id_t qid) {
-				Query *q = ::get_allocator().template allocate<Query>().raw();
+				Query *q = allocator().template allocate<Query>().raw();
 				q->init(this, qid);
 				if(queries_.size() >= queries_.capacity()) {
 					assert(false && "queries full, clean them up from time to time!");
@@ -286,15 +317,55 @@ namespace wiselib {
 				queries_[qid] = query;
 			}
 			
+			/**
+			 * Release what op holds (hash tables, batches, ...) according
+			 * to its type and free it.
+			 */
+			void free_operator(BasicOperator* op) {
+				switch(op->type()) {
+					case BOD::GRAPH_PATTERN_SELECTION:
+					case BOD::COLLECT:
+						break;
+					case BOD::SIMPLE_LOCAL_JOIN:
+						(reinterpret_cast<SLJ*>(op))->destruct();
+						break;
+					case BOD::HASH_JOIN:
+						(reinterpret_cast<HJ*>(op))->destruct();
+						break;
+					case BOD::SORT_MERGE_JOIN:
+						(reinterpret_cast<SMJ*>(op))->destruct();
+						break;
+					case BOD::AGGREGATE:
+						(reinterpret_cast<A*>(op))->destruct();
+						break;
+					default:
+						DBG("unexpected op type: %d", op->type());
+				}
+				allocator().free(op);
+			}
+			
+			/**
+			 * Remove query and free it along with its operators.
+			 */
+			void erase_query(query_id_t qid) {
+				Query *q = get_query(qid);
+				if(!q) { return; }
+				queries_.erase(qid);
+				q->destruct();
+				allocator().free(q);
+			}
+			
 			Dictionary& dictionary() { return tuple_store_->dictionary(); }
 			Translator& translator() { return translator_; }
 			ReverseTranslator& reverse_translator() { return reverse_translator_; }
 			Timer& timer() { return *timer_; }
+			Allocator& allocator() { return *allocator_; }
 			
 		private:
 			
 			typename TupleStoreT::self_pointer_t tuple_store_;
 			typename Timer::self_pointer_t timer_;
+			typename Allocator::self_pointer_t allocator_;
 			row_callback_t row_callback_;
 			resolve_callback_t resolve_callback_;
 			Queries queries_;
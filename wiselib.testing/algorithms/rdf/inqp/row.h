@@ -59,6 +59,17 @@ namespace wiselib {
 				::get_allocator().free_array(reinterpret_cast<block_data_t*>(this));
 			}
 			
+			template<typename Allocator>
+			static Row* create(size_type n, Allocator& allocator) {
+				return reinterpret_cast<Row*>( allocator
+					.template allocate_array<block_data_t>(sizeof(self_type) + sizeof(Value) * n).raw() );
+			}
+			
+			template<typename Allocator>
+			void destroy(Allocator& allocator) {
+				allocator.free_array(reinterpret_cast<block_data_t*>(this));
+			}
+			
 			Value& operator[](size_type i) {
 				return data_[i];
 			}
@@ -22,6 +22,7 @@
 
 #include <algorithms/rdf/inqp/row.h>
 #include <util/pstl/algorithm.h>
+#include <util/allocators/global_allocator.h>
 
 namespace wiselib {
 	
@@ -41,7 +42,8 @@ namespace wiselib {
 	 */
 	template<
 		typename OsModel_P,
-		typename Row_P = Row<OsModel_P>
+		typename Row_P = Row<OsModel_P>,
+		typename Allocator_P = GlobalAllocator<OsModel_P>
 	>
 	class Table {
 		
@@ -50,6 +52,7 @@ namespace wiselib {
 			typedef typename OsModel::block_data_t block_data_t;
 			typedef typename OsModel::size_t size_type;
 			typedef Row_P RowT;
+			typedef Allocator_P Allocator;
 			
 			enum { MIN_CAPACITY = 4 };
 			
@@ -109,7 +112,8 @@ namespace wiselib {
 					size_type row_size_;
 			};
 			
-			void init(size_type columns) {
+			void init(size_type columns, typename Allocator::self_pointer_t allocator = 0) {
+				allocator_ = allocator ? allocator : &default_allocator<Allocator>();
 				row_size_ = columns * sizeof(typename RowT::Value);
 				capacity_ = 0;
 				size_ = 0;
@@ -191,17 +195,18 @@ namespace wiselib {
 			void change_capacity(size_type n) {
 				block_data_t *new_buffer = 0;
 				if(n > 0) {
-					new_buffer = get_allocator().template allocate_array<block_data_t>(n * row_size_).raw();
+					new_buffer = allocator_->template allocate_array<block_data_t>(n * row_size_).raw();
 				}
 				if(buffer_) {
 					memcpy(new_buffer, buffer_, size_ * row_size_);
-					get_allocator().free_array(buffer_);
+					allocator_->free_array(buffer_);
 					buffer_ = 0;
 				}
 				buffer_ = new_buffer;
 				capacity_ = n;
 			}
 			
+			typename Allocator::self_pointer_t allocator_;
 			size_type row_size_;
 			::uint16_t capacity_;
 			::uint16_t size_;
@@ -59,6 +59,18 @@
 #include "external_interface/shawn/shawn_wiselib_application.h"
 #endif
 
+#ifdef WISELIB_SIM
+#include "external_interface/sim/sim_os.h"
+#include "external_interface/sim/sim_world.h"
+#include "external_interface/sim/sim_radio.h"
+#include "external_interface/sim/sim_timer.h"
+#include "external_interface/sim/sim_debug.h"
+#include "external_interface/sim/sim_clock.h"
+#include "external_interface/sim/sim_rand.h"
+#include "external_interface/sim/sim_facet_provider.h"
+#include "external_interface/sim/sim_wiselib_application.h"
+#endif
+
 #ifdef CONTIKI
 #include "external_interface/contiki/contiki_os.h"
 #include "external_interface/contiki/contiki_radio.h"
@@ -259,11 +259,13 @@ namespace wiselib {
 	int ComISenseRadioModel<OsModel_P, ComUart_P, ExtendedData_P>::
 	write_packet(packet_t& p) {
 		// Block SIGALRM to avoid interrupting call of timer_handler.
+		// Not necessary for uarts driven by an event loop.
 
 		sigset_t signal_set, old_signal_set;
-		if ( ( sigemptyset( &signal_set ) == -1 ) ||
+		if ( ComUart::BLOCKS_SIGALRM && (
+				( sigemptyset( &signal_set ) == -1 ) ||
 				( sigaddset( &signal_set, SIGALRM ) == -1 ) ||
-				pthread_sigmask( SIG_BLOCK, &signal_set, &old_signal_set ) )
+				pthread_sigmask( SIG_BLOCK, &signal_set, &old_signal_set ) ) )
 		{
 			perror( "Failed to block SIGALRM" );
 		}
@@ -300,7 +302,7 @@ namespace wiselib {
 		send_uart(ETX);
 
 		// Unblock SIGALRM.
-		if( sigismember( &old_signal_set, SIGALRM ) == 0 )
+		if( ComUart::BLOCKS_SIGALRM && sigismember( &old_signal_set, SIGALRM ) == 0 )
 		{
 			if ( ( sigemptyset( &signal_set ) == -1 ) ||
 					( sigaddset( &signal_set, SIGALRM ) == -1 ) ||
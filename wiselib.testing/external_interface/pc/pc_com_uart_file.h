@@ -89,6 +89,9 @@ namespace wiselib {
 				ERR_UNSPEC = OsModel::ERR_UNSPEC
 			};
 			
+			/// Users have to block SIGALRM while writing
+			enum { BLOCKS_SIGALRM = true };
+			
 			PCComUartModel();
 			
 			void set_baudrate(uint32_t baudrate) {
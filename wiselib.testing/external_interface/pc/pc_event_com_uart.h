@@ -0,0 +1,216 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef PC_EVENT_COM_UART_H
+#define PC_EVENT_COM_UART_H
+
+#include "util/base_classes/uart_base.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <err.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+
+namespace wiselib {
+	
+	/** \brief Uart model for PC, driven by PCEventLoop
+	 *  \ingroup uart_concept
+	 *  \ingroup serial_communication_concept
+	 *
+	 *  Same interface as PCComUartModel, but instead of polling the port
+	 *  every 10ms from a SIGALRM timer the file descriptor is registered
+	 *  with the event loop of Timer_P, so received data is delivered as
+	 *  soon as it arrives and no signals have to be masked.
+	 *
+	 *  \tparam isense_reset If true, toggle RTS/DTR lines at beginning of communication so
+	 *                 an attached iSense node will reboot.
+	 */
+	template<
+		typename OsModel_P,
+		const bool isense_reset_ = false,
+		typename Timer_P = typename OsModel_P::Timer
+	>
+	class PCEventComUartModel
+		: public UartBase<OsModel_P, typename OsModel_P::size_t, char>
+	{
+		public:
+			typedef OsModel_P OsModel;
+			typedef Timer_P Timer;
+			typedef typename Timer::EventLoop EventLoop;
+			typedef typename OsModel::size_t size_t;
+			typedef char block_data_t;
+			typedef PCEventComUartModel<OsModel_P, isense_reset_, Timer_P> self_type;
+			typedef self_type* self_pointer_t;
+			
+			enum ErrorCodes
+			{
+				SUCCESS = OsModel::SUCCESS,
+				ERR_UNSPEC = OsModel::ERR_UNSPEC
+			};
+			
+			enum {
+				BUFFER_SIZE = 256,
+				/// Callbacks run from the event loop, no need to block SIGALRM
+				BLOCKS_SIGALRM = false
+			};
+			
+			PCEventComUartModel() : baudrate_(B115200), address_("/dev/ttyUSB0"), port_fd_(-1) {
+			}
+			
+			void set_baudrate(uint32_t baudrate) {
+				switch(baudrate) {
+					case 9600: baudrate_ = B9600; break;
+					case 19200: baudrate_ = B19200; break;
+					case 38400: baudrate_ = B38400; break;
+					case 57600: baudrate_ = B57600; break;
+					case 115200: baudrate_ = B115200; break;
+					default:
+						assert(false);
+				}
+			}
+			
+			void set_address(const char* port) {
+				address_ = port;
+			}
+			
+			int enable_serial_comm();
+			int disable_serial_comm();
+			
+			int write(size_t len, block_data_t* buf);
+			void try_read(void* userdata);
+			
+			const char* address() { return address_; }
+			int fd() { return port_fd_; }
+			
+		private:
+			Timer timer_;
+			::speed_t baudrate_;
+			const char* address_;
+			int port_fd_;
+	}; // class PCEventComUartModel
+	
+	template<typename OsModel_P, const bool isense_reset_, typename Timer_P>
+	int PCEventComUartModel<OsModel_P, isense_reset_, Timer_P>::enable_serial_comm() {
+		struct termios attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.c_cflag = baudrate_|CS8|CREAD|CLOCAL; // 8N1
+		attr.c_cc[VMIN] = 1;
+		attr.c_cc[VTIME] = 0;
+		
+		port_fd_ = open(address_, O_RDWR | O_NONBLOCK | O_NOCTTY);
+		if(port_fd_ < 0) {
+			err(1, "Error opening UART %s", address_);
+		}
+		
+		if( ( cfsetospeed(&attr, baudrate_) == -1 ) ||
+			( cfsetispeed(&attr, baudrate_) == -1 ) )
+		{
+			perror( "Could not set baudrate:" );
+		}
+		
+		tcflush(port_fd_, TCOFLUSH);
+		tcflush(port_fd_, TCIFLUSH);
+		// Not a terminal (e.g. a pipe or socket) is fine, too
+		if(tcsetattr(port_fd_, TCSANOW, &attr) == -1 && errno != ENOTTY) {
+			err(1, "Error during tcsetattr() on %s", address_);
+		}
+		
+		if(isense_reset_) {
+			int status = TIOCM_RTS | TIOCM_DTR;
+			ioctl(port_fd_, TIOCMSET, &status);
+			timer_.sleep(100);
+			status = 0;
+			ioctl(port_fd_, TIOCMSET, &status);
+			timer_.sleep(100);
+		}
+		
+		if(EventLoop::add_descriptor(port_fd_,
+				EventLoop::descriptor_delegate_t::template from_method<self_type, &self_type::try_read>(this), 0
+		) != SUCCESS) {
+			return ERR_UNSPEC;
+		}
+		return SUCCESS;
+	}
+	
+	template<typename OsModel_P, const bool isense_reset_, typename Timer_P>
+	int PCEventComUartModel<OsModel_P, isense_reset_, Timer_P>::disable_serial_comm() {
+		if(port_fd_ >= 0) {
+			EventLoop::remove_descriptor(port_fd_);
+			close(port_fd_);
+			port_fd_ = -1;
+		}
+		return SUCCESS;
+	}
+	
+	template<typename OsModel_P, const bool isense_reset_, typename Timer_P>
+	int PCEventComUartModel<OsModel_P, isense_reset_, Timer_P>::
+	write(size_t len, block_data_t* buf) {
+		size_t written = 0;
+		while(written < len) {
+			int r = ::write(port_fd_, reinterpret_cast<void*>(buf + written), len - written);
+			if(r >= 0) {
+				written += r;
+			}
+			else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+				// Output buffer full, wait until the port drained instead
+				// of spinning.
+				struct pollfd p;
+				p.fd = port_fd_;
+				p.events = POLLOUT;
+				poll(&p, 1, -1);
+			}
+			else if(errno != EINTR) {
+				warn("Error writing to UART %s", address_);
+				return ERR_UNSPEC;
+			}
+		}
+		return SUCCESS;
+	}
+	
+	template<typename OsModel_P, const bool isense_reset_, typename Timer_P>
+	void PCEventComUartModel<OsModel_P, isense_reset_, Timer_P>::
+	try_read(void* userdata) {
+		block_data_t buffer[BUFFER_SIZE];
+		int bytes = ::read(port_fd_, static_cast<void*>(buffer), BUFFER_SIZE);
+		
+		if(bytes == -1) {
+			if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				err(1, "Couldnt read from UART %s", address_);
+			}
+		}
+		else if(bytes == 0) {
+			// Hangup, stop polling the descriptor
+			EventLoop::remove_descriptor(port_fd_);
+		}
+		else {
+			self_type::notify_receivers(bytes, buffer);
+		}
+	}
+	
+} // ns wiselib
+
+#endif // PC_EVENT_COM_UART_H
+
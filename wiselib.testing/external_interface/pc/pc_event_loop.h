@@ -0,0 +1,358 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef PC_EVENT_LOOP_H
+#define PC_EVENT_LOOP_H
+
+#include <time.h>
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "util/delegates/delegate.hpp"
+
+namespace wiselib {
+	
+	/**
+	 * Binary min-heap of timers with absolute deadlines (in microseconds).
+	 * insert() and pop() are O(log n), timers with equal deadlines fire in
+	 * the order they were inserted.
+	 */
+	template<typename OsModel_P, size_t MaxTimers_P>
+	class PCTimerHeap {
+		public:
+			typedef OsModel_P OsModel;
+			typedef ::uint64_t time_t;
+			typedef delegate1<void, void*> timer_delegate_t;
+			
+			enum Restrictions {
+				MAX_TIMERS = MaxTimers_P
+			};
+			
+			enum { SUCCESS = OsModel::SUCCESS, ERR_UNSPEC = OsModel::ERR_UNSPEC };
+			
+			struct Timer {
+				time_t deadline_;
+				::uint64_t sequence_;
+				timer_delegate_t callback_;
+				void *userdata_;
+				
+				bool operator<(const Timer& other) const {
+					return (deadline_ < other.deadline_) ||
+						(deadline_ == other.deadline_ && sequence_ < other.sequence_);
+				}
+			};
+			
+			PCTimerHeap() : size_(0), sequence_(0) {
+			}
+			
+			/**
+			 * @return current time of the monotonic clock in microseconds.
+			 */
+			static time_t now() {
+				struct timespec ts;
+				clock_gettime(CLOCK_MONOTONIC, &ts);
+				return (time_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+			}
+			
+			int insert(time_t deadline, timer_delegate_t callback, void* userdata) {
+				if(full()) {
+					return ERR_UNSPEC;
+				}
+				
+				Timer t;
+				t.deadline_ = deadline;
+				t.sequence_ = sequence_++;
+				t.callback_ = callback;
+				t.userdata_ = userdata;
+				
+				size_t i = size_++;
+				while(i > 0 && t < timers_[(i - 1) / 2]) {
+					timers_[i] = timers_[(i - 1) / 2];
+					i = (i - 1) / 2;
+				}
+				timers_[i] = t;
+				return SUCCESS;
+			}
+			
+			Timer& top() { return timers_[0]; }
+			
+			void pop() {
+				if(empty()) { return; }
+				
+				Timer t = timers_[--size_];
+				size_t i = 0;
+				for(size_t c = 1; c < size_; c = 2 * i + 1) {
+					if(c + 1 < size_ && timers_[c + 1] < timers_[c]) { c++; }
+					if(!(timers_[c] < t)) { break; }
+					timers_[i] = timers_[c];
+					i = c;
+				}
+				timers_[i] = t;
+			}
+			
+			size_t size() { return size_; }
+			bool empty() { return size_ == 0; }
+			bool full() { return size_ == MAX_TIMERS; }
+			
+		private:
+			Timer timers_[MAX_TIMERS];
+			size_t size_;
+			::uint64_t sequence_;
+	};
+	
+	/**
+	 * Single threaded event loop for the PC, dispatches timers and file
+	 * descriptor events from one epoll instance. Timers are kept in a
+	 * PCTimerHeap, a timerfd armed to the earliest deadline wakes the loop.
+	 * 
+	 * In contrast to PCTimerModel no signals are involved, so callbacks
+	 * never interrupt each other and components do not need to mask
+	 * SIGALRM. All state is static, i.e. all users of the same template
+	 * instance share one loop, which is driven by run() from main().
+	 */
+	template<typename OsModel_P, size_t MaxTimers_P, size_t MaxDescriptors_P = 16>
+	class PCEventLoop {
+		public:
+			typedef OsModel_P OsModel;
+			typedef PCEventLoop<OsModel_P, MaxTimers_P, MaxDescriptors_P> self_t;
+			typedef PCTimerHeap<OsModel_P, MaxTimers_P> TimerHeap;
+			typedef typename TimerHeap::time_t time_t;
+			typedef typename TimerHeap::timer_delegate_t timer_delegate_t;
+			typedef delegate1<void, void*> descriptor_delegate_t;
+			
+			enum Restrictions {
+				MAX_TIMERS = MaxTimers_P,
+				MAX_DESCRIPTORS = MaxDescriptors_P
+			};
+			
+			enum { SUCCESS = OsModel::SUCCESS, ERR_UNSPEC = OsModel::ERR_UNSPEC };
+			
+			/**
+			 * Create epoll and timer descriptors, called implicitly by all
+			 * other methods.
+			 */
+			static int init() {
+				if(epoll_fd_ >= 0) { return SUCCESS; }
+				
+				epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+				if(epoll_fd_ < 0) {
+					err(1, "epoll_create1() failed");
+				}
+				timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+				if(timer_fd_ < 0) {
+					err(1, "timerfd_create() failed");
+				}
+				
+				struct epoll_event ev;
+				ev.events = EPOLLIN;
+				ev.data.u32 = TIMER_SLOT;
+				if(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &ev) == -1) {
+					err(1, "epoll_ctl() failed for timerfd");
+				}
+				
+				for(size_t i = 0; i < MAX_DESCRIPTORS; i++) {
+					descriptors_[i].fd_ = -1;
+				}
+				return SUCCESS;
+			}
+			
+			/**
+			 * @return current time of the monotonic clock in microseconds.
+			 */
+			static time_t now() { return TimerHeap::now(); }
+			
+			/**
+			 * Call \p callback with \p userdata \p micros microseconds from
+			 * now.
+			 */
+			static int add_timer(time_t micros, timer_delegate_t callback, void* userdata) {
+				init();
+				time_t deadline = now() + micros;
+				bool earliest = timers_.empty() || deadline < timers_.top().deadline_;
+				if(timers_.insert(deadline, callback, userdata) != SUCCESS) {
+					return ERR_UNSPEC;
+				}
+				if(earliest) {
+					arm(deadline);
+				}
+				return SUCCESS;
+			}
+			
+			/**
+			 * Call \p callback with \p userdata whenever \p fd signals one of
+			 * \p events (default: readable).
+			 */
+			static int add_descriptor(int fd, descriptor_delegate_t callback, void* userdata,
+					::uint32_t events = EPOLLIN) {
+				init();
+				size_t i = 0;
+				for( ; i < MAX_DESCRIPTORS && descriptors_[i].fd_ >= 0; i++) { }
+				if(i == MAX_DESCRIPTORS) { return ERR_UNSPEC; }
+				
+				struct epoll_event ev;
+				ev.events = events;
+				ev.data.u32 = i;
+				if(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == -1) {
+					warn("epoll_ctl() failed for fd %d", fd);
+					return ERR_UNSPEC;
+				}
+				
+				descriptors_[i].fd_ = fd;
+				descriptors_[i].callback_ = callback;
+				descriptors_[i].userdata_ = userdata;
+				return SUCCESS;
+			}
+			
+			static int remove_descriptor(int fd) {
+				for(size_t i = 0; i < MAX_DESCRIPTORS; i++) {
+					if(descriptors_[i].fd_ == fd) {
+						epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, 0);
+						descriptors_[i].fd_ = -1;
+						return SUCCESS;
+					}
+				}
+				return ERR_UNSPEC;
+			}
+			
+			/**
+			 * Wait at most \p timeout_ms milliseconds (-1: forever) for
+			 * events and dispatch them.
+			 */
+			static int run_once(int timeout_ms = -1) {
+				init();
+				
+				struct epoll_event events[MAX_DESCRIPTORS + 1];
+				int n = epoll_wait(epoll_fd_, events, MAX_DESCRIPTORS + 1, timeout_ms);
+				if(n < 0) {
+					if(errno == EINTR) { return SUCCESS; }
+					err(1, "epoll_wait() failed");
+				}
+				
+				for(int i = 0; i < n; i++) {
+					::uint32_t slot = events[i].data.u32;
+					if(slot == TIMER_SLOT) {
+						::uint64_t expirations;
+						if(read(timer_fd_, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+							err(1, "read() from timerfd failed");
+						}
+						dispatch_timers();
+					}
+					else if(descriptors_[slot].fd_ >= 0) {
+						Descriptor &d = descriptors_[slot];
+						d.callback_(d.userdata_);
+					}
+				}
+				return SUCCESS;
+			}
+			
+			/**
+			 * Dispatch events until stop() is called.
+			 */
+			static int run() {
+				running_ = true;
+				while(running_) {
+					run_once();
+				}
+				return SUCCESS;
+			}
+			
+			/**
+			 * Dispatch events for \p micros microseconds.
+			 */
+			static int run_for(time_t micros) {
+				time_t end = now() + micros;
+				for(time_t t = now(); t < end; t = now()) {
+					run_once((int)((end - t + 999) / 1000));
+				}
+				return SUCCESS;
+			}
+			
+			static void stop() { running_ = false; }
+			
+			static size_t timers() { return timers_.size(); }
+			
+		private:
+			enum { TIMER_SLOT = 0xffffffff };
+			
+			struct Descriptor {
+				int fd_;
+				descriptor_delegate_t callback_;
+				void *userdata_;
+			};
+			
+			static void arm(time_t deadline) {
+				struct itimerspec spec;
+				spec.it_interval.tv_sec = 0;
+				spec.it_interval.tv_nsec = 0;
+				// it_value 0 would disarm
+				if(deadline == 0) { deadline = 1; }
+				spec.it_value.tv_sec = deadline / 1000000;
+				spec.it_value.tv_nsec = (deadline % 1000000) * 1000;
+				if(timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, 0) == -1) {
+					err(1, "timerfd_settime() failed");
+				}
+			}
+			
+			static void dispatch_timers() {
+				time_t t = now();
+				while(!timers_.empty() && timers_.top().deadline_ <= t) {
+					timer_delegate_t callback = timers_.top().callback_;
+					void *userdata = timers_.top().userdata_;
+					timers_.pop();
+					callback(userdata);
+				}
+				if(!timers_.empty()) {
+					arm(timers_.top().deadline_);
+				}
+			}
+			
+			static int epoll_fd_;
+			static int timer_fd_;
+			static bool running_;
+			static TimerHeap timers_;
+			static Descriptor descriptors_[MaxDescriptors_P];
+	}; // class PCEventLoop
+	
+	template<typename OsModel_P, size_t MaxTimers_P, size_t MaxDescriptors_P>
+	int PCEventLoop<OsModel_P, MaxTimers_P, MaxDescriptors_P>::epoll_fd_ = -1;
+	
+	template<typename OsModel_P, size_t MaxTimers_P, size_t MaxDescriptors_P>
+	int PCEventLoop<OsModel_P, MaxTimers_P, MaxDescriptors_P>::timer_fd_ = -1;
+	
+	template<typename OsModel_P, size_t MaxTimers_P, size_t MaxDescriptors_P>
+	bool PCEventLoop<OsModel_P, MaxTimers_P, MaxDescriptors_P>::running_ = false;
+	
+	template<typename OsModel_P, size_t MaxTimers_P, size_t MaxDescriptors_P>
+	typename PCEventLoop<OsModel_P, MaxTimers_P, MaxDescriptors_P>::TimerHeap
+	PCEventLoop<OsModel_P, MaxTimers_P, MaxDescriptors_P>::timers_;
+	
+	template<typename OsModel_P, size_t MaxTimers_P, size_t MaxDescriptors_P>
+	typename PCEventLoop<OsModel_P, MaxTimers_P, MaxDescriptors_P>::Descriptor
+	PCEventLoop<OsModel_P, MaxTimers_P, MaxDescriptors_P>::descriptors_[MaxDescriptors_P];
+	
+} // namespace wiselib
+
+#endif // PC_EVENT_LOOP_H
+
@@ -0,0 +1,85 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef PC_EVENT_TIMER_H
+#define PC_EVENT_TIMER_H
+
+#include <sys/types.h>
+
+#include "external_interface/pc/pc_event_loop.h"
+#include "util/delegates/delegate.hpp"
+
+namespace wiselib {
+	
+	/**
+	 * Timer model driven by PCEventLoop (timerfd + epoll) instead of
+	 * SIGALRM. Callbacks are executed from PCEventLoop::run(), so they
+	 * never interrupt other code.
+	 * 
+	 * \ingroup timer_concept
+	 */
+	template<typename OsModel_P, size_t MaxTimers_P, size_t MaxDescriptors_P = 16>
+	class PCEventTimerModel {
+		public:
+			typedef OsModel_P OsModel;
+			typedef suseconds_t millis_t;
+			typedef suseconds_t micros_t;
+			typedef delegate1<void, void*> timer_delegate_t;
+			typedef PCEventTimerModel<OsModel_P, MaxTimers_P, MaxDescriptors_P> self_t;
+			typedef self_t* self_pointer_t;
+			typedef PCEventLoop<OsModel_P, MaxTimers_P, MaxDescriptors_P> EventLoop;
+			
+			enum Restrictions {
+				MAX_TIMERS = MaxTimers_P
+			};
+			enum { SUCCESS = OsModel::SUCCESS, ERR_UNSPEC = OsModel::ERR_UNSPEC };
+			
+			template<typename T, void (T::*TMethod)(void*)>
+			int set_timer(millis_t millis, T* obj, void* userdata) {
+				if(millis < 1) {
+					return ERR_UNSPEC;
+				}
+				return EventLoop::add_timer((typename EventLoop::time_t)millis * 1000,
+						timer_delegate_t::template from_method<T, TMethod>(obj), userdata);
+			}
+			
+			/**
+			 * Like set_timer() but with microsecond resolution.
+			 */
+			template<typename T, void (T::*TMethod)(void*)>
+			int set_timer_micros(micros_t micros, T* obj, void* userdata) {
+				return EventLoop::add_timer(micros,
+						timer_delegate_t::template from_method<T, TMethod>(obj), userdata);
+			}
+			
+			/**
+			 * Wait for \p duration milliseconds. Timers and descriptor
+			 * events that become due meanwhile are dispatched.
+			 */
+			int sleep(millis_t duration) {
+				return EventLoop::run_for((typename EventLoop::time_t)duration * 1000);
+			}
+	}; // class PCEventTimerModel
+	
+} // namespace wiselib
+
+#endif // PC_EVENT_TIMER_H
+
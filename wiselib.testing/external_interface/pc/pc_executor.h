@@ -0,0 +1,301 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef PC_EXECUTOR_H
+#define PC_EXECUTOR_H
+
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "external_interface/pc/pc_event_loop.h"
+#include "external_interface/pc/pc_mpsc_queue.h"
+#include "util/delegates/delegate.hpp"
+
+namespace wiselib {
+	
+	/**
+	 * A worker thread with its own timer queue.
+	 * 
+	 * All callbacks (timers, posted tasks) of an executor run on its
+	 * thread, so code bound to one executor never runs concurrently with
+	 * itself and needs no locking. Other threads hand over work through a
+	 * lock-free PCMpscQueue and wake the worker with an eventfd, timers
+	 * are kept in a PCTimerHeap and wake the worker through a timerfd.
+	 * 
+	 * Usage: init(), start(), post() / add_timer() from any thread,
+	 * stop(), join().
+	 */
+	template<typename OsModel_P, size_t MaxTimers_P = 256, unsigned long QueueSize_P = 1024>
+	class PCExecutor {
+		public:
+			typedef OsModel_P OsModel;
+			typedef PCExecutor<OsModel_P, MaxTimers_P, QueueSize_P> self_type;
+			typedef self_type* self_pointer_t;
+			typedef PCTimerHeap<OsModel_P, MaxTimers_P> TimerHeap;
+			typedef typename TimerHeap::time_t time_t;
+			typedef delegate1<void, void*> task_delegate_t;
+			
+			enum Restrictions {
+				MAX_TIMERS = MaxTimers_P,
+				QUEUE_SIZE = QueueSize_P
+			};
+			
+			enum { SUCCESS = OsModel::SUCCESS, ERR_UNSPEC = OsModel::ERR_UNSPEC };
+			
+			PCExecutor() : epoll_fd_(-1), timer_fd_(-1), wake_fd_(-1), running_(false), signaled_(0) {
+			}
+			
+			int init() {
+				epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+				timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+				wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+				if(epoll_fd_ < 0 || timer_fd_ < 0 || wake_fd_ < 0) {
+					warn("PCExecutor: could not create descriptors");
+					return ERR_UNSPEC;
+				}
+				
+				struct epoll_event ev;
+				ev.events = EPOLLIN;
+				ev.data.fd = timer_fd_;
+				epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &ev);
+				ev.data.fd = wake_fd_;
+				epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+				
+				armed_ = 0;
+				return SUCCESS;
+			}
+			
+			void destruct() {
+				close(epoll_fd_);
+				close(timer_fd_);
+				close(wake_fd_);
+				epoll_fd_ = timer_fd_ = wake_fd_ = -1;
+			}
+			
+			/**
+			 * Spawn the worker thread.
+			 */
+			int start() {
+				__atomic_store_n(&running_, true, __ATOMIC_SEQ_CST);
+				if(pthread_create(&thread_, 0, &self_type::thread_main, this) != 0) {
+					running_ = false;
+					return ERR_UNSPEC;
+				}
+				return SUCCESS;
+			}
+			
+			/**
+			 * Ask the worker to return after the current iteration, may be
+			 * called from any thread.
+			 */
+			void stop() {
+				__atomic_store_n(&running_, false, __ATOMIC_SEQ_CST);
+				wake();
+			}
+			
+			int join() {
+				return pthread_join(thread_, 0) ? ERR_UNSPEC : SUCCESS;
+			}
+			
+			/**
+			 * Run \p callback(\p userdata) on the worker thread as soon as
+			 * possible. May be called from any thread.
+			 */
+			int post(task_delegate_t callback, void* userdata) {
+				return enqueue(0, callback, userdata);
+			}
+			
+			/**
+			 * Run \p callback(\p userdata) on the worker thread in \p micros
+			 * microseconds. May be called from any thread, from the worker
+			 * itself the timer is added to the heap directly.
+			 */
+			int add_timer(time_t micros, task_delegate_t callback, void* userdata) {
+				time_t deadline = TimerHeap::now() + micros;
+				if(current() != this) {
+					return enqueue(deadline, callback, userdata);
+				}
+				if(timers_.insert(deadline, callback, userdata) != SUCCESS) {
+					return ERR_UNSPEC;
+				}
+				rearm();
+				return SUCCESS;
+			}
+			
+			/**
+			 * @return the executor whose worker thread is calling, 0 for
+			 * other threads.
+			 */
+			static self_pointer_t current() { return current_; }
+			
+			/**
+			 * Worker loop, usually entered through start(). Can also be run
+			 * on an existing thread (e.g. main).
+			 */
+			int run() {
+				current_ = this;
+				while(__atomic_load_n(&running_, __ATOMIC_SEQ_CST)) {
+					run_once(-1);
+				}
+				// deliver whatever was handed over before stop()
+				drain();
+				current_ = 0;
+				return SUCCESS;
+			}
+			
+			/**
+			 * Wait at most \p timeout_ms milliseconds for and dispatch
+			 * events.
+			 */
+			int run_once(int timeout_ms) {
+				current_ = this;
+				struct epoll_event events[2];
+				int n = epoll_wait(epoll_fd_, events, 2, timeout_ms);
+				if(n < 0 && errno != EINTR) {
+					err(1, "epoll_wait() failed");
+				}
+				
+				::uint64_t v;
+				for(int i = 0; i < n; i++) {
+					if(read(events[i].data.fd, &v, sizeof(v)) < 0 && errno != EAGAIN) {
+						err(1, "read() failed");
+					}
+					if(events[i].data.fd == timer_fd_) {
+						armed_ = 0;
+					}
+				}
+				
+				drain();
+				dispatch_timers();
+				return SUCCESS;
+			}
+			
+			size_t timers() { return timers_.size(); }
+			
+		private:
+			struct Task {
+				time_t deadline_;
+				task_delegate_t callback_;
+				void *userdata_;
+			};
+			
+			static void* thread_main(void* self) {
+				reinterpret_cast<self_pointer_t>(self)->run();
+				return 0;
+			}
+			
+			int enqueue(time_t deadline, task_delegate_t callback, void* userdata) {
+				Task t;
+				t.deadline_ = deadline;
+				t.callback_ = callback;
+				t.userdata_ = userdata;
+				if(!tasks_.push(t)) {
+					return ERR_UNSPEC;
+				}
+				// Only the first producer after the worker went through
+				// drain() needs to pay for the system call.
+				if(__atomic_exchange_n(&signaled_, 1, __ATOMIC_SEQ_CST) == 0) {
+					wake();
+				}
+				return SUCCESS;
+			}
+			
+			void wake() {
+				::uint64_t one = 1;
+				if(write(wake_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+					warn("PCExecutor: write() to eventfd failed");
+				}
+			}
+			
+			void drain() {
+				__atomic_store_n(&signaled_, 0, __ATOMIC_SEQ_CST);
+				
+				Task t;
+				while(tasks_.pop(t)) {
+					if(t.deadline_) {
+						if(timers_.insert(t.deadline_, t.callback_, t.userdata_) != SUCCESS) {
+							warn("PCExecutor: timer queue full, dropping timer");
+						}
+					}
+					else {
+						t.callback_(t.userdata_);
+					}
+				}
+			}
+			
+			void dispatch_timers() {
+				time_t now = TimerHeap::now();
+				while(!timers_.empty() && timers_.top().deadline_ <= now) {
+					task_delegate_t callback = timers_.top().callback_;
+					void *userdata = timers_.top().userdata_;
+					timers_.pop();
+					callback(userdata);
+				}
+				rearm();
+			}
+			
+			/**
+			 * Point the timerfd to the earliest deadline unless it is
+			 * already.
+			 */
+			void rearm() {
+				if(timers_.empty() || timers_.top().deadline_ == armed_) {
+					return;
+				}
+				armed_ = timers_.top().deadline_;
+				
+				struct itimerspec spec;
+				spec.it_interval.tv_sec = 0;
+				spec.it_interval.tv_nsec = 0;
+				spec.it_value.tv_sec = armed_ / 1000000;
+				spec.it_value.tv_nsec = (armed_ % 1000000) * 1000;
+				if(timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, 0) == -1) {
+					err(1, "timerfd_settime() failed");
+				}
+			}
+			
+			int epoll_fd_;
+			int timer_fd_;
+			int wake_fd_;
+			bool running_;
+			int signaled_;
+			time_t armed_;
+			pthread_t thread_;
+			TimerHeap timers_;
+			PCMpscQueue<OsModel, Task, QueueSize_P> tasks_;
+			
+			static __thread self_pointer_t current_;
+	}; // class PCExecutor
+	
+	template<typename OsModel_P, size_t MaxTimers_P, unsigned long QueueSize_P>
+	__thread typename PCExecutor<OsModel_P, MaxTimers_P, QueueSize_P>::self_pointer_t
+	PCExecutor<OsModel_P, MaxTimers_P, QueueSize_P>::current_ = 0;
+	
+} // namespace wiselib
+
+#endif // PC_EXECUTOR_H
+
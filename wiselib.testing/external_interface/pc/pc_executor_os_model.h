@@ -0,0 +1,79 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef PC_EXECUTOR_OS_MODEL_H
+#define PC_EXECUTOR_OS_MODEL_H
+
+#include <stdint.h>
+#include <cassert>
+
+#include "external_interface/default_return_values.h"
+#include "external_interface/pc/pc_os_model.h"
+#include "external_interface/pc/pc_executor.h"
+#include "external_interface/pc/pc_executor_timer.h"
+#include "external_interface/pc/pc_executor_radio.h"
+#include "util/serialization/endian.h"
+
+namespace wiselib {
+	
+	/**
+	 * Multi threaded PC OS model for hosting many virtual nodes in one
+	 * process.
+	 * 
+	 * Every node is bound to one Executor (a worker thread with its own
+	 * timer queue), all its timer and radio callbacks run on that thread.
+	 * Algorithms use Timer and Radio exactly as with other OS models; a
+	 * node is set up by posting its initialization to its executor, e.g.
+	 * 
+	 * \code
+	 * Os::Executor workers[4];
+	 * for(i...) { workers[i].init(); workers[i].start(); }
+	 * for(n...) { workers[n % 4].post(delegate for node n's init(), &node[n]); }
+	 * \endcode
+	 * 
+	 * Timer and radio instances created or initialized on an executor
+	 * thread bind to that executor automatically.
+	 */
+	class PCExecutorOsModel
+		: public DefaultReturnValues<PCExecutorOsModel>
+	{
+		public:
+			typedef PCExecutorOsModel AppMainParameter;
+			typedef PCExecutorOsModel Os;
+			
+			typedef unsigned long size_t;
+			typedef uint8_t block_data_t;
+			
+			typedef PCExecutor<PCExecutorOsModel> Executor;
+			
+			typedef PCClockModel<PCExecutorOsModel> Clock;
+			typedef PCDebug<PCExecutorOsModel> Debug;
+			typedef PCRandModel<PCExecutorOsModel> Rand;
+			typedef PCMutex<PCExecutorOsModel> Mutex;
+			typedef PCExecutorTimerModel<PCExecutorOsModel> Timer;
+			typedef PCExecutorRadioModel<PCExecutorOsModel> Radio;
+			
+			static const Endianness endianness = WISELIB_ENDIANNESS;
+	};
+} // ns wiselib
+
+#endif // PC_EXECUTOR_OS_MODEL_H
+
@@ -0,0 +1,194 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef PC_EXECUTOR_RADIO_H
+#define PC_EXECUTOR_RADIO_H
+
+#include <string.h>
+
+#include "util/base_classes/radio_base.h"
+#include "external_interface/pc/pc_executor.h"
+#include "external_interface/pc/pc_mpsc_queue.h"
+
+namespace wiselib {
+	
+	/**
+	 * In-process radio for virtual nodes hosted on PCExecutor threads.
+	 * 
+	 * All enabled radios of the same type form one lossless, fully
+	 * connected medium. send() copies the message into the inbox of the
+	 * receiving radio (a lock-free PCMpscQueue) and schedules delivery on
+	 * the receiver's executor, so receive callbacks always run on the
+	 * thread that owns the receiving node. Messages to a full inbox are
+	 * dropped.
+	 * 
+	 * Radios must be disabled before they are destroyed and while no
+	 * other node is sending, i.e. typically after all executors stopped.
+	 * 
+	 * \ingroup radio_concept
+	 */
+	template<
+		typename OsModel_P,
+		typename Executor_P = typename OsModel_P::Executor,
+		int MAX_NODES_P = 1024,
+		unsigned long INBOX_SIZE_P = 256
+	>
+	class PCExecutorRadioModel
+		: public RadioBase<OsModel_P, ::uint16_t, typename OsModel_P::size_t, typename OsModel_P::block_data_t>
+	{
+		public:
+			typedef OsModel_P OsModel;
+			typedef Executor_P Executor;
+			typedef ::uint16_t node_id_t;
+			typedef typename OsModel::size_t size_t;
+			typedef typename OsModel::block_data_t block_data_t;
+			typedef ::uint8_t message_id_t;
+			typedef PCExecutorRadioModel<OsModel_P, Executor_P, MAX_NODES_P, INBOX_SIZE_P> self_type;
+			typedef self_type* self_pointer_t;
+			
+			enum { SUCCESS = OsModel::SUCCESS, ERR_UNSPEC = OsModel::ERR_UNSPEC };
+			
+			enum SpecialNodeIds {
+				BROADCAST_ADDRESS = 0xffff,
+				NULL_NODE_ID = 0xfffe
+			};
+			
+			enum Restrictions {
+				MAX_MESSAGE_LENGTH = 116,
+				MAX_NODES = MAX_NODES_P
+			};
+			
+			PCExecutorRadioModel() : id_(NULL_NODE_ID), executor_(0), scheduled_(0) {
+			}
+			
+			/**
+			 * @param id node id, smaller than MAX_NODES.
+			 * @param executor executor to deliver received messages on,
+			 *   defaults to the calling one.
+			 */
+			int init(node_id_t id, Executor* executor = 0) {
+				if(id >= MAX_NODES) {
+					return ERR_UNSPEC;
+				}
+				id_ = id;
+				executor_ = executor ? executor : Executor::current();
+				return executor_ ? SUCCESS : ERR_UNSPEC;
+			}
+			
+			int enable_radio() {
+				if(id_ >= MAX_NODES) { return ERR_UNSPEC; }
+				__atomic_store_n(&radios_[id_], this, __ATOMIC_RELEASE);
+				
+				int n = __atomic_load_n(&nodes_, __ATOMIC_RELAXED);
+				while(n <= id_ && !__atomic_compare_exchange_n(&nodes_, &n, id_ + 1,
+							true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+				}
+				return SUCCESS;
+			}
+			
+			int disable_radio() {
+				if(id_ >= MAX_NODES) { return ERR_UNSPEC; }
+				__atomic_store_n(&radios_[id_], (self_pointer_t)0, __ATOMIC_RELEASE);
+				return SUCCESS;
+			}
+			
+			node_id_t id() { return id_; }
+			
+			/**
+			 * May be called from any thread.
+			 */
+			int send(node_id_t destination, size_t len, block_data_t* data) {
+				if(len > MAX_MESSAGE_LENGTH) {
+					return ERR_UNSPEC;
+				}
+				
+				if(destination == BROADCAST_ADDRESS) {
+					int n = __atomic_load_n(&nodes_, __ATOMIC_ACQUIRE);
+					for(int i = 0; i < n; i++) {
+						self_pointer_t r = __atomic_load_n(&radios_[i], __ATOMIC_ACQUIRE);
+						if(r && r != this) {
+							r->deliver(id_, len, data);
+						}
+					}
+					return SUCCESS;
+				}
+				
+				if(destination >= MAX_NODES) { return ERR_UNSPEC; }
+				self_pointer_t r = __atomic_load_n(&radios_[destination], __ATOMIC_ACQUIRE);
+				return r ? r->deliver(id_, len, data) : ERR_UNSPEC;
+			}
+			
+		private:
+			struct Message {
+				node_id_t from_;
+				::uint16_t length_;
+				block_data_t data_[MAX_MESSAGE_LENGTH];
+			};
+			
+			int deliver(node_id_t from, size_t len, block_data_t* data) {
+				Message m;
+				m.from_ = from;
+				m.length_ = len;
+				memcpy(m.data_, data, len);
+				if(!inbox_.push(m)) {
+					return ERR_UNSPEC;
+				}
+				
+				// One pending receive task per radio is enough
+				if(__atomic_exchange_n(&scheduled_, 1, __ATOMIC_SEQ_CST) == 0) {
+					if(executor_->post(
+						Executor::task_delegate_t::template from_method<self_type, &self_type::receive>(this), 0
+					) != SUCCESS) {
+						// message stays in the inbox, next send retries
+						__atomic_store_n(&scheduled_, 0, __ATOMIC_SEQ_CST);
+					}
+				}
+				return SUCCESS;
+			}
+			
+			void receive(void*) {
+				__atomic_store_n(&scheduled_, 0, __ATOMIC_SEQ_CST);
+				Message m;
+				while(inbox_.pop(m)) {
+					this->notify_receivers(m.from_, m.length_, m.data_);
+				}
+			}
+			
+			node_id_t id_;
+			Executor *executor_;
+			int scheduled_;
+			PCMpscQueue<OsModel, Message, INBOX_SIZE_P> inbox_;
+			
+			static self_pointer_t radios_[MAX_NODES_P];
+			static int nodes_;
+	}; // class PCExecutorRadioModel
+	
+	template<typename OsModel_P, typename Executor_P, int MAX_NODES_P, unsigned long INBOX_SIZE_P>
+	typename PCExecutorRadioModel<OsModel_P, Executor_P, MAX_NODES_P, INBOX_SIZE_P>::self_pointer_t
+	PCExecutorRadioModel<OsModel_P, Executor_P, MAX_NODES_P, INBOX_SIZE_P>::radios_[MAX_NODES_P];
+	
+	template<typename OsModel_P, typename Executor_P, int MAX_NODES_P, unsigned long INBOX_SIZE_P>
+	int PCExecutorRadioModel<OsModel_P, Executor_P, MAX_NODES_P, INBOX_SIZE_P>::nodes_ = 0;
+	
+} // namespace wiselib
+
+#endif // PC_EXECUTOR_RADIO_H
+
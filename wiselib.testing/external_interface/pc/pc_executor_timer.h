@@ -0,0 +1,103 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef PC_EXECUTOR_TIMER_H
+#define PC_EXECUTOR_TIMER_H
+
+#include <time.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include "external_interface/pc/pc_executor.h"
+#include "util/delegates/delegate.hpp"
+
+namespace wiselib {
+	
+	/**
+	 * Timer model for PCExecutorOsModel.
+	 * 
+	 * Callbacks are delivered on the thread of the executor the timer is
+	 * bound to: the one passed to init() or, by default, the executor
+	 * calling set_timer(). Timers set from other threads are handed over
+	 * through the executor's task queue.
+	 * 
+	 * \ingroup timer_concept
+	 */
+	template<typename OsModel_P, typename Executor_P = typename OsModel_P::Executor>
+	class PCExecutorTimerModel {
+		public:
+			typedef OsModel_P OsModel;
+			typedef Executor_P Executor;
+			typedef suseconds_t millis_t;
+			typedef suseconds_t micros_t;
+			typedef delegate1<void, void*> timer_delegate_t;
+			typedef PCExecutorTimerModel<OsModel_P, Executor_P> self_t;
+			typedef self_t* self_pointer_t;
+			
+			enum Restrictions {
+				MAX_TIMERS = Executor::MAX_TIMERS
+			};
+			enum { SUCCESS = OsModel::SUCCESS, ERR_UNSPEC = OsModel::ERR_UNSPEC };
+			
+			PCExecutorTimerModel() : executor_(0) {
+			}
+			
+			int init(Executor& executor) {
+				executor_ = &executor;
+				return SUCCESS;
+			}
+			
+			template<typename T, void (T::*TMethod)(void*)>
+			int set_timer(millis_t millis, T* obj, void* userdata) {
+				Executor *e = executor();
+				if(millis < 1 || !e) {
+					return ERR_UNSPEC;
+				}
+				return e->add_timer((typename Executor::time_t)millis * 1000,
+						timer_delegate_t::template from_method<T, TMethod>(obj), userdata);
+			}
+			
+			/**
+			 * Block the calling thread for \p millis milliseconds, callbacks
+			 * of its executor are delayed meanwhile.
+			 */
+			int sleep(millis_t millis) {
+				timespec interval, remainder;
+				interval.tv_sec = millis / 1000;
+				interval.tv_nsec = (millis % 1000) * 1000000;
+				while((nanosleep(&interval, &remainder) == -1) && (errno == EINTR)) {
+					interval = remainder;
+				}
+				return SUCCESS;
+			}
+			
+			Executor* executor() {
+				return executor_ ? executor_ : Executor::current();
+			}
+			
+		private:
+			Executor *executor_;
+	}; // class PCExecutorTimerModel
+	
+} // namespace wiselib
+
+#endif // PC_EXECUTOR_TIMER_H
+
@@ -0,0 +1,131 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef PC_MPSC_QUEUE_H
+#define PC_MPSC_QUEUE_H
+
+#include "util/meta.h"
+
+namespace wiselib {
+	
+	/**
+	 * Bounded lock-free multi producer, single consumer queue.
+	 * 
+	 * push() may be called from any thread, pop() only from one consumer
+	 * thread. Each cell carries a sequence number telling whether it is
+	 * free for the producer of position i (sequence == i) or filled for the
+	 * consumer (sequence == i + 1), producers claim positions with a CAS on
+	 * the enqueue counter (D. Vyukov's bounded queue).
+	 * 
+	 * Uses GCC __atomic builtins, PC only.
+	 * 
+	 * @tparam SIZE_P capacity, must be a power of two.
+	 */
+	template<typename OsModel_P, typename Value_P, unsigned long SIZE_P>
+	class PCMpscQueue {
+		public:
+			typedef OsModel_P OsModel;
+			typedef Value_P value_type;
+			typedef typename OsModel::size_t size_type;
+			
+			enum { SIZE = SIZE_P, MASK = SIZE_P - 1 };
+			
+			PCMpscQueue() {
+				static_assert(((SIZE & MASK) == 0));
+				for(size_type i = 0; i < SIZE; i++) {
+					cells_[i].sequence_ = i;
+				}
+				enqueue_position_ = 0;
+				dequeue_position_ = 0;
+			}
+			
+			/**
+			 * @return false iff the queue is full.
+			 */
+			bool push(const value_type& v) {
+				Cell *cell;
+				size_type position = __atomic_load_n(&enqueue_position_, __ATOMIC_RELAXED);
+				while(true) {
+					cell = &cells_[position & MASK];
+					size_type sequence = __atomic_load_n(&cell->sequence_, __ATOMIC_ACQUIRE);
+					long diff = (long)sequence - (long)position;
+					if(diff == 0) {
+						if(__atomic_compare_exchange_n(&enqueue_position_, &position, position + 1,
+									true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+							break;
+						}
+					}
+					else if(diff < 0) {
+						return false;
+					}
+					else {
+						position = __atomic_load_n(&enqueue_position_, __ATOMIC_RELAXED);
+					}
+				}
+				cell->value_ = v;
+				__atomic_store_n(&cell->sequence_, position + 1, __ATOMIC_RELEASE);
+				return true;
+			}
+			
+			/**
+			 * Consumer only.
+			 * @return false iff the queue is empty.
+			 */
+			bool pop(value_type& v) {
+				Cell &cell = cells_[dequeue_position_ & MASK];
+				size_type sequence = __atomic_load_n(&cell.sequence_, __ATOMIC_ACQUIRE);
+				if(sequence != dequeue_position_ + 1) {
+					return false;
+				}
+				v = cell.value_;
+				__atomic_store_n(&cell.sequence_, dequeue_position_ + SIZE, __ATOMIC_RELEASE);
+				dequeue_position_++;
+				return true;
+			}
+			
+			/**
+			 * Consumer only.
+			 */
+			bool empty() {
+				Cell &cell = cells_[dequeue_position_ & MASK];
+				return __atomic_load_n(&cell.sequence_, __ATOMIC_ACQUIRE) != dequeue_position_ + 1;
+			}
+			
+		private:
+			enum { CACHE_LINE = 64 };
+			
+			struct Cell {
+				size_type sequence_;
+				value_type value_;
+			};
+			
+			Cell cells_[SIZE];
+			// producers and consumer work on different cache lines
+			char pad0_[CACHE_LINE];
+			size_type enqueue_position_;
+			char pad1_[CACHE_LINE];
+			size_type dequeue_position_;
+	};
+	
+} // namespace wiselib
+
+#endif // PC_MPSC_QUEUE_H
+
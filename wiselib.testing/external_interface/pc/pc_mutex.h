@@ -0,0 +1,65 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef PC_MUTEX_H
+#define PC_MUTEX_H
+
+#include <pthread.h>
+
+namespace wiselib {
+	
+	/**
+	 * @brief Non-recursive mutex backed by a pthread mutex.
+	 * 
+	 * Concept: Mutex (lock(), unlock(), try_lock()), see NullMutex for
+	 * the single threaded no-op version.
+	 */
+	template<typename OsModel_P>
+	class PCMutex {
+		public:
+			typedef OsModel_P OsModel;
+			typedef PCMutex<OsModel> self_type;
+			typedef self_type* self_pointer_t;
+			
+			PCMutex() {
+				pthread_mutex_init(&mutex_, 0);
+			}
+			
+			~PCMutex() {
+				pthread_mutex_destroy(&mutex_);
+			}
+			
+			void lock() { pthread_mutex_lock(&mutex_); }
+			void unlock() { pthread_mutex_unlock(&mutex_); }
+			bool try_lock() { return pthread_mutex_trylock(&mutex_) == 0; }
+			
+		private:
+			// not copyable
+			PCMutex(const self_type&);
+			self_type& operator=(const self_type&);
+			
+			pthread_mutex_t mutex_;
+	};
+	
+}; // ns wiselib
+
+#endif // PC_MUTEX_H
+
@@ -38,7 +38,13 @@
 #include "pc_debug.h"
 #include "pc_rand.h"
 #include "pc_timer.h"
+#include "pc_mutex.h"
 #include "pc_com_uart.h"
+#if PC_EVENT_LOOP
+#include "pc_event_timer.h"
+#include "pc_event_com_uart.h"
+#include "pc_socket_radio.h"
+#endif
 #include "com_isense_radio.h"
 #include "util/serialization/endian.h"
 
@@ -50,6 +56,10 @@
 #include "algorithms/block_memory/file_block_memory.h"
 #endif
 
+#if USE_MMAP_BLOCK_MEMORY
+#include "algorithms/block_memory/mmap_block_memory.h"
+#endif
+
 namespace wiselib {
 	class PCOsModel
 		: public DefaultReturnValues<PCOsModel>
@@ -72,10 +82,20 @@ namespace wiselib {
 			// isense node is known so it has to be instantiated by the user
 			
 			typedef PCRandModel<PCOsModel> Rand;
-			typedef PCTimerModel<PCOsModel, 100> Timer;
+			typedef PCMutex<PCOsModel> Mutex;
 			
+#if PC_EVENT_LOOP
+			// timerfd/epoll based runtime, see pc_event_loop.h
+			typedef PCEventTimerModel<PCOsModel, 100> Timer;
+			typedef PCEventComUartModel<PCOsModel, true> ISenseUart;
+			typedef PCEventComUartModel<PCOsModel, false> Uart;
+			// local multi-process testbeds, instantiated by the user as well
+			typedef PCSocketRadioModel<PCOsModel> SocketRadio;
+#else
+			typedef PCTimerModel<PCOsModel, 100> Timer;
 			typedef PCComUartModel<PCOsModel, true> ISenseUart;
 			typedef PCComUartModel<PCOsModel, false> Uart;
+#endif
 			typedef ComISenseRadioModel<PCOsModel, ISenseUart> Radio;
 			
 #if USE_RAM_BLOCK_MEMORY
@@ -84,6 +104,9 @@ namespace wiselib {
 #if USE_FILE_BLOCK_MEMORY
 			typedef FileBlockMemory<PCOsModel> BlockMemory;
 #endif
+#if USE_MMAP_BLOCK_MEMORY
+			typedef MmapBlockMemory<PCOsModel> BlockMemory;
+#endif
 
 			static const Endianness endianness = WISELIB_ENDIANNESS;
 	};
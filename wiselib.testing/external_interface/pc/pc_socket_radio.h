@@ -0,0 +1,486 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef PC_SOCKET_RADIO_H
+#define PC_SOCKET_RADIO_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "util/base_classes/extended_radio_base.h"
+#include "util/base_classes/base_extended_data.h"
+#include "util/delegates/delegate.hpp"
+
+#include "config.h"
+
+namespace wiselib {
+	
+	/** \brief Radio model for local multi-process testbeds
+	 *  \ingroup radio_concept
+	 *  \ingroup extended_radio_concept
+	 *
+	 *  Emulates a radio on top of local datagram sockets, so a number of
+	 *  Wiselib processes on one machine can talk to each other without
+	 *  hardware. Node \c i binds either the abstract Unix socket
+	 *  "<prefix><i>" (TRANSPORT_UNIX, default) or UDP port
+	 *  <base port> + \c i on 127.0.0.1 (TRANSPORT_UDP).
+	 *
+	 *  There is no broadcast medium: a broadcast is sent to every node in
+	 *  the neighbor list (add_neighbor()) or, if that is empty, to all
+	 *  ids below set_nodes(). Sends to many destinations are batched with
+	 *  sendmmsg() and reference the caller's buffer directly, receiving
+	 *  uses recvmmsg() into a set of buffers that are handed to the
+	 *  receivers without copying. Messages a receiver cannot take
+	 *  (missing process, full socket buffer) are lost like on a real
+	 *  radio.
+	 *
+	 *  Loss and delay are applied on the receiving side, per message:
+	 *  with set_loss() messages are dropped with the given probability,
+	 *  with set_delay() delivery is postponed by delay + [0, jitter]
+	 *  microseconds. The link metric passed to extended receivers is the
+	 *  loss probability scaled to [0, 255].
+	 *
+	 *  The socket is registered with the PCEventLoop of Timer_P, so the
+	 *  application has to run that loop (PC_EVENT_LOOP=1).
+	 */
+	template<
+		typename OsModel_P,
+		typename Timer_P = typename OsModel_P::Timer,
+		typename ExtendedData_P = BaseExtendedData<OsModel_P>,
+		int BATCH_SIZE_P = 32,
+		int MAX_DELAYED_P = 64,
+		int MAX_NEIGHBORS_P = 64
+	>
+	class PCSocketRadioModel : public ExtendedRadioBase
+	<
+		OsModel_P,
+		::uint16_t,
+		typename OsModel_P::size_t,
+		typename OsModel_P::block_data_t,
+		RADIO_BASE_MAX_RECEIVERS,
+		ExtendedData_P
+	>
+	{
+		public:
+			typedef OsModel_P OsModel;
+			typedef Timer_P Timer;
+			typedef typename Timer::EventLoop EventLoop;
+			typedef ExtendedData_P ExtendedData;
+			typedef ::uint16_t node_id_t;
+			typedef typename OsModel::size_t size_t;
+			typedef typename OsModel::block_data_t block_data_t;
+			typedef ::uint8_t message_id_t;
+			typedef PCSocketRadioModel<OsModel_P, Timer_P, ExtendedData_P,
+					BATCH_SIZE_P, MAX_DELAYED_P, MAX_NEIGHBORS_P> self_type;
+			typedef self_type* self_pointer_t;
+			
+			enum { SUCCESS = OsModel::SUCCESS, ERR_UNSPEC = OsModel::ERR_UNSPEC };
+			
+			enum SpecialNodeIds {
+				BROADCAST_ADDRESS = 0xffff,
+				NULL_NODE_ID = 0xfffe
+			};
+			
+			enum Restrictions {
+				MAX_MESSAGE_LENGTH = 116,
+				BATCH_SIZE = BATCH_SIZE_P,
+				MAX_DELAYED = MAX_DELAYED_P,
+				MAX_NEIGHBORS = MAX_NEIGHBORS_P
+			};
+			
+			enum Transports {
+				TRANSPORT_UNIX,
+				TRANSPORT_UDP
+			};
+			
+			PCSocketRadioModel()
+				: id_(NULL_NODE_ID), fd_(-1), transport_(TRANSPORT_UNIX),
+				prefix_("wiselib-radio-"), port_(20000), nodes_(0),
+				neighbors_(0), loss_(0), delay_(0), jitter_(0), random_(0) {
+			}
+			
+			PCSocketRadioModel(typename OsModel::Os&)
+				: id_(NULL_NODE_ID), fd_(-1), transport_(TRANSPORT_UNIX),
+				prefix_("wiselib-radio-"), port_(20000), nodes_(0),
+				neighbors_(0), loss_(0), delay_(0), jitter_(0), random_(0) {
+			}
+			
+			/**
+			 * @param id node id of this process, must be unique on the
+			 *   machine (per prefix or base port).
+			 */
+			int init(node_id_t id) {
+				if(id >= NULL_NODE_ID) { return ERR_UNSPEC; }
+				id_ = id;
+				header_[0] = id >> 8;
+				header_[1] = id & 0xff;
+				seed(id);
+				return SUCCESS;
+			}
+			
+			void destruct() { disable_radio(); }
+			
+			/// Use abstract Unix sockets named \p prefix followed by the id.
+			void set_unix(const char* prefix) {
+				transport_ = TRANSPORT_UNIX;
+				prefix_ = prefix;
+			}
+			
+			/// Use UDP on localhost, node i listens on \p base_port + i.
+			void set_udp(::uint16_t base_port) {
+				transport_ = TRANSPORT_UDP;
+				port_ = base_port;
+			}
+			
+			/// Broadcasts go to all ids in [0, \p nodes) unless neighbors are set.
+			void set_nodes(node_id_t nodes) { nodes_ = nodes; }
+			
+			int add_neighbor(node_id_t id) {
+				if(neighbors_ >= MAX_NEIGHBORS) { return ERR_UNSPEC; }
+				neighbor_ids_[neighbors_++] = id;
+				return SUCCESS;
+			}
+			
+			void clear_neighbors() { neighbors_ = 0; }
+			
+			/// Drop received messages with probability \p loss in [0, 1].
+			void set_loss(double loss) {
+				loss_ = (::uint32_t)(loss * 0xffffffffU);
+			}
+			
+			/// Deliver received messages after \p micros + [0, \p jitter] us.
+			void set_delay(::uint32_t micros, ::uint32_t jitter = 0) {
+				delay_ = micros;
+				jitter_ = jitter;
+			}
+			
+			void seed(::uint64_t s) {
+				random_ = s * 0x9e3779b97f4a7c15ULL + 1;
+			}
+			
+			int enable_radio();
+			int disable_radio();
+			
+			node_id_t id() { return id_; }
+			int fd() { return fd_; }
+			
+			int send(node_id_t destination, size_t len, block_data_t* data);
+			
+			void try_read(void* userdata);
+			
+		private:
+			enum { HEADER_SIZE = 2 };
+			
+			struct Delayed {
+				bool used_;
+				node_id_t from_;
+				::uint16_t length_;
+				block_data_t data_[MAX_MESSAGE_LENGTH];
+			};
+			
+			socklen_t make_address(node_id_t id, struct sockaddr_storage& address);
+			int send_batch(node_id_t* destinations, int count, size_t len, block_data_t* data);
+			void receive(node_id_t from, size_t len, block_data_t* data);
+			void deliver_delayed(void* slot);
+			
+			::uint32_t random() {
+				random_ ^= random_ >> 12;
+				random_ ^= random_ << 25;
+				random_ ^= random_ >> 27;
+				return (random_ * 2685821657736338717ULL) >> 32;
+			}
+			
+			node_id_t id_;
+			int fd_;
+			int transport_;
+			const char *prefix_;
+			::uint16_t port_;
+			node_id_t nodes_;
+			int neighbors_;
+			node_id_t neighbor_ids_[MAX_NEIGHBORS_P];
+			::uint32_t loss_, delay_, jitter_;
+			::uint64_t random_;
+			
+			block_data_t header_[HEADER_SIZE];
+			
+			// recvmmsg() targets, set up in enable_radio()
+			struct mmsghdr receive_headers_[BATCH_SIZE_P];
+			struct iovec receive_iovecs_[BATCH_SIZE_P];
+			block_data_t receive_buffers_[BATCH_SIZE_P][HEADER_SIZE + MAX_MESSAGE_LENGTH];
+			
+			Delayed delayed_[MAX_DELAYED_P];
+	}; // class PCSocketRadioModel
+	
+	template<typename OsModel_P, typename Timer_P, typename ExtendedData_P,
+		int BATCH_SIZE_P, int MAX_DELAYED_P, int MAX_NEIGHBORS_P>
+	int PCSocketRadioModel<OsModel_P, Timer_P, ExtendedData_P, BATCH_SIZE_P, MAX_DELAYED_P, MAX_NEIGHBORS_P>::
+	enable_radio() {
+		if(fd_ >= 0) { return SUCCESS; }
+		if(id_ >= NULL_NODE_ID) { return ERR_UNSPEC; }
+		
+		int domain = (transport_ == TRANSPORT_UDP) ? AF_INET : AF_UNIX;
+		fd_ = socket(domain, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if(fd_ < 0) {
+			warn("socket() failed");
+			return ERR_UNSPEC;
+		}
+		
+		struct sockaddr_storage address;
+		socklen_t address_len = make_address(id_, address);
+		if(bind(fd_, reinterpret_cast<struct sockaddr*>(&address), address_len) == -1) {
+			warn("Radio %u: bind() failed", (unsigned)id_);
+			close(fd_);
+			fd_ = -1;
+			return ERR_UNSPEC;
+		}
+		
+		memset(receive_headers_, 0, sizeof(receive_headers_));
+		for(int i = 0; i < BATCH_SIZE; i++) {
+			receive_iovecs_[i].iov_base = receive_buffers_[i];
+			receive_iovecs_[i].iov_len = sizeof(receive_buffers_[i]);
+			receive_headers_[i].msg_hdr.msg_iov = &receive_iovecs_[i];
+			receive_headers_[i].msg_hdr.msg_iovlen = 1;
+		}
+		for(int i = 0; i < MAX_DELAYED; i++) {
+			delayed_[i].used_ = false;
+		}
+		
+		if(EventLoop::add_descriptor(fd_,
+				EventLoop::descriptor_delegate_t::template from_method<self_type, &self_type::try_read>(this), 0
+		) != SUCCESS) {
+			close(fd_);
+			fd_ = -1;
+			return ERR_UNSPEC;
+		}
+		return SUCCESS;
+	}
+	
+	template<typename OsModel_P, typename Timer_P, typename ExtendedData_P,
+		int BATCH_SIZE_P, int MAX_DELAYED_P, int MAX_NEIGHBORS_P>
+	int PCSocketRadioModel<OsModel_P, Timer_P, ExtendedData_P, BATCH_SIZE_P, MAX_DELAYED_P, MAX_NEIGHBORS_P>::
+	disable_radio() {
+		if(fd_ >= 0) {
+			EventLoop::remove_descriptor(fd_);
+			close(fd_);
+			fd_ = -1;
+		}
+		return SUCCESS;
+	}
+	
+	template<typename OsModel_P, typename Timer_P, typename ExtendedData_P,
+		int BATCH_SIZE_P, int MAX_DELAYED_P, int MAX_NEIGHBORS_P>
+	int PCSocketRadioModel<OsModel_P, Timer_P, ExtendedData_P, BATCH_SIZE_P, MAX_DELAYED_P, MAX_NEIGHBORS_P>::
+	send(node_id_t destination, size_t len, block_data_t* data) {
+		if(fd_ < 0 || len > MAX_MESSAGE_LENGTH) {
+			return ERR_UNSPEC;
+		}
+		
+		if(destination != BROADCAST_ADDRESS) {
+			return send_batch(&destination, 1, len, data);
+		}
+		
+		if(neighbors_) {
+			return send_batch(neighbor_ids_, neighbors_, len, data);
+		}
+		
+		node_id_t destinations[BATCH_SIZE_P];
+		int count = 0;
+		for(node_id_t i = 0; i < nodes_; i++) {
+			if(i == id_) { continue; }
+			destinations[count++] = i;
+			if(count == BATCH_SIZE) {
+				send_batch(destinations, count, len, data);
+				count = 0;
+			}
+		}
+		if(count) {
+			send_batch(destinations, count, len, data);
+		}
+		return SUCCESS;
+	}
+	
+	template<typename OsModel_P, typename Timer_P, typename ExtendedData_P,
+		int BATCH_SIZE_P, int MAX_DELAYED_P, int MAX_NEIGHBORS_P>
+	void PCSocketRadioModel<OsModel_P, Timer_P, ExtendedData_P, BATCH_SIZE_P, MAX_DELAYED_P, MAX_NEIGHBORS_P>::
+	try_read(void* userdata) {
+		while(fd_ >= 0) {
+			int n = recvmmsg(fd_, receive_headers_, BATCH_SIZE, MSG_DONTWAIT, 0);
+			if(n < 0) {
+				if(errno == EINTR) { continue; }
+				if(errno != EAGAIN && errno != EWOULDBLOCK) {
+					warn("Radio %u: recvmmsg() failed", (unsigned)id_);
+				}
+				return;
+			}
+			
+			for(int i = 0; i < n && fd_ >= 0; i++) {
+				size_t len = receive_headers_[i].msg_len;
+				block_data_t *buffer = receive_buffers_[i];
+				if(len < HEADER_SIZE || (receive_headers_[i].msg_hdr.msg_flags & MSG_TRUNC)) {
+					continue;
+				}
+				receive((buffer[0] << 8) | buffer[1], len - HEADER_SIZE, buffer + HEADER_SIZE);
+			}
+			
+			if(n < BATCH_SIZE) { return; }
+		}
+	}
+	
+	// private:
+	
+	template<typename OsModel_P, typename Timer_P, typename ExtendedData_P,
+		int BATCH_SIZE_P, int MAX_DELAYED_P, int MAX_NEIGHBORS_P>
+	socklen_t PCSocketRadioModel<OsModel_P, Timer_P, ExtendedData_P, BATCH_SIZE_P, MAX_DELAYED_P, MAX_NEIGHBORS_P>::
+	make_address(node_id_t id, struct sockaddr_storage& address) {
+		memset(&address, 0, sizeof(address));
+		
+		if(transport_ == TRANSPORT_UDP) {
+			struct sockaddr_in *in = reinterpret_cast<struct sockaddr_in*>(&address);
+			in->sin_family = AF_INET;
+			in->sin_port = htons((::uint16_t)(port_ + id));
+			in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			return sizeof(struct sockaddr_in);
+		}
+		
+		// Abstract namespace: leading '\0', no file to clean up
+		struct sockaddr_un *un = reinterpret_cast<struct sockaddr_un*>(&address);
+		un->sun_family = AF_UNIX;
+		int n = snprintf(un->sun_path + 1, sizeof(un->sun_path) - 1, "%s%u", prefix_, (unsigned)id);
+		if(n > (int)sizeof(un->sun_path) - 2) { n = sizeof(un->sun_path) - 2; }
+		return offsetof(struct sockaddr_un, sun_path) + 1 + n;
+	}
+	
+	/**
+	 * Send one message to \p count destinations with as few system
+	 * calls as possible. Destinations that do not accept the message are
+	 * skipped.
+	 */
+	template<typename OsModel_P, typename Timer_P, typename ExtendedData_P,
+		int BATCH_SIZE_P, int MAX_DELAYED_P, int MAX_NEIGHBORS_P>
+	int PCSocketRadioModel<OsModel_P, Timer_P, ExtendedData_P, BATCH_SIZE_P, MAX_DELAYED_P, MAX_NEIGHBORS_P>::
+	send_batch(node_id_t* destinations, int count, size_t len, block_data_t* data) {
+		struct sockaddr_storage addresses[BATCH_SIZE_P];
+		struct mmsghdr headers[BATCH_SIZE_P];
+		struct iovec iov[2];
+		
+		// header and payload are gathered by the kernel, no copy
+		iov[0].iov_base = header_;
+		iov[0].iov_len = HEADER_SIZE;
+		iov[1].iov_base = data;
+		iov[1].iov_len = len;
+		
+		int result = SUCCESS;
+		for(int start = 0; start < count; start += BATCH_SIZE) {
+			int k = count - start;
+			if(k > BATCH_SIZE) { k = BATCH_SIZE; }
+			
+			memset(headers, 0, sizeof(headers[0]) * k);
+			for(int i = 0; i < k; i++) {
+				headers[i].msg_hdr.msg_name = &addresses[i];
+				headers[i].msg_hdr.msg_namelen = make_address(destinations[start + i], addresses[i]);
+				headers[i].msg_hdr.msg_iov = iov;
+				headers[i].msg_hdr.msg_iovlen = 2;
+			}
+			
+			for(int i = 0; i < k; ) {
+				int r = sendmmsg(fd_, headers + i, k - i, MSG_DONTWAIT);
+				if(r > 0) {
+					i += r;
+				}
+				else if(r < 0 && errno == EINTR) {
+				}
+				else {
+					// Receiver not running or its buffer is full
+					result = ERR_UNSPEC;
+					i++;
+				}
+			}
+		}
+		return (count == 1) ? result : SUCCESS;
+	}
+	
+	template<typename OsModel_P, typename Timer_P, typename ExtendedData_P,
+		int BATCH_SIZE_P, int MAX_DELAYED_P, int MAX_NEIGHBORS_P>
+	void PCSocketRadioModel<OsModel_P, Timer_P, ExtendedData_P, BATCH_SIZE_P, MAX_DELAYED_P, MAX_NEIGHBORS_P>::
+	receive(node_id_t from, size_t len, block_data_t* data) {
+		if(from == id_ || (loss_ && random() < loss_)) {
+			return;
+		}
+		
+		if(delay_ == 0 && jitter_ == 0) {
+			ExtendedData ex;
+			ex.set_link_metric(loss_ >> 24);
+			this->notify_receivers(from, len, data, ex);
+			return;
+		}
+		
+		for(int i = 0; i < MAX_DELAYED; i++) {
+			if(!delayed_[i].used_) {
+				Delayed &d = delayed_[i];
+				d.used_ = true;
+				d.from_ = from;
+				d.length_ = len;
+				memcpy(d.data_, data, len);
+				::uint32_t delay = delay_ + (jitter_ ? random() % (jitter_ + 1) : 0);
+				if(EventLoop::add_timer(delay,
+						EventLoop::timer_delegate_t::template from_method<self_type, &self_type::deliver_delayed>(this), &d
+				) != SUCCESS) {
+					d.used_ = false;
+				}
+				return;
+			}
+		}
+		// no free slot: lost
+	}
+	
+	template<typename OsModel_P, typename Timer_P, typename ExtendedData_P,
+		int BATCH_SIZE_P, int MAX_DELAYED_P, int MAX_NEIGHBORS_P>
+	void PCSocketRadioModel<OsModel_P, Timer_P, ExtendedData_P, BATCH_SIZE_P, MAX_DELAYED_P, MAX_NEIGHBORS_P>::
+	deliver_delayed(void* slot) {
+		Delayed &d = *reinterpret_cast<Delayed*>(slot);
+		
+		// Free the slot before calling receivers, they might cause new
+		// delayed receptions
+		node_id_t from = d.from_;
+		size_t len = d.length_;
+		block_data_t data[MAX_MESSAGE_LENGTH];
+		memcpy(data, d.data_, len);
+		d.used_ = false;
+		
+		if(fd_ < 0) { return; }
+		ExtendedData ex;
+		ex.set_link_metric(loss_ >> 24);
+		this->notify_receivers(from, len, data, ex);
+	}
+	
+} // namespace wiselib
+
+#endif // PC_SOCKET_RADIO_H
+
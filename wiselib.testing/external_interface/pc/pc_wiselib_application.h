@@ -49,9 +49,13 @@ int main(int argc, const char** argv) {
 	application_main(app_main_arg);
 	
 	#if not WISELIB_EXIT_MAIN
+		#if PC_EVENT_LOOP
+	wiselib::PCOsModel::Timer::EventLoop::run();
+		#else
 	while(true) {
 		pause();
 	}
+		#endif
 	#endif
 	
 	return 0;
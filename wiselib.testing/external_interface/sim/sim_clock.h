@@ -0,0 +1,70 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef SIM_CLOCK_H
+#define SIM_CLOCK_H
+
+#include "external_interface/sim/sim_world.h"
+
+namespace wiselib {
+	
+	/** \brief Simulator implementation of \ref clock_concept "Clock Concept".
+	 *  \ingroup clock_concept
+	 *
+	 *  Returns virtual time in microseconds.
+	 */
+	template<typename OsModel_P>
+	class SimClockModel {
+		public:
+			typedef OsModel_P OsModel;
+			typedef SimClockModel<OsModel> self_type;
+			typedef self_type* self_pointer_t;
+			typedef SimWorld::time_t time_t;
+			typedef ::uint16_t micros_t;
+			typedef ::uint16_t millis_t;
+			typedef ::uint32_t seconds_t;
+			
+			enum {
+				READY = OsModel::READY,
+				NO_VALUE = OsModel::NO_VALUE,
+				INACTIVE = OsModel::INACTIVE
+			};
+			
+			enum {
+				CLOCKS_PER_SECOND = 1000000
+			};
+			
+			SimClockModel(SimOs& os) : os_(os) {
+			}
+			
+			int state() { return READY; }
+			time_t time() { return os_.world->now(os_.id); }
+			micros_t microseconds(time_t t) { return t % 1000; }
+			millis_t milliseconds(time_t t) { return (t / 1000) % 1000; }
+			seconds_t seconds(time_t t) { return t / SimWorld::SECOND; }
+			
+		private:
+			SimOs& os_;
+	};
+}
+
+#endif // SIM_CLOCK_H
+
@@ -0,0 +1,66 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef SIM_DEBUG_H
+#define SIM_DEBUG_H
+
+#include <cstdarg>
+#include <cstdio>
+
+#include "external_interface/sim/sim_world.h"
+
+namespace wiselib {
+	
+	/** \brief Simulator implementation of \ref debug_concept "Debug Concept".
+	 *  \ingroup debug_concept
+	 *
+	 *  Prefixes every line with virtual time (seconds) and node id,
+	 *  SimWorld::set_debug(false) silences all nodes.
+	 */
+	template<typename OsModel_P>
+	class SimDebug {
+		public:
+			typedef OsModel_P OsModel;
+			typedef SimDebug<OsModel> self_type;
+			typedef self_type* self_pointer_t;
+			
+			SimDebug(SimOs& os) : os_(os) {
+			}
+			
+			void debug(const char* msg, ...) {
+				if(!os_.world->debug()) { return; }
+				
+				va_list fmtargs;
+				char buffer[1024];
+				va_start(fmtargs, msg);
+				vsnprintf(buffer, sizeof(buffer) - 1, msg, fmtargs);
+				va_end(fmtargs);
+				printf("%12.6f %5u: %s\n", (double)os_.world->now(os_.id) / SimWorld::SECOND,
+						(unsigned)os_.id, buffer);
+			}
+			
+		private:
+			SimOs& os_;
+	};
+}
+
+#endif // SIM_DEBUG_H
+
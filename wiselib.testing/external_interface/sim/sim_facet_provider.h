@@ -0,0 +1,49 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef SIM_FACET_PROVIDER_H
+#define SIM_FACET_PROVIDER_H
+
+#include "external_interface/facet_provider.h"
+#include "external_interface/sim/sim_os.h"
+
+namespace wiselib {
+	
+	/**
+	 * Every call creates a new facet for the given node, it is deleted
+	 * with the world.
+	 */
+	template<typename Facet_P>
+	class FacetProvider<SimOsModel, Facet_P> {
+		public:
+			typedef SimOsModel OsModel;
+			typedef Facet_P Facet;
+			
+			static Facet& get_facet(SimOs& os) {
+				Facet *f = new Facet(os);
+				os.world->own(f);
+				return *f;
+			}
+	};
+}
+
+#endif // SIM_FACET_PROVIDER_H
+
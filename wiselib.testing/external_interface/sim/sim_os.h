@@ -0,0 +1,67 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef SIM_OS_H
+#define SIM_OS_H
+
+#include "external_interface/default_return_values.h"
+#include "external_interface/sim/sim_world.h"
+#include "external_interface/sim/sim_timer.h"
+#include "external_interface/sim/sim_radio.h"
+#include "external_interface/sim/sim_debug.h"
+#include "external_interface/sim/sim_rand.h"
+#include "external_interface/sim/sim_clock.h"
+#include "util/serialization/endian.h"
+
+namespace wiselib {
+	
+	/** \brief In-process discrete event simulator implementation of
+	 *  \ref os_concept "Os Concept".
+	 *
+	 *  \ingroup os_concept
+	 *  \ingroup basic_return_values_concept
+	 *
+	 *  Facets are constructed from the per node SimOs handle, see
+	 *  SimWorld for setting up and running a simulation.
+	 */
+	class SimOsModel
+		: public DefaultReturnValues<SimOsModel>
+	{
+		public:
+			typedef SimOs AppMainParameter;
+			
+			typedef unsigned int size_t;
+			typedef uint8_t block_data_t;
+			
+			typedef DefaultReturnValues<SimOsModel> ReturnValues;
+			
+			typedef SimTimerModel<SimOsModel> Timer;
+			typedef SimRadioModel<SimOsModel> Radio;
+			typedef SimDebug<SimOsModel> Debug;
+			typedef SimRandModel<SimOsModel> Rand;
+			typedef SimClockModel<SimOsModel> Clock;
+			
+			static const Endianness endianness = WISELIB_ENDIANNESS;
+	};
+}
+
+#endif // SIM_OS_H
+
@@ -0,0 +1,96 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef SIM_RADIO_H
+#define SIM_RADIO_H
+
+#include "external_interface/sim/sim_world.h"
+
+namespace wiselib {
+	
+	/** \brief Simulator implementation of \ref radio_concept "Radio concept".
+	 *  \ingroup radio_concept
+	 *
+	 *  Which neighbors receive a message and after what delay is decided
+	 *  by the SimLinkModel of the world.
+	 */
+	template<typename OsModel_P>
+	class SimRadioModel {
+		public:
+			typedef OsModel_P OsModel;
+			typedef SimRadioModel<OsModel> self_type;
+			typedef self_type* self_pointer_t;
+			
+			typedef SimWorld::node_id_t node_id_t;
+			typedef SimWorld::size_t size_t;
+			typedef SimWorld::block_data_t block_data_t;
+			typedef ::uint8_t message_id_t;
+			typedef SimWorld::radio_delegate_t radio_delegate_t;
+			
+			enum ErrorCodes {
+				SUCCESS = OsModel::SUCCESS,
+				ERR_UNSPEC = OsModel::ERR_UNSPEC
+			};
+			
+			enum SpecialNodeIds {
+				BROADCAST_ADDRESS = SimWorld::BROADCAST_ADDRESS,
+				NULL_NODE_ID = SimWorld::NULL_NODE_ID
+			};
+			
+			enum Restrictions {
+				MAX_MESSAGE_LENGTH = SimWorld::MAX_MESSAGE_LENGTH
+			};
+			
+			SimRadioModel(SimOs& os) : os_(os) {
+			}
+			
+			int send(node_id_t destination, size_t len, block_data_t* data) {
+				return os_.world->send(os_.id, destination, len, data);
+			}
+			
+			int enable_radio() {
+				os_.world->set_radio_enabled(os_.id, true);
+				return SUCCESS;
+			}
+			
+			int disable_radio() {
+				os_.world->set_radio_enabled(os_.id, false);
+				return SUCCESS;
+			}
+			
+			node_id_t id() { return os_.id; }
+			
+			template<class T, void (T::*TMethod)(node_id_t, size_t, block_data_t*)>
+			int reg_recv_callback(T* obj) {
+				return os_.world->reg_recv_callback(os_.id, radio_delegate_t::from_method<T, TMethod>(obj));
+			}
+			
+			int unreg_recv_callback(int idx) {
+				return os_.world->unreg_recv_callback(os_.id, idx);
+			}
+			
+		private:
+			SimOs& os_;
+	};
+}
+
+#endif // SIM_RADIO_H
+
@@ -0,0 +1,71 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef SIM_RAND_H
+#define SIM_RAND_H
+
+#include "external_interface/sim/sim_world.h"
+
+namespace wiselib {
+	
+	/** \brief Simulator implementation of the Rand concept.
+	 *
+	 *  Every instance is seeded from the world's seed and the node id, so
+	 *  random sequences are reproducible and independent of other nodes.
+	 */
+	template<typename OsModel_P>
+	class SimRandModel {
+		public:
+			typedef OsModel_P OsModel;
+			typedef SimRandModel<OsModel> self_type;
+			typedef self_type* self_pointer_t;
+			typedef ::uint32_t value_t;
+			
+			enum { RANDOM_MAX = 0x7fffffff };
+			
+			SimRandModel(SimOs& os) : os_(os) {
+				state_ = os_.world->node_seed(os_.id);
+			}
+			
+			SimRandModel(SimOs& os, value_t seed) : os_(os) {
+				srand(seed);
+			}
+			
+			void srand(value_t seed) {
+				state_ = SimWorld::mix(os_.world->node_seed(os_.id) ^ seed);
+			}
+			
+			value_t operator()() {
+				return SimWorld::next_random(state_) >> 33;
+			}
+			
+			value_t operator()(value_t max) {
+				return operator()() % max;
+			}
+			
+		private:
+			SimOs& os_;
+			::uint64_t state_;
+	};
+}
+
+#endif // SIM_RAND_H
+
@@ -0,0 +1,48 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef SIM_WISELIB_APPLICATION_H
+#define SIM_WISELIB_APPLICATION_H
+
+#include "external_interface/wiselib_application.h"
+#include "external_interface/sim/sim_os.h"
+
+namespace wiselib {
+	
+	/**
+	 * Creates one application instance per node, owned by the world.
+	 */
+	template<typename Application_P>
+	class WiselibApplication<SimOsModel, Application_P> {
+		public:
+			typedef SimOsModel OsModel;
+			typedef Application_P Application;
+			
+			void init(SimOs& os) {
+				Application *app = new Application();
+				os.world->own(app);
+				app->init(os);
+			}
+	};
+}
+
+#endif // SIM_WISELIB_APPLICATION_H
+
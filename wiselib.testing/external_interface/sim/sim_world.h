@@ -0,0 +1,952 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+// vim: set noexpandtab ts=4 sw=4:
+
+#ifndef SIM_WORLD_H
+#define SIM_WORLD_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <cassert>
+#include <vector>
+#include <algorithm>
+
+#include "util/delegates/delegate.hpp"
+
+namespace wiselib {
+	
+	class SimWorld;
+	
+	/**
+	 * Per node handle that is passed to applications as
+	 * AppMainParameter and to the constructors of all facets.
+	 */
+	struct SimOs {
+		SimWorld *world;
+		::uint16_t id;
+	};
+	
+	/**
+	 * Decides whether and when a message reaches a neighbor.
+	 */
+	class SimLinkModel {
+		public:
+			virtual ~SimLinkModel() { }
+			
+			/**
+			 * Maximum distance over which transmissions can succeed,
+			 * used to precompute neighborhoods.
+			 */
+			virtual double range() = 0;
+			
+			/**
+			 * Lower bound for the delay transmit() returns, in
+			 * microseconds. Parallel simulation needs it to be positive.
+			 */
+			virtual ::uint64_t lookahead() { return 0; }
+			
+			/**
+			 * @param distance distance between sender and receiver, at most
+			 *   range().
+			 * @param delay set to the delivery delay in microseconds.
+			 * @return true iff the message is received. Randomness must be
+			 *   drawn from world.link_random(from) to keep simulations
+			 *   deterministic.
+			 */
+			virtual bool transmit(SimWorld& world, ::uint16_t from, ::uint16_t to,
+					double distance, ::uint64_t& delay) = 0;
+	};
+	
+	/**
+	 * Unit disk graph with independent message loss and a latency that is
+	 * uniformly distributed in [latency, latency + jitter].
+	 */
+	class SimUnitDiskLinkModel : public SimLinkModel {
+		public:
+			SimUnitDiskLinkModel(double range = 1.0, double loss = 0.0,
+					::uint64_t latency = 1000, ::uint64_t jitter = 0)
+				: range_(range), loss_(loss), latency_(latency), jitter_(jitter) {
+			}
+			
+			double range() { return range_; }
+			::uint64_t lookahead() { return latency_; }
+			
+			inline bool transmit(SimWorld& world, ::uint16_t from, ::uint16_t to,
+					double distance, ::uint64_t& delay);
+			
+		private:
+			double range_, loss_;
+			::uint64_t latency_, jitter_;
+	};
+	
+	/**
+	 * Discrete event simulator hosting any number of Wiselib nodes in one
+	 * process.
+	 * 
+	 * Time is virtual (microseconds) and only advances when the next event
+	 * is taken from a queue, a binary heap ordered by (time, creating node,
+	 * per node sequence number). As this order and all random streams
+	 * (Rand facets, link models via link_random()) depend only on the
+	 * history of single nodes, a run is fully deterministic for a given
+	 * seed, node setup and link model, independent of the number of
+	 * threads.
+	 * 
+	 * Neighborhoods are precomputed from the link model's range() using a
+	 * grid of range() sized cells, so broadcasts cost O(degree).
+	 * Payloads live in a refcounted pool shared by all receivers of a
+	 * broadcast.
+	 * 
+	 * With set_threads(n) nodes are split into n partitions (strips along
+	 * the x axis) that are simulated in parallel, conservatively
+	 * synchronized in YAWNS style windows: all partitions process events
+	 * before min(next event) + lookahead, where lookahead is the minimum
+	 * link delay, then exchange messages for other partitions through
+	 * per partition pair outboxes. Results equal the sequential run,
+	 * except for the interleaving of debug output. Nodes must not be
+	 * added or moved and stop() only takes effect at window boundaries
+	 * while running in parallel.
+	 * 
+	 * \code
+	 * SimWorld world(seed);
+	 * SimUnitDiskLinkModel link(10.0, 0.1, 2000, 1000);
+	 * world.set_link_model(&link);
+	 * world.set_threads(8);
+	 * for(...) { WiselibApplication<SimOsModel, App> app; app.init(world.add_node(x, y)); }
+	 * world.run_until(60 * SimWorld::SECOND);
+	 * \endcode
+	 */
+	class SimWorld {
+		public:
+			typedef ::uint64_t time_t;
+			typedef ::uint16_t node_id_t;
+			typedef unsigned int size_t;
+			typedef ::uint8_t block_data_t;
+			typedef delegate1<void, void*> timer_delegate_t;
+			typedef delegate3<void, node_id_t, size_t, block_data_t*> radio_delegate_t;
+			
+			enum { SUCCESS = 0, ERR_UNSPEC = -1 };
+			
+			enum {
+				BROADCAST_ADDRESS = 0xffff,
+				NULL_NODE_ID = 0xfffe,
+				MAX_NODES = 0xfffe,
+				MAX_MESSAGE_LENGTH = 0xff
+			};
+			
+			static const time_t MILLISECOND = 1000ULL;
+			static const time_t SECOND = 1000000ULL;
+			static const time_t NEVER = ~0ULL;
+			
+			SimWorld(::uint64_t seed = 1)
+				: link_(&default_link_), topology_dirty_(false), partitions_dirty_(true),
+				debug_(true), running_(false), parallel_(false), threads_(1),
+				lookahead_(0), windows_(0) {
+				seed_ = seed;
+				srand(seed);
+				partitions_.push_back(new Partition);
+				pthread_mutex_init(&owned_mutex_, 0);
+			}
+			
+			~SimWorld() {
+				for(size_t i = owned_.size(); i > 0; i--) {
+					owned_[i - 1].destroy(owned_[i - 1].object);
+				}
+				for(size_t i = 0; i < nodes_.size(); i++) {
+					delete nodes_[i];
+				}
+				for(size_t i = 0; i < partitions_.size(); i++) {
+					delete partitions_[i];
+				}
+				pthread_mutex_destroy(&owned_mutex_);
+			}
+			
+			// --------------------------------------------------------------------
+			// Setup
+			
+			/**
+			 * Create a node at (\p x, \p y).
+			 * @return handle to pass to the application's init().
+			 */
+			SimOs& add_node(double x = 0.0, double y = 0.0) {
+				assert(nodes_.size() < MAX_NODES && !parallel_);
+				Node *n = new Node;
+				n->x = x;
+				n->y = y;
+				n->radio_enabled = true;
+				n->os.world = this;
+				n->os.id = nodes_.size();
+				n->partition = 0;
+				n->sequence = 0;
+				n->link_random = mix(seed_ ^ mix(~(::uint64_t)n->os.id));
+				nodes_.push_back(n);
+				topology_dirty_ = true;
+				partitions_dirty_ = true;
+				return n->os;
+			}
+			
+			void move_node(node_id_t id, double x, double y) {
+				assert(!parallel_);
+				nodes_[id]->x = x;
+				nodes_[id]->y = y;
+				topology_dirty_ = true;
+			}
+			
+			/**
+			 * The link model is not owned by the world and must outlive it.
+			 */
+			void set_link_model(SimLinkModel* link) {
+				link_ = link;
+				topology_dirty_ = true;
+			}
+			
+			SimLinkModel& link_model() { return *link_; }
+			
+			/**
+			 * Simulate with \p threads worker threads. Falls back to one
+			 * thread if the link model has no lookahead.
+			 */
+			void set_threads(size_t threads) {
+				threads_ = threads ? threads : 1;
+				partitions_dirty_ = true;
+			}
+			
+			size_t threads() { return threads_; }
+			
+			size_t nodes() { return nodes_.size(); }
+			SimOs& node(node_id_t id) { return nodes_[id]->os; }
+			double x(node_id_t id) { return nodes_[id]->x; }
+			double y(node_id_t id) { return nodes_[id]->y; }
+			
+			/**
+			 * Neighbors of \p id according to the link model's range.
+			 */
+			const std::vector<node_id_t>& neighbors(node_id_t id) {
+				update_topology();
+				return nodes_[id]->neighbors;
+			}
+			
+			/**
+			 * Delete \p object together with the world, used by the facet
+			 * provider and WiselibApplication.
+			 */
+			template<typename T>
+			void own(T* object) {
+				Owned o;
+				o.object = object;
+				o.destroy = &destroy<T>;
+				pthread_mutex_lock(&owned_mutex_);
+				owned_.push_back(o);
+				pthread_mutex_unlock(&owned_mutex_);
+			}
+			
+			void set_debug(bool enabled) { debug_ = enabled; }
+			bool debug() { return debug_; }
+			
+			// --------------------------------------------------------------------
+			// Randomness (xorshift64*, seeded through splitmix64)
+			
+			/**
+			 * Seed the world's stream, meant for setup (e.g. placing
+			 * nodes), nodes use their own streams.
+			 */
+			void srand(::uint64_t seed) {
+				random_state_ = mix(seed);
+			}
+			
+			::uint64_t random() {
+				return next_random(random_state_);
+			}
+			
+			/// @return uniformly distributed value in [0, 1)
+			double random_real() {
+				return to_real(random());
+			}
+			
+			/**
+			 * Random stream for link decisions on messages sent by
+			 * \p from.
+			 */
+			::uint64_t link_random(node_id_t from) {
+				return next_random(nodes_[from]->link_random);
+			}
+			
+			double link_random_real(node_id_t from) {
+				return to_real(link_random(from));
+			}
+			
+			/**
+			 * Independent random state for node \p id, does not depend on
+			 * the order in which facets are created.
+			 */
+			::uint64_t node_seed(node_id_t id) {
+				return mix(seed_ ^ mix(id + 1));
+			}
+			
+			static ::uint64_t next_random(::uint64_t& state) {
+				state ^= state >> 12;
+				state ^= state << 25;
+				state ^= state >> 27;
+				return state * 2685821657736338717ULL;
+			}
+			
+			static ::uint64_t mix(::uint64_t z) {
+				z += 0x9e3779b97f4a7c15ULL;
+				z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+				z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+				z ^= z >> 31;
+				return z ? z : 1;
+			}
+			
+			static double to_real(::uint64_t r) {
+				return (r >> 11) * (1.0 / 9007199254740992.0);
+			}
+			
+			// --------------------------------------------------------------------
+			// Services for the facets
+			
+			/**
+			 * @return current time of node \p id.
+			 */
+			time_t now(node_id_t id) {
+				return partitions_[nodes_[id]->partition]->now;
+			}
+			
+			/**
+			 * @return time all partitions have reached.
+			 */
+			time_t now() {
+				time_t t = partitions_[0]->now;
+				for(size_t i = 1; i < partitions_.size(); i++) {
+					t = std::min(t, partitions_[i]->now);
+				}
+				return t;
+			}
+			
+			int add_timer(node_id_t id, time_t delay, timer_delegate_t callback, void* userdata) {
+				Partition &p = *partitions_[nodes_[id]->partition];
+				Event e;
+				e.kind = EVENT_TIMER;
+				e.node = id;
+				e.timer = callback;
+				e.userdata = userdata;
+				stamp(e, p.now + delay, id);
+				p.push(e);
+				return SUCCESS;
+			}
+			
+			int reg_recv_callback(node_id_t id, radio_delegate_t callback) {
+				std::vector<radio_delegate_t> &r = nodes_[id]->receivers;
+				for(size_t i = 0; i < r.size(); i++) {
+					if(!r[i]) {
+						r[i] = callback;
+						return i;
+					}
+				}
+				r.push_back(callback);
+				return r.size() - 1;
+			}
+			
+			int unreg_recv_callback(node_id_t id, int idx) {
+				std::vector<radio_delegate_t> &r = nodes_[id]->receivers;
+				if(idx < 0 || (size_t)idx >= r.size()) { return ERR_UNSPEC; }
+				r[idx] = radio_delegate_t();
+				return SUCCESS;
+			}
+			
+			void set_radio_enabled(node_id_t id, bool enabled) {
+				nodes_[id]->radio_enabled = enabled;
+			}
+			
+			int send(node_id_t from, node_id_t to, size_t len, block_data_t* data) {
+				Node &n = *nodes_[from];
+				Partition &p = *partitions_[n.partition];
+				if(len > MAX_MESSAGE_LENGTH || !n.radio_enabled) {
+					return ERR_UNSPEC;
+				}
+				if(!parallel_) {
+					update_topology();
+				}
+				p.stats.sent++;
+				
+				::uint32_t payload = p.allocate_payload(len, data);
+				if(to == BROADCAST_ADDRESS) {
+					std::vector<node_id_t> &nb = n.neighbors;
+					for(size_t i = 0; i < nb.size(); i++) {
+						transmit(p, from, nb[i], payload, len);
+					}
+				}
+				else if(to < nodes_.size() && to != from && distance(from, to) <= link_->range()) {
+					transmit(p, from, to, payload, len);
+				}
+				else {
+					p.stats.lost++;
+				}
+				p.release_payload(payload);
+				return SUCCESS;
+			}
+			
+			// --------------------------------------------------------------------
+			// Running
+			
+			/**
+			 * Process the next event (single threaded).
+			 * @return false iff there are no events left.
+			 */
+			bool step() {
+				prepare(false);
+				Partition &p = *partitions_[0];
+				if(p.queue.empty()) { return false; }
+				process(p);
+				return true;
+			}
+			
+			/**
+			 * Process all events up to and including time \p t, afterwards
+			 * now() == t.
+			 */
+			void run_until(time_t t) {
+				running_ = true;
+				if(prepare(true)) {
+					run_parallel(t);
+				}
+				else {
+					Partition &p = *partitions_[0];
+					while(running_ && !p.queue.empty() && p.queue[0].time <= t) {
+						process(p);
+					}
+					if(running_ && p.now < t) { p.now = t; }
+				}
+			}
+			
+			/**
+			 * Process events until there are none left or stop() is called.
+			 */
+			void run() {
+				running_ = true;
+				if(prepare(true)) {
+					run_parallel(NEVER - 1);
+				}
+				else {
+					while(running_ && step()) { }
+				}
+			}
+			
+			void stop() { running_ = false; }
+			
+			size_t pending_events() {
+				size_t r = 0;
+				for(size_t i = 0; i < partitions_.size(); i++) {
+					r += partitions_[i]->queue.size();
+				}
+				return r;
+			}
+			
+			struct Stats {
+				::uint64_t events;
+				::uint64_t sent;
+				::uint64_t delivered;
+				::uint64_t lost;
+				::uint64_t windows;
+			};
+			
+			Stats stats() {
+				Stats s;
+				memset(&s, 0, sizeof(s));
+				for(size_t i = 0; i < partitions_.size(); i++) {
+					Stats &p = partitions_[i]->stats;
+					s.events += p.events;
+					s.sent += p.sent;
+					s.delivered += p.delivered;
+					s.lost += p.lost;
+				}
+				s.windows = windows_;
+				return s;
+			}
+			
+		private:
+			enum { EVENT_TIMER, EVENT_MESSAGE };
+			
+			struct Node {
+				double x, y;
+				bool radio_enabled;
+				SimOs os;
+				::uint32_t partition;
+				::uint64_t sequence;
+				::uint64_t link_random;
+				std::vector<radio_delegate_t> receivers;
+				std::vector<node_id_t> neighbors;
+			};
+			
+			struct Event {
+				time_t time;
+				::uint64_t sequence;
+				node_id_t origin;
+				::uint8_t kind;
+				node_id_t node;
+				node_id_t from;
+				::uint16_t length;
+				::uint32_t payload;
+				timer_delegate_t timer;
+				void *userdata;
+				
+				bool operator<(const Event& other) const {
+					if(time != other.time) { return time < other.time; }
+					if(origin != other.origin) { return origin < other.origin; }
+					return sequence < other.sequence;
+				}
+			};
+			
+			struct Payload {
+				::uint32_t references;
+				block_data_t data[MAX_MESSAGE_LENGTH];
+			};
+			
+			/// Message for another partition, carries its own payload copy
+			struct Transfer {
+				Event event;
+				block_data_t data[MAX_MESSAGE_LENGTH];
+			};
+			
+			/**
+			 * Event queue, clock, payload pool and statistics of the nodes
+			 * simulated by one thread.
+			 */
+			struct Partition {
+				Partition() : now(0) {
+					memset(&stats, 0, sizeof(stats));
+				}
+				
+				time_t now;
+				Stats stats;
+				std::vector<Event> queue;
+				std::vector<Payload> payloads;
+				std::vector< ::uint32_t> free_payloads;
+				/// outbox[i]: messages for partition i, read by i between windows
+				std::vector< std::vector<Transfer> > outbox;
+				
+				::uint32_t allocate_payload(size_t len, block_data_t* data) {
+					::uint32_t p;
+					if(free_payloads.empty()) {
+						p = payloads.size();
+						payloads.push_back(Payload());
+					}
+					else {
+						p = free_payloads.back();
+						free_payloads.pop_back();
+					}
+					payloads[p].references = 1;
+					memcpy(payloads[p].data, data, len);
+					return p;
+				}
+				
+				void release_payload(::uint32_t p) {
+					if(--payloads[p].references == 0) {
+						free_payloads.push_back(p);
+					}
+				}
+				
+				void push(Event& e) {
+					size_t i = queue.size();
+					queue.push_back(e);
+					while(i > 0 && e < queue[(i - 1) / 2]) {
+						queue[i] = queue[(i - 1) / 2];
+						i = (i - 1) / 2;
+					}
+					queue[i] = e;
+				}
+				
+				void pop() {
+					Event e = queue.back();
+					queue.pop_back();
+					size_t n = queue.size();
+					if(n == 0) { return; }
+					size_t i = 0;
+					for(size_t c = 1; c < n; c = 2 * i + 1) {
+						if(c + 1 < n && queue[c + 1] < queue[c]) { c++; }
+						if(!(queue[c] < e)) { break; }
+						queue[i] = queue[c];
+						i = c;
+					}
+					queue[i] = e;
+				}
+				
+				time_t next() { return queue.empty() ? NEVER : queue[0].time; }
+			};
+			
+			struct Owned {
+				void *object;
+				void (*destroy)(void*);
+			};
+			
+			struct Worker {
+				SimWorld *world;
+				size_t index;
+				time_t until;
+			};
+			
+			template<typename T>
+			static void destroy(void* object) {
+				delete reinterpret_cast<T*>(object);
+			}
+			
+			double distance(node_id_t a, node_id_t b) {
+				double dx = nodes_[a]->x - nodes_[b]->x;
+				double dy = nodes_[a]->y - nodes_[b]->y;
+				return sqrt(dx * dx + dy * dy);
+			}
+			
+			/**
+			 * Give \p e its place in the global order: \p t, then creating
+			 * node, then the number of events that node created before.
+			 */
+			void stamp(Event& e, time_t t, node_id_t origin) {
+				e.time = t;
+				e.origin = origin;
+				e.sequence = nodes_[origin]->sequence++;
+			}
+			
+			void transmit(Partition& p, node_id_t from, node_id_t to, ::uint32_t payload, size_t len) {
+				time_t delay = 0;
+				if(!link_->transmit(*this, from, to, distance(from, to), delay)) {
+					p.stats.lost++;
+					return;
+				}
+				Event e;
+				e.kind = EVENT_MESSAGE;
+				e.node = to;
+				e.from = from;
+				e.length = len;
+				stamp(e, p.now + delay, from);
+				
+				::uint32_t target = nodes_[to]->partition;
+				if(&p == partitions_[target]) {
+					e.payload = payload;
+					p.payloads[payload].references++;
+					p.push(e);
+				}
+				else {
+					assert(delay >= lookahead_);
+					p.outbox[target].push_back(Transfer());
+					Transfer &t = p.outbox[target].back();
+					t.event = e;
+					memcpy(t.data, p.payloads[payload].data, len);
+				}
+			}
+			
+			void process(Partition& p) {
+				Event e = p.queue[0];
+				p.pop();
+				p.now = e.time;
+				p.stats.events++;
+				
+				if(e.kind == EVENT_TIMER) {
+					e.timer(e.userdata);
+					return;
+				}
+				
+				// Copy out, receivers may send (and grow the pool) or modify
+				// the buffer.
+				block_data_t buffer[MAX_MESSAGE_LENGTH];
+				memcpy(buffer, p.payloads[e.payload].data, e.length);
+				p.release_payload(e.payload);
+				
+				Node &n = *nodes_[e.node];
+				if(!n.radio_enabled) {
+					p.stats.lost++;
+					return;
+				}
+				p.stats.delivered++;
+				for(size_t i = 0; i < n.receivers.size(); i++) {
+					if(n.receivers[i]) {
+						n.receivers[i](e.from, e.length, buffer);
+					}
+				}
+			}
+			
+			/**
+			 * Move incoming transfers into the event queue of partition
+			 * \p index.
+			 */
+			void receive_transfers(size_t index) {
+				Partition &p = *partitions_[index];
+				for(size_t i = 0; i < partitions_.size(); i++) {
+					std::vector<Transfer> &in = partitions_[i]->outbox[index];
+					for(size_t k = 0; k < in.size(); k++) {
+						Event e = in[k].event;
+						e.payload = p.allocate_payload(e.length, in[k].data);
+						p.push(e);
+					}
+					in.clear();
+				}
+			}
+			
+			/**
+			 * Update topology and partitioning.
+			 * @return true iff the run should be parallel.
+			 */
+			bool prepare(bool allow_parallel) {
+				update_topology();
+				
+				lookahead_ = link_->lookahead();
+				size_t want = (allow_parallel && lookahead_ > 0 && nodes_.size() > 1) ? threads_ : 1;
+				if(want > nodes_.size()) { want = nodes_.size(); }
+				if(want < 1) { want = 1; }
+				if(want != partitions_.size() || (want > 1 && partitions_dirty_)) {
+					repartition(want);
+				}
+				return partitions_.size() > 1;
+			}
+			
+			/**
+			 * Split nodes into \p n strips of (almost) equal size along the
+			 * x axis and move all pending events along with their nodes.
+			 */
+			void repartition(size_t n) {
+				time_t t = now();
+				Stats stats;
+				memset(&stats, 0, sizeof(stats));
+				std::vector<Transfer> pending;
+				for(size_t i = 0; i < partitions_.size(); i++) {
+					Partition &p = *partitions_[i];
+					for(size_t k = 0; k < p.queue.size(); k++) {
+						pending.push_back(Transfer());
+						pending.back().event = p.queue[k];
+						if(p.queue[k].kind == EVENT_MESSAGE) {
+							memcpy(pending.back().data, p.payloads[p.queue[k].payload].data, p.queue[k].length);
+						}
+					}
+					add(stats, p.stats);
+					delete partitions_[i];
+				}
+				partitions_.clear();
+				
+				for(size_t i = 0; i < n; i++) {
+					partitions_.push_back(new Partition);
+					partitions_[i]->now = t;
+					partitions_[i]->outbox.resize(n);
+				}
+				partitions_[0]->stats = stats;
+				
+				std::vector<node_id_t> order(nodes_.size());
+				for(size_t i = 0; i < order.size(); i++) { order[i] = i; }
+				std::sort(order.begin(), order.end(), XOrder(nodes_));
+				for(size_t i = 0; i < order.size(); i++) {
+					nodes_[order[i]]->partition = (::uint64_t)i * n / order.size();
+				}
+				
+				for(size_t k = 0; k < pending.size(); k++) {
+					Event e = pending[k].event;
+					Partition &p = *partitions_[nodes_[e.node]->partition];
+					if(e.kind == EVENT_MESSAGE) {
+						e.payload = p.allocate_payload(e.length, pending[k].data);
+					}
+					p.push(e);
+				}
+				partitions_dirty_ = false;
+			}
+			
+			struct XOrder {
+				XOrder(std::vector<Node*>& nodes) : nodes_(nodes) { }
+				bool operator()(node_id_t a, node_id_t b) const {
+					if(nodes_[a]->x != nodes_[b]->x) { return nodes_[a]->x < nodes_[b]->x; }
+					return a < b;
+				}
+				std::vector<Node*>& nodes_;
+			};
+			
+			static void add(Stats& a, const Stats& b) {
+				a.events += b.events;
+				a.sent += b.sent;
+				a.delivered += b.delivered;
+				a.lost += b.lost;
+			}
+			
+			void run_parallel(time_t until) {
+				size_t n = partitions_.size();
+				std::vector<Worker> workers(n);
+				std::vector<pthread_t> threads(n);
+				pthread_barrier_init(&barrier_, 0, n);
+				next_.assign(n, time_t(NEVER));
+				parallel_ = true;
+				
+				for(size_t i = 0; i < n; i++) {
+					workers[i].world = this;
+					workers[i].index = i;
+					workers[i].until = until;
+					if(i) {
+						pthread_create(&threads[i], 0, &SimWorld::worker_main, &workers[i]);
+					}
+				}
+				worker_main(&workers[0]);
+				for(size_t i = 1; i < n; i++) {
+					pthread_join(threads[i], 0);
+				}
+				
+				parallel_ = false;
+				pthread_barrier_destroy(&barrier_);
+				
+				// Leave all partitions where a sequential run would be
+				time_t t = 0;
+				for(size_t i = 0; i < n; i++) {
+					t = std::max(t, partitions_[i]->now);
+				}
+				if(until != NEVER - 1 && running_ && t < until) { t = until; }
+				for(size_t i = 0; i < n; i++) {
+					partitions_[i]->now = t;
+				}
+			}
+			
+			static void* worker_main(void* arg) {
+				Worker &w = *reinterpret_cast<Worker*>(arg);
+				w.world->work(w.index, w.until);
+				return 0;
+			}
+			
+			void work(size_t index, time_t until) {
+				Partition &p = *partitions_[index];
+				size_t n = partitions_.size();
+				
+				while(true) {
+					receive_transfers(index);
+					next_[index] = p.next();
+					pthread_barrier_wait(&barrier_);
+					
+					// Every thread takes the same decision from the same data
+					time_t t = NEVER;
+					for(size_t i = 0; i < n; i++) {
+						t = std::min(t, next_[i]);
+					}
+					bool done = (t == NEVER) || (t > until) || !running_;
+					if(!done && index == 0) { windows_++; }
+					pthread_barrier_wait(&barrier_);
+					
+					if(done) { break; }
+					
+					time_t end = (until - t < lookahead_) ? until + 1 : t + lookahead_;
+					while(!p.queue.empty() && p.queue[0].time < end) {
+						process(p);
+					}
+					pthread_barrier_wait(&barrier_);
+				}
+			}
+			
+			/**
+			 * Recompute all neighborhoods, nodes are sorted into a grid of
+			 * range() sized cells so only the 3x3 surrounding cells have to
+			 * be checked.
+			 */
+			void update_topology() {
+				if(!topology_dirty_) { return; }
+				topology_dirty_ = false;
+				
+				size_t n = nodes_.size();
+				if(n == 0) { return; }
+				double range = link_->range();
+				
+				double min_x = nodes_[0]->x, min_y = nodes_[0]->y, max_x = min_x, max_y = min_y;
+				for(size_t i = 1; i < n; i++) {
+					if(nodes_[i]->x < min_x) { min_x = nodes_[i]->x; }
+					if(nodes_[i]->y < min_y) { min_y = nodes_[i]->y; }
+					if(nodes_[i]->x > max_x) { max_x = nodes_[i]->x; }
+					if(nodes_[i]->y > max_y) { max_y = nodes_[i]->y; }
+				}
+				
+				// keep the grid at most about as large as the node count
+				double cell = range;
+				while(cell > 0 && ((max_x - min_x) / cell + 1) * ((max_y - min_y) / cell + 1) > 4.0 * n) {
+					cell *= 2;
+				}
+				if(cell <= 0) { cell = 1; }
+				size_t columns = (size_t)((max_x - min_x) / cell) + 1;
+				size_t rows = (size_t)((max_y - min_y) / cell) + 1;
+				
+				// counting sort of node ids by cell
+				std::vector< ::uint32_t> start(columns * rows + 1, 0);
+				std::vector<node_id_t> sorted(n);
+				std::vector< ::uint32_t> cell_of(n);
+				for(size_t i = 0; i < n; i++) {
+					size_t cx = (size_t)((nodes_[i]->x - min_x) / cell);
+					size_t cy = (size_t)((nodes_[i]->y - min_y) / cell);
+					cell_of[i] = cy * columns + cx;
+					start[cell_of[i] + 1]++;
+				}
+				for(size_t c = 0; c < columns * rows; c++) {
+					start[c + 1] += start[c];
+				}
+				std::vector< ::uint32_t> fill(start.begin(), start.end() - 1);
+				for(size_t i = 0; i < n; i++) {
+					sorted[fill[cell_of[i]]++] = i;
+				}
+				
+				for(size_t i = 0; i < n; i++) {
+					Node &a = *nodes_[i];
+					a.neighbors.clear();
+					long cx = cell_of[i] % columns, cy = cell_of[i] / columns;
+					for(long y = cy - 1; y <= cy + 1; y++) {
+						if(y < 0 || y >= (long)rows) { continue; }
+						for(long x = cx - 1; x <= cx + 1; x++) {
+							if(x < 0 || x >= (long)columns) { continue; }
+							size_t c = y * columns + x;
+							for(size_t k = start[c]; k < start[c + 1]; k++) {
+								node_id_t j = sorted[k];
+								if(j != i && distance(i, j) <= range) {
+									a.neighbors.push_back(j);
+								}
+							}
+						}
+					}
+				}
+			}
+			
+			::uint64_t seed_;
+			::uint64_t random_state_;
+			SimLinkModel *link_;
+			SimUnitDiskLinkModel default_link_;
+			bool topology_dirty_;
+			bool partitions_dirty_;
+			bool debug_;
+			bool running_;
+			bool parallel_;
+			size_t threads_;
+			time_t lookahead_;
+			::uint64_t windows_;
+			
+			std::vector<Node*> nodes_;
+			std::vector<Partition*> partitions_;
+			std::vector<time_t> next_;
+			std::vector<Owned> owned_;
+			pthread_mutex_t owned_mutex_;
+			pthread_barrier_t barrier_;
+	}; // class SimWorld
+	
+	bool SimUnitDiskLinkModel::transmit(SimWorld& world, ::uint16_t from, ::uint16_t to,
+			double distance, ::uint64_t& delay) {
+		if(distance > range_) { return false; }
+		if(loss_ > 0.0 && world.link_random_real(from) < loss_) { return false; }
+		delay = latency_ + (jitter_ ? world.link_random(from) % (jitter_ + 1) : 0);
+		return true;
+	}
+	
+} // namespace wiselib
+
+#endif // SIM_WORLD_H
+
@@ -0,0 +1,283 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef __WISELIB_UTIL_ALLOCATORS_ARENA_ALLOCATOR_H
+#define __WISELIB_UTIL_ALLOCATORS_ARENA_ALLOCATOR_H
+
+#include <util/allocators/global_allocator.h>
+#include <util/allocators/utils.h>
+
+namespace wiselib {
+
+/**
+ * Region allocator for objects that die together.
+ * 
+ * Memory is handed out from pages of PAGE_SIZE bytes (requests larger than
+ * a page get a page of their own) by bumping a pointer. Individual free()
+ * calls run the destructor but only give back memory if they concern the
+ * most recent allocation. Instead, mark() records the current fill
+ * level and release() frees everything allocated since in one step:
+ * 
+ * @code
+ * typename Arena::Mark m = arena.mark();
+ * // ... execute query / deserialize a burst of messages ...
+ * arena.release(m);
+ * @endcode
+ * 
+ * or, equivalently, use a Scope object. release() does not run
+ * destructors.
+ * 
+ * Pages are obtained from Parent_P (by default the allocator returned by
+ * get_allocator()), so do not use an arena with the default parent as
+ * the application wide allocator itself.
+ * 
+ * @ingroup Allocator_concept
+ */
+template<
+	typename OsModel_P,
+	typename Parent_P = GlobalAllocator<OsModel_P>,
+	unsigned long PAGE_SIZE_P = 4096
+>
+class ArenaAllocator {
+	public:
+		typedef OsModel_P OsModel;
+		typedef Parent_P Parent;
+		typedef ArenaAllocator<OsModel_P, Parent_P, PAGE_SIZE_P> self_type;
+		typedef self_type* self_pointer_t;
+		typedef typename OsModel::size_t size_t;
+		typedef typename OsModel::block_data_t block_data_t;
+		
+		enum { SUCCESS = OsModel::SUCCESS, ERR_UNSPEC = OsModel::ERR_UNSPEC };
+		
+		enum {
+			PAGE_SIZE = PAGE_SIZE_P,
+			ALIGNMENT = sizeof(void*)
+		};
+		
+	private:
+		struct Page {
+			Page *prev;
+			size_t size;
+		};
+		
+		enum { PAGE_HEADER_SIZE = (sizeof(Page) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT };
+		
+	public:
+		template<typename T>
+		struct pointer_t {
+			public:
+				pointer_t() : p_(0) { }
+				pointer_t(T* p) : p_(p) { }
+				T& operator*() const { return *p_; }
+				T* operator->() const { return p_; }
+				T& operator[](size_t idx) { return p_[idx]; }
+				const T& operator[](size_t idx) const { return p_[idx]; }
+				bool operator==(const pointer_t& other) const { return p_ == other.p_; }
+				bool operator!=(const pointer_t& other) const { return p_ != other.p_; }
+				operator bool() const { return p_ != 0; }
+				pointer_t& operator++() { ++p_; return *this; }
+				pointer_t& operator--() { --p_; return *this; }
+				pointer_t operator+(size_t i) { return pointer_t(p_ + i); }
+				
+				T* raw() { return p_; }
+				const T* raw() const { return p_; }
+			protected:
+				T* p_;
+		};
+		
+		template<typename T>
+		struct array_pointer_t : public pointer_t<T> {
+			public:
+				array_pointer_t() : pointer_t<T>(0) { }
+				array_pointer_t(T* p) : pointer_t<T>(p) { }
+		};
+		
+		/**
+		 * Fill level of the arena as returned by mark().
+		 */
+		class Mark {
+			public:
+				Mark() : page_(0), pos_(0) { }
+			private:
+				Mark(Page *page, block_data_t *pos) : page_(page), pos_(pos) { }
+				Page *page_;
+				block_data_t *pos_;
+			friend class ArenaAllocator<OsModel_P, Parent_P, PAGE_SIZE_P>;
+		};
+		
+		/**
+		 * Releases everything allocated during its lifetime.
+		 */
+		class Scope {
+			public:
+				Scope(self_type& arena) : arena_(arena), mark_(arena.mark()) { }
+				~Scope() { arena_.release(mark_); }
+			private:
+				Scope(const Scope&);
+				Scope& operator=(const Scope&);
+				self_type& arena_;
+				Mark mark_;
+		};
+		
+		ArenaAllocator() : parent_(0), page_(0), pos_(0), end_(0), last_(0), size_(0) {
+		}
+		
+		~ArenaAllocator() {
+			destruct();
+		}
+		
+		int init(typename Parent::self_pointer_t parent = 0) {
+			destruct();
+			parent_ = parent;
+			return SUCCESS;
+		}
+		
+		/**
+		 * Free all pages.
+		 */
+		void destruct() {
+			release(Mark());
+		}
+		
+		Mark mark() {
+			// free() must not hand back memory from before the mark
+			last_ = 0;
+			return Mark(page_, pos_);
+		}
+		
+		/**
+		 * Free everything allocated after \p m has been taken. Marks taken
+		 * after \p m become invalid.
+		 */
+		void release(const Mark& m) {
+			while(page_ != m.page_) {
+				Page *prev = page_->prev;
+				size_ -= page_->size;
+				parent().free_array(reinterpret_cast<block_data_t*>(page_));
+				page_ = prev;
+			}
+			if(page_) {
+				pos_ = m.pos_;
+				end_ = reinterpret_cast<block_data_t*>(page_) + page_->size;
+			}
+			else {
+				pos_ = 0;
+				end_ = 0;
+			}
+			last_ = 0;
+		}
+		
+		template<typename T>
+		pointer_t<T> allocate() {
+			void *p = allocate_bytes(sizeof(T));
+			if(!p) { return pointer_t<T>(); }
+			new(p, AllocatorPlacement()) T;
+			return pointer_t<T>(reinterpret_cast<T*>(p));
+		}
+		
+		template<typename T>
+		array_pointer_t<T> allocate_array(typename OsModel::size_t n) {
+			void *p = allocate_bytes(sizeof(T) * n);
+			if(!p) { return array_pointer_t<T>(); }
+			for(typename OsModel::size_t i = 0; i < n; i++) {
+				new(&(reinterpret_cast<T*>(p)[i]), AllocatorPlacement()) T;
+			}
+			return array_pointer_t<T>(reinterpret_cast<T*>(p));
+		}
+		
+		template<typename T>
+		int free(pointer_t<T> p) {
+			return free(p.raw());
+		}
+		
+		template<typename T>
+		int free(T* p) {
+			if(!p) { return ERR_UNSPEC; }
+			p->~T();
+			free_bytes(p);
+			return SUCCESS;
+		}
+		
+		template<typename T>
+		int free_array(array_pointer_t<T> p) {
+			return free_array(p.raw());
+		}
+		
+		template<typename T>
+		int free_array(T* p) {
+			if(!p) { return ERR_UNSPEC; }
+			free_bytes(p);
+			return SUCCESS;
+		}
+		
+		/**
+		 * @return number of bytes in pages currently held by the arena.
+		 */
+		size_t size() { return size_; }
+		size_t capacity() { return (size_t)-1; }
+		
+	private:
+		Parent& parent() {
+			return parent_ ? *parent_ : default_allocator<Parent>();
+		}
+		
+		void* allocate_bytes(size_t bytes) {
+			bytes = (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+			if(!bytes) { bytes = ALIGNMENT; }
+			
+			if(pos_ + bytes > end_) {
+				size_t sz = PAGE_HEADER_SIZE + bytes;
+				if(sz < PAGE_SIZE) { sz = PAGE_SIZE; }
+				
+				Page *page = reinterpret_cast<Page*>(
+						parent().template allocate_array<block_data_t>(sz).raw());
+				if(!page) { return 0; }
+				page->prev = page_;
+				page->size = sz;
+				page_ = page;
+				size_ += sz;
+				pos_ = reinterpret_cast<block_data_t*>(page) + PAGE_HEADER_SIZE;
+				end_ = reinterpret_cast<block_data_t*>(page) + sz;
+			}
+			
+			last_ = pos_;
+			pos_ += bytes;
+			return last_;
+		}
+		
+		void free_bytes(void *p) {
+			// Only the latest allocation can be given back right away
+			if(p == last_) {
+				pos_ = last_;
+				last_ = 0;
+			}
+		}
+		
+		typename Parent::self_pointer_t parent_;
+		Page *page_;
+		block_data_t *pos_;
+		block_data_t *end_;
+		block_data_t *last_;
+		size_t size_;
+};
+
+} // namespace wiselib
+
+#endif // __WISELIB_UTIL_ALLOCATORS_ARENA_ALLOCATOR_H
+
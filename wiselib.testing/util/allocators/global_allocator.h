@@ -0,0 +1,114 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef __WISELIB_UTIL_ALLOCATORS_GLOBAL_ALLOCATOR_H
+#define __WISELIB_UTIL_ALLOCATORS_GLOBAL_ALLOCATOR_H
+
+namespace wiselib {
+
+/**
+ * Forwards all requests to the application wide allocator returned by
+ * get_allocator().
+ * 
+ * Components that accept an allocator as template parameter use this as
+ * default so they behave exactly as if they called get_allocator()
+ * directly.
+ * 
+ * @ingroup Allocator_concept
+ */
+template<
+	typename OsModel_P
+>
+class GlobalAllocator {
+	public:
+		typedef OsModel_P OsModel;
+		typedef GlobalAllocator<OsModel_P> self_type;
+		typedef self_type* self_pointer_t;
+		typedef typename OsModel::size_t size_t;
+		typedef typename OsModel::block_data_t block_data_t;
+		
+		enum { SUCCESS = OsModel::SUCCESS, ERR_UNSPEC = OsModel::ERR_UNSPEC };
+		
+		template<typename T>
+		struct pointer_t {
+			public:
+				pointer_t() : p_(0) { }
+				pointer_t(T* p) : p_(p) { }
+				T& operator*() const { return *p_; }
+				T* operator->() const { return p_; }
+				T& operator[](size_t idx) { return p_[idx]; }
+				const T& operator[](size_t idx) const { return p_[idx]; }
+				bool operator==(const pointer_t& other) const { return p_ == other.p_; }
+				bool operator!=(const pointer_t& other) const { return p_ != other.p_; }
+				operator bool() const { return p_ != 0; }
+				
+				T* raw() { return p_; }
+				const T* raw() const { return p_; }
+			protected:
+				T* p_;
+		};
+		
+		template<typename T>
+		struct array_pointer_t : public pointer_t<T> {
+			public:
+				array_pointer_t() : pointer_t<T>(0) { }
+				array_pointer_t(T* p) : pointer_t<T>(p) { }
+		};
+		
+		template<typename T>
+		pointer_t<T> allocate() {
+			return pointer_t<T>(::get_allocator().template allocate<T>().raw());
+		}
+		
+		template<typename T>
+		array_pointer_t<T> allocate_array(typename OsModel::size_t n) {
+			return array_pointer_t<T>(::get_allocator().template allocate_array<T>(n).raw());
+		}
+		
+		template<typename T>
+		int free(pointer_t<T> p) { return ::get_allocator().free(p.raw()); }
+		
+		template<typename T>
+		int free(T* p) { return ::get_allocator().free(p); }
+		
+		template<typename T>
+		int free_array(array_pointer_t<T> p) { return ::get_allocator().free_array(p.raw()); }
+		
+		template<typename T>
+		int free_array(T* p) { return ::get_allocator().free_array(p); }
+		
+		size_t size() { return ::get_allocator().size(); }
+		size_t capacity() { return ::get_allocator().capacity(); }
+};
+
+/**
+ * @return instance of Allocator_P for components that have not been given
+ * one explicitly. For GlobalAllocator that is all you ever need, stateful
+ * allocators such as ArenaAllocator should be passed in explicitly.
+ */
+template<typename Allocator_P>
+Allocator_P& default_allocator() {
+	static Allocator_P allocator;
+	return allocator;
+}
+
+} // namespace wiselib
+
+#endif // __WISELIB_UTIL_ALLOCATORS_GLOBAL_ALLOCATOR_H
+
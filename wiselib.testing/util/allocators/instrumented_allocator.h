@@ -0,0 +1,458 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef __WISELIB_UTIL_ALLOCATORS_INSTRUMENTED_ALLOCATOR_H
+#define __WISELIB_UTIL_ALLOCATORS_INSTRUMENTED_ALLOCATOR_H
+
+#include <util/allocators/global_allocator.h>
+#include <util/allocators/utils.h>
+
+#ifdef PC
+	#include <stdio.h>
+#endif
+
+#if defined(__GNUC__)
+	#define INSTRUMENTED_ALLOCATOR_NOINLINE __attribute__((noinline))
+	#define INSTRUMENTED_ALLOCATOR_CALLER() __builtin_return_address(0)
+#else
+	#define INSTRUMENTED_ALLOCATOR_NOINLINE
+	#define INSTRUMENTED_ALLOCATOR_CALLER() ((void*)0)
+#endif
+
+namespace wiselib {
+
+/**
+ * Allocator wrapper that keeps a heap profile.
+ * 
+ * Forwards all requests to Allocator_P (any allocator of the
+ * Allocator_concept), prefixing each allocation with a small header that
+ * remembers its size, call site and type. It records
+ * 
+ * - totals: allocations, frees, live bytes, peak live bytes,
+ * - per call site (return address of the allocate() call, resolve with
+ *   addr2line) and per type (name taken from __PRETTY_FUNCTION__, no
+ *   RTTI needed): allocations, frees, live and peak bytes,
+ * 
+ * in fixed size tables of MAX_SITES_P and MAX_TYPES_P entries, the first
+ * entry of each table collects everything that did not fit.
+ * 
+ * print_stats() writes a report to a Debug instance, snapshot() serializes
+ * the same data into a binary buffer (native byte order, see
+ * SnapshotHeader/SnapshotRecord) and write_snapshot() dumps that to a file
+ * on the PC. Fragmentation is reported as the part of the memory the
+ * wrapped allocator claims to use (its size()) that is not held by live
+ * objects, so it is only meaningful for allocators that implement size().
+ * 
+ * Not thread safe.
+ * 
+ * @ingroup Allocator_concept
+ */
+template<
+	typename OsModel_P,
+	typename Allocator_P = GlobalAllocator<OsModel_P>,
+	int MAX_SITES_P = 64,
+	int MAX_TYPES_P = 64
+>
+class InstrumentedAllocator {
+	public:
+		typedef OsModel_P OsModel;
+		typedef Allocator_P Allocator;
+		typedef InstrumentedAllocator<OsModel_P, Allocator_P, MAX_SITES_P, MAX_TYPES_P> self_type;
+		typedef self_type* self_pointer_t;
+		typedef typename OsModel::size_t size_t;
+		typedef typename OsModel::block_data_t block_data_t;
+		
+		enum { SUCCESS = OsModel::SUCCESS, ERR_UNSPEC = OsModel::ERR_UNSPEC };
+		
+		enum {
+			MAX_SITES = MAX_SITES_P,
+			MAX_TYPES = MAX_TYPES_P,
+			NAME_LENGTH = 64
+		};
+		
+		enum { SNAPSHOT_MAGIC = 0x57484150 }; // "WHAP"
+		enum RecordKind { KIND_SITE = 1, KIND_TYPE = 2 };
+		
+		struct SnapshotHeader {
+			::uint32_t magic;
+			::uint16_t version;
+			::uint16_t records;
+			::uint64_t allocations;
+			::uint64_t frees;
+			::uint64_t live;
+			::uint64_t peak;
+			::uint64_t allocator_size;
+			::uint64_t allocator_capacity;
+		};
+		
+		struct SnapshotRecord {
+			::uint8_t kind;
+			::uint8_t reserved[7];
+			::uint64_t site;
+			::uint64_t allocations;
+			::uint64_t frees;
+			::uint64_t live;
+			::uint64_t peak;
+			char name[NAME_LENGTH];
+		};
+		
+		template<typename T>
+		struct pointer_t {
+			public:
+				pointer_t() : p_(0) { }
+				pointer_t(T* p) : p_(p) { }
+				T& operator*() const { return *p_; }
+				T* operator->() const { return p_; }
+				T& operator[](size_t idx) { return p_[idx]; }
+				const T& operator[](size_t idx) const { return p_[idx]; }
+				bool operator==(const pointer_t& other) const { return p_ == other.p_; }
+				bool operator!=(const pointer_t& other) const { return p_ != other.p_; }
+				operator bool() const { return p_ != 0; }
+				
+				T* raw() { return p_; }
+				const T* raw() const { return p_; }
+			protected:
+				T* p_;
+		};
+		
+		template<typename T>
+		struct array_pointer_t : public pointer_t<T> {
+			public:
+				array_pointer_t() : pointer_t<T>(0) { }
+				array_pointer_t(T* p) : pointer_t<T>(p) { }
+		};
+		
+		InstrumentedAllocator() {
+			init();
+		}
+		
+		/**
+		 * Wrap \p allocator (default: the default instance of
+		 * Allocator_P) and reset all statistics.
+		 */
+		int init(typename Allocator::self_pointer_t allocator = 0) {
+			allocator_ = allocator ? allocator : &default_allocator<Allocator>();
+			allocations_ = 0;
+			frees_ = 0;
+			live_ = 0;
+			peak_ = 0;
+			reported_allocations_ = 0;
+			memset(sites_, 0, sizeof(sites_));
+			memset(types_, 0, sizeof(types_));
+			return SUCCESS;
+		}
+		
+		template<typename T>
+		INSTRUMENTED_ALLOCATOR_NOINLINE
+		pointer_t<T> allocate() {
+			void *p = allocate_bytes(sizeof(T), INSTRUMENTED_ALLOCATOR_CALLER(), type_name<T>());
+			if(!p) { return pointer_t<T>(); }
+			new(p, AllocatorPlacement()) T;
+			return pointer_t<T>(reinterpret_cast<T*>(p));
+		}
+		
+		template<typename T>
+		INSTRUMENTED_ALLOCATOR_NOINLINE
+		array_pointer_t<T> allocate_array(typename OsModel::size_t n) {
+			void *p = allocate_bytes(sizeof(T) * n, INSTRUMENTED_ALLOCATOR_CALLER(), type_name<T>());
+			if(!p) { return array_pointer_t<T>(); }
+			for(typename OsModel::size_t i = 0; i < n; i++) {
+				new(&(reinterpret_cast<T*>(p)[i]), AllocatorPlacement()) T;
+			}
+			return array_pointer_t<T>(reinterpret_cast<T*>(p));
+		}
+		
+		template<typename T>
+		int free(pointer_t<T> p) { return free(p.raw()); }
+		
+		template<typename T>
+		int free(T* p) {
+			if(!p) { return ERR_UNSPEC; }
+			p->~T();
+			return free_bytes(p);
+		}
+		
+		template<typename T>
+		int free_array(array_pointer_t<T> p) { return free_array(p.raw()); }
+		
+		template<typename T>
+		int free_array(T* p) {
+			if(!p) { return ERR_UNSPEC; }
+			return free_bytes(p);
+		}
+		
+		/// @return bytes currently held by live objects (without headers)
+		size_t size() { return live_; }
+		size_t peak() { return peak_; }
+		size_t capacity() { return allocator_->capacity(); }
+		unsigned long allocations() { return allocations_; }
+		unsigned long frees() { return frees_; }
+		
+		Allocator& allocator() { return *allocator_; }
+		
+		/**
+		 * Print statistics. If \p interval_ms is given it is taken as time
+		 * since the last call and an allocation rate is printed.
+		 */
+		template<typename Debug_P>
+		void print_stats(Debug_P* d, unsigned long interval_ms = 0) {
+			d->debug("\nheap profile\n");
+			d->debug("------------\n");
+			d->debug("allocations    : %14lu\n", allocations_);
+			d->debug("frees          : %14lu\n", frees_);
+			d->debug("live bytes     : %14lu\n", (unsigned long)live_);
+			d->debug("peak bytes     : %14lu\n", (unsigned long)peak_);
+			if(interval_ms) {
+				d->debug("allocations/s  : %14lu\n",
+						(allocations_ - reported_allocations_) * 1000UL / interval_ms);
+			}
+			reported_allocations_ = allocations_;
+			
+			size_t used = allocator_->size();
+			if(used) {
+				d->debug("allocator size : %14lu\n", (unsigned long)used);
+				d->debug("fragmentation  : %13lu%%\n",
+						(used > live_) ? (unsigned long)((used - live_) * 100 / used) : 0UL);
+			}
+			
+			d->debug("\nby call site     allocs      frees       live       peak\n");
+			for(size_t i = 0; i < MAX_SITES; i++) {
+				Record &r = sites_[i];
+				if(!r.allocations) { continue; }
+				d->debug("%-14p %8lu %10lu %10lu %10lu\n", r.key, r.allocations, r.frees,
+						(unsigned long)r.live, (unsigned long)r.peak);
+			}
+			
+			d->debug("\nby type   allocs      frees       live       peak\n");
+			for(size_t i = 0; i < MAX_TYPES; i++) {
+				Record &r = types_[i];
+				if(!r.allocations) { continue; }
+				char name[NAME_LENGTH];
+				short_type_name(name, r.name);
+				d->debug("%8lu %10lu %10lu %10lu  %s\n", r.allocations, r.frees,
+						(unsigned long)r.live, (unsigned long)r.peak, name);
+			}
+			d->debug("\n");
+		}
+		
+		/**
+		 * @return number of bytes needed for snapshot().
+		 */
+		size_t snapshot_size() {
+			return sizeof(SnapshotHeader) + records() * sizeof(SnapshotRecord);
+		}
+		
+		/**
+		 * Serialize current statistics into \p buffer.
+		 * @return number of bytes written, 0 if \p buffer_size is smaller
+		 * than snapshot_size().
+		 */
+		size_t snapshot(block_data_t *buffer, size_t buffer_size) {
+			size_t sz = snapshot_size();
+			if(buffer_size < sz) { return 0; }
+			
+			SnapshotHeader h;
+			memset(&h, 0, sizeof(h));
+			h.magic = SNAPSHOT_MAGIC;
+			h.version = 1;
+			h.records = records();
+			h.allocations = allocations_;
+			h.frees = frees_;
+			h.live = live_;
+			h.peak = peak_;
+			h.allocator_size = allocator_->size();
+			h.allocator_capacity = allocator_->capacity();
+			memcpy(buffer, &h, sizeof(h));
+			buffer += sizeof(h);
+			
+			buffer = write_records(buffer, sites_, MAX_SITES, KIND_SITE);
+			write_records(buffer, types_, MAX_TYPES, KIND_TYPE);
+			return sz;
+		}
+		
+	#ifdef PC
+		/**
+		 * Write snapshot() to file \p path.
+		 */
+		int write_snapshot(const char *path) {
+			size_t sz = snapshot_size();
+			block_data_t *buffer = allocator_->template allocate_array<block_data_t>(sz).raw();
+			if(!buffer) { return ERR_UNSPEC; }
+			snapshot(buffer, sz);
+			
+			int r = ERR_UNSPEC;
+			FILE *f = fopen(path, "wb");
+			if(f) {
+				if(fwrite(buffer, 1, sz, f) == sz) { r = SUCCESS; }
+				fclose(f);
+			}
+			allocator_->free_array(buffer);
+			return r;
+		}
+	#endif
+		
+	private:
+		typedef typename Allocator::template array_pointer_t<block_data_t> RawPointer;
+		
+		struct Record {
+			const void *key;
+			const char *name;
+			unsigned long allocations;
+			unsigned long frees;
+			size_t live;
+			size_t peak;
+		};
+		
+		struct Header {
+			RawPointer raw;
+			size_t bytes;
+			::uint16_t site;
+			::uint16_t type;
+		};
+		
+		enum { HEADER_SIZE = (sizeof(Header) + 15) / 16 * 16 };
+		
+		template<typename T>
+		static const char* type_name() {
+		#if defined(__GNUC__)
+			return __PRETTY_FUNCTION__;
+		#else
+			return "?";
+		#endif
+		}
+		
+		/**
+		 * Extract "X" from "... [with T = X; ...]" or "... [with T = X]".
+		 */
+		static void short_type_name(char *out, const char *pretty) {
+			const char *s = pretty;
+			for( ; *s; s++) {
+				if(s[0] == 'T' && s[1] == ' ' && s[2] == '=' && s[3] == ' ') { s += 4; break; }
+			}
+			if(!*s) { s = pretty; }
+			size_t i = 0;
+			for( ; s[i] && s[i] != ';' && s[i] != ']' && i < NAME_LENGTH - 1; i++) {
+				out[i] = s[i];
+			}
+			out[i] = '\0';
+		}
+		
+		/**
+		 * Find or create the record for \p key in \p table, entry 0 is
+		 * used for everything that does not fit.
+		 */
+		static size_t lookup(Record *table, size_t n, const void *key, const char *name) {
+			size_t h = reinterpret_cast<unsigned long>(key) % (n - 1);
+			for(size_t i = 0; i < n - 1; i++) {
+				Record &r = table[1 + (h + i) % (n - 1)];
+				if(r.key == key) { return 1 + (h + i) % (n - 1); }
+				if(r.key == 0) {
+					r.key = key;
+					r.name = name;
+					return 1 + (h + i) % (n - 1);
+				}
+			}
+			return 0;
+		}
+		
+		static void account_allocation(Record& r, size_t bytes) {
+			r.allocations++;
+			r.live += bytes;
+			if(r.live > r.peak) { r.peak = r.live; }
+		}
+		
+		static void account_free(Record& r, size_t bytes) {
+			r.frees++;
+			r.live -= bytes;
+		}
+		
+		void* allocate_bytes(size_t bytes, const void *site, const char *type) {
+			RawPointer raw = allocator_->template allocate_array<block_data_t>(HEADER_SIZE + bytes);
+			if(!raw) { return 0; }
+			
+			block_data_t *p = raw.raw();
+			Header &h = *reinterpret_cast<Header*>(p);
+			new(&h.raw, AllocatorPlacement()) RawPointer(raw);
+			h.bytes = bytes;
+			h.site = lookup(sites_, MAX_SITES, site, 0);
+			h.type = lookup(types_, MAX_TYPES, type, type);
+			
+			allocations_++;
+			live_ += bytes;
+			if(live_ > peak_) { peak_ = live_; }
+			account_allocation(sites_[h.site], bytes);
+			account_allocation(types_[h.type], bytes);
+			
+			return p + HEADER_SIZE;
+		}
+		
+		int free_bytes(void *ptr) {
+			Header &h = *reinterpret_cast<Header*>(reinterpret_cast<block_data_t*>(ptr) - HEADER_SIZE);
+			
+			frees_++;
+			live_ -= h.bytes;
+			account_free(sites_[h.site], h.bytes);
+			account_free(types_[h.type], h.bytes);
+			
+			RawPointer raw(h.raw);
+			h.raw.~RawPointer();
+			return allocator_->free_array(raw);
+		}
+		
+		size_t records() {
+			size_t r = 0;
+			for(size_t i = 0; i < MAX_SITES; i++) { if(sites_[i].allocations) { r++; } }
+			for(size_t i = 0; i < MAX_TYPES; i++) { if(types_[i].allocations) { r++; } }
+			return r;
+		}
+		
+		block_data_t* write_records(block_data_t *buffer, Record *table, size_t n, RecordKind kind) {
+			for(size_t i = 0; i < n; i++) {
+				Record &r = table[i];
+				if(!r.allocations) { continue; }
+				
+				SnapshotRecord s;
+				memset(&s, 0, sizeof(s));
+				s.kind = kind;
+				s.site = reinterpret_cast<unsigned long>(r.key);
+				s.allocations = r.allocations;
+				s.frees = r.frees;
+				s.live = r.live;
+				s.peak = r.peak;
+				if(r.name) { short_type_name(s.name, r.name); }
+				memcpy(buffer, &s, sizeof(s));
+				buffer += sizeof(s);
+			}
+			return buffer;
+		}
+		
+		typename Allocator::self_pointer_t allocator_;
+		unsigned long allocations_;
+		unsigned long frees_;
+		unsigned long reported_allocations_;
+		size_t live_;
+		size_t peak_;
+		Record sites_[MAX_SITES];
+		Record types_[MAX_TYPES];
+};
+
+} // namespace wiselib
+
+#endif // __WISELIB_UTIL_ALLOCATORS_INSTRUMENTED_ALLOCATOR_H
+
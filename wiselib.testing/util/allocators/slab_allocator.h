@@ -0,0 +1,497 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef __WISELIB_UTIL_ALLOCATORS_SLAB_ALLOCATOR_H
+#define __WISELIB_UTIL_ALLOCATORS_SLAB_ALLOCATOR_H
+
+#include <stdlib.h>
+#include <util/meta.h>
+#include <util/null_mutex.h>
+
+namespace wiselib {
+	struct SlabPlacement { };
+}
+
+inline void* operator new(size_t size, void* ptr, wiselib::SlabPlacement) {
+	return ptr;
+}
+
+namespace wiselib {
+
+/**
+ * Size class (slab) allocator.
+ * 
+ * Requests of up to MAX_SMALL bytes are rounded up to a multiple of
+ * GRANULE and served from per size class free lists. These are refilled
+ * from slabs, i.e. blocks of SLAB_SIZE bytes aligned to SLAB_SIZE that
+ * carry a small header with their size class. Thus both allocation and
+ * freeing are O(1): free() finds the size class of a pointer by masking
+ * off the lower bits of its address. Larger requests get their own
+ * SLAB_SIZE-aligned block with the same header. Slabs are only returned
+ * to the system by destruct().
+ * 
+ * Thread safety is controlled by Mutex_P (NullMutex: single threaded,
+ * PCMutex: every allocation locks). With THREAD_CACHE_P each thread keeps
+ * a small stack of free objects per size class and only takes the lock
+ * to move batches of BATCH objects from and to the shared free lists.
+ * Objects cached by a thread when it exits are not reused before
+ * destruct(). The thread cache is shared by all allocator instances of the
+ * same type, so only use one instance per type with it (which is what
+ * get_allocator() does anyway).
+ * 
+ * Statistics are only collected with KEEP_STATS_P and compiled out
+ * entirely otherwise.
+ * 
+ * @ingroup Allocator_concept
+ */
+template<
+	typename OsModel_P,
+	typename Mutex_P = NullMutex<OsModel_P>,
+	bool THREAD_CACHE_P = false,
+	bool KEEP_STATS_P = false,
+	unsigned long SLAB_SIZE_P = 65536UL
+>
+class SlabAllocator {
+	public:
+		typedef OsModel_P OsModel;
+		typedef Mutex_P Mutex;
+		typedef SlabAllocator<OsModel_P, Mutex_P, THREAD_CACHE_P, KEEP_STATS_P, SLAB_SIZE_P> self_type;
+		typedef self_type* self_pointer_t;
+		typedef typename OsModel::size_t size_t;
+		typedef typename OsModel::block_data_t block_data_t;
+		
+		enum { SUCCESS = OsModel::SUCCESS, ERR_UNSPEC = OsModel::ERR_UNSPEC };
+		
+		enum {
+			SLAB_SIZE = SLAB_SIZE_P,
+			GRANULE = 16,
+			SIZE_CLASSES = 64,
+			MAX_SMALL = GRANULE * SIZE_CLASSES,
+			/// Number of objects moved between thread cache and shared free
+			/// lists at once
+			BATCH = 32,
+			THREAD_CACHE = THREAD_CACHE_P,
+			COLLECT_STATS = KEEP_STATS_P
+		};
+		
+		template<typename T>
+		struct pointer_t {
+			public:
+				pointer_t() : p_(0) { }
+				pointer_t(T* p) : p_(p) { }
+				pointer_t(const pointer_t& other) : p_(other.p_) { }
+				pointer_t& operator=(const pointer_t& other) { p_ = other.p_; return *this; }
+				T& operator*() const { return *p_; }
+				T* operator->() const { return p_; }
+				T& operator[](size_t idx) { return p_[idx]; }
+				const T& operator[](size_t idx) const { return p_[idx]; }
+				bool operator==(const pointer_t& other) const { return p_ == other.p_; }
+				bool operator!=(const pointer_t& other) const { return p_ != other.p_; }
+				operator bool() const { return p_ != 0; }
+				pointer_t& operator++() { ++p_; return *this; }
+				pointer_t& operator--() { --p_; return *this; }
+				pointer_t operator+(size_t i) { return pointer_t(p_ + i); }
+				
+				T* raw() { return p_; }
+				const T* raw() const { return p_; }
+			protected:
+				T* p_;
+				
+			friend class SlabAllocator<OsModel_P, Mutex_P, THREAD_CACHE_P, KEEP_STATS_P, SLAB_SIZE_P>;
+		};
+		
+		template<typename T>
+		struct array_pointer_t : public pointer_t<T> {
+			public:
+				array_pointer_t() : pointer_t<T>(0), elements_(0) { }
+				array_pointer_t(T* p) : pointer_t<T>(p), elements_(1) { }
+				array_pointer_t(T* p, size_t e) : pointer_t<T>(p), elements_(e) {
+				}
+				array_pointer_t(const array_pointer_t& other) : pointer_t<T>(other.p_), elements_(other.elements_) {
+				}
+				array_pointer_t& operator=(const array_pointer_t& other) {
+					this->p_ = other.p_;
+					elements_ = other.elements_;
+					return *this;
+				}
+				array_pointer_t& operator++() { ++this->p_; --elements_; return *this; }
+				array_pointer_t& operator--() { --this->p_; ++elements_; return *this; }
+				array_pointer_t operator+(size_t n) const { return array_pointer_t(this->p_ + n, elements_); }
+				array_pointer_t operator-(size_t n) const { return array_pointer_t(this->p_ - n, elements_); }
+				
+				size_t elements() const { return elements_; }
+				
+			private:
+				size_t elements_;
+		};
+		
+		SlabAllocator() : slabs_(0), large_(0), generation_(0) {
+			static_assert(((SLAB_SIZE & (SLAB_SIZE - 1)) == 0) && (SLAB_SIZE >= 4 * MAX_SMALL));
+			#ifndef PC
+			{
+				static_assert(!THREAD_CACHE);
+			}
+			#endif
+			reset();
+		}
+		
+		~SlabAllocator() {
+			destruct();
+		}
+		
+		/**
+		 * Return all slabs to the system. All objects allocated so far
+		 * become invalid.
+		 */
+		void destruct() {
+			MutexGuard<Mutex> guard(mutex_);
+			free_list(slabs_);
+			free_list(large_);
+			slabs_ = 0;
+			large_ = 0;
+			generation_++;
+			reset();
+		}
+		
+		template<typename T>
+		pointer_t<T> allocate() {
+			void *p = allocate_bytes(sizeof(T));
+			if(!p) { return pointer_t<T>(); }
+			new(p, SlabPlacement()) T;
+			return pointer_t<T>(reinterpret_cast<T*>(p));
+		}
+		
+		template<typename T>
+		array_pointer_t<T> allocate_array(typename OsModel::size_t n) {
+			void *p = allocate_bytes(sizeof(T) * n);
+			if(!p) { return array_pointer_t<T>(); }
+			for(typename OsModel::size_t i = 0; i < n; i++) {
+				new(&(reinterpret_cast<T*>(p)[i]), SlabPlacement()) T;
+			}
+			return array_pointer_t<T>(reinterpret_cast<T*>(p), n);
+		}
+		
+		template<typename T>
+		int free(pointer_t<T> p) {
+			return free(p.raw());
+		}
+		
+		template<typename T>
+		int free(T* p) {
+			if(!p) { return ERR_UNSPEC; }
+			p->~T();
+			free_bytes(p);
+			return SUCCESS;
+		}
+		
+		template<typename T>
+		int free_array(array_pointer_t<T> p) {
+			if(!p) { return ERR_UNSPEC; }
+			for(size_t i = 0; i < p.elements(); i++) {
+				p.raw()[i].~T();
+			}
+			free_bytes(p.raw());
+			return SUCCESS;
+		}
+		
+		/**
+		 * Free array allocated with allocate_array(). As the number of
+		 * elements is unknown here, destructors are not called.
+		 */
+		template<typename T>
+		int free_array(T* p) {
+			if(!p) { return ERR_UNSPEC; }
+			free_bytes(p);
+			return SUCCESS;
+		}
+		
+		/**
+		 * @return bytes currently handed out (rounded up to size classes),
+		 * 0 without KEEP_STATS_P.
+		 */
+		size_t size() { return COLLECT_STATS ? stats_.bytes : 0; }
+		size_t capacity() { return (size_t)-1; }
+		
+		template<typename Debug_P>
+		void print_stats(Debug_P* d) {
+			if(!COLLECT_STATS) { return; }
+			d->debug("\nslab allocator statistics\n");
+			d->debug("-------------------------\n");
+			d->debug("allocations    : %14lu\n", stats_.allocations);
+			d->debug("frees          : %14lu\n", stats_.frees);
+			d->debug("bytes in use   : %14lu\n", stats_.bytes);
+			d->debug("slabs          : %14lu\n", stats_.slabs);
+			d->debug("large blocks   : %14lu\n", stats_.large);
+			d->debug("\n");
+		}
+		
+	private:
+		enum { LARGE = SIZE_CLASSES };
+		
+		/// At the start of every slab and every large block.
+		struct Header {
+			Header *next;
+			Header *prev;
+			size_t size_class;
+			size_t bytes;
+		};
+		
+		enum { HEADER_SIZE = (sizeof(Header) + GRANULE - 1) / GRANULE * GRANULE };
+		
+		struct Stats {
+			unsigned long allocations, frees, bytes, slabs, large;
+		};
+		
+	#ifdef PC
+		struct ThreadCache {
+			const self_type *owner;
+			unsigned long generation;
+			block_data_t *free[SIZE_CLASSES];
+			size_t count[SIZE_CLASSES];
+		};
+		
+		static __thread ThreadCache thread_cache_;
+	#endif
+		
+		static size_t size_class(size_t bytes) {
+			return bytes ? (bytes - 1) / GRANULE : 0;
+		}
+		
+		static size_t class_size(size_t c) {
+			return (c + 1) * GRANULE;
+		}
+		
+		static Header* header(void *p) {
+			return reinterpret_cast<Header*>(reinterpret_cast<unsigned long>(p) & ~(SLAB_SIZE - 1UL));
+		}
+		
+		static block_data_t*& next(block_data_t *p) {
+			return *reinterpret_cast<block_data_t**>(p);
+		}
+		
+		static void stat(unsigned long& v, long d) {
+			#ifdef PC
+				__sync_fetch_and_add(&v, d);
+			#else
+				v += d;
+			#endif
+		}
+		
+		void reset() {
+			for(size_t c = 0; c < SIZE_CLASSES; c++) {
+				free_[c] = 0;
+				bump_[c] = 0;
+				bump_end_[c] = 0;
+			}
+			if(COLLECT_STATS) {
+				stats_.allocations = stats_.frees = stats_.bytes = stats_.slabs = stats_.large = 0;
+			}
+		}
+		
+		void free_list(Header *h) {
+			while(h) {
+				Header *n = h->next;
+				::free(h);
+				h = n;
+			}
+		}
+		
+		static Header* allocate_block(size_t bytes) {
+			void *p = 0;
+			if(posix_memalign(&p, SLAB_SIZE, bytes) != 0) { return 0; }
+			return reinterpret_cast<Header*>(p);
+		}
+		
+		void* allocate_bytes(size_t bytes) {
+			if(bytes > MAX_SMALL) { return allocate_large(bytes); }
+			
+			size_t c = size_class(bytes);
+			block_data_t *r;
+			
+		#ifdef PC
+			if(THREAD_CACHE) {
+				ThreadCache &tc = thread_cache();
+				if(!tc.free[c]) {
+					MutexGuard<Mutex> guard(mutex_);
+					for(size_t i = 0; i < BATCH; i++) {
+						block_data_t *p = pop(c);
+						if(!p) { break; }
+						next(p) = tc.free[c];
+						tc.free[c] = p;
+						tc.count[c]++;
+					}
+				}
+				r = tc.free[c];
+				if(r) {
+					tc.free[c] = next(r);
+					tc.count[c]--;
+				}
+			}
+			else
+		#endif
+			{
+				MutexGuard<Mutex> guard(mutex_);
+				r = pop(c);
+			}
+			
+			if(COLLECT_STATS && r) {
+				stat(stats_.allocations, 1);
+				stat(stats_.bytes, class_size(c));
+			}
+			return r;
+		}
+		
+		void free_bytes(void *ptr) {
+			block_data_t *p = reinterpret_cast<block_data_t*>(ptr);
+			Header *h = header(p);
+			if(h->size_class == LARGE) {
+				free_large(h);
+				return;
+			}
+			
+			size_t c = h->size_class;
+			if(COLLECT_STATS) {
+				stat(stats_.frees, 1);
+				stat(stats_.bytes, -(long)class_size(c));
+			}
+			
+		#ifdef PC
+			if(THREAD_CACHE) {
+				ThreadCache &tc = thread_cache();
+				next(p) = tc.free[c];
+				tc.free[c] = p;
+				tc.count[c]++;
+				if(tc.count[c] > 2 * BATCH) {
+					MutexGuard<Mutex> guard(mutex_);
+					for(size_t i = 0; i < BATCH; i++) {
+						block_data_t *q = tc.free[c];
+						tc.free[c] = next(q);
+						next(q) = free_[c];
+						free_[c] = q;
+					}
+					tc.count[c] -= BATCH;
+				}
+				return;
+			}
+		#endif
+			
+			MutexGuard<Mutex> guard(mutex_);
+			next(p) = free_[c];
+			free_[c] = p;
+		}
+		
+		/**
+		 * Take an object of size class c from the shared free list or a
+		 * slab. Caller must hold mutex_.
+		 */
+		block_data_t* pop(size_t c) {
+			block_data_t *r = free_[c];
+			if(r) {
+				free_[c] = next(r);
+				return r;
+			}
+			
+			size_t sz = class_size(c);
+			if(bump_[c] + sz > bump_end_[c]) {
+				Header *h = allocate_block(SLAB_SIZE);
+				if(!h) { return 0; }
+				h->size_class = c;
+				h->bytes = SLAB_SIZE;
+				h->prev = 0;
+				h->next = slabs_;
+				slabs_ = h;
+				bump_[c] = reinterpret_cast<block_data_t*>(h) + HEADER_SIZE;
+				bump_end_[c] = reinterpret_cast<block_data_t*>(h) + SLAB_SIZE;
+				if(COLLECT_STATS) { stat(stats_.slabs, 1); }
+			}
+			r = bump_[c];
+			bump_[c] += sz;
+			return r;
+		}
+		
+		void* allocate_large(size_t bytes) {
+			Header *h = allocate_block(HEADER_SIZE + bytes);
+			if(!h) { return 0; }
+			h->size_class = LARGE;
+			h->bytes = bytes;
+			h->prev = 0;
+			{
+				MutexGuard<Mutex> guard(mutex_);
+				h->next = large_;
+				if(large_) { large_->prev = h; }
+				large_ = h;
+			}
+			if(COLLECT_STATS) {
+				stat(stats_.allocations, 1);
+				stat(stats_.bytes, bytes);
+				stat(stats_.large, 1);
+			}
+			return reinterpret_cast<block_data_t*>(h) + HEADER_SIZE;
+		}
+		
+		void free_large(Header *h) {
+			if(COLLECT_STATS) {
+				stat(stats_.frees, 1);
+				stat(stats_.bytes, -(long)h->bytes);
+				stat(stats_.large, -1);
+			}
+			{
+				MutexGuard<Mutex> guard(mutex_);
+				if(h->prev) { h->prev->next = h->next; }
+				else { large_ = h->next; }
+				if(h->next) { h->next->prev = h->prev; }
+			}
+			::free(h);
+		}
+		
+	#ifdef PC
+		ThreadCache& thread_cache() {
+			ThreadCache &tc = thread_cache_;
+			if(tc.owner != this || tc.generation != generation_) {
+				// first use in this thread or allocator has been reset
+				memset(&tc, 0, sizeof(tc));
+				tc.owner = this;
+				tc.generation = generation_;
+			}
+			return tc;
+		}
+	#endif
+		
+		Mutex mutex_;
+		Header *slabs_;
+		Header *large_;
+		unsigned long generation_;
+		block_data_t *free_[SIZE_CLASSES];
+		block_data_t *bump_[SIZE_CLASSES];
+		block_data_t *bump_end_[SIZE_CLASSES];
+		Stats stats_;
+};
+
+#ifdef PC
+template<
+	typename OsModel_P, typename Mutex_P, bool THREAD_CACHE_P, bool KEEP_STATS_P, unsigned long SLAB_SIZE_P
+>
+__thread typename SlabAllocator<OsModel_P, Mutex_P, THREAD_CACHE_P, KEEP_STATS_P, SLAB_SIZE_P>::ThreadCache
+SlabAllocator<OsModel_P, Mutex_P, THREAD_CACHE_P, KEEP_STATS_P, SLAB_SIZE_P>::thread_cache_;
+#endif
+
+} // namespace wiselib
+
+#endif // __WISELIB_UTIL_ALLOCATORS_SLAB_ALLOCATOR_H
+
@@ -33,8 +33,17 @@ namespace wiselib {
 		}
 	}
 	
+	/**
+	 * Tag for the placement new used by allocators to construct objects
+	 * in memory they handed out.
+	 */
+	struct AllocatorPlacement { };
 	
 }
 
+inline void* operator new(size_t size, void* ptr, wiselib::AllocatorPlacement) {
+	return ptr;
+}
+
 #endif // __UTIL_ALLOCATORS_UTIL_H__
 
@@ -3,17 +3,20 @@
 #define SHDT_SERIALIZER_H
 
 #include <util/meta.h>
+#include <util/allocators/global_allocator.h>
 
 namespace wiselib {
 	
 	template<
 		typename OsModel_P,
 		size_t TABLE_SIZE_P,
-		size_t TUPLE_SIZE_P = 3
+		size_t TUPLE_SIZE_P = 3,
+		typename Allocator_P = GlobalAllocator<OsModel_P>
 	>
 	class ShdtSerializer {
 		public:
 			typedef OsModel_P OsModel;
+			typedef Allocator_P Allocator;
 			enum { TABLE_SIZE = TABLE_SIZE_P };
 			enum { TUPLE_SIZE = TUPLE_SIZE_P };
 			
@@ -27,10 +30,21 @@ namespace wiselib {
 			enum Commands { CMD_INSERT = 0xfe, CMD_END = 0xff };
 			enum { SUCCESS = OsModel::SUCCESS, ERR_UNSPEC = OsModel::ERR_UNSPEC };
 			
-			ShdtSerializer() {
+			ShdtSerializer() : allocator_(&default_allocator<Allocator>()) {
 				memset((void*)lookup_table_, 0, sizeof(lookup_table_));
 			}
 			
+			/**
+			 * Reset and use \p allocator for lookup table entries from now
+			 * on. With an ArenaAllocator, the entries of a message burst
+			 * can be freed at once by calling reset() and releasing the
+			 * arena afterwards.
+			 */
+			void init(typename Allocator::self_pointer_t allocator) {
+				reset();
+				allocator_ = allocator;
+			}
+			
 			~ShdtSerializer() {
 				reset();
 			}
@@ -48,7 +62,7 @@ namespace wiselib {
 			void reset() {
 				for(size_type i=0; i<TABLE_SIZE; i++) {
 					if(lookup_table_[i]) {
-						get_allocator().free(lookup_table_[i]);
+						allocator_->free(lookup_table_[i]);
 					}
 				}
 				memset((void*)lookup_table_, 0, sizeof(lookup_table_));
@@ -150,9 +164,9 @@ namespace wiselib {
 							buffer += sizeof(table_id_t); buffer_size -= sizeof(table_id_t);
 							size_type l = strlen((char*)buffer) + 1; //strnlen((char*)buffer, buffer_size);
 							if(lookup_table_[pos]) {
-								get_allocator().free_array(lookup_table_[pos]);
+								allocator_->free_array(lookup_table_[pos]);
 							}
-							lookup_table_[pos] = get_allocator().allocate_array<block_data_t>(l) .raw();
+							lookup_table_[pos] = allocator_->template allocate_array<block_data_t>(l) .raw();
 							memcpy((void*)lookup_table_[pos], (void*)buffer, l);
 							buffer += l; buffer_size -= l;
 						}
@@ -228,7 +242,7 @@ namespace wiselib {
 					else {
 						//printf("  --> overwrite\n");
 //						GET_OS.debug("free(2) %x", t);
-						get_allocator().free(t);
+						allocator_->free(t);
 						lookup_table_[id2] = 0;
 						
 						if(insert(id2, data, buffer, max_size) == ERR_UNSPEC) { return nidx; }
@@ -265,7 +279,7 @@ namespace wiselib {
 //
 				max_size -= cmdlen;
 
-				block_data_t* d = get_allocator().allocate_array<block_data_t>(l).raw();
+				block_data_t* d = allocator_->template allocate_array<block_data_t>(l).raw();
 //				GET_OS.debug("aod: %x", d);
 //				block_data_t* d = (block_data_t*)isense::malloc(l);
 				memcpy((void*)d, (void*)data, l);
@@ -291,6 +305,7 @@ namespace wiselib {
 			
 			
 			//iterator current_, end_;
+			typename Allocator::self_pointer_t allocator_;
 			block_data_t *lookup_table_[TABLE_SIZE];
 	};
 	
@@ -0,0 +1,387 @@
+
+#ifndef SHDT_STREAM_SERIALIZER_H
+#define SHDT_STREAM_SERIALIZER_H
+
+#include <util/meta.h>
+#include <util/serialization/serialization.h>
+#include <algorithms/hash/fnv.h>
+
+namespace wiselib {
+
+	/**
+	 * @brief SHDT serializer that keeps its lookup table in a caller owned
+	 * ring buffer instead of heap allocated copies.
+	 *
+	 * Uses the same wire format as ShdtSerializer. Table
+	 * entries hold the hash, length and ring position of their string, so
+	 * lookups compare hashes before bytes and no allocation takes place.
+	 * The strings of inserted entries are appended to the ring; once the
+	 * ring has wrapped around an entry its bytes may be overwritten, so it
+	 * counts as gone and will be inserted again when needed.
+	 *
+	 * Eviction only depends on the sequence of inserts, so encoder and
+	 * decoder stay in sync as long as both use rings of the same size.
+	 * The encoder makes sure none of the entries a tuple references is
+	 * evicted before the tuple is written. Its output can be read by a
+	 * ShdtSerializer, but not the other way round as ShdtSerializer
+	 * assumes entries never expire.
+	 *
+	 * Tuples returned by read_buffer() / read_frames() point into the
+	 * ring and stay valid until ring_size more bytes of strings have been
+	 * inserted.
+	 *
+	 * fill_frames() and read_frames() work directly on a list of radio
+	 * frames; no command is split between frames, so each frame can also
+	 * be handed to read_buffer() on its own.
+	 */
+	template<
+		typename OsModel_P,
+		size_t TABLE_SIZE_P,
+		size_t TUPLE_SIZE_P = 3,
+		typename Hash_P = Fnv32<OsModel_P>
+	>
+	class ShdtStreamSerializer {
+		public:
+			typedef OsModel_P OsModel;
+			typedef Hash_P Hash;
+			enum { TABLE_SIZE = TABLE_SIZE_P };
+			enum { TUPLE_SIZE = TUPLE_SIZE_P };
+
+			typedef typename OsModel::size_t size_type;
+			typedef typename OsModel::block_data_t block_data_t;
+			typedef typename Hash::hash_t hash_t;
+			typedef uint8_t command_t;
+			typedef typename SmallUint<TABLE_SIZE + 1>::t table_id_t;
+			typedef ShdtStreamSerializer<OsModel, TABLE_SIZE, TUPLE_SIZE, Hash> self_type;
+
+			enum { npos = (size_type)(-1) };
+			enum { nidx = (table_id_t)(-1) };
+			enum Commands { CMD_INSERT = 0xfe, CMD_END = 0xff };
+			enum { SUCCESS = OsModel::SUCCESS, ERR_UNSPEC = OsModel::ERR_UNSPEC };
+
+			/// Size of an insert command without the string.
+			enum { INSERT_HEADER_SIZE = 2 * sizeof(table_id_t) + sizeof(command_t) };
+
+			static_assert((TABLE_SIZE_P >= TUPLE_SIZE_P));
+
+			/**
+			 * A radio frame to fill or read. size is its capacity,
+			 * length the number of bytes in use.
+			 */
+			struct Frame {
+				block_data_t *data;
+				size_type size;
+				size_type length;
+			};
+
+			ShdtStreamSerializer() : ring_(0), ring_size_(0) {
+				reset();
+			}
+
+			/**
+			 * Use the ring_size bytes at ring for table strings and reset.
+			 * The ring is not freed by the serializer.
+			 */
+			int init(block_data_t* ring, size_type ring_size) {
+				ring_ = ring;
+				ring_size_ = ring_size;
+				reset();
+				return SUCCESS;
+			}
+
+			/**
+			 * Clear the lookup table, see ShdtSerializer::reset().
+			 */
+			void reset() {
+				for(size_type i = 0; i < TABLE_SIZE; i++) { table_[i].length = 0; }
+				head_ = 0;
+				offset_ = 0;
+			}
+
+			/**
+			 * Write as many complete tuples (including the inserts they
+			 * need) from [current, end) to buffer as fit into max_size
+			 * bytes. Same contract as ShdtSerializer::fill_buffer().
+			 *
+			 * \return Number of bytes written.
+			 */
+			template<typename iterator>
+			size_type fill_buffer(block_data_t* buffer, size_type max_size, iterator& current, const iterator& end) {
+				block_data_t *old_buffer = buffer;
+				for( ; current != end; ++current) {
+					typename iterator::Tuple t = *current;
+					if(!write_tuple(t, buffer, max_size)) { break; }
+				}
+				return buffer - old_buffer;
+			}
+
+			/**
+			 * Fill frames[0 .. count) one after another with tuples from
+			 * [current, end), setting their length.
+			 *
+			 * \return Number of frames used. If current != end afterwards
+			 * either all frames are full or the next tuple does not fit
+			 * into an empty frame.
+			 */
+			template<typename iterator>
+			size_type fill_frames(Frame* frames, size_type count, iterator& current, const iterator& end) {
+				size_type i = 0;
+				for( ; i < count && current != end; i++) {
+					frames[i].length = fill_buffer(frames[i].data, frames[i].size, current, end);
+					if(!frames[i].length) { break; }
+				}
+				return i;
+			}
+
+			/**
+			 * Read commands from buffer up to and including the first
+			 * tuple, which is stored into tuple via tuple.set().
+			 * Same contract as ShdtSerializer::read_buffer().
+			 *
+			 * \return Number of bytes read.
+			 */
+			template<typename Tuple>
+			size_type read_buffer(Tuple& tuple, block_data_t* buffer, size_type buffer_size) {
+				bool found;
+				return read(tuple, buffer, buffer_size, found);
+			}
+
+			/**
+			 * Read the next tuple from frames[0 .. count) starting at
+			 * byte offset of frame and advance (frame, offset) behind it.
+			 * Start with frame = offset = 0.
+			 *
+			 * \return true if a tuple has been read, false if the frames
+			 * are exhausted.
+			 */
+			template<typename Tuple>
+			bool read_frames(Tuple& tuple, const Frame* frames, size_type count, size_type& frame, size_type& offset) {
+				for( ; frame < count; frame++, offset = 0) {
+					while(offset < frames[frame].length) {
+						bool found;
+						size_type r = read(tuple, frames[frame].data + offset, frames[frame].length - offset, found);
+						offset += r;
+						if(found) { return true; }
+						if(!r) { break; }
+					}
+				}
+				return false;
+			}
+
+		private:
+			struct Entry {
+				hash_t hash;
+				/// Position in the ring, counting from the last reset()
+				::uint32_t position;
+				size_type offset;
+				/// Including terminating 0, 0 for unused entries
+				size_type length;
+			};
+
+			/**
+			 * Write inserts and references for t or nothing if they do not
+			 * fit into max_size or the ring.
+			 */
+			template<typename Tuple>
+			bool write_tuple(Tuple& t, block_data_t*& buffer, size_type& max_size) {
+				const block_data_t *data[TUPLE_SIZE];
+				size_type length[TUPLE_SIZE];
+				hash_t hash[TUPLE_SIZE];
+				table_id_t ids[TUPLE_SIZE];
+				bool insert[TUPLE_SIZE];
+
+				for(size_type i = 0; i < TUPLE_SIZE; i++) {
+					data[i] = t.get(i);
+					length[i] = strlen((const char*)data[i]) + 1;
+					hash[i] = Hash::hash(data[i], length[i] - 1);
+					ids[i] = find(data[i], length[i], hash[i]);
+					insert[i] = (ids[i] == nidx);
+				}
+
+				// Place missing entries, then check the inserts will not
+				// evict anything this tuple needs. Entries that would be
+				// evicted are inserted again which only moves the ring
+				// further, so this settles after at most TUPLE_SIZE rounds.
+				for(size_type round = 0; ; round++) {
+					if(round > TUPLE_SIZE) { return false; }
+
+					for(size_type i = 0; i < TUPLE_SIZE; i++) {
+						if(insert[i] && ids[i] == nidx) { ids[i] = place(hash[i], ids, i); }
+					}
+
+					::uint32_t head = head_;
+					size_type offset = offset_;
+					::uint32_t position[TUPLE_SIZE];
+					for(size_type i = 0; i < TUPLE_SIZE; i++) {
+						if(!insert[i]) { continue; }
+						if(length[i] > ring_size_) { return false; }
+						position[i] = allocate(head, offset, length[i]);
+					}
+
+					bool stable = true;
+					for(size_type i = 0; i < TUPLE_SIZE; i++) {
+						::uint32_t p = insert[i] ? position[i] : table_[ids[i]].position;
+						if((::uint32_t)(head - p) <= ring_size_) { continue; }
+						if(insert[i]) { return false; }
+						insert[i] = true;
+						stable = false;
+					}
+					if(stable) { break; }
+				}
+
+				size_type cmdlen = TUPLE_SIZE * sizeof(table_id_t);
+				for(size_type i = 0; i < TUPLE_SIZE; i++) {
+					if(insert[i]) { cmdlen += INSERT_HEADER_SIZE + length[i]; }
+				}
+				if(cmdlen > max_size) { return false; }
+
+				table_id_t tid = nidx;
+				command_t cmd = CMD_INSERT;
+				for(size_type i = 0; i < TUPLE_SIZE; i++) {
+					if(!insert[i]) { continue; }
+					wiselib::write<OsModel, block_data_t, table_id_t>(buffer, tid); buffer += sizeof(table_id_t);
+					wiselib::write<OsModel, block_data_t, command_t>(buffer, cmd); buffer += sizeof(command_t);
+					wiselib::write<OsModel, block_data_t, table_id_t>(buffer, ids[i]); buffer += sizeof(table_id_t);
+					memcpy((void*)buffer, (const void*)data[i], length[i]); buffer += length[i];
+					store(ids[i], data[i], length[i], hash[i]);
+				}
+				for(size_type i = 0; i < TUPLE_SIZE; i++) {
+					wiselib::write<OsModel, block_data_t, table_id_t>(buffer, ids[i]);
+					buffer += sizeof(table_id_t);
+				}
+				max_size -= cmdlen;
+				return true;
+			}
+
+			template<typename Tuple>
+			size_type read(Tuple& tuple, block_data_t* buffer, size_type buffer_size, bool& found) {
+				block_data_t *old_buffer = buffer;
+				found = false;
+
+				while(buffer_size >= sizeof(table_id_t)) {
+					table_id_t tid = wiselib::read<OsModel, block_data_t, table_id_t>(buffer);
+
+					if(tid != nidx) { // tuple
+						if(buffer_size < TUPLE_SIZE * sizeof(table_id_t)) { break; }
+						for(size_type i = 0; i < TUPLE_SIZE; i++) {
+							tid = wiselib::read<OsModel, block_data_t, table_id_t>(buffer);
+							buffer += sizeof(table_id_t); buffer_size -= sizeof(table_id_t);
+							tuple.set(i, get(tid));
+						}
+						found = true;
+						return buffer - old_buffer;
+					}
+
+					buffer += sizeof(table_id_t); buffer_size -= sizeof(table_id_t);
+					if(buffer_size < sizeof(command_t)) { break; }
+					command_t cmd = wiselib::read<OsModel, block_data_t, command_t>(buffer);
+					buffer += sizeof(command_t); buffer_size -= sizeof(command_t);
+
+					if(cmd != CMD_INSERT || buffer_size < sizeof(table_id_t)) { break; }
+					table_id_t pos = wiselib::read<OsModel, block_data_t, table_id_t>(buffer);
+					buffer += sizeof(table_id_t); buffer_size -= sizeof(table_id_t);
+
+					const block_data_t *z = (const block_data_t*)memchr(buffer, 0, buffer_size);
+					if(!z) { break; }
+					size_type l = z - buffer + 1;
+					if(pos < TABLE_SIZE) {
+						if(l <= ring_size_) { store(pos, buffer, l, Hash::hash(buffer, l - 1)); }
+						else { table_[pos].length = 0; }
+					}
+					buffer += l; buffer_size -= l;
+				}
+
+				// end command or malformed data: skip the rest
+				return buffer - old_buffer + buffer_size;
+			}
+
+			/**
+			 * \return slot holding the given string or nidx. Besides its
+			 * home slot a string may have been placed in one of the
+			 * following TUPLE_SIZE - 1 slots.
+			 */
+			table_id_t find(const block_data_t* data, size_type length, hash_t hash) {
+				for(size_type i = 0; i < TUPLE_SIZE; i++) {
+					table_id_t id = (hash + i) % TABLE_SIZE;
+					Entry &e = table_[id];
+					if(e.length == length && e.hash == hash && valid(e) &&
+							memcmp(ring_ + e.offset, data, length) == 0) {
+						return id;
+					}
+				}
+				return nidx;
+			}
+
+			/**
+			 * \return first slot from the home slot of hash that is not
+			 * used by ids[0 .. TUPLE_SIZE) other than ids[self].
+			 */
+			table_id_t place(hash_t hash, const table_id_t* ids, size_type self) {
+				for(size_type offs = 0; ; offs++) {
+					table_id_t id = (hash + offs) % TABLE_SIZE;
+					bool used = false;
+					for(size_type i = 0; i < TUPLE_SIZE; i++) {
+						if(i != self && ids[i] == id) { used = true; }
+					}
+					if(!used) { return id; }
+				}
+			}
+
+			block_data_t* get(table_id_t id) {
+				if(id >= TABLE_SIZE || !table_[id].length || !valid(table_[id])) { return 0; }
+				return ring_ + table_[id].offset;
+			}
+
+			bool valid(const Entry& e) {
+				return (::uint32_t)(head_ - e.position) <= ring_size_;
+			}
+
+			/**
+			 * Reserve length bytes at (head, offset), skipping the end of
+			 * the ring if they do not fit there.
+			 * \return position of the reserved bytes
+			 */
+			::uint32_t allocate(::uint32_t& head, size_type& offset, size_type length) {
+				if(offset + length > ring_size_) {
+					head += ring_size_ - offset;
+					offset = 0;
+				}
+				::uint32_t r = head;
+				head += length;
+				offset += length;
+				return r;
+			}
+
+			void store(table_id_t id, const block_data_t* data, size_type length, hash_t hash) {
+				::uint32_t old_head = head_;
+				Entry &e = table_[id];
+				e.position = allocate(head_, offset_, length);
+				if(head_ - old_head != length) { expire(); }
+				e.offset = offset_ - length;
+				e.length = length;
+				e.hash = hash;
+				memcpy((void*)(ring_ + e.offset), (const void*)data, length);
+			}
+
+			/**
+			 * Drop entries that have been overwritten, called whenever the
+			 * ring wraps so positions never grow more than two rings
+			 * apart.
+			 */
+			void expire() {
+				for(size_type i = 0; i < TABLE_SIZE; i++) {
+					if(table_[i].length && !valid(table_[i])) { table_[i].length = 0; }
+				}
+			}
+
+			block_data_t *ring_;
+			size_type ring_size_;
+			::uint32_t head_;
+			size_type offset_;
+			Entry table_[TABLE_SIZE];
+	};
+
+} // namespace wiselib
+
+#endif // SHDT_STREAM_SERIALIZER_H
+
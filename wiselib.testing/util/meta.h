@@ -183,6 +183,12 @@ struct RemovePointer { typedef T t; };
 template<typename T>
 struct RemovePointer<T*> { typedef T t; };
 
+template<typename T>
+struct IsPointer { enum { value = false }; };
+
+template<typename T>
+struct IsPointer<T*> { enum { value = true }; };
+
 
 /**
  * Calculate length of a string constant at compile time.
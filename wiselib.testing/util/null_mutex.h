@@ -0,0 +1,59 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef NULL_MUTEX_H
+#define NULL_MUTEX_H
+
+namespace wiselib {
+	
+	/**
+	 * @brief Mutex that does nothing, for data structures that are
+	 * parametrized with a mutex type but only used from a single thread
+	 * (which is what you want on most of the nodes wiselib runs on).
+	 */
+	template<typename OsModel_P>
+	class NullMutex {
+		public:
+			typedef OsModel_P OsModel;
+			
+			void lock() { }
+			void unlock() { }
+			bool try_lock() { return true; }
+	};
+	
+	/**
+	 * @brief Locks the given mutex for the lifetime of the guard.
+	 */
+	template<typename Mutex_P>
+	class MutexGuard {
+		public:
+			MutexGuard(Mutex_P& mutex) : mutex_(mutex) { mutex_.lock(); }
+			~MutexGuard() { mutex_.unlock(); }
+			
+		private:
+			MutexGuard(const MutexGuard&);
+			MutexGuard& operator=(const MutexGuard&);
+			
+			Mutex_P& mutex_;
+	};
+}
+
+#endif // NULL_MUTEX_H
+
+/* vim: set ts=3 sw=3 tw=78 noexpandtab :*/
@@ -20,18 +20,40 @@
 #ifndef BLOCK_DICTIONARY_H
 #define BLOCK_DICTIONARY_H
 
+#include <util/traits.h>
+#include <algorithms/hash/fnv.h>
+#include <algorithms/block_memory/b_plus_hash_set.h>
+
 namespace wiselib {
 	
 	/**
-	 * \brief
+	 * \brief Dictionary that keeps its values in chunk pages of a block
+	 * storage (e.g. a BitmapChunkAllocator).
+	 * 
+	 * Each value is stored exactly once as an entry of a BPlusHashSet,
+	 * i.e. in a chunk page together with its reference count and the link
+	 * to the next entry with the same hash value. The B+ tree of the hash
+	 * set maps hash values to these entries, so value -> key lookups cost
+	 * one tree descent plus a walk along the (usually single-element)
+	 * collision chain. Keys are the chunk addresses of the entries and
+	 * thus stay valid for the lifetime of the value.
+	 * 
+	 * Reference counts live on the block storage, insert() of an
+	 * existing value increments, erase() decrements and the entry is
+	 * freed when the count drops to zero.
 	 * 
-	 * \ingroup
+	 * Values must fit into a single block together with the entry header,
+	 * see MAX_VALUE_LENGTH; insert() of longer values returns NULL_KEY.
 	 * 
-	 * \tparam 
+	 * \ingroup Dictionary_concept
+	 * 
+	 * \tparam BlockStorage_P Chunk allocator providing create_chunks(),
+	 * read_chunks(), write_chunks() and free_chunks().
 	 */
 	template<
 		typename OsModel_P,
-		typename BlockStorage_P
+		typename BlockStorage_P,
+		typename Hash_P = Fnv32<OsModel_P>
 	>
 	class BlockDictionary {
 		
@@ -40,44 +62,150 @@ namespace wiselib {
 			typedef typename OsModel::block_data_t block_data_t;
 			typedef typename OsModel::size_t size_type;
 			typedef BlockStorage_P BlockStorage;
+			typedef Hash_P Hash;
+			typedef BlockDictionary<OsModel_P, BlockStorage_P, Hash_P> self_type;
+			typedef self_type* self_pointer_t;
+			
+			typedef BPlusHashSet<OsModel, BlockStorage, Hash, char*> HashSet;
+			typedef typename HashSet::Entry Entry;
 			
-			typedef typename ... key_type;
+			typedef typename BlockStorage::ChunkAddress key_type;
 			typedef block_data_t* mapped_type;
-			typedef ::uint32_t refcount_t;
+			typedef typename HashSet::refcount_t refcount_t;
 			
 			enum { ABSTRACT_KEYS = true };
 			static const key_type NULL_KEY;
 			
+			enum {
+				MAX_VALUE_LENGTH = BlockStorage::BLOCK_SIZE - sizeof(Entry) - 1
+			};
+			
 			enum ErrorCodes {
 				SUCCESS = OsModel::SUCCESS,
 				ERR_UNSPEC = OsModel::ERR_UNSPEC
 			};
 			
+			BlockDictionary() : block_storage_(0), debug_(0), size_(0) {
+			}
+			
+			int init(typename BlockStorage::self_pointer_t block_storage, typename OsModel::Debug::self_pointer_t debug) {
+				block_storage_ = block_storage;
+				debug_ = debug;
+				size_ = 0;
+				return hash_set_.init(block_storage_, debug_);
+			}
+			
+			/**
+			 * Insert value, or increase its reference count if it is already
+			 * contained.
+			 * @return key of the value or NULL_KEY if it is too long.
+			 */
 			key_type insert(mapped_type value) {
-				// TODO
+				check();
+				if(strlen(reinterpret_cast<char*>(value)) > MAX_VALUE_LENGTH) {
+					return NULL_KEY;
+				}
+				typename HashSet::iterator it = hash_set_.insert(reinterpret_cast<char*>(value));
+				key_type r = it.chunk_address();
+				if(count(r) == 1) {
+					size_++;
+				}
+				return r;
 			}
 			
+			/**
+			 * @return key of the given value or NULL_KEY if not contained.
+			 * Does not change the reference count.
+			 */
 			key_type find(mapped_type value) {
-				// TODO
+				check();
+				if(strlen(reinterpret_cast<char*>(value)) > MAX_VALUE_LENGTH) {
+					return NULL_KEY;
+				}
+				return hash_set_.find(reinterpret_cast<char*>(value)).chunk_address();
 			}
 			
+			/**
+			 * Decrease the reference count of the value with key \p entry,
+			 * remove it when it drops to zero.
+			 */
 			void erase(key_type entry) {
-				// TODO
+				check();
+				assert(entry != NULL_KEY);
+				block_data_t buffer[BlockStorage::BUFFER_SIZE];
+				Entry &e = read_entry(buffer, entry);
+				typename HashSet::iterator it = hash_set_.find(e.payload());
+				assert(it.chunk_address() == entry);
+				if(e.refcount() == 1) {
+					size_--;
+				}
+				hash_set_.erase(it);
 			}
 			
+			/**
+			 * @return number of times the value with key \p k has been
+			 * inserted (and not erased).
+			 */
+			refcount_t count(key_type k) {
+				check();
+				block_data_t buffer[BlockStorage::BUFFER_SIZE];
+				return read_entry(buffer, k).refcount();
+			}
+			
+			/**
+			 * @return copy of the value with key \p k, must be released
+			 * with free_value().
+			 */
 			mapped_type get(key_type k) {
-				// TODO
+				check();
+				block_data_t buffer[BlockStorage::BUFFER_SIZE];
+				Entry &e = read_entry(buffer, k);
+				size_type l = e.length();
+				mapped_type r = get_allocator().template allocate_array<block_data_t>(l) .raw();
+				memcpy(r, e.payload(), l);
+				return r;
 			}
 			
-			mapped_type get_value(key_type k) { return getk(k); }
+			mapped_type operator[](key_type k) { return get(k); }
+			
+			mapped_type get_value(key_type k) { return get(k); }
 			
 			void free_value(mapped_type v) {
-				// TODO
+				get_allocator().free_array(v);
+			}
+			
+			/**
+			 * @return number of distinct values (the hash set tree only
+			 * counts distinct hash values).
+			 */
+			size_type size() { return size_; }
+			
+			HashSet& hash_set() { return hash_set_; }
+			
+			void check() {
+				assert(block_storage_ != 0);
 			}
 		
 		private:
+			Entry& read_entry(block_data_t *buffer, key_type k) {
+				assert(k != NULL_KEY);
+				Entry &e = *reinterpret_cast<Entry*>(buffer);
+				block_storage_->read_chunks(buffer, k, sizeof(Entry));
+				block_storage_->read_chunks(buffer, k, e.total_length());
+				return e;
+			}
+			
+			typename BlockStorage::self_pointer_t block_storage_;
+			typename OsModel::Debug::self_pointer_t debug_;
+			HashSet hash_set_;
+			size_type size_;
 		
 	}; // BlockDictionary
+	
+	template<
+		typename OsModel_P, typename BlockStorage_P, typename Hash_P
+	>
+	const typename BlockDictionary<OsModel_P, BlockStorage_P, Hash_P>::key_type BlockDictionary<OsModel_P, BlockStorage_P, Hash_P>::NULL_KEY = BlockStorage_P::ChunkAddress::invalid();
 }
 
 #endif // BLOCK_DICTIONARY_H
@@ -0,0 +1,350 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef HASH_DICTIONARY_H
+#define HASH_DICTIONARY_H
+
+#include <algorithms/hash/fnv.h>
+
+namespace wiselib {
+	
+	/**
+	 * \brief Dictionary for zero-terminated block_data_t-arrays (e.g. strings)
+	 * based on an open addressing hash table.
+	 * 
+	 * Values are copied into a string arena, i.e. into pages of
+	 * ARENA_PAGE_SIZE bytes that are carved up with a bump pointer. Each
+	 * value is preceded by a small header holding its hash value, reference
+	 * count and allocation size. Freed arena entries are kept in per-size
+	 * free lists and reused, values that do not fit into a page slot of at
+	 * most MAX_ARENA_ENTRY bytes get their own allocation.
+	 * 
+	 * The table itself consists of two flat arrays, one with the hash
+	 * values and one with pointers to the values. Probing is linear and
+	 * only touches the dense hash array until a hash matches, so one cache
+	 * line covers several probes and the loop vectorizes well; the
+	 * arena is only accessed to confirm a hash match. Erasing uses backward
+	 * shift deletion, so there are no tombstones.
+	 * 
+	 * Keys are pointers to the stored values and stay valid until the
+	 * value is erased, get_value() thus does not copy.
+	 * 
+	 * @ingroup ConcreteBDTDictionary_concept
+	 * 
+	 * @tparam Hash_P Hash function, e.g. Fnv32 or Fnv64.
+	 */
+	template<
+		typename OsModel_P,
+		typename Hash_P = Fnv32<OsModel_P>,
+		int ARENA_PAGE_SIZE_P = 4096,
+		int INITIAL_CAPACITY_P = 64
+	>
+	class HashDictionary {
+		public:
+			typedef OsModel_P OsModel;
+			typedef typename OsModel::block_data_t block_data_t;
+			typedef typename OsModel::size_t size_type;
+			typedef Hash_P Hash;
+			typedef typename Hash::hash_t hash_t;
+			
+			typedef block_data_t* key_type;
+			typedef block_data_t* mapped_type;
+			typedef ::uint32_t refcount_t;
+			
+			typedef HashDictionary<OsModel_P, Hash_P, ARENA_PAGE_SIZE_P, INITIAL_CAPACITY_P> self_type;
+			typedef self_type* self_pointer_t;
+			
+			enum {
+				ABSTRACT_KEYS = false
+			};
+			static const key_type NULL_KEY;
+			
+			enum ErrorCodes {
+				SUCCESS = OsModel::SUCCESS,
+				ERR_UNSPEC = OsModel::ERR_UNSPEC
+			};
+			
+			enum {
+				ARENA_PAGE_SIZE = ARENA_PAGE_SIZE_P,
+				GRANULE = sizeof(block_data_t*),
+				SIZE_CLASSES = 32,
+				MAX_ARENA_ENTRY = SIZE_CLASSES * GRANULE,
+				INITIAL_CAPACITY = INITIAL_CAPACITY_P
+			};
+			
+		private:
+			struct Header {
+				hash_t hash;
+				refcount_t refcount;
+				::uint32_t size;
+			};
+			
+			enum {
+				HEADER_SIZE = sizeof(Header),
+				/// Offset of the first entry in a page, the page starts with
+				/// a pointer to the next page.
+				PAGE_START = GRANULE
+			};
+			
+		public:
+			HashDictionary() : hashes_(0), slots_(0), capacity_(0), size_(0),
+				pages_(0), arena_pos_(0), arena_end_(0) {
+			}
+			
+			~HashDictionary() {
+				destruct();
+			}
+			
+			int init(typename OsModel::Debug::self_pointer_t debug) {
+				static_assert((INITIAL_CAPACITY & (INITIAL_CAPACITY - 1)) == 0
+						&& (ARENA_PAGE_SIZE >= PAGE_START + MAX_ARENA_ENTRY));
+				
+				debug_ = debug;
+				destruct();
+				for(size_type i = 0; i < SIZE_CLASSES; i++) {
+					free_lists_[i] = 0;
+				}
+				return allocate_table(INITIAL_CAPACITY);
+			}
+			
+			void destruct() {
+				if(slots_) {
+					for(size_type i = 0; i < capacity_; i++) {
+						if(slots_[i] && header(slots_[i]).size > MAX_ARENA_ENTRY) {
+							get_allocator().free_array(slots_[i] - HEADER_SIZE);
+						}
+					}
+					get_allocator().free_array(hashes_);
+					get_allocator().free_array(slots_);
+				}
+				while(pages_) {
+					block_data_t *next = *reinterpret_cast<block_data_t**>(pages_);
+					get_allocator().free_array(pages_);
+					pages_ = next;
+				}
+				hashes_ = 0;
+				slots_ = 0;
+				capacity_ = 0;
+				size_ = 0;
+				arena_pos_ = 0;
+				arena_end_ = 0;
+			}
+			
+			key_type insert(mapped_type value) {
+				size_type l = strlen((char*)value) + 1;
+				hash_t h = hash_value(value, l);
+				
+				size_type i = probe(value, h);
+				if(slots_[i]) {
+					header(slots_[i]).refcount++;
+					return slots_[i];
+				}
+				
+				if((size_ + 1) * 4 > capacity_ * 3) {
+					if(allocate_table(capacity_ * 2) != SUCCESS) {
+						return NULL_KEY;
+					}
+					i = probe(value, h);
+				}
+				
+				block_data_t *e = allocate_entry(HEADER_SIZE + l);
+				if(!e) { return NULL_KEY; }
+				Header &hd = *reinterpret_cast<Header*>(e);
+				hd.hash = h;
+				hd.refcount = 1;
+				memcpy(e + HEADER_SIZE, value, l);
+				
+				hashes_[i] = h;
+				slots_[i] = e + HEADER_SIZE;
+				size_++;
+				return slots_[i];
+			}
+			
+			key_type find(mapped_type value) {
+				size_type l = strlen((char*)value) + 1;
+				return slots_[probe(value, hash_value(value, l))];
+			}
+			
+			void erase(key_type entry) {
+				if(entry == NULL_KEY) { return; }
+				
+				Header &hd = header(entry);
+				if(hd.refcount > 1) {
+					hd.refcount--;
+					return;
+				}
+				
+				size_type mask = capacity_ - 1;
+				size_type i = hd.hash & mask;
+				while(slots_[i] != entry) {
+					assert(hashes_[i] != 0);
+					i = (i + 1) & mask;
+				}
+				
+				// Backward shift: move following entries of the cluster up
+				// unless that would put them before their home slot.
+				for(size_type j = (i + 1) & mask; hashes_[j] != 0; j = (j + 1) & mask) {
+					size_type home = hashes_[j] & mask;
+					if(((j - home) & mask) >= ((j - i) & mask)) {
+						hashes_[i] = hashes_[j];
+						slots_[i] = slots_[j];
+						i = j;
+					}
+				}
+				hashes_[i] = 0;
+				slots_[i] = 0;
+				size_--;
+				
+				free_entry(entry - HEADER_SIZE);
+			}
+			
+			mapped_type get(key_type k) { return k; }
+			mapped_type operator[](key_type k) { return k; }
+			mapped_type get_value(key_type k) { return k; }
+			void free_value(mapped_type v) { }
+			
+			/**
+			 * @return reference count of the value with key \p k.
+			 */
+			refcount_t count(key_type k) { return header(k).refcount; }
+			
+			size_type size() { return size_; }
+			size_type capacity() { return capacity_; }
+			
+		private:
+			static Header& header(key_type k) {
+				return *reinterpret_cast<Header*>(k - HEADER_SIZE);
+			}
+			
+			static hash_t hash_value(const block_data_t *v, size_type l) {
+				hash_t h = Hash::hash(v, l);
+				// 0 marks empty slots
+				return h ? h : 1;
+			}
+			
+			/**
+			 * @return slot holding \p value or the empty slot where it
+			 * would have to be inserted.
+			 */
+			size_type probe(const block_data_t *value, hash_t h) {
+				size_type mask = capacity_ - 1;
+				size_type i = h & mask;
+				for( ; hashes_[i] != 0; i = (i + 1) & mask) {
+					if(hashes_[i] == h && strcmp((const char*)slots_[i], (const char*)value) == 0) {
+						break;
+					}
+				}
+				return i;
+			}
+			
+			int allocate_table(size_type capacity) {
+				hash_t *hashes = get_allocator().template allocate_array<hash_t>(capacity) .raw();
+				block_data_t **slots = get_allocator().template allocate_array<block_data_t*>(capacity) .raw();
+				if(!hashes || !slots) {
+					if(hashes) { get_allocator().free_array(hashes); }
+					if(slots) { get_allocator().free_array(slots); }
+					return ERR_UNSPEC;
+				}
+				memset(hashes, 0, capacity * sizeof(hash_t));
+				memset(slots, 0, capacity * sizeof(block_data_t*));
+				
+				size_type mask = capacity - 1;
+				for(size_type i = 0; i < capacity_; i++) {
+					if(hashes_[i] == 0) { continue; }
+					size_type j = hashes_[i] & mask;
+					while(hashes[j] != 0) { j = (j + 1) & mask; }
+					hashes[j] = hashes_[i];
+					slots[j] = slots_[i];
+				}
+				
+				if(hashes_) {
+					get_allocator().free_array(hashes_);
+					get_allocator().free_array(slots_);
+				}
+				hashes_ = hashes;
+				slots_ = slots;
+				capacity_ = capacity;
+				return SUCCESS;
+			}
+			
+			block_data_t* allocate_entry(size_type bytes) {
+				size_type sz = (bytes + GRANULE - 1) / GRANULE * GRANULE;
+				block_data_t *e;
+				
+				if(sz > MAX_ARENA_ENTRY) {
+					e = get_allocator().template allocate_array<block_data_t>(sz) .raw();
+				}
+				else if(free_lists_[sz / GRANULE - 1]) {
+					e = free_lists_[sz / GRANULE - 1];
+					free_lists_[sz / GRANULE - 1] = *reinterpret_cast<block_data_t**>(e);
+				}
+				else {
+					if(arena_pos_ + sz > arena_end_) {
+						block_data_t *page = get_allocator().template allocate_array<block_data_t>(ARENA_PAGE_SIZE) .raw();
+						if(!page) { return 0; }
+						*reinterpret_cast<block_data_t**>(page) = pages_;
+						pages_ = page;
+						arena_pos_ = page + PAGE_START;
+						arena_end_ = page + ARENA_PAGE_SIZE;
+					}
+					e = arena_pos_;
+					arena_pos_ += sz;
+				}
+				
+				if(e) {
+					reinterpret_cast<Header*>(e)->size = sz;
+				}
+				return e;
+			}
+			
+			void free_entry(block_data_t *e) {
+				size_type sz = reinterpret_cast<Header*>(e)->size;
+				if(sz > MAX_ARENA_ENTRY) {
+					get_allocator().free_array(e);
+				}
+				else {
+					*reinterpret_cast<block_data_t**>(e) = free_lists_[sz / GRANULE - 1];
+					free_lists_[sz / GRANULE - 1] = e;
+				}
+			}
+			
+			hash_t *hashes_;
+			block_data_t **slots_;
+			size_type capacity_;
+			size_type size_;
+			
+			/// Singly linked list of arena pages
+			block_data_t *pages_;
+			block_data_t *arena_pos_;
+			block_data_t *arena_end_;
+			block_data_t *free_lists_[SIZE_CLASSES];
+			
+			typename OsModel::Debug::self_pointer_t debug_;
+	}; // HashDictionary
+	
+	template<
+		typename OsModel_P, typename Hash_P, int ARENA_PAGE_SIZE_P, int INITIAL_CAPACITY_P
+	>
+	const typename HashDictionary<OsModel_P, Hash_P, ARENA_PAGE_SIZE_P, INITIAL_CAPACITY_P>::key_type
+	HashDictionary<OsModel_P, Hash_P, ARENA_PAGE_SIZE_P, INITIAL_CAPACITY_P>::NULL_KEY = 0;
+	
+} // namespace wiselib
+
+#endif // HASH_DICTIONARY_H
+
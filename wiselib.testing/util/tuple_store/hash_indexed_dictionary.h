@@ -0,0 +1,309 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef HASH_INDEXED_DICTIONARY_H
+#define HASH_INDEXED_DICTIONARY_H
+
+#include <algorithms/hash/fnv.h>
+
+namespace wiselib {
+	
+	/**
+	 * \brief Dictionary wrapper that maintains an index from the hash of
+	 * each stored value to its key.
+	 * 
+	 * Forwards insert(), find(), erase() and value access to the wrapped
+	 * dictionary and on every insert/erase updates a chained hash table
+	 * mapping Hash_P::hash(value, strlen(value)) (the hash INQP uses to
+	 * refer to strings) to the dictionary key. find_hash() thus resolves
+	 * a hash in O(1) instead of rehashing every stored value;
+	 * HashTranslator uses it automatically when given such a dictionary.
+	 * 
+	 * The index keeps its own reference count per key, so it mirrors
+	 * refcounting dictionaries exactly if all inserts and erases go
+	 * through the wrapper. init() indexes values already in the wrapped
+	 * dictionary with a count of one, as their real count is unknown;
+	 * erasing them more often than inserting them through the wrapper
+	 * can thus drop them from the index early. Bucket and entry arrays
+	 * grow with the number of distinct values.
+	 * 
+	 * find_hash() is a pure index lookup and may miss a value the index
+	 * could not record (see above, or when growing the table fails);
+	 * HashTranslator then falls back to scanning the dictionary.
+	 * If several values share a hash, find_hash() returns any of them.
+	 * 
+	 * @ingroup ConcreteBDTDictionary_concept
+	 * 
+	 * @tparam Dictionary_P wrapped dictionary, must be initialized
+	 *   separately and provide key iteration (begin_keys(), end_keys()).
+	 */
+	template<
+		typename OsModel_P,
+		typename Dictionary_P,
+		typename Hash_P = Fnv32<OsModel_P>,
+		int INITIAL_CAPACITY_P = 64
+	>
+	class HashIndexedDictionary {
+		public:
+			typedef OsModel_P OsModel;
+			typedef typename OsModel::block_data_t block_data_t;
+			typedef typename OsModel::size_t size_type;
+			typedef Dictionary_P Dictionary;
+			typedef Hash_P Hash;
+			typedef typename Hash::hash_t hash_t;
+			
+			typedef typename Dictionary::key_type key_type;
+			typedef typename Dictionary::mapped_type mapped_type;
+			typedef typename Dictionary::iterator iterator;
+			
+			typedef HashIndexedDictionary<OsModel_P, Dictionary_P, Hash_P, INITIAL_CAPACITY_P> self_type;
+			typedef self_type* self_pointer_t;
+			
+			enum {
+				ABSTRACT_KEYS = Dictionary::ABSTRACT_KEYS
+			};
+			static const key_type NULL_KEY;
+			
+			enum ErrorCodes {
+				SUCCESS = OsModel::SUCCESS,
+				ERR_UNSPEC = OsModel::ERR_UNSPEC
+			};
+			
+			enum {
+				INITIAL_CAPACITY = INITIAL_CAPACITY_P
+			};
+			
+		private:
+			enum { NIL = (::uint32_t)-1 };
+			
+			struct Entry {
+				hash_t hash;
+				key_type key;
+				::uint32_t refcount;
+				/// next entry in the bucket or in the free list
+				::uint32_t next;
+			};
+			
+		public:
+			HashIndexedDictionary() : dictionary_(0), buckets_(0), entries_(0),
+				capacity_(0), size_(0), free_(NIL) {
+			}
+			
+			~HashIndexedDictionary() {
+				destruct();
+			}
+			
+			/**
+			 * Wrap \p dictionary and index all values it already holds.
+			 */
+			int init(Dictionary* dictionary) {
+				static_assert((INITIAL_CAPACITY & (INITIAL_CAPACITY - 1)) == 0);
+				
+				dictionary_ = dictionary;
+				destruct();
+				if(allocate_table(INITIAL_CAPACITY) != SUCCESS) { return ERR_UNSPEC; }
+				
+				for(iterator it = dictionary_->begin_keys(); it != dictionary_->end_keys(); ++it) {
+					key_type k = *it;
+					mapped_type v = dictionary_->get_value(k);
+					hash_t h = Hash::hash(v, strlen((char*)v));
+					dictionary_->free_value(v);
+					if(lookup(h, k) == NIL && add(h, k) != SUCCESS) {
+						return ERR_UNSPEC;
+					}
+				}
+				return SUCCESS;
+			}
+			
+			void destruct() {
+				if(buckets_) {
+					get_allocator().free_array(buckets_);
+					get_allocator().free_array(entries_);
+				}
+				buckets_ = 0;
+				entries_ = 0;
+				capacity_ = 0;
+				size_ = 0;
+				free_ = NIL;
+			}
+			
+			key_type insert(mapped_type value) {
+				key_type k = dictionary_->insert(value);
+				if(k == NULL_KEY) { return k; }
+				
+				hash_t h = Hash::hash(value, strlen((char*)value));
+				::uint32_t e = lookup(h, k);
+				if(e != NIL) {
+					entries_[e].refcount++;
+				}
+				else {
+					// On error still a valid dictionary, only the index
+					// misses k
+					add(h, k);
+				}
+				return k;
+			}
+			
+			key_type find(mapped_type value) {
+				return dictionary_->find(value);
+			}
+			
+			void erase(key_type k) {
+				if(k == NULL_KEY) { return; }
+				
+				mapped_type v = dictionary_->get_value(k);
+				hash_t h = Hash::hash(v, strlen((char*)v));
+				dictionary_->free_value(v);
+				
+				::uint32_t *p = &buckets_[h & (capacity_ - 1)];
+				for( ; *p != NIL; p = &entries_[*p].next) {
+					Entry &en = entries_[*p];
+					if(en.hash == h && en.key == k) {
+						if(--en.refcount == 0) {
+							::uint32_t e = *p;
+							*p = en.next;
+							en.next = free_;
+							free_ = e;
+							size_--;
+						}
+						break;
+					}
+				}
+				
+				dictionary_->erase(k);
+			}
+			
+			/**
+			 * @return key of a value \c v with Hash::hash(v, strlen(v)) ==
+			 * \p h or NULL_KEY.
+			 */
+			key_type find_hash(hash_t h) {
+				if(!buckets_) { return NULL_KEY; }
+				for(::uint32_t e = buckets_[h & (capacity_ - 1)]; e != NIL; e = entries_[e].next) {
+					if(entries_[e].hash == h) {
+						return entries_[e].key;
+					}
+				}
+				return NULL_KEY;
+			}
+			
+			iterator begin_keys() { return dictionary_->begin_keys(); }
+			iterator end_keys() { return dictionary_->end_keys(); }
+			
+			mapped_type get(key_type k) { return dictionary_->get_value(k); }
+			mapped_type operator[](key_type k) { return dictionary_->get_value(k); }
+			mapped_type get_value(key_type k) { return dictionary_->get_value(k); }
+			void free_value(mapped_type v) { dictionary_->free_value(v); }
+			
+			/// @return number of distinct values in the index
+			size_type size() { return size_; }
+			size_type capacity() { return capacity_; }
+			
+			Dictionary& dictionary() { return *dictionary_; }
+			
+		private:
+			::uint32_t lookup(hash_t h, key_type k) {
+				for(::uint32_t e = buckets_[h & (capacity_ - 1)]; e != NIL; e = entries_[e].next) {
+					if(entries_[e].hash == h && entries_[e].key == k) {
+						return e;
+					}
+				}
+				return NIL;
+			}
+			
+			/**
+			 * Add an entry for (\p h, \p k) with a count of one.
+			 */
+			int add(hash_t h, key_type k) {
+				if(free_ == NIL && allocate_table(capacity_ * 2) != SUCCESS) {
+					return ERR_UNSPEC;
+				}
+				::uint32_t e = free_;
+				free_ = entries_[e].next;
+				
+				Entry &en = entries_[e];
+				en.hash = h;
+				en.key = k;
+				en.refcount = 1;
+				en.next = buckets_[h & (capacity_ - 1)];
+				buckets_[h & (capacity_ - 1)] = e;
+				size_++;
+				return SUCCESS;
+			}
+			
+			/**
+			 * (Re)allocate \p capacity buckets and entries. Only called
+			 * when all entries are in use, entries keep their positions.
+			 */
+			int allocate_table(size_type capacity) {
+				::uint32_t *buckets = get_allocator().template allocate_array< ::uint32_t>(capacity) .raw();
+				Entry *entries = get_allocator().template allocate_array<Entry>(capacity) .raw();
+				if(!buckets || !entries) {
+					if(buckets) { get_allocator().free_array(buckets); }
+					if(entries) { get_allocator().free_array(entries); }
+					return ERR_UNSPEC;
+				}
+				
+				if(entries_) {
+					for(size_type i = 0; i < capacity_; i++) {
+						entries[i] = entries_[i];
+					}
+					get_allocator().free_array(buckets_);
+					get_allocator().free_array(entries_);
+				}
+				
+				// the new entries form the free list
+				for(size_type i = capacity_; i < capacity; i++) {
+					entries[i].next = (i + 1 < capacity) ? (::uint32_t)(i + 1) : (::uint32_t)NIL;
+				}
+				free_ = capacity_;
+				
+				::uint32_t mask = capacity - 1;
+				for(size_type i = 0; i < capacity; i++) {
+					buckets[i] = NIL;
+				}
+				for(size_type i = 0; i < capacity_; i++) {
+					entries[i].next = buckets[entries[i].hash & mask];
+					buckets[entries[i].hash & mask] = i;
+				}
+				
+				buckets_ = buckets;
+				entries_ = entries;
+				capacity_ = capacity;
+				return SUCCESS;
+			}
+			
+			Dictionary *dictionary_;
+			::uint32_t *buckets_;
+			Entry *entries_;
+			size_type capacity_;
+			size_type size_;
+			::uint32_t free_;
+	}; // HashIndexedDictionary
+	
+	template<
+		typename OsModel_P, typename Dictionary_P, typename Hash_P, int INITIAL_CAPACITY_P
+	>
+	const typename HashIndexedDictionary<OsModel_P, Dictionary_P, Hash_P, INITIAL_CAPACITY_P>::key_type
+	HashIndexedDictionary<OsModel_P, Dictionary_P, Hash_P, INITIAL_CAPACITY_P>::NULL_KEY = Dictionary_P::NULL_KEY;
+	
+} // namespace wiselib
+
+#endif // HASH_INDEXED_DICTIONARY_H
+
@@ -0,0 +1,549 @@
+/***************************************************************************
+ ** This file is part of the generic algorithm library Wiselib.           **
+ ** Copyright (C) 2008,2009 by the Wisebed (www.wisebed.eu) project.      **
+ **                                                                       **
+ ** The Wiselib is free software: you can redistribute it and/or modify   **
+ ** it under the terms of the GNU Lesser General Public License as        **
+ ** published by the Free Software Foundation, either version 3 of the    **
+ ** License, or (at your option) any later version.                       **
+ **                                                                       **
+ ** The Wiselib is distributed in the hope that it will be useful,        **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+ ** GNU Lesser General Public License for more details.                   **
+ **                                                                       **
+ ** You should have received a copy of the GNU Lesser General Public      **
+ ** License along with the Wiselib.                                       **
+ ** If not, see <http://www.gnu.org/licenses/>.                           **
+ ***************************************************************************/
+
+#ifndef INDEXED_TUPLE_STORE_H
+#define INDEXED_TUPLE_STORE_H
+
+#include <util/meta.h>
+#include <algorithms/block_memory/b_plus_tree.h>
+
+namespace wiselib {
+
+	namespace IndexedTupleStore_detail {
+
+		/**
+		 * Fixed-size key consisting of N_P integer parts that is ordered
+		 * lexicographically (part 0 being the most significant one).
+		 *
+		 * BPlusTree needs its keys to support a bit of arithmetic for
+		 * computing pivots, so this also implements the required operators
+		 * by treating the key as one big unsigned integer.
+		 */
+		template<
+			typename Part_P,
+			int N_P
+		>
+		class CompositeKey {
+			// {{{
+			public:
+				typedef Part_P part_t;
+				typedef CompositeKey<Part_P, N_P> self_type;
+				enum { PARTS = N_P, PART_BITS = 8 * sizeof(part_t) };
+
+				CompositeKey() {
+					for(int i = 0; i < PARTS; i++) { parts_[i] = 0; }
+				}
+
+				/// Allows BPlusTree to write 0 and (key_type)(-1)
+				CompositeKey(int v) {
+					for(int i = 0; i < PARTS - 1; i++) { parts_[i] = (v < 0) ? (part_t)(-1) : 0; }
+					parts_[PARTS - 1] = (part_t)v;
+				}
+
+				part_t& operator[](int i) { return parts_[i]; }
+				const part_t& operator[](int i) const { return parts_[i]; }
+
+				int cmp(const self_type& other) const {
+					for(int i = 0; i < PARTS; i++) {
+						if(parts_[i] != other.parts_[i]) {
+							return (parts_[i] < other.parts_[i]) ? -1 : 1;
+						}
+					}
+					return 0;
+				}
+
+				bool operator==(const self_type& other) const { return cmp(other) == 0; }
+				bool operator!=(const self_type& other) const { return cmp(other) != 0; }
+				bool operator<(const self_type& other) const { return cmp(other) < 0; }
+				bool operator>(const self_type& other) const { return cmp(other) > 0; }
+				bool operator<=(const self_type& other) const { return cmp(other) <= 0; }
+				bool operator>=(const self_type& other) const { return cmp(other) >= 0; }
+
+				self_type operator+(const self_type& other) const {
+					self_type r;
+					part_t carry = 0;
+					for(int i = PARTS - 1; i >= 0; i--) {
+						part_t s = parts_[i] + other.parts_[i];
+						part_t c = (s < parts_[i]);
+						r.parts_[i] = s + carry;
+						c |= (r.parts_[i] < s);
+						carry = c;
+					}
+					return r;
+				}
+
+				self_type operator+(int v) const { return *this + self_type(v); }
+
+				self_type operator&(const self_type& other) const {
+					self_type r;
+					for(int i = 0; i < PARTS; i++) { r.parts_[i] = parts_[i] & other.parts_[i]; }
+					return r;
+				}
+
+				self_type operator^(const self_type& other) const {
+					self_type r;
+					for(int i = 0; i < PARTS; i++) { r.parts_[i] = parts_[i] ^ other.parts_[i]; }
+					return r;
+				}
+
+				/**
+				 * @param s number of bits to shift, has to be smaller than
+				 * PART_BITS.
+				 */
+				self_type operator>>(int s) const {
+					self_type r;
+					if(s == 0) { return *this; }
+					for(int i = PARTS - 1; i >= 0; i--) {
+						r.parts_[i] = parts_[i] >> s;
+						if(i > 0) { r.parts_[i] |= parts_[i - 1] << (PART_BITS - s); }
+					}
+					return r;
+				}
+
+			private:
+				part_t parts_[PARTS];
+			// }}}
+		};
+
+	} // namespace IndexedTupleStore_detail
+
+	/**
+	 * @brief Wraps a dictionary-based TupleStore and maintains secondary
+	 * indexes on configurable column permutations (e.g. SPO, POS, OSP) so
+	 * masked queries become range scans instead of full container scans.
+	 *
+	 * Each index is a BPlusTree whose keys consist of the dictionary keys
+	 * of all columns in the order given by the permutation. For a query
+	 * begin(&q, mask), the index with the longest permutation prefix
+	 * covered by mask is chosen and scanned from the first key that
+	 * matches that prefix; remaining columns of mask are filtered on the
+	 * keys directly. If no index covers the first column of mask, the
+	 * wrapped tuple store is scanned as before.
+	 *
+	 * Usage:
+	 * @code
+	 * ::uint8_t pos[] = { 1, 2, 0 };
+	 * ts.init(&tuple_store, &block_memory, debug);
+	 * ts.add_index(pos);
+	 * @endcode
+	 *
+	 * All columns of the wrapped tuple store have to be dictionary columns.
+	 * Tuples have to be inserted and erased through this class for the
+	 * indexes to stay in sync.
+	 *
+	 * @ingroup tuple_store
+	 *
+	 * @tparam TupleStore_P TupleStore with DICTIONARY_COLUMNS == MASK_ALL.
+	 * @tparam BlockMemory_P Allocating block memory the B+ trees of the
+	 *   indexes are stored in (e.g. a BitmapChunkAllocator).
+	 * @tparam MAX_INDICES_P maximum number of permutations that can be
+	 *   indexed at the same time.
+	 */
+	template<
+		typename OsModel_P,
+		typename TupleStore_P,
+		typename BlockMemory_P,
+		int MAX_INDICES_P = 3,
+		typename Debug_P = typename OsModel_P::Debug
+	>
+	class IndexedTupleStore {
+
+		public:
+			typedef OsModel_P OsModel;
+			typedef typename OsModel::block_data_t block_data_t;
+			typedef typename OsModel::size_t size_type;
+			typedef Debug_P Debug;
+			typedef TupleStore_P TupleStore;
+			typedef BlockMemory_P BlockMemory;
+
+			typedef IndexedTupleStore<OsModel_P, TupleStore_P, BlockMemory_P, MAX_INDICES_P, Debug_P> self_type;
+			typedef self_type* self_pointer_t;
+
+			typedef typename TupleStore::Tuple Tuple;
+			typedef typename TupleStore::TupleContainer TupleContainer;
+			typedef typename TupleStore::Dictionary Dictionary;
+			typedef typename TupleStore::column_mask_t column_mask_t;
+			typedef typename Dictionary::key_type key_type;
+			typedef typename Dictionary::mapped_type mapped_type;
+
+			enum {
+				COLUMNS = TupleStore::COLUMNS,
+				MASK_ALL = TupleStore::MASK_ALL,
+				DICTIONARY_COLUMNS = TupleStore::DICTIONARY_COLUMNS,
+				MAX_INDICES = MAX_INDICES_P
+			};
+			enum { SUCCESS = OsModel::SUCCESS, ERR_UNSPEC = OsModel::ERR_UNSPEC };
+
+			/// Bit representation of a dictionary key as stored in the container
+			typedef typename Uint<sizeof(block_data_t*)>::t key_part_t;
+			typedef IndexedTupleStore_detail::CompositeKey<key_part_t, COLUMNS> index_key_t;
+			typedef BPlusTree<OsModel, BlockMemory, index_key_t, ::uint8_t, Debug> Tree;
+
+			class Index {
+				// {{{
+				public:
+					void init(const ::uint8_t* permutation, BlockMemory* block_memory, Debug* debug) {
+						for(size_type i = 0; i < COLUMNS; i++) {
+							permutation_[i] = permutation[i];
+							position_[permutation[i]] = i;
+						}
+						tree_.init(block_memory, debug);
+					}
+
+					/**
+					 * @return number of leading columns of this index'
+					 * permutation that are fully determined by mask.
+					 */
+					size_type prefix_length(column_mask_t mask) {
+						size_type l = 0;
+						while(l < COLUMNS && (mask & (1 << permutation_[l]))) { l++; }
+						return l;
+					}
+
+					/**
+					 * Build the index key from a tuple as stored in the
+					 * container (i.e. holding dictionary keys).
+					 */
+					index_key_t make_key(Tuple& t) {
+						index_key_t k;
+						for(size_type i = 0; i < COLUMNS; i++) {
+							k[i] = bdt_to_part(t.get(permutation_[i]));
+						}
+						return k;
+					}
+
+					::uint8_t column(size_type i) { return permutation_[i]; }
+					::uint8_t position(size_type column) { return position_[column]; }
+					Tree& tree() { return tree_; }
+
+				private:
+					::uint8_t permutation_[COLUMNS];
+					::uint8_t position_[COLUMNS];
+					Tree tree_;
+				// }}}
+			};
+
+			class iterator {
+				// {{{
+				public:
+					iterator() : index_(0), store_(0), prefix_length_(0), filter_mask_(0), up_to_date_(false) {
+					}
+
+					iterator(const iterator& other) : index_(0), store_(0), prefix_length_(0), filter_mask_(0), up_to_date_(false) {
+						*this = other;
+					}
+
+					iterator& operator=(const iterator& other) {
+						iterator& o = const_cast<iterator&>(other);
+						store_ = o.store_;
+						index_ = o.index_;
+						tree_iterator_ = o.tree_iterator_;
+						scan_iterator_ = o.scan_iterator_;
+						prefix_ = o.prefix_;
+						prefix_length_ = o.prefix_length_;
+						filter_ = o.filter_;
+						filter_mask_ = o.filter_mask_;
+						up_to_date_ = false;
+						return *this;
+					}
+
+					~iterator() {
+						current_.destruct_deep();
+					}
+
+					Tuple& operator*() {
+						if(!index_) { return *scan_iterator_; }
+						if(!up_to_date_) { update_current(); }
+						return current_;
+					}
+					Tuple* operator->() { return &operator*(); }
+
+					iterator& operator++() {
+						if(index_) {
+							++tree_iterator_;
+							forward();
+						}
+						else {
+							++scan_iterator_;
+						}
+						up_to_date_ = false;
+						return *this;
+					}
+
+					bool at_end() {
+						if(index_) { return tree_iterator_ == index_->tree().end(); }
+						return store_ == 0 || scan_iterator_ == store_->tuple_store().end();
+					}
+
+					bool operator==(const iterator& cother) {
+						iterator& other = const_cast<iterator&>(cother);
+						if(at_end() || other.at_end()) { return at_end() && other.at_end(); }
+						if(index_ != other.index_) { return false; }
+						if(index_) { return tree_iterator_ == other.tree_iterator_; }
+						return scan_iterator_ == other.scan_iterator_;
+					}
+					bool operator!=(const iterator& other) { return !(*this == other); }
+
+					/**
+					 * @return the index this iterator scans or 0 if it is
+					 * a plain scan over the wrapped tuple store.
+					 */
+					Index* index() { return index_; }
+					index_key_t key() { return (*tree_iterator_).key(); }
+
+				private:
+					/**
+					 * Skip forward to the next key in range that matches
+					 * the filter, end the scan once the prefix differs.
+					 */
+					void forward() {
+						typename Tree::iterator e = index_->tree().end();
+						while(tree_iterator_ != e) {
+							index_key_t k = (*tree_iterator_).key();
+							for(size_type i = 0; i < prefix_length_; i++) {
+								if(k[i] != prefix_[i]) {
+									tree_iterator_ = e;
+									return;
+								}
+							}
+							bool match = true;
+							for(size_type i = prefix_length_; i < COLUMNS; i++) {
+								if((filter_mask_ & (1 << i)) && k[i] != filter_[i]) {
+									match = false;
+									break;
+								}
+							}
+							if(match) { return; }
+							++tree_iterator_;
+						}
+					}
+
+					void update_current() {
+						index_key_t k = (*tree_iterator_).key();
+						Dictionary &dictionary = store_->dictionary();
+						for(size_type c = 0; c < COLUMNS; c++) {
+							key_type dictkey = TupleStore::to_key(part_to_bdt(k[index_->position(c)]));
+							block_data_t *b = dictionary.get_value(dictkey);
+							assert(b != 0);
+							current_.free_deep(c);
+							current_.set_deep(c, b);
+							dictionary.free_value(b);
+						}
+						up_to_date_ = true;
+					}
+
+					Index *index_;
+					self_type *store_;
+					typename Tree::iterator tree_iterator_;
+					typename TupleStore::iterator scan_iterator_;
+					index_key_t prefix_;
+					size_type prefix_length_;
+					index_key_t filter_;
+					column_mask_t filter_mask_;
+					Tuple current_;
+					bool up_to_date_;
+
+				friend class IndexedTupleStore;
+				// }}}
+			};
+
+			int init(TupleStore* tuple_store, BlockMemory* block_memory, typename Debug::self_pointer_t debug) {
+				static_assert((int)DICTIONARY_COLUMNS == (int)MASK_ALL);
+
+				tuple_store_ = tuple_store;
+				block_memory_ = block_memory;
+				debug_ = debug;
+				indices_ = 0;
+				return SUCCESS;
+			}
+
+			/**
+			 * Add an index for the given column permutation and fill it
+			 * with the current contents of the tuple store.
+			 *
+			 * @param permutation array of COLUMNS column numbers,
+			 *   e.g. { 1, 2, 0 } for a POS index over SPO triples.
+			 */
+			int add_index(const ::uint8_t* permutation) {
+				if(indices_ >= MAX_INDICES) { return ERR_UNSPEC; }
+
+				Index &index = indices_array_[indices_++];
+				index.init(permutation, block_memory_, debug_);
+
+				TupleContainer &c = tuple_store_->container();
+				for(typename TupleContainer::iterator it = c.begin(); it != c.end(); ++it) {
+					index.tree().insert(index.make_key(*it), 0);
+				}
+				return SUCCESS;
+			}
+
+			size_type indices() { return indices_; }
+			Index& index(size_type i) { return indices_array_[i]; }
+
+			template<typename UserTuple>
+			iterator insert(UserTuple& t) {
+				size_type sz = tuple_store_->size();
+				typename TupleStore::iterator it = tuple_store_->insert(t);
+
+				if(tuple_store_->size() != sz) {
+					Tuple &stored = *it.container_iterator();
+					for(size_type i = 0; i < indices_; i++) {
+						Index &index = indices_array_[i];
+						index.tree().insert(index.make_key(stored), 0);
+					}
+				}
+
+				iterator r;
+				r.store_ = this;
+				r.scan_iterator_ = it;
+				return r;
+			}
+
+			iterator erase(iterator iter) {
+				assert(!iter.at_end());
+
+				if(!iter.index_) {
+					unindex(*iter.scan_iterator_.container_iterator());
+					iter.scan_iterator_ = tuple_store_->erase(iter.scan_iterator_);
+					return iter;
+				}
+
+				// Locate the tuple in the wrapped store by its values,
+				// the index key alone does not tell us the container position.
+				index_key_t k = iter.key();
+				typename TupleStore::iterator it = tuple_store_->find(*iter);
+				assert(it != tuple_store_->end());
+				unindex(*it.container_iterator());
+				tuple_store_->erase(it);
+
+				// k is gone from the index, so its lower bound is the
+				// successor of the erased element
+				iter.tree_iterator_ = iter.index_->tree().lower_bound(k);
+				iter.up_to_date_ = false;
+				iter.forward();
+				return iter;
+			}
+
+			iterator begin(Tuple* query = 0, column_mask_t mask = 0) {
+				Index *best = 0;
+				size_type best_length = 0;
+				for(size_type i = 0; i < indices_; i++) {
+					size_type l = indices_array_[i].prefix_length(mask);
+					if(l > best_length) {
+						best = &indices_array_[i];
+						best_length = l;
+					}
+				}
+
+				iterator r;
+				r.store_ = this;
+				if(!best) {
+					r.scan_iterator_ = tuple_store_->begin(query, mask);
+					return r;
+				}
+
+				// Translate query values to their dictionary keys, if one is
+				// not in the dictionary there can not be any match.
+				index_key_t q;
+				for(size_type i = 0; i < COLUMNS; i++) {
+					column_mask_t c = best->column(i);
+					if(mask & (1 << c)) {
+						key_type k = tuple_store_->dictionary().find(query->get(c));
+						if(k == Dictionary::NULL_KEY) { return end(); }
+						q[i] = bdt_to_part(TupleStore::to_bdt(k));
+					}
+				}
+
+				r.index_ = best;
+				r.prefix_length_ = best_length;
+				r.filter_mask_ = 0;
+				for(size_type i = 0; i < COLUMNS; i++) {
+					if(i < best_length) {
+						r.prefix_[i] = q[i];
+					}
+					else if(mask & (1 << best->column(i))) {
+						r.filter_[i] = q[i];
+						r.filter_mask_ |= (1 << i);
+					}
+				}
+				r.tree_iterator_ = best->tree().lower_bound(r.prefix_);
+				r.forward();
+				return r;
+			}
+
+			iterator end() {
+				iterator r;
+				r.store_ = this;
+				r.scan_iterator_ = tuple_store_->end();
+				return r;
+			}
+
+			iterator find(Tuple& query) {
+				return begin(&query, MASK_ALL);
+			}
+
+			size_type size() { return tuple_store_->size(); }
+			bool empty() { return tuple_store_->empty(); }
+
+			TupleStore& tuple_store() { return *tuple_store_; }
+			Dictionary& dictionary() { return tuple_store_->dictionary(); }
+			TupleContainer& container() { return tuple_store_->container(); }
+
+			static key_type to_key(block_data_t* bdt) { return TupleStore::to_key(bdt); }
+			static block_data_t* to_bdt(key_type k) { return TupleStore::to_bdt(k); }
+
+		private:
+
+			static key_part_t bdt_to_part(block_data_t* bdt) {
+				key_part_t r;
+				memcpy(&r, &bdt, sizeof(block_data_t*));
+				return r;
+			}
+
+			static block_data_t* part_to_bdt(key_part_t p) {
+				block_data_t *r;
+				memcpy(&r, &p, sizeof(block_data_t*));
+				return r;
+			}
+
+			/**
+			 * Remove container tuple t from all indices.
+			 */
+			void unindex(Tuple& t) {
+				for(size_type i = 0; i < indices_; i++) {
+					Index &index = indices_array_[i];
+					typename Tree::iterator it = index.tree().find(index.make_key(t));
+					if(it != index.tree().end()) {
+						index.tree().erase(it);
+					}
+				}
+			}
+
+			TupleStore *tuple_store_;
+			BlockMemory *block_memory_;
+			typename Debug::self_pointer_t debug_;
+			Index indices_array_[MAX_INDICES];
+			size_type indices_;
+
+	}; // IndexedTupleStore
+}
+
+#endif // INDEXED_TUPLE_STORE_H
+
+/* vim: set ts=3 sw=3 tw=78 noexpandtab :*/
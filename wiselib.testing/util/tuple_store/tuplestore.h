@@ -226,6 +226,12 @@ namespace wiselib {
 								}
 							}
 							
+							// t only borrowed the dictionary keys
+							for(size_type i = 0; i<COLUMNS; i++) {
+								if(DICTIONARY_COLUMNS && (DICTIONARY_COLUMNS & (1 << i))) {
+									t.set(i, 0);
+								}
+							}
 							t.destruct_deep();
 						}
 						up_to_date_ = true;